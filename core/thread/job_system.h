@@ -1,7 +1,9 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <memory>
-#include <queue>
+#include <string>
 #include <vector>
 
 #include "condition_variable.h"
@@ -9,6 +11,9 @@
 #include "mutex.h"
 #include "spin_lock.h"
 #include "thread.h"
+#include "thread_affinity.h"
+#include "tracer.h"
+#include "work_stealing_deque.h"
 
 namespace ho {
 
@@ -19,150 +24,337 @@ namespace ho {
         void* input_data = nullptr;                             // input payload
         int input_size = 0;                                     // size of input payload
         std::shared_ptr<AtomicNumeric<std::uint32_t>> counter;  // completion counter
+        const char* name = nullptr;                             // label in traces, "Job" if nullptr
     };
 
 // JobSystem: Manages workers and job scheduling
 #ifdef THREAD_ENABLED
+    // Every worker owns a work-stealing deque. Jobs kicked from a worker go to its own deque, jobs kicked from any
+    // other thread go to one shared deque. Idle workers steal from the top of the other deques and sleep only when
+    // no job is queued anywhere. Waiting threads run queued jobs until their jobs are done.
     class JobSystem {
        public:
+        // Deque of one worker, or the shared one of threads outside of the system.
+        struct alignas(Thread::CACHE_LINE_BYTES) WorkQueue {
+            WorkQueue(JobSystem* job_sys, uint32_t queue_index) : owner(job_sys), index(queue_index) {}
+
+            JobSystem* owner;
+            uint32_t index;
+            WorkStealingDeque<JobDeclaration*> deque;
+        };
+
         // Nested Worker class
         class Worker : public Thread {
            public:
-            explicit Worker(JobSystem* owner) : Thread(&Worker::WorkerLoop, owner) {}
+            explicit Worker(WorkQueue* queue) : Thread(&Worker::WorkerLoop, queue) {}
 
            private:
             // worker's entry function
-            static void WorkerLoop(void* owner) {
-                JobSystem* job_sys = static_cast<JobSystem*>(owner);
-
-                while (true) {
-                    JobDeclaration job;
-                    {
-                        MutexLock lock(job_sys->mutex_);
-                        while (job_sys->job_queue_.empty() && job_sys->is_running_) {
-                            job_sys->cv_.wait(lock);  // wait until job is kicked in queue
-                        }
-                        if (!job_sys->is_running_) {
-                            return;  // thread exit
-                        }
-                        job = job_sys->job_queue_.front();
-                        job_sys->job_queue_.pop();
+            static void WorkerLoop(void* queue) {
+                WorkQueue* own = static_cast<WorkQueue*>(queue);
+                JobSystem* job_sys = own->owner;
+                tls_queue_ = own;
+                job_sys->PinWorker(own->index);
+                Tracer::GetInstance().SetThreadName("Worker " + std::to_string(own->index));
+
+                while (job_sys->is_running_.load(std::memory_order_acquire)) {
+                    if (job_sys->RunQueuedJob(own)) {
+                        continue;
                     }
 
-                    job.entry(job.input_data, job.input_size);
-
-                    if (job.counter != nullptr) {
-                        // if job was waited by job system
-                        // decrement count and if count is zero, wake up main thread
-                        if (job.counter->Decrement() == 0) {
-                            MutexLock lock(job_sys->mutex_);
-                            job_sys->cv_.notify_all();
-                        }
+                    // spin briefly before going to sleep
+                    bool is_queued = false;
+                    for (int i = 0; i < IDLE_SPIN_COUNT && !is_queued; i++) {
+                        CPU_PAUSE();
+                        is_queued = job_sys->queued_job_count_.load() > 0;
+                    }
+                    if (is_queued) {
+                        continue;
                     }
 
-                    if (job_sys->job_count_.Decrement() == 0) {
-                        MutexLock lock(job_sys->mutex_);
-                        job_sys->cv_.notify_all();  // for wake up main thread
+                    TRACE_SCOPE("JobSystem::Sleep");
+                    MutexLock lock(job_sys->mutex_);
+                    job_sys->sleeping_worker_count_++;
+                    while (job_sys->queued_job_count_.load() <= 0 && job_sys->is_running_.load()) {
+                        job_sys->cv_.wait(lock);  // wait until job is kicked
                     }
+                    job_sys->sleeping_worker_count_--;
                 }
             }
         };
 
        public:
-        explicit JobSystem(uint32_t worker_count) : is_running_(true) {
+        explicit JobSystem(uint32_t worker_count, ThreadAffinity affinity = ThreadAffinity::NONE)
+            : affinity_(affinity), is_running_(true) {
             assert(worker_count != 0);
+            // The last queue is shared by the threads outside of the system.
+            queues_.reserve(worker_count + 1);
+            for (uint32_t i = 0; i <= worker_count; i++) {
+                queues_.emplace_back(std::make_unique<WorkQueue>(this, i));
+            }
+
             worker_pool_.reserve(worker_count);
             for (uint32_t i = 0; i < worker_count; i++) {
-                worker_pool_.emplace_back(std::make_unique<Worker>(this));
+                worker_pool_.emplace_back(std::make_unique<Worker>(queues_[i].get()));
             }
         }
 
         ~JobSystem() {
             {
                 MutexLock lock(mutex_);
-                is_running_ = false;
+                is_running_.store(false);
                 cv_.notify_all();
             }
 
             for (auto& w : worker_pool_) {
                 w->Join();
             }
+
+            // jobs never run
+            for (auto& queue : queues_) {
+                JobDeclaration* job = nullptr;
+                while (queue->deque.Steal(job)) {
+                    delete job;
+                }
+            }
         }
 
         // Job submission
-        void KickJob(const JobDeclaration& job) {
-            MutexLock lock(mutex_);
-            job_count_.Increment();
-            job_queue_.push(job);
-            cv_.notify_one();
-        }
+        void KickJob(const JobDeclaration& job) { Submit(&job, 1, nullptr); }
 
         void KickJobs(const std::vector<JobDeclaration>& jobs) {
-            MutexLock lock(mutex_);
-            job_count_.Add(static_cast<uint32_t>(jobs.size()));
-            for (const JobDeclaration& job : jobs) {
-                job_queue_.push(job);
-            }
-            cv_.notify_all();
+            if (jobs.empty()) return;
+            Submit(jobs.data(), jobs.size(), nullptr);
         }
 
         void KickJobAndWait(const JobDeclaration& job) {
             auto counter = std::make_shared<AtomicNumeric<uint32_t>>(1);
-            JobDeclaration j = job;
-            j.counter = counter;
-            KickJob(j);
+            Submit(&job, 1, &counter);
             WaitForCounter(counter);
         }
 
         void KickJobsAndWait(const std::vector<JobDeclaration>& jobs) {
             if (jobs.empty()) return;
             auto counter = std::make_shared<AtomicNumeric<uint32_t>>(static_cast<uint32_t>(jobs.size()));
-            std::vector<JobDeclaration> with_counter;
-            with_counter.reserve(jobs.size());
+            Submit(jobs.data(), jobs.size(), &counter);
+            WaitForCounter(counter);
+        }
 
-            for (auto job : jobs) {
-                job.counter = counter;
-                with_counter.push_back(job);
+        // Runs fn(first, last) on the ranges [first, last) of at most 'grain' indices that split [begin, end), and
+        // waits for all of them. The calling thread runs ranges as well. 'name' labels the ranges in traces.
+        template <typename Fn>
+        void ParallelFor(size_t begin, size_t end, size_t grain, const Fn& fn, const char* name = "ParallelFor") {
+            if (begin >= end) return;
+            const size_t step = grain == 0 ? 1 : grain;
+            const size_t range_count = (end - begin + step - 1) / step;
+            if (range_count == 1) {
+                TRACE_SCOPE(name);
+                fn(begin, end);
+                return;
             }
-            KickJobs(with_counter);
-            WaitForCounter(counter);
+
+            std::vector<ParallelForRange<Fn>> ranges(range_count);
+            std::vector<JobDeclaration> jobs(range_count);
+            for (size_t i = 0; i < range_count; i++) {
+                const size_t first = begin + i * step;
+                ranges[i] = {&fn, first, end - first < step ? end : first + step};
+                jobs[i].entry = &ParallelForEntry<Fn>;
+                jobs[i].input_data = &ranges[i];
+                jobs[i].input_size = sizeof(ParallelForRange<Fn>);
+                jobs[i].name = name;
+            }
+            KickJobsAndWait(jobs);
         }
 
         // Job synchronization
-        void WaitForCounter(std::shared_ptr<AtomicNumeric<std::uint32_t>>& counter) {
-            int spin_count = 100;
-            while (counter->Get() > 0 && spin_count) {
-                if (counter->Get() == 0) return;
-                CPU_PAUSE();
-            }
-            if (counter->Get() == 0) return;
+        // The calling thread runs queued jobs, of any caller, until the counter reaches zero.
+        void WaitForCounter(const std::shared_ptr<AtomicNumeric<std::uint32_t>>& counter) {
+            WaitUntil([&] { return counter->Get() == 0; });
+        }
 
-            MutexLock lock(mutex_);
-            while (counter->Get() > 0) {
-                cv_.wait(lock);
+        // Waits at most 'timeout' for the counter to reach zero, returns whether it did.
+        // Queued jobs are not run, one of them could outlast the timeout.
+        bool TryWaitForCounter(const std::shared_ptr<AtomicNumeric<std::uint32_t>>& counter,
+                               std::chrono::nanoseconds timeout) {
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            int idle_count = 0;
+            while (counter->Get() != 0) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    return false;
+                }
+                if (++idle_count < IDLE_SPIN_COUNT) {
+                    CPU_PAUSE();
+                } else {
+                    Thread::Yield();
+                }
             }
+            return true;
         }
 
         void WaitForIdle() {
-            for (int i = 0; i < 100; ++i) {
-                if (job_count_.Get() == 0) return;
-                CPU_PAUSE();
+            WaitUntil([&] { return job_count_.Get() == 0; });
+        }
+
+        uint32_t GetWorkerCount() const { return static_cast<uint32_t>(worker_pool_.size()); }
+
+        ThreadAffinity GetAffinity() const { return affinity_; }
+
+        // Index of the calling worker, GetWorkerCount() for threads outside of the system.
+        uint32_t GetCurrentWorkerIndex() const {
+            const WorkQueue* own = GetOwnQueue();
+            return own != nullptr ? own->index : GetWorkerCount();
+        }
+
+       private:
+        static constexpr int IDLE_SPIN_COUNT = 256;
+
+        template <typename Fn>
+        struct ParallelForRange {
+            const Fn* fn;
+            size_t first;
+            size_t last;
+        };
+
+        template <typename Fn>
+        static void ParallelForEntry(void* input, int size) {
+            assert(size == sizeof(ParallelForRange<Fn>));
+            (void)size;
+            const ParallelForRange<Fn>* range = static_cast<const ParallelForRange<Fn>*>(input);
+            (*range->fn)(range->first, range->last);
+        }
+
+        // Pinning is best effort, a worker that cannot be pinned stays unrestricted.
+        void PinWorker(uint32_t worker_index) const {
+            switch (affinity_) {
+                case ThreadAffinity::CORE:
+                    PinCurrentThreadToProcessor(worker_index % GetHardwareThreadCount());
+                    break;
+                case ThreadAffinity::NUMA_NODE:
+                    PinCurrentThreadToNumaNode(worker_index % GetNumaNodeCount());
+                    break;
+                default:
+                    break;
             }
+        }
+
+        // Returns the deque of the calling worker, nullptr for threads outside of the system.
+        WorkQueue* GetOwnQueue() const {
+            WorkQueue* queue = tls_queue_;
+            return queue != nullptr && queue->owner == this ? queue : nullptr;
+        }
 
-            MutexLock lock(mutex_);
+        // 'counter' replaces the counters of the jobs unless it is nullptr.
+        void Submit(const JobDeclaration* jobs, size_t count,
+                    const std::shared_ptr<AtomicNumeric<std::uint32_t>>* counter) {
+            job_count_.Add(static_cast<uint32_t>(count));
+            queued_job_count_.fetch_add(static_cast<int64_t>(count));
 
-            while (job_count_.Get() > 0) {
-                cv_.wait(lock);
+            WorkQueue* own = GetOwnQueue();
+            WorkQueue* queue = own != nullptr ? own : queues_.back().get();
+            if (own == nullptr) {
+                shared_queue_lock_.Lock();
+            }
+            for (size_t i = 0; i < count; i++) {
+                JobDeclaration* job = new JobDeclaration(jobs[i]);
+                if (counter != nullptr) {
+                    job->counter = *counter;
+                }
+                queue->deque.Push(job);
+            }
+            if (own == nullptr) {
+                shared_queue_lock_.Unlock();
+            }
+
+            if (sleeping_worker_count_.load() > 0) {
+                MutexLock lock(mutex_);
+                if (count == 1) {
+                    cv_.notify_one();
+                } else {
+                    cv_.notify_all();
+                }
             }
         }
 
-       private:
+        // Runs one job of the own deque, or steals one. Returns false if no job was found.
+        bool RunQueuedJob(WorkQueue* own) {
+            JobDeclaration* job = nullptr;
+            bool is_found = false;
+            if (own != nullptr) {
+                is_found = own->deque.Pop(job);
+            } else {
+                shared_queue_lock_.Lock();
+                is_found = queues_.back()->deque.Pop(job);
+                shared_queue_lock_.Unlock();
+            }
+
+            // Start at a random victim so that thieves spread over the deques.
+            const size_t queue_count = queues_.size();
+            const size_t first_victim = static_cast<size_t>(NextRandom()) % queue_count;
+            for (size_t i = 0; i < queue_count && !is_found; i++) {
+                WorkQueue* victim = queues_[(first_victim + i) % queue_count].get();
+                if (victim != own) {
+                    is_found = victim->deque.Steal(job);
+                }
+            }
+            if (!is_found) {
+                return false;
+            }
+
+            queued_job_count_.fetch_sub(1);
+            {
+                TRACE_SCOPE(job->name != nullptr ? job->name : "Job");
+                job->entry(job->input_data, job->input_size);
+            }
+            if (job->counter != nullptr) {
+                job->counter->Decrement();
+            }
+            delete job;
+            job_count_.Decrement();
+            return true;
+        }
+
+        template <typename Predicate>
+        void WaitUntil(const Predicate& is_done) {
+            TRACE_SCOPE("JobSystem::Wait");
+            WorkQueue* own = GetOwnQueue();
+            int idle_count = 0;
+            while (!is_done()) {
+                if (RunQueuedJob(own)) {
+                    idle_count = 0;
+                } else if (++idle_count < IDLE_SPIN_COUNT) {
+                    CPU_PAUSE();
+                } else {
+                    Thread::Yield();
+                }
+            }
+        }
+
+        static uint32_t NextRandom() {
+            // xorshift32
+            uint32_t x = tls_random_state_;
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            tls_random_state_ = x;
+            return x;
+        }
+
+        static inline thread_local WorkQueue* tls_queue_ = nullptr;
+        static inline thread_local uint32_t tls_random_state_ = 0x9E3779B9u;
+
+        ThreadAffinity affinity_;
+        std::vector<std::unique_ptr<WorkQueue>> queues_;  // one per worker, then the shared one
+        SpinLock shared_queue_lock_;                       // serializes the owner side of the shared deque
+        std::vector<std::unique_ptr<Worker>> worker_pool_;
+
+        AtomicNumeric<uint32_t> job_count_{0};      // kicked and not finished
+        std::atomic<int64_t> queued_job_count_{0};  // kicked and not started, may be briefly ahead of the deques
+
+        // sleeping workers
         BinaryMutex mutex_;
         ConditionVariable cv_;
-        std::queue<JobDeclaration> job_queue_;
-        std::vector<std::unique_ptr<Worker>> worker_pool_;
-        AtomicNumeric<uint32_t> job_count_{0};
-        bool is_running_;
+        std::atomic<int> sleeping_worker_count_{0};
+        std::atomic<bool> is_running_;
     };
 
 #else
@@ -170,10 +362,13 @@ namespace ho {
     // Single-threaded fallback version (no threads)
     class JobSystem {
        public:
-        explicit JobSystem(uint32_t) {}
+        explicit JobSystem(uint32_t, ThreadAffinity = ThreadAffinity::NONE) {}
 
         void KickJob(const JobDeclaration& job) {
-            job.entry(job.input_data, job.input_size);
+            {
+                TRACE_SCOPE(job.name != nullptr ? job.name : "Job");
+                job.entry(job.input_data, job.input_size);
+            }
             if (job.counter != nullptr) {
                 job.counter->Decrement();
             }
@@ -189,6 +384,12 @@ namespace ho {
             (void)counter;  // no-op, all jobs run inline
         }
 
+        bool TryWaitForCounter(const std::shared_ptr<AtomicNumeric<std::uint32_t>>& counter,
+                               std::chrono::nanoseconds timeout) {
+            (void)timeout;
+            return counter->Get() == 0;
+        }
+
         void KickJobAndWait(const JobDeclaration& job) {
             auto counter = std::make_shared<AtomicNumeric<uint32_t>>(1);
             JobDeclaration j = job;
@@ -207,6 +408,23 @@ namespace ho {
             }
             KickJobs(with_counter);
         }
+
+        template <typename Fn>
+        void ParallelFor(size_t begin, size_t end, size_t grain, const Fn& fn, const char* name = "ParallelFor") {
+            TRACE_SCOPE(name);
+            const size_t step = grain == 0 ? 1 : grain;
+            for (size_t first = begin; first < end; first += end - first < step ? end - first : step) {
+                fn(first, end - first < step ? end : first + step);
+            }
+        }
+
+        void WaitForIdle() {}
+
+        uint32_t GetWorkerCount() const { return 0; }
+
+        ThreadAffinity GetAffinity() const { return ThreadAffinity::NONE; }
+
+        uint32_t GetCurrentWorkerIndex() const { return 0; }
     };
 
 #endif  // THREAD_ENABLED
@@ -0,0 +1,129 @@
+#include "thread_affinity.h"
+
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#endif
+
+namespace ho {
+
+#if defined(__linux__)
+    namespace {
+        // Reads a cpulist like "0-3,8-11" of a NUMA node.
+        bool ReadNodeProcessors(uint32_t node, cpu_set_t& set) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!file || !std::getline(file, list)) {
+                return false;
+            }
+
+            CPU_ZERO(&set);
+            bool is_any_set = false;
+            std::stringstream stream(list);
+            std::string range;
+            while (std::getline(stream, range, ',')) {
+                if (range.empty()) {
+                    continue;
+                }
+                const size_t dash = range.find('-');
+                const unsigned long first = std::stoul(range.substr(0, dash));
+                const unsigned long last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+                for (unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+                    CPU_SET(cpu, &set);
+                    is_any_set = true;
+                }
+            }
+            return is_any_set;
+        }
+    }  // namespace
+#endif
+
+    uint32_t GetHardwareThreadCount() {
+        const unsigned int count = std::thread::hardware_concurrency();
+        return count == 0 ? 1u : static_cast<uint32_t>(count);
+    }
+
+    uint32_t GetNumaNodeCount() {
+#if defined(_WIN32)
+        ULONG highest_node = 0;
+        if (!GetNumaHighestNodeNumber(&highest_node)) {
+            return 1;
+        }
+        return static_cast<uint32_t>(highest_node) + 1;
+#elif defined(__linux__)
+        uint32_t count = 0;
+        while (std::ifstream("/sys/devices/system/node/node" + std::to_string(count) + "/cpulist")) {
+            count++;
+        }
+        return count == 0 ? 1u : count;
+#else
+        return 1;
+#endif
+    }
+
+    bool PinCurrentThreadToProcessor(uint32_t processor) {
+#if defined(_WIN32)
+        // Processors are numbered across processor groups.
+        const WORD group_count = GetActiveProcessorGroupCount();
+        for (WORD group = 0; group < group_count; group++) {
+            const DWORD group_size = GetActiveProcessorCount(group);
+            if (processor < group_size) {
+                GROUP_AFFINITY affinity = {};
+                affinity.Group = group;
+                affinity.Mask = static_cast<KAFFINITY>(1) << processor;
+                return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+            }
+            processor -= group_size;
+        }
+        return false;
+#elif defined(__linux__)
+        if (processor >= CPU_SETSIZE) {
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(processor, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)processor;
+        return false;
+#endif
+    }
+
+    bool PinCurrentThreadToNumaNode(uint32_t node) {
+#if defined(_WIN32)
+        if (node >= GetNumaNodeCount()) {
+            return false;
+        }
+        GROUP_AFFINITY affinity = {};
+        if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity) || affinity.Mask == 0) {
+            return false;
+        }
+        return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+        cpu_set_t set;
+        if (!ReadNodeProcessors(node, set)) {
+            return false;
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)node;
+        return false;
+#endif
+    }
+
+}  // namespace ho
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ho {
+
+    // How JobSystem workers are pinned to processors.
+    enum class ThreadAffinity {
+        NONE,       // scheduled freely by the OS
+        CORE,       // worker i runs on logical processor i, wrapping around the processor count
+        NUMA_NODE,  // workers are spread round-robin over NUMA nodes and may run on any processor of their node
+    };
+
+    // Number of logical processors, at least 1.
+    uint32_t GetHardwareThreadCount();
+
+    // Number of NUMA nodes, 1 if the platform does not report them.
+    uint32_t GetNumaNodeCount();
+
+    // Restricts the calling thread to one logical processor.
+    // Returns false if the processor does not exist or the platform does not support pinning.
+    bool PinCurrentThreadToProcessor(uint32_t processor);
+
+    // Restricts the calling thread to the processors of a NUMA node.
+    // Returns false if the node does not exist or the platform does not support pinning.
+    bool PinCurrentThreadToNumaNode(uint32_t node);
+
+}  // namespace ho
@@ -0,0 +1,161 @@
+#include "tracer.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+
+namespace ho {
+
+    namespace {
+        void AppendEscaped(std::string& out, const char* text) {
+            for (const char* c = text; *c != '\0'; c++) {
+                if (*c == '"' || *c == '\\') {
+                    out += '\\';
+                    out += *c;
+                } else if (static_cast<unsigned char>(*c) < 0x20) {
+                    out += ' ';
+                } else {
+                    out += *c;
+                }
+            }
+        }
+
+        // Trace timestamps are microseconds, nanoseconds are kept as decimals.
+        void AppendMicroseconds(std::string& out, uint64_t nanoseconds) {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%" PRIu64 ".%03" PRIu64, nanoseconds / 1000, nanoseconds % 1000);
+            out += text;
+        }
+    }  // namespace
+
+    Tracer::Tracer(size_t event_capacity)
+        : tracer_id_(next_tracer_id_.fetch_add(1)), event_capacity_(event_capacity == 0 ? 1 : event_capacity) {}
+
+    Tracer& Tracer::GetInstance() {
+        // Never destroyed, workers of static job systems may still end their scopes during static destruction.
+        static Tracer* instance = new Tracer();
+        return *instance;
+    }
+
+    void Tracer::Start() {
+        Clear();
+        is_recording_.store(true, std::memory_order_relaxed);
+    }
+
+    void Tracer::Stop() { is_recording_.store(false, std::memory_order_relaxed); }
+
+    void Tracer::Clear() {
+        MutexLock lock(mutex_);
+        for (auto& buffer : buffers_) {
+            buffer->write_count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Tracer::SetThreadName(const std::string& name) {
+        ThreadBuffer* buffer = GetThreadBuffer();
+        MutexLock lock(mutex_);
+        buffer->name = name;
+    }
+
+    void Tracer::Record(const char* name, uint64_t begin, uint64_t end) {
+        if (!IsRecording()) {
+            return;
+        }
+
+        ThreadBuffer* buffer = GetThreadBuffer();
+        if (buffer->events.empty()) {
+            buffer->events.resize(event_capacity_);
+        }
+        const uint64_t count = buffer->write_count.load(std::memory_order_relaxed);
+        buffer->events[static_cast<size_t>(count % event_capacity_)] = {name, begin, end};
+        buffer->write_count.store(count + 1, std::memory_order_release);
+    }
+
+    std::vector<Tracer::Event> Tracer::GetThreadEvents() {
+        const ThreadBuffer* buffer = GetThreadBuffer();
+        const uint64_t count = buffer->write_count.load(std::memory_order_acquire);
+        const uint64_t first = count > event_capacity_ ? count - event_capacity_ : 0;
+
+        std::vector<Event> events;
+        events.reserve(static_cast<size_t>(count - first));
+        for (uint64_t i = first; i < count; i++) {
+            events.push_back(buffer->events[static_cast<size_t>(i % event_capacity_)]);
+        }
+        return events;
+    }
+
+    std::string Tracer::ToChromeTrace() const {
+        MutexLock lock(mutex_);
+
+        // Timestamps start at the earliest event.
+        uint64_t origin = UINT64_MAX;
+        for (const auto& buffer : buffers_) {
+            const uint64_t count = buffer->write_count.load(std::memory_order_acquire);
+            const uint64_t first = count > event_capacity_ ? count - event_capacity_ : 0;
+            for (uint64_t i = first; i < count; i++) {
+                origin = std::min(origin, buffer->events[static_cast<size_t>(i % event_capacity_)].begin);
+            }
+        }
+
+        std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool is_first = true;
+        for (const auto& buffer : buffers_) {
+            const std::string tid = std::to_string(buffer->id);
+
+            // Thread names are metadata events.
+            out += is_first ? "\n" : ",\n";
+            is_first = false;
+            out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"";
+            AppendEscaped(out, buffer->name.empty() ? ("Thread " + tid).c_str() : buffer->name.c_str());
+            out += "\"}}";
+
+            const uint64_t count = buffer->write_count.load(std::memory_order_acquire);
+            const uint64_t first = count > event_capacity_ ? count - event_capacity_ : 0;
+            for (uint64_t i = first; i < count; i++) {
+                const Event& event = buffer->events[static_cast<size_t>(i % event_capacity_)];
+                out += ",\n{\"name\":\"";
+                AppendEscaped(out, event.name);
+                out += "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid + ",\"ts\":";
+                AppendMicroseconds(out, event.begin - origin);
+                out += ",\"dur\":";
+                AppendMicroseconds(out, event.end - event.begin);
+                out += "}";
+            }
+        }
+        out += "\n]}\n";
+        return out;
+    }
+
+    bool Tracer::WriteChromeTrace(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        file << ToChromeTrace();
+        return static_cast<bool>(file);
+    }
+
+    Tracer::ThreadBuffer* Tracer::GetThreadBuffer() {
+        if (tls_tracer_id_ == tracer_id_) {
+            return tls_buffer_;
+        }
+
+        // First use of this tracer on the calling thread, a thread that records again finds its old buffer.
+        MutexLock lock(mutex_);
+        const std::thread::id thread_id = std::this_thread::get_id();
+        auto it = std::find_if(buffers_.begin(), buffers_.end(),
+                               [&](const auto& buffer) { return buffer->thread_id == thread_id; });
+        if (it == buffers_.end()) {
+            auto buffer = std::make_unique<ThreadBuffer>();
+            buffer->thread_id = thread_id;
+            buffer->id = static_cast<uint32_t>(buffers_.size());
+            buffers_.emplace_back(std::move(buffer));
+            it = buffers_.end() - 1;
+        }
+        tls_buffer_ = it->get();
+        tls_tracer_id_ = tracer_id_;
+        return tls_buffer_;
+    }
+
+}  // namespace ho
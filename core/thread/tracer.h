@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/macros.h"
+#include "mutex.h"
+
+namespace ho {
+
+    // Records timed scopes into per-thread ring buffers and writes them as Chrome trace JSON, which
+    // chrome://tracing and ui.perfetto.dev open. Recording is off until Start, a scope of a stopped tracer costs
+    // one relaxed load. Every thread writes only its own buffer, without locks, and keeps its latest events.
+    // Start, Clear and the dumps must not run concurrently with traced work, e.g. call them after vgFinish.
+    class Tracer {
+       public:
+        struct Event {
+            const char* name = nullptr;  // must outlive the tracer, usually a string literal
+            uint64_t begin = 0;          // nanoseconds of GetTimestamp
+            uint64_t end = 0;
+        };
+
+        static constexpr size_t DEFAULT_EVENT_CAPACITY = 1 << 16;
+
+        explicit Tracer(size_t event_capacity = DEFAULT_EVENT_CAPACITY);
+
+        Tracer(const Tracer&) = delete;
+        Tracer& operator=(const Tracer&) = delete;
+
+        // The tracer of TRACE_SCOPE.
+        static Tracer& GetInstance();
+
+        static ALWAYS_INLINE uint64_t GetTimestamp() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             std::chrono::steady_clock::now().time_since_epoch())
+                                             .count());
+        }
+
+        // Clears the recorded events and starts recording.
+        void Start();
+        void Stop();
+        ALWAYS_INLINE bool IsRecording() const { return is_recording_.load(std::memory_order_relaxed); }
+
+        void Clear();
+
+        // Names the calling thread in the trace. Threads without a name show up as "Thread <id>".
+        void SetThreadName(const std::string& name);
+
+        // Adds a finished scope of the calling thread, the oldest event is overwritten once the buffer is full.
+        void Record(const char* name, uint64_t begin, uint64_t end);
+
+        // Recorded events of the calling thread, oldest first.
+        std::vector<Event> GetThreadEvents();
+
+        std::string ToChromeTrace() const;
+        bool WriteChromeTrace(const std::string& path) const;
+
+       private:
+        struct ThreadBuffer {
+            std::thread::id thread_id;
+            uint32_t id = 0;  // tid in the trace
+            std::string name;
+            std::vector<Event> events;            // ring, allocated by the first Record
+            std::atomic<uint64_t> write_count{0};  // events ever written since Clear
+        };
+
+        ThreadBuffer* GetThreadBuffer();
+
+        static inline std::atomic<uint64_t> next_tracer_id_{1};
+        static inline thread_local ThreadBuffer* tls_buffer_ = nullptr;
+        static inline thread_local uint64_t tls_tracer_id_ = 0;  // tracer of tls_buffer_
+
+        uint64_t tracer_id_;
+        size_t event_capacity_;
+        std::atomic<bool> is_recording_{false};
+
+        mutable BinaryMutex mutex_;                          // guards the list, not the buffers
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers_;  // one per thread that ever recorded
+    };
+
+    // Records the lifetime of the scope into the global tracer while it is recording.
+    class TraceScope {
+       public:
+        explicit TraceScope(const char* name)
+            : name_(name), begin_(Tracer::GetInstance().IsRecording() ? Tracer::GetTimestamp() : 0) {}
+
+        ~TraceScope() {
+            if (begin_ != 0) {
+                Tracer::GetInstance().Record(name_, begin_, Tracer::GetTimestamp());
+            }
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+       private:
+        const char* name_;
+        uint64_t begin_;
+    };
+
+}  // namespace ho
+
+#define HO_TRACE_CONCAT_IMPL(a, b) a##b
+#define HO_TRACE_CONCAT(a, b) HO_TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) ::ho::TraceScope HO_TRACE_CONCAT(trace_scope_, __LINE__)(name)
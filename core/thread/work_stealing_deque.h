@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "core/macros.h"
+#include "thread.h"
+
+namespace ho {
+
+#ifdef THREAD_ENABLED
+
+    // Chase-Lev work-stealing deque.
+    // The owner thread pushes and pops at the bottom, any thread may steal from the top.
+    // Push and Pop must not run concurrently with each other, Steal can run concurrently with both.
+    // T must be trivially copyable, a thief may read a slot that the owner overwrites before the thief's claim fails.
+    template <typename T>
+    class WorkStealingDeque {
+        static_assert(std::is_trivially_copyable_v<T>, "WorkStealingDeque holds trivially copyable values.");
+
+       public:
+        explicit WorkStealingDeque(int64_t capacity = 1024) {
+            assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+            rings_.emplace_back(std::make_unique<Ring>(capacity));
+            ring_.store(rings_.back().get(), std::memory_order_relaxed);
+        }
+
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+        // Owner only
+        void Push(T value) {
+            const int64_t b = bottom_.load(std::memory_order_relaxed);
+            const int64_t t = top_.load(std::memory_order_acquire);
+            Ring* ring = ring_.load(std::memory_order_relaxed);
+            if (b - t > ring->capacity - 1) {
+                ring = Grow(ring, t, b);
+            }
+            ring->Put(b, value);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+
+        // Owner only, takes the most recently pushed value.
+        bool Pop(T& out) {
+            const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+            Ring* ring = ring_.load(std::memory_order_relaxed);
+            bottom_.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top_.load(std::memory_order_relaxed);
+
+            if (t > b) {
+                // empty
+                bottom_.store(b + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            out = ring->Get(b);
+            if (t == b) {
+                // last value, race against thieves
+                const bool is_won =
+                    top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                bottom_.store(b + 1, std::memory_order_relaxed);
+                return is_won;
+            }
+            return true;
+        }
+
+        // Any thread, takes the least recently pushed value. Fails if empty or if another thread won the race.
+        bool Steal(T& out) {
+            int64_t t = top_.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = bottom_.load(std::memory_order_acquire);
+            if (t >= b) {
+                return false;
+            }
+
+            Ring* ring = ring_.load(std::memory_order_acquire);
+            T value = ring->Get(t);
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return false;
+            }
+            out = value;
+            return true;
+        }
+
+        // Approximate when called concurrently.
+        bool IsEmpty() const {
+            const int64_t t = top_.load(std::memory_order_relaxed);
+            const int64_t b = bottom_.load(std::memory_order_relaxed);
+            return b <= t;
+        }
+
+        int64_t GetCapacity() const { return ring_.load(std::memory_order_relaxed)->capacity; }
+
+       private:
+        struct Ring {
+            explicit Ring(int64_t size)
+                : capacity(size), mask(size - 1), slots(new std::atomic<T>[static_cast<size_t>(size)]) {}
+
+            ALWAYS_INLINE T Get(int64_t i) const {
+                return slots[static_cast<size_t>(i & mask)].load(std::memory_order_relaxed);
+            }
+            ALWAYS_INLINE void Put(int64_t i, T value) {
+                slots[static_cast<size_t>(i & mask)].store(value, std::memory_order_relaxed);
+            }
+
+            int64_t capacity;
+            int64_t mask;
+            std::unique_ptr<std::atomic<T>[]> slots;
+        };
+
+        // Thieves may still read the old ring, so it is kept until the deque is destroyed.
+        Ring* Grow(Ring* old_ring, int64_t t, int64_t b) {
+            rings_.emplace_back(std::make_unique<Ring>(old_ring->capacity * 2));
+            Ring* ring = rings_.back().get();
+            for (int64_t i = t; i < b; i++) {
+                ring->Put(i, old_ring->Get(i));
+            }
+            ring_.store(ring, std::memory_order_release);
+            return ring;
+        }
+
+        alignas(Thread::CACHE_LINE_BYTES) std::atomic<int64_t> top_{0};
+        alignas(Thread::CACHE_LINE_BYTES) std::atomic<int64_t> bottom_{0};
+        std::atomic<Ring*> ring_{nullptr};
+        std::vector<std::unique_ptr<Ring>> rings_;  // owner only
+    };
+
+#else
+
+    // Single-threaded fallback version, a plain double-ended stack.
+    template <typename T>
+    class WorkStealingDeque {
+       public:
+        explicit WorkStealingDeque(int64_t capacity = 1024) { values_.reserve(static_cast<size_t>(capacity)); }
+
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+        void Push(T value) { values_.push_back(value); }
+
+        bool Pop(T& out) {
+            if (head_ >= values_.size()) {
+                return false;
+            }
+            out = values_.back();
+            values_.pop_back();
+            Compact();
+            return true;
+        }
+
+        bool Steal(T& out) {
+            if (head_ >= values_.size()) {
+                return false;
+            }
+            out = values_[head_++];
+            Compact();
+            return true;
+        }
+
+        bool IsEmpty() const { return head_ >= values_.size(); }
+
+        int64_t GetCapacity() const { return static_cast<int64_t>(values_.capacity()); }
+
+       private:
+        void Compact() {
+            if (head_ >= values_.size()) {
+                values_.clear();
+                head_ = 0;
+            }
+        }
+
+        std::vector<T> values_;
+        size_t head_ = 0;
+    };
+
+#endif  // THREAD_ENABLED
+
+}  // namespace ho
@@ -6,6 +6,7 @@
 #include "../shader/blinn_phong_vs.h"
 #include "core/io/resource_loader.h"
 #include "core/math/frustum.h"
+#include "core/thread/tracer.h"
 #include "renderer/renderer.h"
 #include "resource/material.h"
 #include "resource/mesh.h"
@@ -178,6 +179,8 @@ namespace ho {
                         vgBindTexture(VG_TEXTURE_2D, tid);
                         vgTexImage2D(VG_TEXTURE_2D, 0, format, tex->images[0]->width(), tex->images[0]->height(), 0,
                                      format, VG_UNSIGNED_BYTE, tex->images[0]->GetBitmap());
+                        vgGenerateMipmap(VG_TEXTURE_2D);
+                        vgTexParameteri(VG_TEXTURE_2D, VG_TEXTURE_MIN_FILTER, VG_LINEAR_MIPMAP_LINEAR);
 
                         // delete texture after uploading
                         resource_manager_.DeleteTexture(rid);
@@ -249,6 +252,8 @@ namespace ho {
     }
 
     bool BlinnPhongRenderer::Render() {
+        // Deferred commands run after Render returns, so the scope measures recording only.
+        TRACE_SCOPE("Record MainPass");
         vgUseProgram(program_);
 
         vgBindFramebuffer(VG_FRAMEBUFFER, 0);
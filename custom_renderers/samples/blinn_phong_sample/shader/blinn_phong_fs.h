@@ -11,6 +11,8 @@ namespace ho {
         float v_handedness = in.InFlat<float>("handedness"_vg);
         Vector3 v_normal = in.In<Vector3>("normal"_vg).Normalized();
         Vector2 v_uv = in.In<Vector2>("uv"_vg);
+        Vector2 v_uv_dx = in.InDx<Vector2>("uv"_vg);
+        Vector2 v_uv_dy = in.InDy<Vector2>("uv"_vg);
 
         int u_diffuse_sampler = FetchUniform<int>("u_diffuse_sampler"_vg);
         int u_specular_sampler = FetchUniform<int>("u_specular_sampler"_vg);
@@ -18,12 +20,12 @@ namespace ho {
 
         Vector3 bitangent = v_handedness * v_normal.Cross(Vector3(v_tangent));
         Matrix3x3 tbn = Matrix3x3(Vector3(v_tangent), bitangent, v_normal).Transpose();
-        Vector3 normal = Texture2D<Color128>(u_normal_sampler, v_uv).ToVector3();
+        Vector3 normal = Texture2DGrad<Color128>(u_normal_sampler, v_uv, v_uv_dx, v_uv_dy).ToVector3();
         normal = (tbn * normal).Normalized();
 
-        Color128 diffuse = Texture2D<Color128>(u_diffuse_sampler, v_uv);
+        Color128 diffuse = Texture2DGrad<Color128>(u_diffuse_sampler, v_uv, v_uv_dx, v_uv_dy);
 
-        Color128 specular = Texture2D<Color128>(u_specular_sampler, v_uv);
+        Color128 specular = Texture2DGrad<Color128>(u_specular_sampler, v_uv, v_uv_dx, v_uv_dy);
 
         Vector3 light_dir_raw = FetchUniform<Vector3>("u_light_directions"_vg, 0);
         Vector3 L = -light_dir_raw.Normalized();
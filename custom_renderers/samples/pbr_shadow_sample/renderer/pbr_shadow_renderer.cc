@@ -8,6 +8,7 @@
 #include "../shader/pbr_vs.h"
 #include "core/io/resource_loader.h"
 #include "core/math/frustum.h"
+#include "core/thread/tracer.h"
 #include "renderer/renderer.h"
 #include "resource/material.h"
 #include "resource/mesh.h"
@@ -196,6 +197,8 @@ namespace ho {
                         vgBindTexture(VG_TEXTURE_2D, tid);
                         vgTexImage2D(VG_TEXTURE_2D, 0, format, tex->images[0]->width(), tex->images[0]->height(), 0,
                                      format, VG_UNSIGNED_BYTE, tex->images[0]->GetBitmap());
+                        vgGenerateMipmap(VG_TEXTURE_2D);
+                        vgTexParameteri(VG_TEXTURE_2D, VG_TEXTURE_MIN_FILTER, VG_LINEAR_MIPMAP_LINEAR);
 
                         // delete texture after uploading
                         resource_manager_.DeleteTexture(rid);
@@ -232,18 +235,22 @@ namespace ho {
         vgAttachShader(depthmap_program_, depthmap_vs);
         vgAttachShader(depthmap_program_, depthmap_fs);
         vgLinkProgram(depthmap_program_);
+        vgProgramParameteri(depthmap_program_, VG_EARLY_FRAGMENT_TESTS, VG_TRUE);
 
         // PBR program
         VGuint pbr_vs = vgCreateShader(VG_VERTEX_SHADER);
         vgShaderSource(pbr_vs, PBR_VS);
+        vgShaderSourceWide(pbr_vs, PBR_VS_WIDE);
         vgCompileShader(pbr_vs);
         VGuint pbr_fs = vgCreateShader(VG_FRAGMENT_SHADER);
         vgShaderSource(pbr_fs, PBR_FS);
+        vgShaderSourceWide(pbr_fs, PBR_FS_QUAD);
         vgCompileShader(pbr_fs);
         pbr_program_ = vgCreateProgram();
         vgAttachShader(pbr_program_, pbr_vs);
         vgAttachShader(pbr_program_, pbr_fs);
         vgLinkProgram(pbr_program_);
+        vgProgramParameteri(pbr_program_, VG_EARLY_FRAGMENT_TESTS, VG_TRUE);
 
         if (vgGetError() != VG_NONE) {
             return false;
@@ -281,161 +288,169 @@ namespace ho {
     }
 
     bool PBRShadowRenderer::Render() {
+        // Deferred commands run after Render returns, so the pass scopes measure recording only.
+        const Skeleton* sklt = object_.skeleton;
+        std::vector<Transform3D> acc_transforms;
+        Matrix4x4 light_view_projection = light_.projection.matrix * light_.view.ToMatrix();
+
         // ===================================================================
         // 1 Pass : Make Shadow Map
         // ===================================================================
-        vgUseProgram(depthmap_program_);
-
-        vgBindFramebuffer(VG_FRAMEBUFFER, depthmap_framebuffer_);
-        vgDrawBuffer(VG_NONE);
+        {
+            TRACE_SCOPE("Record ShadowPass");
+            vgUseProgram(depthmap_program_);
+
+            vgBindFramebuffer(VG_FRAMEBUFFER, depthmap_framebuffer_);
+            vgDrawBuffer(VG_NONE);
+
+            vgClear(VG_DEPTH_BUFFER_BIT);
+
+            // traversal skeleton tree
+            acc_transforms.resize(sklt->GetBoneCount());
+            for (uint32_t bi = 0; bi < sklt->GetBoneCount(); bi++) {
+                int parent_idx = sklt->GetParentIndex(bi);
+                // get accumulated modeling transform
+                Transform3D model_t = parent_idx == -1 ? object_.modeling_transform * sklt->GetLocalTransform(bi)
+                                                       : acc_transforms[parent_idx] * sklt->GetLocalTransform(bi);
+                acc_transforms[bi] = model_t;
+
+                // Prepare frustum in local space for bounding volume cullling
+                Matrix4x4 PVM_mat = light_view_projection * model_t.ToMatrix();
+                Frustum frustum = Frustum::FromMatrix4x4(PVM_mat);
+
+                // draw submesh bound to bone
+                auto& bound_submesh_idx = object_.skin->bind_sub_meshes[bi];
+                for (int smi = 0; smi < bound_submesh_idx.size(); smi++) {
+                    const UploadedSubMesh& usm = object_.sub_meshes[bound_submesh_idx[smi]];
+                    // Bounding volume culling
+                    if (frustum.GetSide(usm.sphere) == math::OUTSIDE) {
+                        continue;
+                    }
 
-        vgClear(VG_DEPTH_BUFFER_BIT);
+                    VGuint vao = usm.vao;
+                    vgBindVertexArray(vao);
 
-        Matrix4x4 light_view_projection = light_.projection.matrix * light_.view.ToMatrix();
+                    VGuint u_model = vgGetUniformLocation(depthmap_program_, "u_model"_vg);
+                    vgUniformMatrix4fv(u_model, 1, false, (const VGfloat*)model_t.ToMatrix().data);
+                    VGuint u_view_projection = vgGetUniformLocation(depthmap_program_, "u_view_projection"_vg);
+                    vgUniformMatrix4fv(u_view_projection, 1, false, (const VGfloat*)light_view_projection.data);
 
-        // traversal skeleton tree
-        const Skeleton* sklt = object_.skeleton;
-        std::vector<Transform3D> acc_transforms;
-        acc_transforms.resize(sklt->GetBoneCount());
-        for (uint32_t bi = 0; bi < sklt->GetBoneCount(); bi++) {
-            int parent_idx = sklt->GetParentIndex(bi);
-            // get accumulated modeling transform
-            Transform3D model_t = parent_idx == -1 ? object_.modeling_transform * sklt->GetLocalTransform(bi)
-                                                   : acc_transforms[parent_idx] * sklt->GetLocalTransform(bi);
-            acc_transforms[bi] = model_t;
-
-            // Prepare frustum in local space for bounding volume cullling
-            Matrix4x4 PVM_mat = light_view_projection * model_t.ToMatrix();
-            Frustum frustum = Frustum::FromMatrix4x4(PVM_mat);
-
-            // draw submesh bound to bone
-            auto& bound_submesh_idx = object_.skin->bind_sub_meshes[bi];
-            for (int smi = 0; smi < bound_submesh_idx.size(); smi++) {
-                const UploadedSubMesh& usm = object_.sub_meshes[bound_submesh_idx[smi]];
-                // Bounding volume culling
-                if (frustum.GetSide(usm.sphere) == math::OUTSIDE) {
-                    continue;
+                    vgDrawElements(VG_TRIANGLES, usm.index_count, VG_UNSIGNED_INT, (const void*)0);
                 }
-
-                VGuint vao = usm.vao;
-                vgBindVertexArray(vao);
-
-                VGuint u_model = vgGetUniformLocation(depthmap_program_, "u_model"_vg);
-                vgUniformMatrix4fv(u_model, 1, false, (const VGfloat*)model_t.ToMatrix().data);
-                VGuint u_view_projection = vgGetUniformLocation(depthmap_program_, "u_view_projection"_vg);
-                vgUniformMatrix4fv(u_view_projection, 1, false, (const VGfloat*)light_view_projection.data);
-
-                vgDrawElements(VG_TRIANGLES, usm.index_count, VG_UNSIGNED_INT, (const void*)0);
             }
         }
 
         // ===================================================================
         // 2 Pass : Actual rendering
         // ===================================================================
-        vgUseProgram(pbr_program_);
+        {
+            TRACE_SCOPE("Record MainPass");
+            vgUseProgram(pbr_program_);
+
+            vgBindFramebuffer(VG_FRAMEBUFFER, 0);
+            vgDrawBuffer(VG_BACK);
+
+            vgClear(VG_COLOR_BUFFER_BIT | VG_DEPTH_BUFFER_BIT);
+            // Prepare PV matrix for bounding volume culling
+            Matrix4x4 view_mat = camera_.modeling_transform.InverseFast().ToMatrix();
+            Matrix4x4 PV_mat = camera_.projection.matrix * view_mat;
+
+            // traversal skeleton tree
+            acc_transforms.resize(sklt->GetBoneCount());
+            for (uint32_t bi = 0; bi < sklt->GetBoneCount(); bi++) {
+                int parent_idx = sklt->GetParentIndex(bi);
+                // get accumulated modeling transform
+                Transform3D model_t = parent_idx == -1 ? object_.modeling_transform * sklt->GetLocalTransform(bi)
+                                                       : acc_transforms[parent_idx] * sklt->GetLocalTransform(bi);
+
+                // Prepare frustum in local space for bounding volume cullling
+                Matrix4x4 PVM_mat = PV_mat * model_t.ToMatrix();
+                Frustum frustum = Frustum::FromMatrix4x4(PVM_mat);
+
+                // draw submesh bound to bone
+                auto& bound_submesh_idx = object_.skin->bind_sub_meshes[bi];
+                for (int smi = 0; smi < bound_submesh_idx.size(); smi++) {
+                    const UploadedSubMesh& usm = object_.sub_meshes[bound_submesh_idx[smi]];
+                    // Bounding volume culling
+                    if (frustum.GetSide(usm.sphere) == math::OUTSIDE) {
+                        continue;
+                    }
 
-        vgBindFramebuffer(VG_FRAMEBUFFER, 0);
-        vgDrawBuffer(VG_BACK);
-
-        vgClear(VG_COLOR_BUFFER_BIT | VG_DEPTH_BUFFER_BIT);
-        // Prepare PV matrix for bounding volume culling
-        Matrix4x4 view_mat = camera_.modeling_transform.InverseFast().ToMatrix();
-        Matrix4x4 PV_mat = camera_.projection.matrix * view_mat;
-
-        // traversal skeleton tree
-        acc_transforms.resize(sklt->GetBoneCount());
-        for (uint32_t bi = 0; bi < sklt->GetBoneCount(); bi++) {
-            int parent_idx = sklt->GetParentIndex(bi);
-            // get accumulated modeling transform
-            Transform3D model_t = parent_idx == -1 ? object_.modeling_transform * sklt->GetLocalTransform(bi)
-                                                   : acc_transforms[parent_idx] * sklt->GetLocalTransform(bi);
-
-            // Prepare frustum in local space for bounding volume cullling
-            Matrix4x4 PVM_mat = PV_mat * model_t.ToMatrix();
-            Frustum frustum = Frustum::FromMatrix4x4(PVM_mat);
-
-            // draw submesh bound to bone
-            auto& bound_submesh_idx = object_.skin->bind_sub_meshes[bi];
-            for (int smi = 0; smi < bound_submesh_idx.size(); smi++) {
-                const UploadedSubMesh& usm = object_.sub_meshes[bound_submesh_idx[smi]];
-                // Bounding volume culling
-                if (frustum.GetSide(usm.sphere) == math::OUTSIDE) {
-                    continue;
+                    VGuint vao = usm.vao;
+                    vgBindVertexArray(vao);
+
+                    const Material* mat = usm.material;
+                    VGuint u_model = vgGetUniformLocation(pbr_program_, "u_model"_vg);
+                    vgUniformMatrix4fv(u_model, 1, false, (const VGfloat*)model_t.ToMatrix().data);
+                    VGuint u_view = vgGetUniformLocation(pbr_program_, "u_view"_vg);
+                    vgUniformMatrix4fv(u_view, 1, false, (const VGfloat*)view_mat.data);
+                    VGuint u_projection = vgGetUniformLocation(pbr_program_, "u_projection"_vg);
+                    vgUniformMatrix4fv(u_projection, 1, false, (const VGfloat*)camera_.projection.matrix.data);
+                    VGuint u_light_view_projection = vgGetUniformLocation(pbr_program_, "u_light_view_projection"_vg);
+                    vgUniformMatrix4fv(u_light_view_projection, 1, false, (const VGfloat*)light_view_projection.data);
+
+                    // unit - texture mapping
+                    // 0: diffuse, 1: specular, 2: shininess, 3: opacitry, 4: normal, 5: albedo, 6: emission,
+                    // 7: metallic/roughness, 8:ao, 9: depthmap
+
+                    // bind normal
+                    vgActiveTexture(VG_TEXTURE4);
+                    vgBindTexture(VG_TEXTURE_2D, object_.texture_rid_to_vgid[mat->textures[TEXTURE_TYPE_NORMAL]]);
+                    VGuint u_normal = vgGetUniformLocation(pbr_program_, "u_normal_sampler"_vg);
+                    vgUniform1i(u_normal, 4);
+
+                    // bind albedo
+                    vgActiveTexture(VG_TEXTURE5);
+                    vgBindTexture(VG_TEXTURE_2D, object_.texture_rid_to_vgid[mat->textures[TEXTURE_TYPE_ALBEDO]]);
+                    VGuint u_albedo = vgGetUniformLocation(pbr_program_, "u_albedo_sampler"_vg);
+                    vgUniform1i(u_albedo, 5);
+
+                    // bind metallic/roughness
+                    vgActiveTexture(VG_TEXTURE7);
+                    vgBindTexture(VG_TEXTURE_2D,
+                                  object_.texture_rid_to_vgid[mat->textures[TEXTURE_TYPE_METALLIC_ROUGHNESS]]);
+                    VGuint u_metallic_roughness = vgGetUniformLocation(pbr_program_, "u_metallic_roughness_sampler"_vg);
+                    vgUniform1i(u_metallic_roughness, 7);
+
+                    // bind emission
+                    vgActiveTexture(VG_TEXTURE6);
+                    vgBindTexture(VG_TEXTURE_2D, object_.texture_rid_to_vgid[mat->textures[TEXTURE_TYPE_EMISSION]]);
+                    VGuint u_emission = vgGetUniformLocation(pbr_program_, "u_emission_sampler"_vg);
+                    vgUniform1i(u_emission, 6);
+
+                    // bind ao
+                    vgActiveTexture(VG_TEXTURE8);
+                    vgBindTexture(VG_TEXTURE_2D,
+                                  object_.texture_rid_to_vgid[mat->textures[TEXTURE_TYPE_AMBIENT_OCCLUSION]]);
+                    VGuint u_ao = vgGetUniformLocation(pbr_program_, "u_ao_sampler"_vg);
+                    vgUniform1i(u_ao, 8);
+
+                    // bind depthmap
+                    vgActiveTexture(VG_TEXTURE9);
+                    vgBindTexture(VG_TEXTURE_2D, depthmap_);
+                    VGuint u_depthmap = vgGetUniformLocation(pbr_program_, "u_depthmap_sampler"_vg);
+                    vgUniform1i(u_depthmap, 9);
+
+                    VGuint u_light_positions = vgGetUniformLocation(pbr_program_, "u_light_positions"_vg);
+                    Vector3 light_pos[1];
+                    light_pos[0] = Vector3(5.f, 5.f, 5.f);
+                    vgUniform3fv(u_light_positions, 1, (const VGfloat*)(light_pos));
+
+                    VGuint u_lightColors = vgGetUniformLocation(pbr_program_, "u_light_colors"_vg);
+                    Vector3 light_colors[1];
+                    Color128 lc = light_.color * light_.intensity;
+                    light_colors[0] = Vector3(lc.r, lc.g, lc.b);
+                    vgUniform3fv(u_lightColors, 1, (const VGfloat*)(light_colors));
+
+                    VGuint u_eye_position = vgGetUniformLocation(pbr_program_, "u_eye_position"_vg);
+                    vgUniform3f(u_eye_position, camera_.modeling_transform.origin.x,
+                                camera_.modeling_transform.origin.y, camera_.modeling_transform.origin.z);
+
+                    vgDrawElements(VG_TRIANGLES, usm.index_count, VG_UNSIGNED_INT, (const void*)0);
                 }
-
-                VGuint vao = usm.vao;
-                vgBindVertexArray(vao);
-
-                const Material* mat = usm.material;
-                VGuint u_model = vgGetUniformLocation(pbr_program_, "u_model"_vg);
-                vgUniformMatrix4fv(u_model, 1, false, (const VGfloat*)model_t.ToMatrix().data);
-                VGuint u_view = vgGetUniformLocation(pbr_program_, "u_view"_vg);
-                vgUniformMatrix4fv(u_view, 1, false, (const VGfloat*)view_mat.data);
-                VGuint u_projection = vgGetUniformLocation(pbr_program_, "u_projection"_vg);
-                vgUniformMatrix4fv(u_projection, 1, false, (const VGfloat*)camera_.projection.matrix.data);
-                VGuint u_light_view_projection = vgGetUniformLocation(pbr_program_, "u_light_view_projection"_vg);
-                vgUniformMatrix4fv(u_light_view_projection, 1, false, (const VGfloat*)light_view_projection.data);
-
-                // unit - texture mapping
-                // 0: diffuse, 1: specular, 2: shininess, 3: opacitry, 4: normal, 5: albedo, 6: emission,
-                // 7: metallic/roughness, 8:ao, 9: depthmap
-
-                // bind normal
-                vgActiveTexture(VG_TEXTURE4);
-                vgBindTexture(VG_TEXTURE_2D, object_.texture_rid_to_vgid[mat->textures[TEXTURE_TYPE_NORMAL]]);
-                VGuint u_normal = vgGetUniformLocation(pbr_program_, "u_normal_sampler"_vg);
-                vgUniform1i(u_normal, 4);
-
-                // bind albedo
-                vgActiveTexture(VG_TEXTURE5);
-                vgBindTexture(VG_TEXTURE_2D, object_.texture_rid_to_vgid[mat->textures[TEXTURE_TYPE_ALBEDO]]);
-                VGuint u_albedo = vgGetUniformLocation(pbr_program_, "u_albedo_sampler"_vg);
-                vgUniform1i(u_albedo, 5);
-
-                // bind metallic/roughness
-                vgActiveTexture(VG_TEXTURE7);
-                vgBindTexture(VG_TEXTURE_2D,
-                              object_.texture_rid_to_vgid[mat->textures[TEXTURE_TYPE_METALLIC_ROUGHNESS]]);
-                VGuint u_metallic_roughness = vgGetUniformLocation(pbr_program_, "u_metallic_roughness_sampler"_vg);
-                vgUniform1i(u_metallic_roughness, 7);
-
-                // bind emission
-                vgActiveTexture(VG_TEXTURE6);
-                vgBindTexture(VG_TEXTURE_2D, object_.texture_rid_to_vgid[mat->textures[TEXTURE_TYPE_EMISSION]]);
-                VGuint u_emission = vgGetUniformLocation(pbr_program_, "u_emission_sampler"_vg);
-                vgUniform1i(u_emission, 6);
-
-                // bind ao
-                vgActiveTexture(VG_TEXTURE8);
-                vgBindTexture(VG_TEXTURE_2D,
-                              object_.texture_rid_to_vgid[mat->textures[TEXTURE_TYPE_AMBIENT_OCCLUSION]]);
-                VGuint u_ao = vgGetUniformLocation(pbr_program_, "u_ao_sampler"_vg);
-                vgUniform1i(u_ao, 8);
-
-                // bind depthmap
-                vgActiveTexture(VG_TEXTURE9);
-                vgBindTexture(VG_TEXTURE_2D, depthmap_);
-                VGuint u_depthmap = vgGetUniformLocation(pbr_program_, "u_depthmap_sampler"_vg);
-                vgUniform1i(u_depthmap, 9);
-
-                VGuint u_light_positions = vgGetUniformLocation(pbr_program_, "u_light_positions"_vg);
-                Vector3 light_pos[1];
-                light_pos[0] = Vector3(5.f, 5.f, 5.f);
-                vgUniform3fv(u_light_positions, 1, (const VGfloat*)(light_pos));
-
-                VGuint u_lightColors = vgGetUniformLocation(pbr_program_, "u_light_colors"_vg);
-                Vector3 light_colors[1];
-                Color128 lc = light_.color * light_.intensity;
-                light_colors[0] = Vector3(lc.r, lc.g, lc.b);
-                vgUniform3fv(u_lightColors, 1, (const VGfloat*)(light_colors));
-
-                VGuint u_eye_position = vgGetUniformLocation(pbr_program_, "u_eye_position"_vg);
-                vgUniform3f(u_eye_position, camera_.modeling_transform.origin.x, camera_.modeling_transform.origin.y,
-                            camera_.modeling_transform.origin.z);
-
-                vgDrawElements(VG_TRIANGLES, usm.index_count, VG_UNSIGNED_INT, (const void*)0);
             }
         }
+
         if (vgGetError() != VG_NONE) {
             return false;
         }
@@ -51,7 +51,36 @@ namespace ho {
         return F0 + (Vector3(1.f, 1.f, 1.f) - F0) * math::Pow(1.f - cos_theta, 5.f);
     }
 
-    ALWAYS_INLINE void PBR_FS(const VirtualGPU::Fragment& in, VirtualGPU::FSOutputs& out) {
+    // Uniforms of PBR_FS, fetched once per fragment or once per quad.
+    struct PBRUniforms {
+        int normal_sampler;
+        int albedo_sampler;
+        int metallic_roughness_sampler;
+        int emission_sampler;
+        int ao_sampler;
+        int depthmap_sampler;
+        UniformRef light_positions;
+        UniformRef light_colors;
+        Vector3 eye_position;
+    };
+
+    ALWAYS_INLINE PBRUniforms FetchPBRUniforms() {
+        PBRUniforms u;
+        u.normal_sampler = FetchUniform<int>("u_normal_sampler"_vg);
+        u.albedo_sampler = FetchUniform<int>("u_albedo_sampler"_vg);
+        u.metallic_roughness_sampler = FetchUniform<int>("u_metallic_roughness_sampler"_vg);
+        u.emission_sampler = FetchUniform<int>("u_emission_sampler"_vg);
+        u.ao_sampler = FetchUniform<int>("u_ao_sampler"_vg);
+        u.depthmap_sampler = FetchUniform<int>("u_depthmap_sampler"_vg);
+        u.light_positions = GetUniformRef("u_light_positions"_vg);
+        u.light_colors = GetUniformRef("u_light_colors"_vg);
+        u.eye_position = FetchUniform<Vector3>("u_eye_position"_vg);
+        return u;
+    }
+
+    // 'v_uv_dx' and 'v_uv_dy' are the screen space derivatives of the uv of 'in'.
+    ALWAYS_INLINE Color128 ShadePBR(const VirtualGPU::Fragment& in, const PBRUniforms& u, Vector2 v_uv_dx,
+                                    Vector2 v_uv_dy) {
         Vector3 v_world_pos = in.In<Vector3>("world_pos"_vg);
         Vector3 v_tangent = in.In<Vector3>("tangent"_vg).Normalized();
         float v_handedness = in.InFlat<float>("handedness"_vg);
@@ -59,40 +88,37 @@ namespace ho {
         Vector2 v_uv = in.In<Vector2>("uv"_vg);
         Vector4 v_light_space_pos = in.In<Vector4>("light_space_pos"_vg);
 
-        int u_normal_sampler = FetchUniform<int>("u_normal_sampler"_vg);
-        int u_albedo_sampler = FetchUniform<int>("u_albedo_sampler"_vg);
-        int u_metallic_roughness_sampler = FetchUniform<int>("u_metallic_roughness_sampler"_vg);
-        int u_emission_sampler = FetchUniform<int>("u_emission_sampler"_vg);
-        int u_ao_sampler = FetchUniform<int>("u_ao_sampler"_vg);
-        int u_depthmap_sampler = FetchUniform<int>("u_depthmap_sampler"_vg);
+        int u_normal_sampler = u.normal_sampler;
+        int u_albedo_sampler = u.albedo_sampler;
+        int u_metallic_roughness_sampler = u.metallic_roughness_sampler;
+        int u_emission_sampler = u.emission_sampler;
+        int u_ao_sampler = u.ao_sampler;
+        int u_depthmap_sampler = u.depthmap_sampler;
 
         // sample normal
         Vector3 bitangent = v_handedness * v_normal.Cross(Vector3(v_tangent));
         Matrix3x3 tbn = Matrix3x3(Vector3(v_tangent), bitangent, v_normal).Transpose();
-        Vector3 normal = Texture2D<Color128>(u_normal_sampler, v_uv).ToVector3();
+        Vector3 normal = Texture2DGrad<Color128>(u_normal_sampler, v_uv, v_uv_dx, v_uv_dy).ToVector3();
         normal = (tbn * normal).Normalized();
 
         // sample albedo
-        Color128 albedo = Texture2D<Color128>(u_albedo_sampler, v_uv);
+        Color128 albedo = Texture2DGrad<Color128>(u_albedo_sampler, v_uv, v_uv_dx, v_uv_dy);
         albedo = albedo.sRGBToLinear();
 
         // sample metallic/roughness
-        Color128 metallic_roughness = Texture2D<Color128>(u_metallic_roughness_sampler, v_uv);
+        Color128 metallic_roughness = Texture2DGrad<Color128>(u_metallic_roughness_sampler, v_uv, v_uv_dx, v_uv_dy);
 
         // sample emission
-        Color128 emission = Texture2D<Color128>(u_emission_sampler, v_uv);
+        Color128 emission = Texture2DGrad<Color128>(u_emission_sampler, v_uv, v_uv_dx, v_uv_dy);
         emission = emission.sRGBToLinear();
 
         // sample AO
-        Color128 ao = Texture2D<Color128>(u_ao_sampler, v_uv);
+        Color128 ao = Texture2DGrad<Color128>(u_ao_sampler, v_uv, v_uv_dx, v_uv_dy);
 
-        Vector3 u_light_positions[1];
-        u_light_positions[0] = FetchUniform<Vector3>("u_light_positions"_vg, 0);
+        const UniformRef& u_light_positions = u.light_positions;
+        const UniformRef& u_light_colors = u.light_colors;
 
-        Vector3 u_light_colors[1];
-        u_light_colors[0] = FetchUniform<Vector3>("u_light_colors"_vg, 0);
-
-        Vector3 u_eye_position = FetchUniform<Vector3>("u_eye_position"_vg);
+        Vector3 u_eye_position = u.eye_position;
 
         Vector3 N = normal.Normalized();
         Vector3 V = (u_eye_position - v_world_pos).Normalized();
@@ -103,13 +129,14 @@ namespace ho {
         // reflectance equation
         Vector3 Lo = Vector3(0.f, 0.f, 0.f);
 
-        for (int i = 0; i < 1; i++) {
+        for (size_t i = 0; i < 1; i++) {
             // calculate per-light radiance
-            Vector3 L = (u_light_positions[i] - v_world_pos).Normalized();
+            Vector3 light_position = FetchUniform<Vector3>(u_light_positions, i);
+            Vector3 L = (light_position - v_world_pos).Normalized();
             Vector3 H = (V + L).Normalized();
-            float distance = (u_light_positions[i] - v_world_pos).Magnitude();
+            float distance = (light_position - v_world_pos).Magnitude();
             float attenuation = 1.f / (distance * distance);
-            Vector3 radiance = u_light_colors[i] * attenuation;
+            Vector3 radiance = FetchUniform<Vector3>(u_light_colors, i) * attenuation;
 
             // cook-torrance brdf
             float NDF = DistributionGGX(N, H, metallic_roughness.g);
@@ -161,7 +188,24 @@ namespace ho {
         final_color.b = color.z;
         final_color.a = 1.f;
 
-        out.Out(0, final_color.LinearTosRGB());
+        return final_color.LinearTosRGB();
+    }
+
+    ALWAYS_INLINE void PBR_FS(const VirtualGPU::Fragment& in, VirtualGPU::FSOutputs& out) {
+        out.Out(0, ShadePBR(in, FetchPBRUniforms(), in.InDx<Vector2>("uv"_vg), in.InDy<Vector2>("uv"_vg)));
+    }
+
+    // PBR_FS of a quad, fetches the uniforms once and takes the uv derivatives across the quad.
+    ALWAYS_INLINE void PBR_FS_QUAD(const VirtualGPU::FragmentQuad& in, VirtualGPU::FSQuadOutputs& out) {
+        const PBRUniforms u = FetchPBRUniforms();
+        Vector2 v_uv[VirtualGPU::FragmentQuad::LANE_COUNT];
+        in.In<Vector2>("uv"_vg, v_uv);
+        for (size_t lane = 0; lane < VirtualGPU::FragmentQuad::LANE_COUNT; lane++) {
+            if (in.IsHelper(lane)) {
+                continue;
+            }
+            out.Out(lane, 0, ShadePBR(in[lane], u, dFdx(v_uv, lane), dFdy(v_uv, lane)));
+        }
     }
 
 }  // namespace ho
\ No newline at end of file
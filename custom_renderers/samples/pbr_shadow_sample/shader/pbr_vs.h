@@ -34,4 +34,78 @@ namespace ho {
         Vector4 light_space_pos = u_light_view_projection * u_model * a_position.ToHomogeneous();
         out.Out("light_space_pos"_vg, light_space_pos);
     }
+
+    // out[r] = row r of m dot (v[0], v[1], v[2], v[3]) of every lane
+    ALWAYS_INLINE void TransformBatch(const Matrix4x4& m, const float (&v)[4][VirtualGPU::VertexBatch::WIDTH],
+                                      float (&out)[4][VirtualGPU::VertexBatch::WIDTH]) {
+        for (size_t r = 0; r < 4; r++) {
+            const real* row = m.data[r];
+            for (size_t i = 0; i < VirtualGPU::VertexBatch::WIDTH; i++) {
+                out[r][i] = row[0] * v[0][i] + row[1] * v[1][i] + row[2] * v[2][i] + row[3] * v[3][i];
+            }
+        }
+    }
+
+    // out[r] = (m.ToMatrix3x3() * (v[0], v[1], v[2]))[r] of every lane
+    ALWAYS_INLINE void TransformBatch3(const Matrix4x4& m, const float (&v)[4][VirtualGPU::VertexBatch::WIDTH],
+                                       float (&out)[3][VirtualGPU::VertexBatch::WIDTH]) {
+        for (size_t r = 0; r < 3; r++) {
+            const real* row = m.data[r];
+            for (size_t i = 0; i < VirtualGPU::VertexBatch::WIDTH; i++) {
+                out[r][i] = row[0] * v[0][i] + row[1] * v[1][i] + row[2] * v[2][i];
+            }
+        }
+    }
+
+    // PBR_VS of a batch of vertices, see VirtualGPU::VertexBatch.
+    ALWAYS_INLINE void PBR_VS_WIDE(VirtualGPU::VertexBatch& out) {
+        constexpr size_t WIDTH = VirtualGPU::VertexBatch::WIDTH;
+
+        float a_position[4][WIDTH];  // w is 1 for the 3 component attribute
+        float a_normal[4][WIDTH];
+        float a_tangent[4][WIDTH];
+        float a_texcoord[4][WIDTH];
+        FetchAttributes(0, out, a_position);
+        FetchAttributes(1, out, a_normal);
+        FetchAttributes(2, out, a_tangent);
+        FetchAttributes(3, out, a_texcoord);
+
+        Matrix4x4 u_model = FetchUniform<Matrix4x4>("u_model"_vg);
+        Matrix4x4 u_view = FetchUniform<Matrix4x4>("u_view"_vg);
+        Matrix4x4 u_projection = FetchUniform<Matrix4x4>("u_projection"_vg);
+        Matrix4x4 u_light_view_projection = FetchUniform<Matrix4x4>("u_light_view_projection"_vg);
+
+        TransformBatch(u_projection * u_view * u_model, a_position, out.vg_Position);
+
+        float world[4][WIDTH];
+        TransformBatch(u_model, a_position, world);
+        float world_pos[3][WIDTH];
+        for (size_t i = 0; i < WIDTH; i++) {
+            const float inv_w = 1.f / world[3][i];
+            world_pos[0][i] = inv_w * world[0][i];
+            world_pos[1][i] = inv_w * world[1][i];
+            world_pos[2][i] = inv_w * world[2][i];
+        }
+        out.Out("world_pos"_vg, world_pos);
+
+        float handedness[1][WIDTH];
+        std::memcpy(handedness[0], a_tangent[3], sizeof(handedness[0]));
+        out.OutFlat("handedness"_vg, handedness);
+
+        float tangent[3][WIDTH];
+        TransformBatch3(u_model, a_tangent, tangent);
+        out.Out("tangent"_vg, tangent);
+
+        float normal[3][WIDTH];
+        TransformBatch3(u_model, a_normal, normal);
+        out.Out("normal"_vg, normal);
+
+        float uv[2][WIDTH];
+        std::memcpy(uv, a_texcoord, sizeof(uv));
+        out.Out("uv"_vg, uv);
+
+        float light_space_pos[4][WIDTH];
+        TransformBatch(u_light_view_projection * u_model, a_position, light_space_pos);
+        out.Out("light_space_pos"_vg, light_space_pos);
+    }
 }  // namespace ho
\ No newline at end of file
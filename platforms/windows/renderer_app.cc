@@ -98,17 +98,18 @@ void RendererApp::Run() {
             }
 
             // =============================================================
-            // Buffer swap
-            // =============================================================
-            main_window_->SwapCPUBuffer(0);
-
-            // =============================================================
-            // PostUpdate
+            // PostUpdate, runs while the frame is rasterized
             // =============================================================
             if (!renderer_adapter_.PostUpdate(timer_.DeltaTime())) {
                 main_window_->ShowMessageBox(L"Error", L"Renderer PostUpdate() failed");
                 return;
             }
+
+            // =============================================================
+            // Buffer swap
+            // =============================================================
+            renderer_adapter_.FinishRender();
+            main_window_->SwapCPUBuffer(0);
         }
     }
 }
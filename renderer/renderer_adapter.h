@@ -17,12 +17,26 @@ namespace ho {
             if (!renderer_->CreateDefaultFramebuffer(color_buffer, width, height)) {
                 return false;
             }
-            return renderer_->Initialize();
+            if (!renderer_->Initialize()) {
+                return false;
+            }
+            // Frames are recorded by Render and rasterized while the next update runs.
+            vgEnable(VG_DEFERRED_COMMANDS);
+            return true;
         }
 
         bool PreUpdate(float delta_time) { return renderer_->PreUpdate(delta_time); }
 
-        bool Render() { return renderer_->Render(); }
+        bool Render() {
+            if (!renderer_->Render()) {
+                return false;
+            }
+            vgFlush();
+            return true;
+        }
+
+        // Blocks until the frame submitted by Render is rasterized.
+        void FinishRender() { vgFinish(); }
 
         bool PostUpdate(float delta_time) { return renderer_->PostUpdate(delta_time); }
 
@@ -2,6 +2,7 @@
 #include <gtest/gtest.h>
 
 #include <atomic>
+#include <chrono>
 #include <thread>
 #include <vector>
 
@@ -95,6 +96,23 @@ TEST(JobSystemTest, CounterBasedSynchronization) {
     for (auto v : values) EXPECT_EQ(v, 1);
 }
 
+TEST(JobSystemTest, TryWaitForCounterTimesOut) {
+    JobSystem js(2);
+
+    std::atomic<bool> release{false};
+    auto counter = std::make_shared<AtomicNumeric<uint32_t>>(1);
+    JobDeclaration j{[](void* data, int) {
+                         auto* flag = reinterpret_cast<std::atomic<bool>*>(data);
+                         while (!flag->load()) std::this_thread::yield();
+                     },
+                     &release, sizeof(release), counter};
+    js.KickJob(j);
+
+    EXPECT_FALSE(js.TryWaitForCounter(counter, std::chrono::milliseconds(1)));
+    release.store(true);
+    EXPECT_TRUE(js.TryWaitForCounter(counter, std::chrono::seconds(10)));
+}
+
 TEST(JobSystemTest, StressTest) {
     JobSystem js(8);
 
@@ -113,3 +131,66 @@ TEST(JobSystemTest, StressTest) {
     js.WaitForIdle();
     for (auto v : values) EXPECT_EQ(v, 1);
 }
+
+TEST(JobSystemTest, ParallelForCoversRange) {
+    JobSystem js(4);
+
+    const size_t COUNT = 1000;
+    std::vector<std::atomic<int>> hits(COUNT);
+    for (auto& h : hits) h = 0;
+    std::atomic<int> range_count{0};
+
+    js.ParallelFor(10, COUNT, 64, [&](size_t first, size_t last) {
+        EXPECT_LE(last - first, 64u);
+        for (size_t i = first; i < last; i++) {
+            hits[i]++;
+        }
+        range_count++;
+    });
+
+    for (size_t i = 0; i < COUNT; i++) EXPECT_EQ(hits[i].load(), i < 10 ? 0 : 1);
+    EXPECT_EQ(range_count.load(), 16);
+
+    // empty and single ranges
+    js.ParallelFor(5, 5, 8, [&](size_t, size_t) { range_count++; });
+    EXPECT_EQ(range_count.load(), 16);
+    js.ParallelFor(0, 3, 0, [&](size_t first, size_t last) { range_count += static_cast<int>(last - first); });
+    EXPECT_EQ(range_count.load(), 19);
+}
+
+TEST(JobSystemTest, NestedParallelFor) {
+    JobSystem js(4);
+
+    std::atomic<int> sum{0};
+    js.ParallelFor(0, 8, 1, [&](size_t, size_t) {
+        // kicked from a worker, waited by the same worker
+        js.ParallelFor(0, 100, 10, [&](size_t first, size_t last) { sum += static_cast<int>(last - first); });
+    });
+
+    EXPECT_EQ(sum.load(), 800);
+}
+
+TEST(JobSystemTest, WaitingThreadRunsJobs) {
+    // The only worker is kept busy until the other job runs, so the waiting thread has to run it.
+    JobSystem js(1);
+
+    std::atomic<bool> released{false};
+    std::atomic<bool> blocker_started{false};
+    auto block = [&](size_t first, size_t) {
+        if (first == 0) {
+            blocker_started = true;
+            while (!released.load()) {
+                std::this_thread::yield();
+            }
+        } else {
+            while (!blocker_started.load()) {
+                std::this_thread::yield();
+            }
+            released = true;
+        }
+    };
+
+    js.ParallelFor(0, 2, 1, block);
+
+    EXPECT_TRUE(released.load());
+}
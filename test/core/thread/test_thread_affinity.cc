@@ -0,0 +1,40 @@
+#define THREAD_ENABLED
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+#include "core/thread/job_system.h"
+#include "core/thread/thread_affinity.h"
+
+using namespace ho;
+
+static void IncrementAtomic(void* data, int size) {
+    EXPECT_EQ(size, sizeof(std::atomic<int>));
+    static_cast<std::atomic<int>*>(data)->fetch_add(1);
+}
+
+TEST(ThreadAffinityTest, CountsAreAtLeastOne) {
+    EXPECT_GE(GetHardwareThreadCount(), 1u);
+    EXPECT_GE(GetNumaNodeCount(), 1u);
+}
+
+TEST(ThreadAffinityTest, PinToMissingProcessorFails) {
+    EXPECT_FALSE(PinCurrentThreadToProcessor(0xFFFFFFFFu));
+    EXPECT_FALSE(PinCurrentThreadToNumaNode(0xFFFFFFFFu));
+}
+
+TEST(ThreadAffinityTest, PinnedJobSystemRunsJobs) {
+    for (ThreadAffinity affinity : {ThreadAffinity::CORE, ThreadAffinity::NUMA_NODE}) {
+        // more workers than processors wrap around
+        JobSystem js(GetHardwareThreadCount() + 1, affinity);
+        EXPECT_EQ(js.GetAffinity(), affinity);
+
+        const int JOB_COUNT = 64;
+        std::atomic<int> value{0};
+        std::vector<JobDeclaration> jobs(JOB_COUNT, JobDeclaration{IncrementAtomic, &value, sizeof(value), nullptr});
+        js.KickJobsAndWait(jobs);
+
+        EXPECT_EQ(value.load(), JOB_COUNT);
+    }
+}
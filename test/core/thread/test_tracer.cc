@@ -0,0 +1,91 @@
+#define THREAD_ENABLED
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "core/thread/job_system.h"
+#include "core/thread/tracer.h"
+
+using namespace ho;
+
+static void EmptyJob(void*, int) {}
+
+static size_t CountOf(const std::string& text, const std::string& pattern) {
+    size_t count = 0;
+    for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1)) {
+        count++;
+    }
+    return count;
+}
+
+TEST(TracerTest, RecordsOnlyWhileRecording) {
+    Tracer& tracer = Tracer::GetInstance();
+    { TRACE_SCOPE("Before"); }
+
+    tracer.Start();
+    { TRACE_SCOPE("During"); }
+    tracer.Stop();
+
+    { TRACE_SCOPE("After"); }
+
+    std::vector<Tracer::Event> events = tracer.GetThreadEvents();
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_STREQ(events[0].name, "During");
+    EXPECT_LE(events[0].begin, events[0].end);
+
+    tracer.Clear();
+    EXPECT_TRUE(tracer.GetThreadEvents().empty());
+}
+
+TEST(TracerTest, RingKeepsLatestEvents) {
+    Tracer tracer(4);
+    static const char* const NAMES[] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
+
+    tracer.Start();
+    for (uint64_t i = 0; i < 10; i++) {
+        tracer.Record(NAMES[i], i, i + 1);
+    }
+    tracer.Stop();
+
+    std::vector<Tracer::Event> events = tracer.GetThreadEvents();
+    ASSERT_EQ(events.size(), 4u);
+    for (size_t i = 0; i < events.size(); i++) {
+        EXPECT_STREQ(events[i].name, NAMES[6 + i]);
+        EXPECT_EQ(events[i].begin, 6 + i);
+    }
+}
+
+TEST(TracerTest, ChromeTraceHasJobsOfWorkers) {
+    JobSystem js(2);
+    const int JOB_COUNT = 16;
+    std::vector<JobDeclaration> jobs(JOB_COUNT);
+    for (auto& job : jobs) {
+        job.entry = EmptyJob;
+        job.name = "TestJob";
+    }
+
+    Tracer& tracer = Tracer::GetInstance();
+    tracer.Start();
+    js.KickJobsAndWait(jobs);
+    tracer.Stop();
+
+    const std::string trace = tracer.ToChromeTrace();
+    EXPECT_EQ(trace.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["), 0u);
+    EXPECT_EQ(CountOf(trace, "\"name\":\"TestJob\",\"ph\":\"X\""), static_cast<size_t>(JOB_COUNT));
+    EXPECT_EQ(CountOf(trace, "\"name\":\"JobSystem::Wait\""), 1u);
+    EXPECT_GE(CountOf(trace, "\"name\":\"thread_name\",\"ph\":\"M\""), 1u);
+}
+
+TEST(TracerTest, ChromeTraceEscapesNames) {
+    Tracer tracer;
+    tracer.SetThreadName("Main \"thread\"");
+    tracer.Start();
+    tracer.Record("a\\b", 1000, 3500);
+    tracer.Stop();
+
+    const std::string trace = tracer.ToChromeTrace();
+    EXPECT_NE(trace.find("\"args\":{\"name\":\"Main \\\"thread\\\"\"}"), std::string::npos);
+    EXPECT_NE(trace.find("{\"name\":\"a\\\\b\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":0.000,\"dur\":2.500}"),
+              std::string::npos);
+}
@@ -0,0 +1,107 @@
+#define THREAD_ENABLED
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "core/thread/work_stealing_deque.h"
+
+using namespace ho;
+
+TEST(WorkStealingDequeTest, PopIsLastInFirstOut) {
+    WorkStealingDeque<int> deque;
+    for (int i = 0; i < 4; i++) {
+        deque.Push(i);
+    }
+
+    int v = -1;
+    for (int i = 3; i >= 0; i--) {
+        EXPECT_TRUE(deque.Pop(v));
+        EXPECT_EQ(v, i);
+    }
+    EXPECT_FALSE(deque.Pop(v));
+    EXPECT_TRUE(deque.IsEmpty());
+}
+
+TEST(WorkStealingDequeTest, StealIsFirstInFirstOut) {
+    WorkStealingDeque<int> deque;
+    for (int i = 0; i < 4; i++) {
+        deque.Push(i);
+    }
+
+    int v = -1;
+    EXPECT_TRUE(deque.Steal(v));
+    EXPECT_EQ(v, 0);
+    EXPECT_TRUE(deque.Pop(v));
+    EXPECT_EQ(v, 3);
+    EXPECT_TRUE(deque.Steal(v));
+    EXPECT_EQ(v, 1);
+    EXPECT_TRUE(deque.Pop(v));
+    EXPECT_EQ(v, 2);
+    EXPECT_FALSE(deque.Steal(v));
+}
+
+TEST(WorkStealingDequeTest, GrowKeepsValues) {
+    WorkStealingDeque<int> deque(4);
+
+    int v = -1;
+    deque.Push(-1);
+    EXPECT_TRUE(deque.Steal(v));  // wrap around the first ring
+
+    for (int i = 0; i < 100; i++) {
+        deque.Push(i);
+    }
+    EXPECT_GE(deque.GetCapacity(), 100);
+
+    for (int i = 0; i < 100; i++) {
+        EXPECT_TRUE(deque.Steal(v));
+        EXPECT_EQ(v, i);
+    }
+}
+
+TEST(WorkStealingDequeTest, ConcurrentStealTakesEveryValueOnce) {
+    WorkStealingDeque<int> deque(64);
+
+    const int VALUE_COUNT = 100000;
+    const int THIEF_COUNT = 3;
+    std::vector<std::atomic<int>> taken(VALUE_COUNT);
+    for (auto& t : taken) t = 0;
+    std::atomic<int> taken_count{0};
+
+    auto thief = [&]() {
+        int v = 0;
+        while (taken_count.load() < VALUE_COUNT) {
+            if (deque.Steal(v)) {
+                taken[static_cast<size_t>(v)]++;
+                taken_count++;
+            }
+        }
+    };
+
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < THIEF_COUNT; i++) {
+        thieves.emplace_back(thief);
+    }
+
+    // owner pushes and pops at the bottom while thieves take from the top
+    int v = 0;
+    for (int i = 0; i < VALUE_COUNT; i++) {
+        deque.Push(i);
+        if (i % 3 == 0 && deque.Pop(v)) {
+            taken[static_cast<size_t>(v)]++;
+            taken_count++;
+        }
+    }
+    while (deque.Pop(v)) {
+        taken[static_cast<size_t>(v)]++;
+        taken_count++;
+    }
+
+    for (auto& t : thieves) {
+        t.join();
+    }
+
+    EXPECT_EQ(taken_count.load(), VALUE_COUNT);
+    for (auto& t : taken) EXPECT_EQ(t.load(), 1);
+}
@@ -0,0 +1,26 @@
+#define THREAD_DISABLED
+#include <gtest/gtest.h>
+
+#include "core/thread/work_stealing_deque.h"
+
+using namespace ho;
+
+TEST(WorkStealingDequeFallbackTest, PopAndSteal) {
+    WorkStealingDeque<int> deque;
+    for (int i = 0; i < 4; i++) {
+        deque.Push(i);
+    }
+
+    int v = -1;
+    EXPECT_TRUE(deque.Steal(v));
+    EXPECT_EQ(v, 0);
+    EXPECT_TRUE(deque.Pop(v));
+    EXPECT_EQ(v, 3);
+    EXPECT_TRUE(deque.Steal(v));
+    EXPECT_EQ(v, 1);
+    EXPECT_TRUE(deque.Pop(v));
+    EXPECT_EQ(v, 2);
+    EXPECT_FALSE(deque.Pop(v));
+    EXPECT_FALSE(deque.Steal(v));
+    EXPECT_TRUE(deque.IsEmpty());
+}
@@ -10,9 +10,13 @@ TEST(VirtualGPUTest, InitializeFail) { EXPECT_TRUE(VirtualGPUTester::InitializeF
 TEST(VirtualGPUTest, VaryingOut) { EXPECT_TRUE(VirtualGPUTester::VaryingOut()); }
 TEST(VirtualGPUTest, FragmentIn) { EXPECT_TRUE(VirtualGPUTester::FragmentIn()); }
 TEST(VirtualGPUTest, FSOutput) { EXPECT_TRUE(VirtualGPUTester::FSOutputOut()); }
+TEST(VirtualGPUTest, FragmentInDerivative) { EXPECT_TRUE(VirtualGPUTester::FragmentInDerivative()); }
 
 TEST(VirtualGPUTest, GetColorLock) { EXPECT_TRUE(VirtualGPUTester::GetColorLock()); }
 TEST(VirtualGPUTest, GetDepthLock) { EXPECT_TRUE(VirtualGPUTester::GetDepthLock()); }
+TEST(VirtualGPUTest, PrepareLockTablesSizedToAttachments) {
+    EXPECT_TRUE(VirtualGPUTester::PrepareLockTablesSizedToAttachments());
+}
 
 TEST(VirtualGPUTest, ClearColorAttachmentFullViewport) {
     EXPECT_TRUE(VirtualGPUTester::ClearColorAttachmentFullViewport());
@@ -271,3 +275,65 @@ TEST(VirtualGPUTest, RasterizeTriangleEarlyDepthFailed) {
 TEST(VirtualGPUTest, RasterizeTriangleEarlyStencilFailed) {
     EXPECT_TRUE(VirtualGPUTester::RasterizeTriangleEarlyStencilFailed());
 }
+TEST(VirtualGPUTest, RasterizeTriangleRegion) { EXPECT_TRUE(VirtualGPUTester::RasterizeTriangleRegion()); }
+TEST(VirtualGPUTest, CoverageRowMatchesPortable) { EXPECT_TRUE(VirtualGPUTester::CoverageRowMatchesPortable()); }
+TEST(VirtualGPUTest, RasterizeTriangleBlockMatchesReference) {
+    EXPECT_TRUE(VirtualGPUTester::RasterizeTriangleBlockMatchesReference());
+}
+TEST(VirtualGPUTest, HiZClearAndResolve) { EXPECT_TRUE(VirtualGPUTester::HiZClearAndResolve()); }
+TEST(VirtualGPUTest, HiZRejectsOccludedBlocks) { EXPECT_TRUE(VirtualGPUTester::HiZRejectsOccludedBlocks()); }
+
+TEST(VirtualGPUTest, SetupPrimitiveTriangle) { EXPECT_TRUE(VirtualGPUTester::SetupPrimitiveTriangle()); }
+TEST(VirtualGPUTest, SetupPrimitiveCulled) { EXPECT_TRUE(VirtualGPUTester::SetupPrimitiveCulled()); }
+TEST(VirtualGPUTest, SetupPrimitivePolygonModeLine) { EXPECT_TRUE(VirtualGPUTester::SetupPrimitivePolygonModeLine()); }
+
+TEST(VirtualGPUTest, GetRenderAreaViewportScissorIntersect) {
+    EXPECT_TRUE(VirtualGPUTester::GetRenderAreaViewportScissorIntersect());
+}
+
+TEST(VirtualGPUTest, DrawBinnedSubmissionOrder) { EXPECT_TRUE(VirtualGPUTester::DrawBinnedSubmissionOrder()); }
+TEST(VirtualGPUTest, DrawBinnedRespectsScissor) { EXPECT_TRUE(VirtualGPUTester::DrawBinnedRespectsScissor()); }
+
+TEST(VirtualGPUTest, ShadeFragmentsEarlyFragmentTests) {
+    EXPECT_TRUE(VirtualGPUTester::ShadeFragmentsEarlyFragmentTests());
+}
+
+TEST(VirtualGPUTest, ProgramParameteriEarlyFragmentTests) {
+    EXPECT_TRUE(VirtualGPUTester::ProgramParameteriEarlyFragmentTests());
+}
+
+TEST(VirtualGPUTest, TexImage2DMipmapLevels) { EXPECT_TRUE(VirtualGPUTester::TexImage2DMipmapLevels()); }
+TEST(VirtualGPUTest, GenerateMipmapBoxFilter) { EXPECT_TRUE(VirtualGPUTester::GenerateMipmapBoxFilter()); }
+TEST(VirtualGPUTest, GenerateMipmapErrors) { EXPECT_TRUE(VirtualGPUTester::GenerateMipmapErrors()); }
+
+TEST(VirtualGPUTest, DrawElementsShadesReferencedVertices) {
+    EXPECT_TRUE(VirtualGPUTester::DrawElementsShadesReferencedVertices());
+}
+TEST(VirtualGPUTest, DrawRangeElementsVertexRange) { EXPECT_TRUE(VirtualGPUTester::DrawRangeElementsVertexRange()); }
+
+TEST(VirtualGPUTest, AssemblePrimitivesLayout) { EXPECT_TRUE(VirtualGPUTester::AssemblePrimitivesLayout()); }
+TEST(VirtualGPUTest, DrawArraysPrimitiveBatches) { EXPECT_TRUE(VirtualGPUTester::DrawArraysPrimitiveBatches()); }
+
+TEST(VirtualGPUTest, InitializeWorkerCount) { EXPECT_TRUE(VirtualGPUTester::InitializeWorkerCount()); }
+
+TEST(VirtualGPUTest, DeferredCommands) { EXPECT_TRUE(VirtualGPUTester::DeferredCommands()); }
+TEST(VirtualGPUTest, FenceSync) { EXPECT_TRUE(VirtualGPUTester::FenceSync()); }
+TEST(VirtualGPUTest, ClientWaitSyncFlushPoll) { EXPECT_TRUE(VirtualGPUTester::ClientWaitSyncFlushPoll()); }
+TEST(VirtualGPUTest, OcclusionQuery) { EXPECT_TRUE(VirtualGPUTester::OcclusionQuery()); }
+TEST(VirtualGPUTest, ConditionalRender) { EXPECT_TRUE(VirtualGPUTester::ConditionalRender()); }
+TEST(VirtualGPUTest, TimerQuery) { EXPECT_TRUE(VirtualGPUTester::TimerQuery()); }
+TEST(VirtualGPUTest, PipelineStatisticsQuery) { EXPECT_TRUE(VirtualGPUTester::PipelineStatisticsQuery()); }
+TEST(VirtualGPUTest, VaryingLookup) { EXPECT_TRUE(VirtualGPUTester::VaryingLookup()); }
+TEST(VirtualGPUTest, VaryingLayoutLink) { EXPECT_TRUE(VirtualGPUTester::VaryingLayoutLink()); }
+TEST(VirtualGPUTest, UniformLookup) { EXPECT_TRUE(VirtualGPUTester::UniformLookup()); }
+TEST(VirtualGPUTest, UniformSnapshot) { EXPECT_TRUE(VirtualGPUTester::UniformSnapshot()); }
+TEST(VirtualGPUTest, AttributeFetchers) { EXPECT_TRUE(VirtualGPUTester::AttributeFetchers()); }
+TEST(VirtualGPUTest, WideVertexShader) { EXPECT_TRUE(VirtualGPUTester::WideVertexShader()); }
+TEST(VirtualGPUTest, QuadFragmentShader) { EXPECT_TRUE(VirtualGPUTester::QuadFragmentShader()); }
+TEST(VirtualGPUTest, ClipOutcodesAndGuardBand) { EXPECT_TRUE(VirtualGPUTester::ClipOutcodesAndGuardBand()); }
+TEST(VirtualGPUTest, RasterizeWatertight) { EXPECT_TRUE(VirtualGPUTester::RasterizeWatertight()); }
+TEST(VirtualGPUTest, RasterizeStreamsFragmentChunks) {
+    EXPECT_TRUE(VirtualGPUTester::RasterizeStreamsFragmentChunks());
+}
+TEST(VirtualGPUTest, LinkSetsVaryingStride) { EXPECT_TRUE(VirtualGPUTester::LinkSetsVaryingStride()); }
+TEST(VirtualGPUTest, DepthOnlyDrawSkipsShading) { EXPECT_TRUE(VirtualGPUTester::DepthOnlyDrawSkipsShading()); }
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include <cstring>
+#include <limits>
 
 #include "virtual_gpu/virtual_gpu_utils.h"
 
@@ -404,3 +405,64 @@ TEST(VirtualGPUUtilsTest, EncodeDecodeDepthStencil) {
     EXPECT_EQ(stencil, 123);
     EXPECT_NEAR(depth, 0.5f, 1e-5f);
 }
+
+TEST(VirtualGPUUtilsTest, MipmapSizeAndLevelCount) {
+    EXPECT_EQ(GetMipmapSize(8, 0), 8);
+    EXPECT_EQ(GetMipmapSize(8, 2), 2);
+    EXPECT_EQ(GetMipmapSize(5, 1), 2);
+    EXPECT_EQ(GetMipmapSize(8, 5), 1);
+
+    EXPECT_EQ(GetMipmapLevelCount(1, 1, 1), 1);
+    EXPECT_EQ(GetMipmapLevelCount(8, 1, 1), 4);
+    EXPECT_EQ(GetMipmapLevelCount(5, 3, 1), 3);
+    EXPECT_EQ(GetMipmapLevelCount(4096, 4096, 1), 13);
+}
+
+TEST(VirtualGPUUtilsTest, SelectMipmap) {
+    // magnification
+    MipmapSelection s = SelectMipmap(VG_LINEAR_MIPMAP_LINEAR, VG_NEAREST, 0.f, 4);
+    EXPECT_EQ(s.filter, static_cast<VGint>(VG_NEAREST));
+    EXPECT_EQ(s.level0, 0);
+    EXPECT_EQ(s.weight, 0.f);
+
+    // minification without mipmaps
+    s = SelectMipmap(VG_LINEAR, VG_NEAREST, 2.f, 4);
+    EXPECT_EQ(s.filter, static_cast<VGint>(VG_LINEAR));
+    EXPECT_EQ(s.level0, 0);
+
+    // nearest level
+    s = SelectMipmap(VG_NEAREST_MIPMAP_NEAREST, VG_LINEAR, 1.4f, 4);
+    EXPECT_EQ(s.filter, static_cast<VGint>(VG_NEAREST));
+    EXPECT_EQ(s.level0, 1);
+    EXPECT_EQ(s.weight, 0.f);
+
+    s = SelectMipmap(VG_LINEAR_MIPMAP_NEAREST, VG_LINEAR, 1.6f, 4);
+    EXPECT_EQ(s.filter, static_cast<VGint>(VG_LINEAR));
+    EXPECT_EQ(s.level0, 2);
+
+    s = SelectMipmap(VG_LINEAR_MIPMAP_NEAREST, VG_LINEAR, 9.f, 4);
+    EXPECT_EQ(s.level0, 3);
+
+    // two levels blended
+    s = SelectMipmap(VG_LINEAR_MIPMAP_LINEAR, VG_LINEAR, 1.25f, 4);
+    EXPECT_EQ(s.filter, static_cast<VGint>(VG_LINEAR));
+    EXPECT_EQ(s.level0, 1);
+    EXPECT_EQ(s.level1, 2);
+    EXPECT_NEAR(s.weight, 0.25f, 1e-6f);
+
+    s = SelectMipmap(VG_NEAREST_MIPMAP_LINEAR, VG_LINEAR, 7.5f, 4);
+    EXPECT_EQ(s.filter, static_cast<VGint>(VG_NEAREST));
+    EXPECT_EQ(s.level0, 3);
+    EXPECT_EQ(s.level1, 3);
+    EXPECT_EQ(s.weight, 0.f);
+
+    // non-finite lod
+    s = SelectMipmap(VG_NEAREST_MIPMAP_NEAREST, VG_LINEAR, std::numeric_limits<float>::infinity(), 4);
+    EXPECT_EQ(s.level0, 3);
+    s = SelectMipmap(VG_LINEAR_MIPMAP_LINEAR, VG_LINEAR, std::numeric_limits<float>::infinity(), 4);
+    EXPECT_EQ(s.level0, 3);
+    EXPECT_EQ(s.level1, 3);
+    s = SelectMipmap(VG_LINEAR_MIPMAP_NEAREST, VG_NEAREST, std::numeric_limits<float>::quiet_NaN(), 4);
+    EXPECT_EQ(s.filter, static_cast<VGint>(VG_NEAREST));
+    EXPECT_EQ(s.level0, 0);
+}
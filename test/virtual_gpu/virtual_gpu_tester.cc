@@ -1,5 +1,7 @@
 #include "virtual_gpu_tester.h"
 
+#include <random>
+
 namespace ho {
     bool VirtualGPUTester::InitFreshGPU() {
         VirtualGPU& vg = VirtualGPU::GetInstance();
@@ -548,6 +550,7 @@ namespace ho {
         prog->flat_varying_descs[1].register_index = 1;
 
         prog->flat_varying_count = 2;
+        VirtualGPU::LinkVaryingLayout(*prog);
 
         VirtualGPU::Fragment frag;
 
@@ -662,6 +665,85 @@ namespace ho {
         return true;
     }
 
+    bool VirtualGPUTester::FragmentInDerivative() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        VGuint p = vgCreateProgram();
+        VGuint vs = vgCreateShader(VG_VERTEX_SHADER);
+        VGuint fs = vgCreateShader(VG_FRAGMENT_SHADER);
+        vgAttachShader(p, vs);
+        vgAttachShader(p, fs);
+        vgLinkProgram(p);
+        vgUseProgram(p);
+
+        // A perspective triangle with texture coordinates
+        VirtualGPU::Varying v0, v1, v2;
+        v0.vg_Position = Vector4(-0.9_r, -0.9_r, 0.0_r, 1.0_r);
+        v0.Out(0x1001, Vector2(0.f, 0.f));
+        VirtualGPU::LinkVaryingLayout(*gpu.using_program_);
+        v1.vg_Position = Vector4(3.6_r, -3.6_r, 0.0_r, 4.0_r);
+        v1.Out(0x1001, Vector2(1.f, 0.f));
+        v2.vg_Position = Vector4(-1.8_r, 1.8_r, 0.0_r, 2.0_r);
+        v2.Out(0x1001, Vector2(0.f, 1.f));
+
+        gpu.state_.cull_enabled = false;
+
+        std::vector<VirtualGPU::RasterPrimitive> prims;
+        gpu.SetupPrimitive({&v0, &v1, &v2}, prims);
+        if (prims.size() != 1) return false;
+
+        const VirtualGPU::Rect region = {0, 0, 128, 64};
+        const std::vector<VirtualGPU::Fragment> frags =
+            gpu.Rasterize(prims[0].vertices[0], prims[0].vertices[1], prims[0].vertices[2], region,
+                          &prims[0].smooth_gradient);
+
+        std::unordered_map<int, const VirtualGPU::Fragment*> frag_at;
+        for (const VirtualGPU::Fragment& frag : frags) {
+            const int x = static_cast<int>(frag.screen_coord.x);
+            const int y = static_cast<int>(frag.screen_coord.y);
+            frag_at[y * 128 + x] = &frag;
+        }
+
+        // Analytic derivatives match central differences of the interpolated values.
+        int checked = 0;
+        for (const VirtualGPU::Fragment& frag : frags) {
+            const int x = static_cast<int>(frag.screen_coord.x);
+            const int y = static_cast<int>(frag.screen_coord.y);
+            auto left = frag_at.find(y * 128 + x - 1);
+            auto right = frag_at.find(y * 128 + x + 1);
+            auto up = frag_at.find((y - 1) * 128 + x);
+            auto down = frag_at.find((y + 1) * 128 + x);
+            if (left == frag_at.end() || right == frag_at.end() || up == frag_at.end() || down == frag_at.end()) {
+                continue;
+            }
+
+            const Vector2 dx = frag.InDx<Vector2>(0x1001);
+            const Vector2 dy = frag.InDy<Vector2>(0x1001);
+            const Vector2 diff_x = (right->second->In<Vector2>(0x1001) - left->second->In<Vector2>(0x1001)) * 0.5f;
+            const Vector2 diff_y = (down->second->In<Vector2>(0x1001) - up->second->In<Vector2>(0x1001)) * 0.5f;
+
+            if (!math::IsEqualApprox(dx.x, diff_x.x, 1e-4f) || !math::IsEqualApprox(dx.y, diff_x.y, 1e-4f)) {
+                return false;
+            }
+            if (!math::IsEqualApprox(dy.x, diff_y.x, 1e-4f) || !math::IsEqualApprox(dy.y, diff_y.y, 1e-4f)) {
+                return false;
+            }
+            checked++;
+        }
+        if (checked < 100) return false;
+
+        // Fragments without a gradient have zero derivatives.
+        VirtualGPU::Fragment frag = frags.front();
+        frag.smooth_gradient = nullptr;
+        const Vector2 zero = frag.InDx<Vector2>(0x1001);
+        if (zero.x != 0.f || zero.y != 0.f) return false;
+
+        return true;
+    }
+
     bool VirtualGPUTester::GetColorLock() {
         VirtualGPU& vg = VirtualGPU::GetInstance();
 
@@ -672,6 +754,9 @@ namespace ho {
         const VGuint att0 = 0;
         const VGuint att1 = 1;
 
+        vg.PrepareLockTables();
+        VirtualGPU::ReserveLockTable(vg.color_lock_tables_[att1], VirtualGPU::TILE_WIDTH * 2, VirtualGPU::TILE_HEIGHT);
+
         const int x0 = 0;
         const int y0 = 0;
 
@@ -709,6 +794,8 @@ namespace ho {
             return false;
         }
 
+        vg.PrepareLockTables();
+
         const int x0 = 0;
         const int y0 = 0;
 
@@ -734,6 +821,50 @@ namespace ho {
         return true;
     }
 
+    bool VirtualGPUTester::PrepareLockTablesSizedToAttachments() {
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        // nothing allocated until the per primitive path needs locks
+        if (vg.color_lock_tables_[0].locks || vg.depth_lock_table_.locks) {
+            return false;
+        }
+
+        vg.PrepareLockTables();
+
+        // 128x64 default frame buffer
+        const VirtualGPU::LockTable& color = vg.color_lock_tables_[0];
+        if (!color.locks || color.width != 128 / VirtualGPU::TILE_WIDTH ||
+            color.height != 64 / VirtualGPU::TILE_HEIGHT) {
+            return false;
+        }
+        const VirtualGPU::LockTable& depth = vg.depth_lock_table_;
+        if (!depth.locks || depth.width != color.width || depth.height != color.height) {
+            return false;
+        }
+
+        // unbound attachments stay empty
+        if (vg.color_lock_tables_[1].locks) {
+            return false;
+        }
+
+        // partial tiles are covered, tables only grow
+        VirtualGPU::LockTable table;
+        VirtualGPU::ReserveLockTable(table, VirtualGPU::TILE_WIDTH + 1, 1);
+        if (table.width != 2 || table.height != 1) {
+            return false;
+        }
+        const SpinLock* locks = table.locks.get();
+        VirtualGPU::ReserveLockTable(table, 1, 1);
+        if (table.locks.get() != locks || table.width != 2 || table.height != 1) {
+            return false;
+        }
+
+        return true;
+    }
+
     bool VirtualGPUTester::ClearColorAttachmentFullViewport() {
         VirtualGPU& gpu = VirtualGPU::GetInstance();
         if (!InitFreshGPU()) {
@@ -1556,12 +1687,13 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> vs;
+        VirtualGPU::ClipPolygon vs;
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.5_r, 0.0_r, 0.0_r, 1.0_r);
         vs.push_back(v0);
 
-        auto out = gpu.ClipAgainstPlane(vs, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(vs, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 1u) return false;
         for (const auto& v : out) {
@@ -1577,12 +1709,13 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> vs;
+        VirtualGPU::ClipPolygon vs;
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(1.0_r, 0.0_r, 0.0_r, 1.0_r);
         vs.push_back(v0);
 
-        auto out = gpu.ClipAgainstPlane(vs, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(vs, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 1u) return false;
         for (const auto& v : out) {
@@ -1598,12 +1731,13 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> vs;
+        VirtualGPU::ClipPolygon vs;
         VirtualGPU::Varying v;
         v.vg_Position = Vector4(1.5_r, 0.0_r, 0.0_r, 1.0_r);
         vs.push_back(v);
 
-        auto out = gpu.ClipAgainstPlane(vs, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(vs, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (!out.empty()) return false;
 
@@ -1616,7 +1750,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.2_r, 0._r, 0._r, 1.0_r);
@@ -1627,7 +1761,8 @@ namespace ho {
         poly.push_back(v0);
         poly.push_back(v1);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 2u) return false;
         for (const auto& v : out) {
@@ -1643,7 +1778,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.5_r, 0.0_r, 0.0_r, 1.0_r);
@@ -1654,7 +1789,8 @@ namespace ho {
         poly.push_back(v0);
         poly.push_back(v1);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         // ClipAgainstPlane is polygon clipping function, so result is [intersection, v0, intersection]
         if (out.size() != 3u) return false;
@@ -1671,7 +1807,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(1.5_r, 0.0_r, 0.0_r, 1.0_r);
@@ -1682,7 +1818,8 @@ namespace ho {
         poly.push_back(v0);
         poly.push_back(v1);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 3u) return false;
         for (const auto& v : out) {
@@ -1698,7 +1835,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(1.2_r, 0.0_r, 0.0_r, 1.0_r);
@@ -1709,7 +1846,8 @@ namespace ho {
         poly.push_back(v0);
         poly.push_back(v1);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (!out.empty()) return false;
 
@@ -1722,7 +1860,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.5_r, 0.0_r, 0.0_r, 1.0_r);
@@ -1733,7 +1871,8 @@ namespace ho {
         poly.push_back(v0);
         poly.push_back(v1);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 2u) return false;
         for (const auto& v : out) {
@@ -1749,7 +1888,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(1.5_r, 0.0_r, 0.0_r, 1.0_r);
@@ -1760,7 +1899,8 @@ namespace ho {
         poly.push_back(v0);
         poly.push_back(v1);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 3u) return false;
         for (const auto& v : out) {
@@ -1776,7 +1916,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(1.0_r, 0.0_r, 0.0_r, 1.0_r);
@@ -1787,7 +1927,8 @@ namespace ho {
         poly.push_back(v0);
         poly.push_back(v1);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 2u) return false;
         for (const auto& v : out) {
@@ -1803,7 +1944,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.5_r, 0.0_r, 0.0_r, 1.0_r);
@@ -1811,7 +1952,8 @@ namespace ho {
         poly.push_back(v0);
         poly.push_back(v0);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 2u) return false;
         for (const auto& v : out) {
@@ -1827,7 +1969,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.2_r, 0.0_r, 0.0_r, 1.0_r);
@@ -1842,7 +1984,8 @@ namespace ho {
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
         if (out.size() != 3u) return false;
 
         for (const auto& v : out) {
@@ -1868,13 +2011,14 @@ namespace ho {
         VirtualGPU::Varying v2;
         v2.vg_Position = Vector4(0.2_r, 0.0_r, 0.0_r, 1.0_r);  // inside
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         poly.push_back(v0);
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 4u) return false;
         for (const auto& v : out) {
@@ -1900,12 +2044,13 @@ namespace ho {
         VirtualGPU::Varying v2;
         v2.vg_Position = Vector4(1.2_r, 0.0_r, 0.0_r, 1.0_r);  // outside
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
         poly.push_back(v0);
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
         if (out.size() != 3u) return false;
 
         for (const auto& v : out) {
@@ -1930,12 +2075,13 @@ namespace ho {
         VirtualGPU::Varying v2;
         v2.vg_Position = Vector4(1.6_r, 0.0_r, 0.0_r, 1.0_r);
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
         poly.push_back(v0);
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
         if (!out.empty()) return false;
 
         return true;
@@ -1956,12 +2102,13 @@ namespace ho {
         VirtualGPU::Varying v2;
         v2.vg_Position = Vector4(1.5_r, 0.0_r, 0.0_r, 1.0_r);  // outside
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
         poly.push_back(v0);
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
         if (out.size() != 4u) return false;
 
         for (const auto& v : out) {
@@ -1986,12 +2133,13 @@ namespace ho {
         VirtualGPU::Varying v2;
         v2.vg_Position = Vector4(0.5_r, 0.0_r, 0.0_r, 1.0_r);  // inside
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
         poly.push_back(v0);
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
         if (out.size() != 3u) return false;
 
         for (const auto& v : out) {
@@ -2007,7 +2155,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(1.0_r, 0.0_r, 0.0_r, 1.0_r);  // on-plane
@@ -2022,7 +2170,8 @@ namespace ho {
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 3u) return false;
 
@@ -2048,12 +2197,13 @@ namespace ho {
         VirtualGPU::Varying v2;
         v2.vg_Position = Vector4(1.5_r, 0.0_r, 0.0_r, 1.0_r);
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
         poly.push_back(v);
         poly.push_back(v);
         poly.push_back(v2);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
         if (out.size() != 4u) return false;
 
         for (const auto& varying : out) {
@@ -2072,12 +2222,13 @@ namespace ho {
         VirtualGPU::Varying v;
         v.vg_Position = Vector4(0.5_r, 0.0_r, 0.0_r, 1.0_r);
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
         poly.push_back(v);
         poly.push_back(v);
         poly.push_back(v);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
         if (out.size() != 3u) return false;
 
         for (const auto& varying : out) {
@@ -2102,12 +2253,13 @@ namespace ho {
         VirtualGPU::Varying v2;
         v2.vg_Position = Vector4(2.0_r, 0.0_r, 0.0_r, 1.0_r);  // inside
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
         poly.push_back(v0);
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
         if (out.size() != 3u) return false;
 
         for (const auto& varying : out) {
@@ -2142,12 +2294,13 @@ namespace ho {
         v2.used_flat_register_size = 1;
         v2.flat_register[0] = 10.f;
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
         poly.push_back(v0);
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT);
+        VirtualGPU::ClipPolygon out;
+        gpu.ClipAgainstPlane(poly, VirtualGPU::VG_PLANE_POS_RIGHT, out);
 
         if (out.size() != 4u) return false;
 
@@ -2181,7 +2334,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.0_r, 0.0_r, 0.0_r, 1.0_r);  // inside
@@ -2196,7 +2349,8 @@ namespace ho {
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.Clip(poly);
+        gpu.Clip(poly);
+        const VirtualGPU::ClipPolygon& out = poly;
 
         if (out.size() != 3u) return false;
 
@@ -2217,7 +2371,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.5_r, 0.0_r, 0.0_r, 1.0_r);  // inside
@@ -2232,7 +2386,8 @@ namespace ho {
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.Clip(poly);
+        gpu.Clip(poly);
+        const VirtualGPU::ClipPolygon& out = poly;
 
         if (out.empty()) return false;
 
@@ -2253,7 +2408,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(1.5_r, 1.5_r, 0.0_r, 1.0_r);  // outside
@@ -2268,7 +2423,8 @@ namespace ho {
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.Clip(poly);
+        gpu.Clip(poly);
+        const VirtualGPU::ClipPolygon& out = poly;
 
         if (out.empty()) return false;
 
@@ -2286,7 +2442,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(2.0_r, 0.0_r, 0.0_r, 1.0_r);
@@ -2301,7 +2457,8 @@ namespace ho {
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.Clip(poly);
+        gpu.Clip(poly);
+        const VirtualGPU::ClipPolygon& out = poly;
 
         return out.empty();
     }
@@ -2312,7 +2469,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.0_r, 0.0_r, 0.0_r, 1.0_r);  // inside
@@ -2327,7 +2484,8 @@ namespace ho {
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.Clip(poly);
+        gpu.Clip(poly);
+        const VirtualGPU::ClipPolygon& out = poly;
 
         for (const auto& v : out) {
             for (VirtualGPU::PlanePos p :
@@ -2349,7 +2507,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.0_r, 0.0_r, -0.5_r, 1.0_r);  // inside
@@ -2364,7 +2522,8 @@ namespace ho {
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.Clip(poly);
+        gpu.Clip(poly);
+        const VirtualGPU::ClipPolygon& out = poly;
 
         if (out.empty()) return false;
 
@@ -2383,7 +2542,7 @@ namespace ho {
             return false;
         }
 
-        std::vector<VirtualGPU::Varying> poly;
+        VirtualGPU::ClipPolygon poly;
 
         VirtualGPU::Varying v0;
         v0.vg_Position = Vector4(0.0_r, 0.0_r, 0.5_r, 1.0_r);  // inside
@@ -2398,7 +2557,8 @@ namespace ho {
         poly.push_back(v1);
         poly.push_back(v2);
 
-        auto out = gpu.Clip(poly);
+        gpu.Clip(poly);
+        const VirtualGPU::ClipPolygon& out = poly;
 
         if (out.empty()) return false;
 
@@ -4995,4 +5155,2293 @@ namespace ho {
         return true;
     }
 
-}  // namespace ho
\ No newline at end of file
+    bool VirtualGPUTester::RasterizeTriangleRegion() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        VirtualGPU::Varying v0, v1, v2;
+        PopulateVarying(v0, 1.0f, 10.0f);
+        PopulateVarying(v1, 2.0f, 20.0f);
+        PopulateVarying(v2, 3.0f, 30.0f);
+
+        v0.viewport_coord = Vector3(3.0_r, 5.0_r, 0.5_r);
+        v1.viewport_coord = Vector3(20.0_r, 60.0_r, 0.5_r);
+        v2.viewport_coord = Vector3(110.0_r, 12.0_r, 0.5_r);
+
+        v0.vg_Position = Vector4(0.0_r, 0.0_r, 0.0_r, 1.0_r);
+        v1.vg_Position = Vector4(0.0_r, 0.0_r, 0.0_r, 1.0_r);
+        v2.vg_Position = Vector4(0.0_r, 0.0_r, 0.0_r, 1.0_r);
+
+        gpu.state_.cull_enabled = false;
+        gpu.state_.depth_test_enabled = false;
+        gpu.state_.scissor_test_enabled = false;
+
+        const auto full = gpu.Rasterize(v0, v1, v2);
+        if (full.empty()) return false;
+
+        // Rasterizing tile by tile must cover the same pixels exactly once.
+        std::vector<int> coverage(128 * 64, 0);
+        size_t tiled_count = 0;
+        for (int ty = 0; ty < 64; ty += VirtualGPU::TILE_HEIGHT) {
+            for (int tx = 0; tx < 128; tx += VirtualGPU::TILE_WIDTH) {
+                const VirtualGPU::Rect region = {tx, ty, VirtualGPU::TILE_WIDTH, VirtualGPU::TILE_HEIGHT};
+                for (const auto& f : gpu.Rasterize(v0, v1, v2, region)) {
+                    const int px = static_cast<int>(math::Floor(f.screen_coord.x));
+                    const int py = static_cast<int>(math::Floor(f.screen_coord.y));
+                    if (px < tx || px >= tx + VirtualGPU::TILE_WIDTH) return false;
+                    if (py < ty || py >= ty + VirtualGPU::TILE_HEIGHT) return false;
+                    coverage[static_cast<size_t>(py * 128 + px)]++;
+                    tiled_count++;
+                }
+            }
+        }
+
+        if (tiled_count != full.size()) return false;
+
+        for (const auto& f : full) {
+            const int px = static_cast<int>(math::Floor(f.screen_coord.x));
+            const int py = static_cast<int>(math::Floor(f.screen_coord.y));
+            if (coverage[static_cast<size_t>(py * 128 + px)] != 1) return false;
+        }
+
+        return true;
+    }
+
+    bool VirtualGPUTester::CoverageRowMatchesPortable() {
+        const vg::CoverageRowFunc portable = vg::GetCoverageRowFunc(vg::SimdLevel::BLOCK);
+        if (portable == nullptr || vg::GetCoverageRowFunc(vg::SimdLevel::SCALAR) != nullptr) return false;
+        if (!vg::IsSimdLevelSupported(vg::DetectSimdLevel())) return false;
+
+        const vg::SimdLevel levels[] = {vg::SimdLevel::SSE2, vg::SimdLevel::AVX2, vg::SimdLevel::NEON};
+
+        // Small values hit zero, the boundary between covered and not covered, in many lanes.
+        uint32_t seed = 12345u;
+        const auto Next = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<int64_t>(seed >> 24) - 128;
+        };
+
+        for (const vg::SimdLevel level : levels) {
+            const vg::CoverageRowFunc func = vg::GetCoverageRowFunc(level);
+            if (vg::IsSimdLevelSupported(level) != (func != nullptr)) return false;
+            if (func == nullptr) continue;
+
+            for (int n = 0; n < 1000; n++) {
+                vg::TriangleEdges edges;
+                int64_t row_value[3];
+                for (int e = 0; e < 3; e++) {
+                    const int64_t scale = n % 2 == 0 ? 1 : int64_t(1) << 30;
+                    edges.dx[e] = Next() * scale;
+                    edges.dy[e] = Next() * scale;
+                    row_value[e] = Next() * 4 * scale;
+                }
+                if (func(edges, row_value) != portable(edges, row_value)) return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool VirtualGPUTester::RasterizeTriangleBlockMatchesReference() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        gpu.state_.cull_enabled = false;
+        gpu.state_.depth_test_enabled = false;
+        gpu.state_.scissor_test_enabled = false;
+
+        const vg::SimdLevel levels[] = {vg::SimdLevel::BLOCK, vg::SimdLevel::SSE2, vg::SimdLevel::AVX2,
+                                        vg::SimdLevel::NEON};
+
+        // large, thin, partially off screen and axis aligned triangles of both windings on a 1/4 pixel grid
+        const Vector3 triangles[][3] = {
+            {Vector3(3.0_r, 5.0_r, 0.1_r), Vector3(20.0_r, 60.0_r, 0.5_r), Vector3(110.0_r, 12.0_r, 0.9_r)},
+            {Vector3(110.0_r, 12.0_r, 0.9_r), Vector3(20.0_r, 60.0_r, 0.5_r), Vector3(3.0_r, 5.0_r, 0.1_r)},
+            {Vector3(0.5_r, 0.5_r, 0.2_r), Vector3(127.5_r, 1.25_r, 0.2_r), Vector3(64.0_r, 63.75_r, 0.8_r)},
+            {Vector3(-40.0_r, -10.0_r, 0.3_r), Vector3(200.0_r, 30.0_r, 0.3_r), Vector3(10.0_r, 90.0_r, 0.3_r)},
+            {Vector3(8.0_r, 8.0_r, 0.5_r), Vector3(40.0_r, 8.0_r, 0.5_r), Vector3(8.0_r, 40.0_r, 0.5_r)},
+            {Vector3(2.25_r, 30.0_r, 0.5_r), Vector3(125.75_r, 31.5_r, 0.5_r), Vector3(60.0_r, 32.0_r, 0.5_r)},
+        };
+
+        for (const auto& tri : triangles) {
+            VirtualGPU::Varying v0, v1, v2;
+            PopulateVarying(v0, 1.0f, 10.0f);
+            PopulateVarying(v1, 2.0f, 20.0f);
+            PopulateVarying(v2, 3.0f, 30.0f);
+            v0.viewport_coord = tri[0];
+            v1.viewport_coord = tri[1];
+            v2.viewport_coord = tri[2];
+            v0.vg_Position.w = 1.0_r;
+            v1.vg_Position.w = 2.0_r;
+            v2.vg_Position.w = 4.0_r;
+
+            gpu.coverage_row_func_ = nullptr;
+            const auto reference = gpu.Rasterize(v0, v1, v2);
+            if (reference.empty()) return false;
+
+            std::vector<int> index(128 * 64, -1);
+            for (size_t i = 0; i < reference.size(); i++) {
+                const int px = static_cast<int>(math::Floor(reference[i].screen_coord.x));
+                const int py = static_cast<int>(math::Floor(reference[i].screen_coord.y));
+                index[static_cast<size_t>(py * 128 + px)] = static_cast<int>(i);
+            }
+
+            for (const vg::SimdLevel level : levels) {
+                gpu.coverage_row_func_ = vg::GetCoverageRowFunc(level);
+                if (gpu.coverage_row_func_ == nullptr) continue;
+
+                const auto blocks = gpu.Rasterize(v0, v1, v2);
+                if (blocks.size() != reference.size()) return false;
+
+                for (const auto& f : blocks) {
+                    const int px = static_cast<int>(math::Floor(f.screen_coord.x));
+                    const int py = static_cast<int>(math::Floor(f.screen_coord.y));
+                    const int i = index[static_cast<size_t>(py * 128 + px)];
+                    if (i < 0) return false;
+
+                    const VirtualGPU::Fragment& r = reference[static_cast<size_t>(i)];
+                    if (f.is_front != r.is_front) return false;
+                    if (math::Abs(f.depth - r.depth) > 1e-4_r) return false;
+                    for (size_t k = 0; k < static_cast<size_t>(r.used_smooth_register_size); k++) {
+                        if (math::Abs(f.smooth_register[k] - r.smooth_register[k]) > 1e-3f) return false;
+                    }
+                    for (size_t k = 0; k < static_cast<size_t>(r.used_flat_register_size); k++) {
+                        if (f.flat_register[k] != r.flat_register[k]) return false;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool VirtualGPUTester::HiZClearAndResolve() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        gpu.state_.depth_test_enabled = true;
+        gpu.state_.depth_func = VG_LESS;
+        gpu.state_.depth_write_enabled = true;
+
+        // created on first tiled draw with depth test
+        gpu.PrepareHiZ();
+        VirtualGPU::HiZBuffer* hiz = gpu.active_hiz_;
+        if (hiz == nullptr) return false;
+        if (hiz->block_columns != 128 / vg::RASTER_BLOCK_SIZE || hiz->block_rows != 64 / vg::RASTER_BLOCK_SIZE) {
+            return false;
+        }
+        if (hiz->tile_columns != 128 / VirtualGPU::TILE_WIDTH || hiz->tile_rows != 64 / VirtualGPU::TILE_HEIGHT) {
+            return false;
+        }
+
+        gpu.ClearDepthAttachment(0.5_r);
+        for (size_t i = 0; i < hiz->block_dirty.size(); i++) {
+            if (hiz->block_dirty[i]) return false;
+            if (!math::IsEqualApprox(hiz->block_min_depth[i], 0.5f, 1e-6f)) return false;
+            if (!math::IsEqualApprox(hiz->block_max_depth[i], 0.5f, 1e-6f)) return false;
+        }
+        for (size_t i = 0; i < hiz->tile_dirty.size(); i++) {
+            if (hiz->tile_dirty[i]) return false;
+        }
+
+        // a depth write leaves its block and tile unknown until resolved
+        if (!gpu.TestDepthStencil(19.5_r, 3.5_r, 0.25_r, true)) return false;
+        const size_t block_index = static_cast<size_t>(0 * hiz->block_columns + 19 / vg::RASTER_BLOCK_SIZE);
+        const size_t tile_index = static_cast<size_t>(0 * hiz->tile_columns + 19 / VirtualGPU::TILE_WIDTH);
+        if (!hiz->block_dirty[block_index] || !hiz->tile_dirty[tile_index]) return false;
+
+        VirtualGPU::ResolveHiZ(*hiz, {16, 0, VirtualGPU::TILE_WIDTH, VirtualGPU::TILE_HEIGHT});
+        if (hiz->block_dirty[block_index] || hiz->tile_dirty[tile_index]) return false;
+        if (!math::IsEqualApprox(hiz->block_min_depth[block_index], 0.25f, 1e-6f)) return false;
+        if (!math::IsEqualApprox(hiz->block_max_depth[block_index], 0.5f, 1e-6f)) return false;
+        if (!math::IsEqualApprox(hiz->tile_min_depth[tile_index], 0.25f, 1e-6f)) return false;
+
+        // a partial clear resolves the blocks on its border
+        gpu.state_.scissor_test_enabled = true;
+        gpu.state_.scissor = {0, 0, 20, 4};
+        gpu.ClearDepthAttachment(0.75_r);
+        if (hiz->block_dirty[block_index] || hiz->tile_dirty[tile_index]) return false;
+        if (!math::IsEqualApprox(hiz->block_min_depth[block_index], 0.5f, 1e-6f)) return false;
+        if (!math::IsEqualApprox(hiz->block_max_depth[block_index], 0.75f, 1e-6f)) return false;
+
+        // a per primitive draw binds none and leaves everything unknown for the next tiled draw
+        gpu.state_.tiled_rasterization_enabled = false;
+        gpu.PrepareHiZ();
+        if (gpu.active_hiz_ != nullptr) return false;
+        for (size_t i = 0; i < hiz->block_dirty.size(); i++) {
+            if (!hiz->block_dirty[i]) return false;
+        }
+        for (size_t i = 0; i < hiz->tile_dirty.size(); i++) {
+            if (!hiz->tile_dirty[i]) return false;
+        }
+        gpu.state_.tiled_rasterization_enabled = true;
+        gpu.PrepareHiZ();
+        if (gpu.active_hiz_ != hiz || hiz->block_dirty[block_index] || hiz->tile_dirty[tile_index]) return false;
+
+        // writes outside the pipeline drop it
+        gpu.InvalidateHiZ(hiz->memory);
+        if (gpu.active_hiz_ != nullptr || !gpu.hiz_buffers_.empty()) return false;
+
+        return true;
+    }
+
+    bool VirtualGPUTester::HiZRejectsOccludedBlocks() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        VirtualGPU::Varying v0, v1, v2;
+        PopulateVarying(v0, 1.0f, 10.0f);
+        PopulateVarying(v1, 2.0f, 20.0f);
+        PopulateVarying(v2, 3.0f, 30.0f);
+        v0.viewport_coord = Vector3(0.0_r, 0.0_r, 0.5_r);
+        v1.viewport_coord = Vector3(128.0_r, 0.0_r, 0.5_r);
+        v2.viewport_coord = Vector3(0.0_r, 64.0_r, 0.5_r);
+
+        gpu.state_.cull_enabled = false;
+        gpu.state_.scissor_test_enabled = false;
+        gpu.state_.depth_test_enabled = true;
+        gpu.state_.depth_func = VG_LESS;
+        gpu.state_.depth_write_enabled = false;
+
+        gpu.PrepareHiZ();
+        VirtualGPU::HiZBuffer* hiz = gpu.active_hiz_;
+        if (hiz == nullptr) return false;
+        gpu.ClearDepthAttachment(1.0_r);
+
+        const size_t visible = gpu.Rasterize(v0, v1, v2).size();
+        if (visible == 0) return false;
+
+        // Bounds claiming the first tile holds nearer depth skip it without reading the depth buffer.
+        const VirtualGPU::Rect first_tile = {0, 0, VirtualGPU::TILE_WIDTH, VirtualGPU::TILE_HEIGHT};
+        const VirtualGPU::Rect second_tile = {VirtualGPU::TILE_WIDTH, 0, VirtualGPU::TILE_WIDTH,
+                                              VirtualGPU::TILE_HEIGHT};
+        if (gpu.Rasterize(v0, v1, v2, first_tile).empty()) return false;
+        hiz->tile_min_depth[0] = 0.1f;
+        hiz->tile_max_depth[0] = 0.1f;
+        if (!gpu.Rasterize(v0, v1, v2, first_tile).empty()) return false;
+        if (gpu.Rasterize(v0, v1, v2, second_tile).empty()) return false;
+
+        // the same for a single block, unless it was written since the last resolve
+        hiz->tile_dirty[0] = 1;
+        hiz->block_min_depth[0] = 0.1f;
+        hiz->block_max_depth[0] = 0.1f;
+        const auto SkipsFirstBlock = [&]() {
+            for (const auto& f : gpu.Rasterize(v0, v1, v2)) {
+                if (f.screen_coord.x < vg::RASTER_BLOCK_SIZE && f.screen_coord.y < vg::RASTER_BLOCK_SIZE) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        if (!SkipsFirstBlock()) return false;
+        hiz->block_dirty[0] = 1;
+        if (SkipsFirstBlock()) return false;
+
+        // stencil test may update on depth fail, so it disables Hi-Z
+        hiz->block_dirty[0] = 0;
+        gpu.state_.stencil_test_enabled = true;
+        if (SkipsFirstBlock()) return false;
+        gpu.state_.stencil_test_enabled = false;
+
+        // GREATER rejects against the nearest stored depth
+        gpu.state_.depth_func = VG_GREATER;
+        gpu.ClearDepthAttachment(0.0_r);
+        if (SkipsFirstBlock()) return false;
+        hiz->block_min_depth[0] = 0.9f;
+        hiz->block_max_depth[0] = 0.9f;
+        if (!SkipsFirstBlock()) return false;
+
+        return true;
+    }
+
+    bool VirtualGPUTester::SetupPrimitiveTriangle() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        // viewport is 128x64
+        VirtualGPU::Varying v0, v1, v2;
+        PopulateClipVarying(v0, Vector4(-0.5_r, 0.5_r, 0.0_r, 1.0_r), Color128(1.f, 0.f, 0.f, 1.f));
+        PopulateClipVarying(v1, Vector4(-0.5_r, -0.5_r, 0.0_r, 1.0_r), Color128(1.f, 0.f, 0.f, 1.f));
+        PopulateClipVarying(v2, Vector4(0.5_r, -0.5_r, 0.0_r, 1.0_r), Color128(1.f, 0.f, 0.f, 1.f));
+
+        gpu.state_.cull_enabled = false;
+
+        std::vector<VirtualGPU::RasterPrimitive> prims;
+        gpu.SetupPrimitive({&v0, &v1, &v2}, prims);
+
+        if (prims.size() != 1u) return false;
+
+        const VirtualGPU::RasterPrimitive& prim = prims[0];
+        if (prim.vertex_count != 3) return false;
+
+        // screen space: (32, 16), (32, 48), (96, 48)
+        if (!math::IsEqualApprox(prim.vertices[0].viewport_coord.x, 32.0_r)) return false;
+        if (!math::IsEqualApprox(prim.vertices[0].viewport_coord.y, 16.0_r)) return false;
+        if (!math::IsEqualApprox(prim.vertices[2].viewport_coord.x, 96.0_r)) return false;
+        if (!math::IsEqualApprox(prim.vertices[2].viewport_coord.y, 48.0_r)) return false;
+
+        if (prim.bounds.x != 32 || prim.bounds.y != 16) return false;
+        if (prim.bounds.width != 64 || prim.bounds.height != 32) return false;
+
+        // A left edge at x = 15.501 snaps to 15.5, so the bounds and the rasterizer both include pixel 15
+        PopulateClipVarying(v0, Vector4(15.501_r / 64.0_r - 1.0_r, 0.75_r, 0.0_r, 1.0_r), Color128());
+        PopulateClipVarying(v1, Vector4(15.501_r / 64.0_r - 1.0_r, -0.25_r, 0.0_r, 1.0_r), Color128());
+        PopulateClipVarying(v2, Vector4(-0.375_r, -0.25_r, 0.0_r, 1.0_r), Color128());
+        prims.clear();
+        gpu.SetupPrimitive({&v0, &v1, &v2}, prims);
+        if (prims.size() != 1u || prims[0].bounds.x != 15) return false;
+
+        gpu.state_.scissor_test_enabled = false;
+        gpu.state_.depth_test_enabled = false;
+        const VirtualGPU::Rect& bounds = prims[0].bounds;
+        const std::vector<VirtualGPU::Fragment> fragments =
+            gpu.Rasterize(prims[0].vertices[0], prims[0].vertices[1], prims[0].vertices[2]);
+        bool is_left_covered = false;
+        for (const VirtualGPU::Fragment& fragment : fragments) {
+            const int x = static_cast<int>(math::Floor(fragment.screen_coord.x));
+            const int y = static_cast<int>(math::Floor(fragment.screen_coord.y));
+            if (x < bounds.x || x >= bounds.x + bounds.width || y < bounds.y || y >= bounds.y + bounds.height) {
+                return false;
+            }
+            is_left_covered = is_left_covered || x == 15;
+        }
+
+        return is_left_covered;
+    }
+
+    bool VirtualGPUTester::SetupPrimitiveCulled() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        // CCW in NDC (y-up)
+        VirtualGPU::Varying v0, v1, v2;
+        PopulateClipVarying(v0, Vector4(-0.5_r, -0.5_r, 0.0_r, 1.0_r), Color128());
+        PopulateClipVarying(v1, Vector4(0.5_r, -0.5_r, 0.0_r, 1.0_r), Color128());
+        PopulateClipVarying(v2, Vector4(0.0_r, 0.5_r, 0.0_r, 1.0_r), Color128());
+
+        gpu.state_.front_face = VG_CCW;
+        gpu.state_.cull_enabled = true;
+
+        std::vector<VirtualGPU::RasterPrimitive> prims;
+
+        gpu.state_.cull_face = VG_BACK;
+        gpu.SetupPrimitive({&v0, &v1, &v2}, prims);
+        if (prims.size() != 1u) return false;
+
+        prims.clear();
+        gpu.SetupPrimitive({&v0, &v2, &v1}, prims);
+        if (!prims.empty()) return false;
+
+        gpu.state_.cull_face = VG_FRONT;
+        gpu.SetupPrimitive({&v0, &v1, &v2}, prims);
+        if (!prims.empty()) return false;
+
+        gpu.state_.cull_face = VG_FRONT_AND_BACK;
+        gpu.SetupPrimitive({&v0, &v2, &v1}, prims);
+        if (!prims.empty()) return false;
+
+        // fully outside of the frustum
+        gpu.state_.cull_enabled = false;
+        PopulateClipVarying(v0, Vector4(2.0_r, 2.0_r, 0.0_r, 1.0_r), Color128());
+        PopulateClipVarying(v1, Vector4(3.0_r, 2.0_r, 0.0_r, 1.0_r), Color128());
+        PopulateClipVarying(v2, Vector4(2.5_r, 3.0_r, 0.0_r, 1.0_r), Color128());
+        gpu.SetupPrimitive({&v0, &v1, &v2}, prims);
+        if (!prims.empty()) return false;
+
+        return true;
+    }
+
+    bool VirtualGPUTester::SetupPrimitivePolygonModeLine() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        VirtualGPU::Varying v0, v1, v2;
+        PopulateClipVarying(v0, Vector4(-0.5_r, -0.5_r, 0.0_r, 1.0_r), Color128());
+        PopulateClipVarying(v1, Vector4(0.5_r, -0.5_r, 0.0_r, 1.0_r), Color128());
+        PopulateClipVarying(v2, Vector4(0.0_r, 0.5_r, 0.0_r, 1.0_r), Color128());
+
+        gpu.state_.polygon_mode = VG_LINE;
+
+        std::vector<VirtualGPU::RasterPrimitive> prims;
+        gpu.SetupPrimitive({&v0, &v1, &v2}, prims);
+
+        if (prims.size() != 3u) return false;
+        for (const auto& prim : prims) {
+            if (prim.vertex_count != 2) return false;
+            if (prim.bounds.width <= 0 || prim.bounds.height <= 0) return false;
+        }
+
+        return true;
+    }
+
+    bool VirtualGPUTester::GetRenderAreaViewportScissorIntersect() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        VirtualGPU::Rect area = gpu.GetRenderArea();
+        if (area.x != 0 || area.y != 0 || area.width != 128 || area.height != 64) return false;
+
+        // viewport is clamped by the attachment size
+        gpu.state_.viewport = {-10, 20, 200, 100};
+        area = gpu.GetRenderArea();
+        if (area.x != 0 || area.y != 20 || area.width != 128 || area.height != 44) return false;
+
+        gpu.state_.scissor_test_enabled = true;
+        gpu.state_.scissor = {100, 0, 50, 30};
+        area = gpu.GetRenderArea();
+        if (area.x != 100 || area.y != 20 || area.width != 28 || area.height != 10) return false;
+
+        // scissor doesn't overlap the viewport vertically
+        gpu.state_.scissor = {0, 0, 10, 10};
+        area = gpu.GetRenderArea();
+        if (area.height != 0) return false;
+
+        return true;
+    }
+
+    bool VirtualGPUTester::DrawBinnedSubmissionOrder() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        // Two full screen triangles, the later one must win on every pixel.
+        VirtualGPU::Varying r0, r1, r2;
+        PopulateClipVarying(r0, Vector4(-1.0_r, -1.0_r, 0.0_r, 1.0_r), Color128(1.f, 0.f, 0.f, 1.f));
+        PopulateClipVarying(r1, Vector4(3.0_r, -1.0_r, 0.0_r, 1.0_r), Color128(1.f, 0.f, 0.f, 1.f));
+        PopulateClipVarying(r2, Vector4(-1.0_r, 3.0_r, 0.0_r, 1.0_r), Color128(1.f, 0.f, 0.f, 1.f));
+
+        VirtualGPU::Varying g0, g1, g2;
+        PopulateClipVarying(g0, Vector4(-1.0_r, -1.0_r, 0.0_r, 1.0_r), Color128(0.f, 1.f, 0.f, 1.f));
+        PopulateClipVarying(g1, Vector4(3.0_r, -1.0_r, 0.0_r, 1.0_r), Color128(0.f, 1.f, 0.f, 1.f));
+        PopulateClipVarying(g2, Vector4(-1.0_r, 3.0_r, 0.0_r, 1.0_r), Color128(0.f, 1.f, 0.f, 1.f));
+
+        gpu.state_.tiled_rasterization_enabled = true;
+        gpu.state_.cull_enabled = false;
+        gpu.state_.depth_test_enabled = false;
+
+        std::vector<const VirtualGPU::Varying*> varyings;
+        for (int i = 0; i < 8; i++) {
+            varyings.insert(varyings.end(), {&r0, &r1, &r2});
+            varyings.insert(varyings.end(), {&g0, &g1, &g2});
+        }
+
+        VirtualGPU::Program prog;
+        VirtualGPU::PrimitiveList prims;
+        prims.vertex_count = 3;
+        PackClipVaryings(prog, varyings, prims);
+
+        gpu.DrawBinned(prims, FlatColorFragmentShader);
+        gpu.using_program_ = nullptr;
+
+        const VirtualGPU::Attachment& attch = gpu.bound_draw_frame_buffer_->color_attachments[0];
+        for (int y = 0; y < attch.height; y++) {
+            for (int x = 0; x < attch.width; x++) {
+                const uint8_t* p = attch.external_memory + static_cast<size_t>((y * attch.width + x) * 4);
+                if (p[0] != 0 || p[1] != 255 || p[2] != 0 || p[3] != 255) return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool VirtualGPUTester::DrawBinnedRespectsScissor() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        VirtualGPU::Varying v0, v1, v2;
+        PopulateClipVarying(v0, Vector4(-1.0_r, -1.0_r, 0.0_r, 1.0_r), Color128(1.f, 1.f, 1.f, 1.f));
+        PopulateClipVarying(v1, Vector4(3.0_r, -1.0_r, 0.0_r, 1.0_r), Color128(1.f, 1.f, 1.f, 1.f));
+        PopulateClipVarying(v2, Vector4(-1.0_r, 3.0_r, 0.0_r, 1.0_r), Color128(1.f, 1.f, 1.f, 1.f));
+
+        gpu.state_.tiled_rasterization_enabled = true;
+        gpu.state_.cull_enabled = false;
+        gpu.state_.scissor_test_enabled = true;
+        gpu.state_.scissor = {10, 5, 30, 20};
+
+        VirtualGPU::Program prog;
+        VirtualGPU::PrimitiveList prims;
+        prims.vertex_count = 3;
+        PackClipVaryings(prog, {&v0, &v1, &v2}, prims);
+        gpu.DrawBinned(prims, FlatColorFragmentShader);
+        gpu.using_program_ = nullptr;
+
+        const VirtualGPU::Attachment& attch = gpu.bound_draw_frame_buffer_->color_attachments[0];
+        for (int y = 0; y < attch.height; y++) {
+            for (int x = 0; x < attch.width; x++) {
+                const uint8_t* p = attch.external_memory + static_cast<size_t>((y * attch.width + x) * 4);
+                const bool inside = x >= 10 && x < 40 && y >= 5 && y < 25;
+                if (inside && p[0] != 255) return false;
+                if (!inside && p[0] != 0) return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool VirtualGPUTester::ShadeFragmentsEarlyFragmentTests() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        VGuint p = vgCreateProgram();
+        VGuint vs = vgCreateShader(VG_VERTEX_SHADER);
+        VGuint fs = vgCreateShader(VG_FRAGMENT_SHADER);
+        vgAttachShader(p, vs);
+        vgAttachShader(p, fs);
+        vgLinkProgram(p);
+        vgUseProgram(p);
+
+        gpu.state_.tiled_rasterization_enabled = true;
+        gpu.state_.depth_test_enabled = true;
+        gpu.state_.depth_func = VG_LESS;
+
+        // Each pixel of the first row gets a near red fragment followed by a far green one.
+        const VirtualGPU::Attachment& attch = gpu.bound_draw_frame_buffer_->color_attachments[0];
+        std::vector<VirtualGPU::Fragment> frags;
+        for (int x = 0; x < attch.width; x++) {
+            for (int i = 0; i < 2; i++) {
+                VirtualGPU::Fragment frag;
+                frag.screen_coord = Vector2(static_cast<real>(x) + 0.5_r, 0.5_r);
+                frag.depth = i == 0 ? 0.25_r : 0.75_r;
+                frag.is_front = true;
+                frag.used_flat_register_size = 4;
+                frag.flat_register[0] = i == 0 ? 1.f : 0.f;
+                frag.flat_register[1] = i == 0 ? 0.f : 1.f;
+                frag.flat_register[2] = 0.f;
+                frag.flat_register[3] = 1.f;
+                frags.push_back(frag);
+            }
+        }
+
+        for (int pass = 0; pass < 2; pass++) {
+            const bool early = pass == 1;
+            vgProgramParameteri(p, VG_EARLY_FRAGMENT_TESTS, early ? VG_TRUE : VG_FALSE);
+            gpu.ClearDepthStencilAttachment(true, false, 1.0_r, 0);
+
+            fragment_shader_invocations = 0;
+            gpu.ShadeFragments(frags.data(), frags.size(), CountingFragmentShader);
+
+            // Late tests shade the far fragments before rejecting them, early tests never shade them.
+            if (fragment_shader_invocations != (early ? attch.width : attch.width * 2)) return false;
+
+            for (int x = 0; x < attch.width; x++) {
+                const uint8_t* px = attch.external_memory + static_cast<size_t>(x * 4);
+                if (px[0] != 255 || px[1] != 0) return false;
+            }
+        }
+
+        vgUseProgram(0);
+        vgDeleteProgram(p);
+        return true;
+    }
+
+    bool VirtualGPUTester::ProgramParameteriEarlyFragmentTests() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        VGuint p = vgCreateProgram();
+        VirtualGPU::Program& prog = gpu.program_pool_[p];
+        if (prog.early_fragment_tests) return false;
+
+        vgProgramParameteri(p, VG_EARLY_FRAGMENT_TESTS, VG_TRUE);
+        if (vgGetError() != VG_NO_ERROR || !prog.early_fragment_tests) return false;
+
+        vgProgramParameteri(p, VG_EARLY_FRAGMENT_TESTS, VG_FALSE);
+        if (vgGetError() != VG_NO_ERROR || prog.early_fragment_tests) return false;
+
+        vgProgramParameteri(p + 100, VG_EARLY_FRAGMENT_TESTS, VG_TRUE);
+        if (vgGetError() != VG_INVALID_VALUE) return false;
+
+        vgProgramParameteri(p, VG_TILED_RASTERIZATION, VG_TRUE);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+
+        vgProgramParameteri(p, VG_EARLY_FRAGMENT_TESTS, 2);
+        if (vgGetError() != VG_INVALID_VALUE || prog.early_fragment_tests) return false;
+
+        vgDeleteProgram(p);
+        return true;
+    }
+
+    bool VirtualGPUTester::TexImage2DMipmapLevels() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        VGuint tex_id = 0;
+        vgGenTextures(1, &tex_id);
+        vgBindTexture(VG_TEXTURE_2D, tex_id);
+        VirtualGPU::TextureObject* tex =
+            gpu.texture_units_[gpu.active_texture_unit_].bound_texture_targets[vg::GetTextureSlot(VG_TEXTURE_2D)];
+
+        std::vector<uint8_t> pixels(8 * 8 * 4, 255);
+        vgTexImage2D(VG_TEXTURE_2D, 0, VG_RGBA, 8, 8, 0, VG_RGBA, VG_UNSIGNED_BYTE, pixels.data());
+        if (vgGetError() != VG_NO_ERROR || tex->mipmap_count != 1) return false;
+
+        vgTexImage2D(VG_TEXTURE_2D, 1, VG_RGBA, 4, 4, 0, VG_RGBA, VG_UNSIGNED_BYTE, pixels.data());
+        if (vgGetError() != VG_NO_ERROR || tex->mipmap_count != 2) return false;
+        if (tex->mipmap[1].width != 4 || tex->mipmap[1].height != 4 || tex->mipmap[1].mipmap_level != 1) return false;
+
+        // A level that does not halve the previous one ends the chain.
+        vgTexImage2D(VG_TEXTURE_2D, 2, VG_RGBA, 3, 3, 0, VG_RGBA, VG_UNSIGNED_BYTE, pixels.data());
+        if (vgGetError() != VG_NO_ERROR || tex->mipmap_count != 2) return false;
+
+        vgTexImage2D(VG_TEXTURE_2D, 2, VG_RGBA, 2, 2, 0, VG_RGBA, VG_UNSIGNED_BYTE, pixels.data());
+        if (vgGetError() != VG_NO_ERROR || tex->mipmap_count != 3) return false;
+
+        vgTexSubImage2D(VG_TEXTURE_2D, 1, 1, 1, 2, 2, VG_RGBA, VG_UNSIGNED_BYTE, pixels.data());
+        if (vgGetError() != VG_NO_ERROR) return false;
+
+        vgTexImage2D(VG_TEXTURE_2D, VirtualGPU::MAX_MIPMAP_LEVEL_COUNT, VG_RGBA, 1, 1, 0, VG_RGBA, VG_UNSIGNED_BYTE,
+                     pixels.data());
+        if (vgGetError() != VG_INVALID_VALUE) return false;
+
+        vgTexImage2D(VG_TEXTURE_2D, -1, VG_RGBA, 1, 1, 0, VG_RGBA, VG_UNSIGNED_BYTE, pixels.data());
+        if (vgGetError() != VG_INVALID_VALUE) return false;
+
+        // Respecifying level 0 with another size breaks the chain.
+        vgTexImage2D(VG_TEXTURE_2D, 0, VG_RGBA, 4, 4, 0, VG_RGBA, VG_UNSIGNED_BYTE, pixels.data());
+        if (vgGetError() != VG_NO_ERROR || tex->mipmap_count != 1) return false;
+
+        vgDeleteTextures(1, &tex_id);
+        return true;
+    }
+
+    bool VirtualGPUTester::GenerateMipmapBoxFilter() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        VGuint tex_id = 0;
+        vgGenTextures(1, &tex_id);
+        vgBindTexture(VG_TEXTURE_2D, tex_id);
+        VirtualGPU::TextureObject* tex =
+            gpu.texture_units_[gpu.active_texture_unit_].bound_texture_targets[vg::GetTextureSlot(VG_TEXTURE_2D)];
+
+        // 4x2 gray levels
+        const uint8_t values[8] = {0, 100, 200, 40, 20, 60, 80, 120};
+        std::vector<uint8_t> pixels;
+        for (uint8_t v : values) {
+            pixels.insert(pixels.end(), {v, v, v, 255});
+        }
+        vgTexImage2D(VG_TEXTURE_2D, 0, VG_RGBA, 4, 2, 0, VG_RGBA, VG_UNSIGNED_BYTE, pixels.data());
+        vgGenerateMipmap(VG_TEXTURE_2D);
+        if (vgGetError() != VG_NO_ERROR) return false;
+
+        if (tex->mipmap_count != 3) return false;
+        if (tex->mipmap[1].width != 2 || tex->mipmap[1].height != 1) return false;
+        if (tex->mipmap[2].width != 1 || tex->mipmap[2].height != 1) return false;
+
+        const auto IsNear = [](uint8_t value, int expected) {
+            return math::Abs(static_cast<int>(value) - expected) <= 1;
+        };
+        const std::vector<uint8_t>& level1 = *tex->mipmap[1].memory;
+        if (!IsNear(level1[0], 45) || !IsNear(level1[4], 110) || level1[3] != 255 || level1[7] != 255) return false;
+        const std::vector<uint8_t>& level2 = *tex->mipmap[2].memory;
+        if (!IsNear(level2[0], 78) || level2[3] != 255) return false;
+
+        // A large texture is split into several jobs per level.
+        const VGsizei size = 512;
+        pixels.assign(static_cast<size_t>(size * size * 4), 0);
+        for (size_t i = 0; i < pixels.size(); i += 4) {
+            pixels[i + 0] = 10;
+            pixels[i + 1] = 20;
+            pixels[i + 2] = 30;
+            pixels[i + 3] = 40;
+        }
+        vgTexImage2D(VG_TEXTURE_2D, 0, VG_RGBA, size, size, 0, VG_RGBA, VG_UNSIGNED_BYTE, pixels.data());
+        vgGenerateMipmap(VG_TEXTURE_2D);
+        if (vgGetError() != VG_NO_ERROR || tex->mipmap_count != 10) return false;
+
+        for (int level = 1; level < tex->mipmap_count; level++) {
+            const VirtualGPU::TextureLevel& lvl = tex->mipmap[static_cast<size_t>(level)];
+            if (lvl.width != (size >> level) || lvl.height != (size >> level)) return false;
+            const std::vector<uint8_t>& mem = *lvl.memory;
+            if (mem.size() != static_cast<size_t>(lvl.width * lvl.height * 4)) return false;
+            for (size_t i = 0; i < mem.size(); i += 4) {
+                if (mem[i] != 10 || mem[i + 1] != 20 || mem[i + 2] != 30 || mem[i + 3] != 40) return false;
+            }
+        }
+
+        vgDeleteTextures(1, &tex_id);
+        return true;
+    }
+
+    bool VirtualGPUTester::GenerateMipmapErrors() {
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        vgGenerateMipmap(VG_TEXTURE_2D);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+
+        vgGenerateMipmap(VG_ARRAY_BUFFER);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+
+        VGuint tex_id = 0;
+        vgGenTextures(1, &tex_id);
+        vgBindTexture(VG_TEXTURE_2D, tex_id);
+
+        // no level 0
+        vgGenerateMipmap(VG_TEXTURE_2D);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+
+        // depth values are not averaged
+        vgTexImage2D(VG_TEXTURE_2D, 0, VG_DEPTH_COMPONENT, 4, 4, 0, VG_DEPTH_COMPONENT, VG_FLOAT, nullptr);
+        vgGenerateMipmap(VG_TEXTURE_2D);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+
+        vgTexParameteri(VG_TEXTURE_2D, VG_TEXTURE_MIN_FILTER, VG_LINEAR_MIPMAP_LINEAR);
+        if (vgGetError() != VG_NO_ERROR) return false;
+        vgTexParameteri(VG_TEXTURE_2D, VG_TEXTURE_MAG_FILTER, VG_LINEAR_MIPMAP_LINEAR);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+
+        vgDeleteTextures(1, &tex_id);
+        return true;
+    }
+
+    void VirtualGPUTester::SetupCountingDraw(const std::vector<uint16_t>& indices) {
+        VGuint p = vgCreateProgram();
+        VGuint vs = vgCreateShader(VG_VERTEX_SHADER);
+        VGuint fs = vgCreateShader(VG_FRAGMENT_SHADER);
+        vgShaderSource(vs, reinterpret_cast<void*>(CountingVertexShader));
+        vgShaderSource(fs, reinterpret_cast<void*>(CountingFragmentShader));
+        vgAttachShader(p, vs);
+        vgAttachShader(p, fs);
+        vgLinkProgram(p);
+        vgUseProgram(p);
+
+        VGuint vao = 0;
+        vgGenVertexArrays(1, &vao);
+        vgBindVertexArray(vao);
+
+        VGuint buffers[2] = {0, 0};
+        vgGenBuffers(2, buffers);
+        const std::vector<float> positions(vertex_shader_invocations.size() * 4, 0.f);
+        vgBindBuffer(VG_ARRAY_BUFFER, buffers[0]);
+        vgBufferData(VG_ARRAY_BUFFER, static_cast<VGsizeiptr>(positions.size() * sizeof(float)), positions.data(),
+                     VG_STATIC_DRAW);
+        vgVertexAttribPointer(0, 4, VG_FLOAT, VG_FALSE, 4 * sizeof(float), nullptr);
+        vgEnableVertexAttribArray(0);
+
+        vgBindBuffer(VG_ELEMENT_ARRAY_BUFFER, buffers[1]);
+        vgBufferData(VG_ELEMENT_ARRAY_BUFFER, static_cast<VGsizeiptr>(indices.size() * sizeof(uint16_t)),
+                     indices.data(), VG_STATIC_DRAW);
+    }
+
+    void VirtualGPUTester::ResetInvocationCounts() {
+        for (std::atomic<int>& count : vertex_shader_invocations) {
+            count = 0;
+        }
+        fragment_shader_invocations = 0;
+    }
+
+    bool VirtualGPUTester::DrawElementsShadesReferencedVertices() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        // Two triangles sharing an edge, taken from the middle of the vertex buffer.
+        const std::vector<uint16_t> indices = {30, 31, 32, 32, 31, 33, 30, 31, 32};
+        SetupCountingDraw(indices);
+        if (vgGetError() != VG_NO_ERROR) return false;
+
+        for (bool tiled : {true, false}) {
+            gpu.state_.tiled_rasterization_enabled = tiled;
+            ResetInvocationCounts();
+
+            vgDrawElements(VG_TRIANGLES, static_cast<VGsizei>(indices.size()), VG_UNSIGNED_SHORT, nullptr);
+            if (vgGetError() != VG_NO_ERROR) return false;
+
+            for (size_t i = 0; i < vertex_shader_invocations.size(); i++) {
+                const int expected = (i >= 30 && i <= 33) ? 1 : 0;
+                if (vertex_shader_invocations[i] != expected) return false;
+            }
+            if (fragment_shader_invocations == 0) return false;
+            if (!gpu.using_program_->varying_buffer.empty()) return false;
+
+            // Slots follow the order of first reference.
+            const VirtualGPU::VertexCache& cache = gpu.vertex_cache_;
+            if (cache.slot_to_index != std::vector<uint32_t>({30, 31, 32, 33})) return false;
+            if (cache.element_slots != std::vector<uint32_t>({0, 1, 2, 2, 1, 3, 0, 1, 2})) return false;
+        }
+
+        // Offset into the element buffer
+        ResetInvocationCounts();
+        vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, reinterpret_cast<const void*>(3 * sizeof(uint16_t)));
+        if (vgGetError() != VG_NO_ERROR) return false;
+        if (vertex_shader_invocations[30] != 0 || vertex_shader_invocations[33] != 1) return false;
+
+        // Invalid mode shades nothing
+        ResetInvocationCounts();
+        vgDrawElements(VG_LESS, static_cast<VGsizei>(indices.size()), VG_UNSIGNED_SHORT, nullptr);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+        if (vertex_shader_invocations[30] != 0) return false;
+
+        return true;
+    }
+
+    bool VirtualGPUTester::DrawRangeElementsVertexRange() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        const std::vector<uint16_t> indices = {40, 41, 42, 45, 46, 47};
+        SetupCountingDraw(indices);
+
+        // The range sizes the cache without scanning the indices.
+        ResetInvocationCounts();
+        vgDrawRangeElements(VG_TRIANGLES, 40, 47, static_cast<VGsizei>(indices.size()), VG_UNSIGNED_SHORT, nullptr);
+        if (vgGetError() != VG_NO_ERROR) return false;
+        if (gpu.vertex_cache_.min_index != 40 || gpu.vertex_cache_.index_to_slot.size() != 8) return false;
+        for (size_t i = 0; i < vertex_shader_invocations.size(); i++) {
+            const int expected = (i >= 40 && i <= 42) || (i >= 45 && i <= 47) ? 1 : 0;
+            if (vertex_shader_invocations[i] != expected) return false;
+        }
+
+        // A range missing some indices falls back to the referenced range.
+        ResetInvocationCounts();
+        vgDrawRangeElements(VG_TRIANGLES, 40, 42, static_cast<VGsizei>(indices.size()), VG_UNSIGNED_SHORT, nullptr);
+        if (vgGetError() != VG_NO_ERROR) return false;
+        if (gpu.vertex_cache_.min_index != 40 || gpu.vertex_cache_.index_to_slot.size() != 8) return false;
+        if (vertex_shader_invocations[47] != 1) return false;
+
+        // A range wider than the vertex array is ignored.
+        ResetInvocationCounts();
+        vgDrawRangeElements(VG_TRIANGLES, 0, 1000, static_cast<VGsizei>(indices.size()), VG_UNSIGNED_SHORT, nullptr);
+        if (vgGetError() != VG_NO_ERROR) return false;
+        if (gpu.vertex_cache_.index_to_slot.size() != 8) return false;
+
+        // So is a range ending past the vertex array.
+        vgDrawRangeElements(VG_TRIANGLES, 40, 600, static_cast<VGsizei>(indices.size()), VG_UNSIGNED_SHORT, nullptr);
+        if (vgGetError() != VG_NO_ERROR) return false;
+        if (gpu.vertex_cache_.min_index != 40 || gpu.vertex_cache_.index_to_slot.size() != 8) return false;
+
+        // Indices far apart are cached without a dense table.
+        const std::vector<uint16_t> sparse_indices = {300, 1, 2, 0, 301, 300};
+        vgBufferData(VG_ELEMENT_ARRAY_BUFFER, static_cast<VGsizeiptr>(sparse_indices.size() * sizeof(uint16_t)),
+                     sparse_indices.data(), VG_STATIC_DRAW);
+        ResetInvocationCounts();
+        vgDrawElements(VG_TRIANGLES, static_cast<VGsizei>(sparse_indices.size()), VG_UNSIGNED_SHORT, nullptr);
+        if (vgGetError() != VG_NO_ERROR) return false;
+        const VirtualGPU::VertexCache& cache = gpu.vertex_cache_;
+        if (!cache.index_to_slot.empty()) return false;
+        if (cache.slot_to_index != std::vector<uint32_t>{0, 1, 2, 300, 301}) return false;
+        if (cache.element_slots != std::vector<uint32_t>{3, 1, 2, 0, 4, 3}) return false;
+        for (size_t i = 0; i < vertex_shader_invocations.size(); i++) {
+            const int expected = i <= 2 || i == 300 || i == 301 ? 1 : 0;
+            if (vertex_shader_invocations[i] != expected) return false;
+        }
+
+        vgDrawRangeElements(VG_TRIANGLES, 47, 40, static_cast<VGsizei>(indices.size()), VG_UNSIGNED_SHORT, nullptr);
+        if (vgGetError() != VG_INVALID_VALUE) return false;
+
+        return true;
+    }
+
+    bool VirtualGPUTester::AssemblePrimitivesLayout() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({0});
+        VirtualGPU::Program& prog = *gpu.using_program_;
+        prog.varying_stride = VirtualGPU::VARYING_POSITION_SIZE + 3;
+        prog.varying_buffer.resize(6 * prog.varying_stride);
+        const auto varying = [&prog](size_t slot) { return prog.varying_buffer.data() + slot * prog.varying_stride; };
+
+        // Odd strip triangles swap their last two vertices.
+        gpu.AssemblePrimitives(VG_TRIANGLE_STRIP, 5, nullptr);
+        const VirtualGPU::PrimitiveList& prims = gpu.primitives_;
+        if (prims.GetCount() != 3 || prims.vertex_count != 3) return false;
+        if (prims.Get(0)[0] != varying(0) || prims.Get(0)[1] != varying(1) || prims.Get(0)[2] != varying(2)) {
+            return false;
+        }
+        if (prims.Get(1)[0] != varying(1) || prims.Get(1)[1] != varying(3) || prims.Get(1)[2] != varying(2)) {
+            return false;
+        }
+        if (prims.Get(2)[0] != varying(2) || prims.Get(2)[1] != varying(3) || prims.Get(2)[2] != varying(4)) {
+            return false;
+        }
+
+        // Elements are mapped to slots, incomplete primitives are dropped.
+        const uint32_t slots[7] = {5, 4, 3, 2, 1, 0, 5};
+        gpu.AssemblePrimitives(VG_TRIANGLES, 7, slots);
+        if (prims.GetCount() != 2) return false;
+        if (prims.Get(1)[0] != varying(2) || prims.Get(1)[2] != varying(0)) return false;
+
+        gpu.AssemblePrimitives(VG_LINE_STRIP, 3, slots);
+        if (prims.GetCount() != 2 || prims.vertex_count != 2) return false;
+        if (prims.Get(1)[0] != varying(4) || prims.Get(1)[1] != varying(3)) return false;
+
+        gpu.AssemblePrimitives(VG_TRIANGLES, 2, nullptr);
+        if (prims.GetCount() != 0) return false;
+
+        prog.varying_buffer.clear();
+        return true;
+    }
+
+    bool VirtualGPUTester::DrawArraysPrimitiveBatches() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({0});
+        vgViewport(0, 0, 8, 8);
+
+        // More primitives than one batch holds
+        const VGsizei prim_count = 150;
+        for (bool tiled : {false, true}) {
+            gpu.state_.tiled_rasterization_enabled = tiled;
+            ResetInvocationCounts();
+
+            vgDrawArrays(VG_TRIANGLES, 0, prim_count * 3);
+            if (vgGetError() != VG_NO_ERROR) return false;
+            if (gpu.primitives_.GetCount() != static_cast<size_t>(prim_count)) return false;
+
+            for (size_t i = 0; i < vertex_shader_invocations.size(); i++) {
+                if (vertex_shader_invocations[i] != (i < static_cast<size_t>(prim_count * 3) ? 1 : 0)) return false;
+            }
+            if (fragment_shader_invocations != prim_count * 8 * 8) return false;
+        }
+
+        // Invalid mode shades nothing
+        ResetInvocationCounts();
+        vgDrawArrays(VG_LESS, 0, 3);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+        if (vertex_shader_invocations[0] != 0) return false;
+
+        return true;
+    }
+
+    bool VirtualGPUTester::InitializeWorkerCount() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+
+        constexpr VGsizei kWidth = 8;
+        constexpr VGsizei kHeight = 8;
+        std::vector<uint8_t> color_buffer(kWidth * kHeight * 4);
+
+        if (!gpu.Initialize(color_buffer.data(), kWidth, kHeight, VG_RGBA, VG_UNSIGNED_BYTE, 3)) return false;
+        if (gpu.job_system_->GetWorkerCount() != 3) return false;
+
+        // Pinned workers still draw
+        if (!gpu.Initialize(color_buffer.data(), kWidth, kHeight, VG_RGBA, VG_UNSIGNED_BYTE, 2,
+                            ThreadAffinity::CORE)) {
+            return false;
+        }
+        if (gpu.job_system_->GetWorkerCount() != 2 || gpu.job_system_->GetAffinity() != ThreadAffinity::CORE) {
+            return false;
+        }
+        SetupCountingDraw({0});
+        vgViewport(0, 0, kWidth, kHeight);
+        ResetInvocationCounts();
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        if (vgGetError() != VG_NO_ERROR) return false;
+        if (fragment_shader_invocations != kWidth * kHeight) return false;
+
+        // Default is one worker per logical processor
+        if (!InitFreshGPU()) return false;
+        if (gpu.job_system_->GetWorkerCount() != GetHardwareThreadCount()) return false;
+        if (gpu.job_system_->GetAffinity() != ThreadAffinity::NONE) return false;
+
+        return true;
+    }
+
+    bool VirtualGPUTester::DeferredCommands() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({0});
+        const VGint location = vgGetUniformLocation(gpu.using_program_->id, 0x1234u);
+        vgEnable(VG_DEFERRED_COMMANDS);
+        if (vgIsEnabled(VG_DEFERRED_COMMANDS) != VG_TRUE) return false;
+        ResetInvocationCounts();
+
+        // Draws are recorded with the state and uniforms of their call
+        vgViewport(0, 0, 8, 8);
+        vgUniform1f(location, 1.f);
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        vgViewport(0, 0, 4, 4);
+        vgUniform1f(location, 2.f);
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        if (vgGetError() != VG_NO_ERROR) return false;
+        if (fragment_shader_invocations != 0 || gpu.recorded_commands_.size() != 2) return false;
+
+        const VirtualGPU::Uniform& recorded =
+            gpu.recorded_commands_[0].draw_state.uniforms[static_cast<size_t>(location)];
+        float recorded_value = 0.f;
+        std::memcpy(&recorded_value, recorded.data.data(), sizeof(float));
+        if (recorded_value != 1.f) return false;
+
+        // Errors are reported by the call, nothing is recorded
+        vgDrawArrays(VG_LESS, 0, 3);
+        if (vgGetError() != VG_INVALID_ENUM || gpu.recorded_commands_.size() != 2) return false;
+
+        vgFlush();
+        if (!gpu.recorded_commands_.empty()) return false;
+        vgFinish();
+        if (fragment_shader_invocations != 8 * 8 + 4 * 4) return false;
+
+        // The state after the last call is kept
+        if (gpu.state_.viewport.width != 4) return false;
+        float value = 0.f;
+        std::memcpy(&value, gpu.using_program_->uniforms[static_cast<size_t>(location)].data.data(), sizeof(float));
+        if (value != 2.f) return false;
+
+        // Draw buffers are recorded too, changing them keeps the draws queued
+        ResetInvocationCounts();
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        vgDrawBuffer(VG_NONE);
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        vgDrawBuffer(VG_BACK);
+        if (vgGetError() != VG_NO_ERROR) return false;
+        if (fragment_shader_invocations != 0 || gpu.recorded_commands_.size() != 2) return false;
+        vgFinish();
+        // The second draw has no color output and is not shaded
+        if (fragment_shader_invocations != 4 * 4) return false;
+        if (gpu.bound_draw_frame_buffer_->draw_slot_to_color_attachment[0] != 0) return false;
+
+        // Changing a buffer runs the recorded draws first
+        ResetInvocationCounts();
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        const float zero[4] = {0.f, 0.f, 0.f, 0.f};
+        vgBufferSubData(VG_ARRAY_BUFFER, 0, sizeof(zero), zero);
+        if (fragment_shader_invocations != 4 * 4) return false;
+
+        vgDisable(VG_DEFERRED_COMMANDS);
+        if (vgGetError() != VG_NO_ERROR) return false;
+
+        // Without deferred commands, draws run at once
+        ResetInvocationCounts();
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        return fragment_shader_invocations == 4 * 4 && gpu.recorded_commands_.empty();
+    }
+
+    bool VirtualGPUTester::FenceSync() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        // The first fence of a fresh context is not the null sync
+        VGsync first = vgFenceSync(VG_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (first == nullptr || vgIsSync(first) != VG_TRUE) return false;
+        vgDeleteSync(first);
+        if (vgIsSync(first) != VG_FALSE) return false;
+
+        SetupCountingDraw({0});
+        vgViewport(0, 0, 4, 4);
+        VGint value = -1;
+        VGsizei length = -1;
+
+        // Without pending commands the fence is signaled at once
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        VGsync done = vgFenceSync(VG_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (vgIsSync(done) != VG_TRUE) return false;
+        vgGetSynciv(done, VG_SYNC_STATUS, 1, &length, &value);
+        if (value != static_cast<VGint>(VG_SIGNALED) || length != 1) return false;
+        if (vgClientWaitSync(done, 0, 0) != VG_ALREADY_SIGNALED) return false;
+
+        // A fence on recorded draws signals once they ran
+        vgEnable(VG_DEFERRED_COMMANDS);
+        ResetInvocationCounts();
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        VGsync pending = vgFenceSync(VG_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        vgGetSynciv(pending, VG_SYNC_STATUS, 1, nullptr, &value);
+        if (value != static_cast<VGint>(VG_UNSIGNALED)) return false;
+        if (vgClientWaitSync(pending, 0, 0) != VG_TIMEOUT_EXPIRED) return false;
+        vgWaitSync(pending, 0, VG_TIMEOUT_IGNORED);
+        if (vgGetError() != VG_NO_ERROR || fragment_shader_invocations != 0) return false;
+
+        if (vgClientWaitSync(pending, VG_SYNC_FLUSH_COMMANDS_BIT, VG_TIMEOUT_IGNORED) != VG_CONDITION_SATISFIED) {
+            return false;
+        }
+        if (fragment_shader_invocations != 4 * 4 || !gpu.recorded_commands_.empty()) return false;
+        vgGetSynciv(pending, VG_SYNC_STATUS, 1, nullptr, &value);
+        if (value != static_cast<VGint>(VG_SIGNALED)) return false;
+
+        // A finite timeout flushes too
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        VGsync timed = vgFenceSync(VG_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        const VGenum result = vgClientWaitSync(timed, 0, 10'000'000'000ull);
+        if (result != VG_CONDITION_SATISFIED || fragment_shader_invocations != 2 * 4 * 4) return false;
+        vgDisable(VG_DEFERRED_COMMANDS);
+
+        vgGetSynciv(timed, VG_OBJECT_TYPE, 1, nullptr, &value);
+        if (value != static_cast<VGint>(VG_SYNC_FENCE)) return false;
+        vgGetSynciv(timed, VG_SYNC_CONDITION, 1, nullptr, &value);
+        if (value != static_cast<VGint>(VG_SYNC_GPU_COMMANDS_COMPLETE)) return false;
+
+        // Errors
+        vgFenceSync(VG_SYNC_FENCE, 0);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+        vgFenceSync(VG_SYNC_GPU_COMMANDS_COMPLETE, 1);
+        if (vgGetError() != VG_INVALID_VALUE) return false;
+        if (vgClientWaitSync(timed, 2, 0) != VG_WAIT_FAILED || vgGetError() != VG_INVALID_VALUE) return false;
+        vgWaitSync(timed, 0, 0);
+        if (vgGetError() != VG_INVALID_VALUE) return false;
+        vgGetSynciv(timed, VG_SYNC_FENCE, 1, nullptr, &value);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+
+        vgDeleteSync(done);
+        vgDeleteSync(pending);
+        vgDeleteSync(nullptr);
+        if (vgGetError() != VG_NO_ERROR || vgIsSync(done) != VG_FALSE) return false;
+        vgDeleteSync(done);
+        if (vgGetError() != VG_INVALID_VALUE) return false;
+        if (vgClientWaitSync(done, 0, 0) != VG_WAIT_FAILED || vgGetError() != VG_INVALID_VALUE) return false;
+        return vgIsSync(timed) == VG_TRUE;
+    }
+
+    bool VirtualGPUTester::ClientWaitSyncFlushPoll() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({0});
+        vgViewport(0, 0, 4, 4);
+        vgEnable(VG_DEFERRED_COMMANDS);
+        ResetInvocationCounts();
+
+        // Polling without a timeout flushes the fenced draws, also behind a batch that is still running
+        for (bool is_batch_running : {false, true}) {
+            if (is_batch_running) {
+                vgDrawArrays(VG_TRIANGLES, 0, 3);
+                vgFlush();
+            }
+            vgDrawArrays(VG_TRIANGLES, 0, 3);
+            VGsync sync = vgFenceSync(VG_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            VGenum result = VG_TIMEOUT_EXPIRED;
+            while ((result = vgClientWaitSync(sync, VG_SYNC_FLUSH_COMMANDS_BIT, 0)) == VG_TIMEOUT_EXPIRED) {
+                if (std::chrono::steady_clock::now() > deadline) return false;
+            }
+            if (result != VG_ALREADY_SIGNALED && result != VG_CONDITION_SATISFIED) return false;
+            if (!gpu.recorded_commands_.empty()) return false;
+            vgDeleteSync(sync);
+        }
+        vgDisable(VG_DEFERRED_COMMANDS);
+
+        return vgGetError() == VG_NO_ERROR && fragment_shader_invocations == 3 * 4 * 4;
+    }
+
+    bool VirtualGPUTester::OcclusionQuery() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({0, 1, 2});
+        vgViewport(0, 0, 8, 8);
+        vgEnable(VG_DEPTH_TEST);
+        VGuint queries[2] = {0, 0};
+        vgGenQueries(2, queries);
+        if (vgIsQuery(queries[0]) != VG_TRUE || vgIsQuery(0) != VG_FALSE) return false;
+
+        VGuint samples = 0;
+        VGint any_samples = -1;
+        for (bool tiled : {true, false}) {
+            gpu.state_.tiled_rasterization_enabled = tiled;
+
+            // Both targets count at once
+            vgClear(VG_DEPTH_BUFFER_BIT);
+            vgDepthFunc(VG_LESS);
+            vgBeginQuery(VG_SAMPLES_PASSED, queries[0]);
+            vgBeginQuery(VG_ANY_SAMPLES_PASSED, queries[1]);
+            VGint current = 0;
+            vgGetQueryiv(VG_SAMPLES_PASSED, VG_CURRENT_QUERY, &current);
+            if (current != static_cast<VGint>(queries[0])) return false;
+            vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+            vgEndQuery(VG_ANY_SAMPLES_PASSED);
+            vgEndQuery(VG_SAMPLES_PASSED);
+            vgGetQueryObjectuiv(queries[0], VG_QUERY_RESULT, &samples);
+            vgGetQueryObjectiv(queries[1], VG_QUERY_RESULT, &any_samples);
+            if (vgGetError() != VG_NO_ERROR || samples != 8 * 8 || any_samples != 1) return false;
+
+            // Rejected fragments are not counted
+            vgDepthFunc(VG_NEVER);
+            vgBeginQuery(VG_SAMPLES_PASSED, queries[0]);
+            vgBeginQuery(VG_ANY_SAMPLES_PASSED, queries[1]);
+            vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+            vgEndQuery(VG_SAMPLES_PASSED);
+            vgEndQuery(VG_ANY_SAMPLES_PASSED);
+            vgGetQueryObjectuiv(queries[0], VG_QUERY_RESULT, &samples);
+            vgGetQueryObjectiv(queries[1], VG_QUERY_RESULT, &any_samples);
+            if (vgGetError() != VG_NO_ERROR || samples != 0 || any_samples != 0) return false;
+        }
+
+        // Recorded queries resolve once their commands ran
+        vgEnable(VG_DEFERRED_COMMANDS);
+        vgDepthFunc(VG_ALWAYS);
+        vgBeginQuery(VG_SAMPLES_PASSED, queries[0]);
+        vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+        vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+        vgEndQuery(VG_SAMPLES_PASSED);
+        VGuint available = VG_TRUE;
+        vgGetQueryObjectuiv(queries[0], VG_QUERY_RESULT_AVAILABLE, &available);
+        if (available != VG_FALSE) return false;
+        vgGetQueryObjectuiv(queries[0], VG_QUERY_RESULT_AVAILABLE, &available);
+        if (available != VG_TRUE) return false;
+        vgGetQueryObjectuiv(queries[0], VG_QUERY_RESULT, &samples);
+        if (vgGetError() != VG_NO_ERROR || samples != 2 * 8 * 8) return false;
+        vgDisable(VG_DEFERRED_COMMANDS);
+
+        // Errors
+        vgBeginQuery(VG_ARRAY_BUFFER, queries[0]);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+        vgBeginQuery(VG_SAMPLES_PASSED, 0);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+        vgEndQuery(VG_SAMPLES_PASSED);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+        vgBeginQuery(VG_SAMPLES_PASSED, queries[1]);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+
+        vgBeginQuery(VG_SAMPLES_PASSED, queries[0]);
+        vgBeginQuery(VG_ANY_SAMPLES_PASSED, queries[0]);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+        vgGetQueryObjectuiv(queries[0], VG_QUERY_RESULT, &samples);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+        vgEndQuery(VG_SAMPLES_PASSED);
+        vgGetQueryObjectuiv(queries[0], VG_CURRENT_QUERY, &samples);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+
+        VGuint unused = 0;
+        vgGenQueries(1, &unused);
+        vgGetQueryObjectuiv(unused, VG_QUERY_RESULT, &samples);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+
+        vgDeleteQueries(2, queries);
+        if (vgGetError() != VG_NO_ERROR || vgIsQuery(queries[0]) != VG_FALSE) return false;
+        return vgIsQuery(unused) == VG_TRUE;
+    }
+
+    bool VirtualGPUTester::ConditionalRender() {
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({0, 1, 2});
+        vgViewport(0, 0, 8, 8);
+        vgEnable(VG_DEPTH_TEST);
+        VGuint queries[2] = {0, 0};
+        vgGenQueries(2, queries);
+
+        for (bool deferred : {false, true}) {
+            if (deferred) {
+                vgEnable(VG_DEFERRED_COMMANDS);
+            }
+            // queries[0] sees no samples, queries[1] does
+            vgDepthFunc(VG_NEVER);
+            vgBeginQuery(VG_ANY_SAMPLES_PASSED, queries[0]);
+            vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+            vgEndQuery(VG_ANY_SAMPLES_PASSED);
+            vgDepthFunc(VG_ALWAYS);
+            vgBeginQuery(VG_SAMPLES_PASSED, queries[1]);
+            vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+            vgEndQuery(VG_SAMPLES_PASSED);
+            vgFinish();
+            ResetInvocationCounts();
+
+            // The whole draw is skipped
+            vgBeginConditionalRender(queries[0], VG_QUERY_WAIT);
+            vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+            vgDrawArrays(VG_TRIANGLES, 0, 3);
+            vgEndConditionalRender();
+            vgFinish();
+            if (vgGetError() != VG_NO_ERROR || fragment_shader_invocations != 0) return false;
+            for (const std::atomic<int>& count : vertex_shader_invocations) {
+                if (count != 0) return false;
+            }
+
+            vgBeginConditionalRender(queries[1], VG_QUERY_NO_WAIT);
+            vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+            vgEndConditionalRender();
+            vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+            vgFinish();
+            if (vgGetError() != VG_NO_ERROR || fragment_shader_invocations != 2 * 8 * 8) return false;
+        }
+        vgDisable(VG_DEFERRED_COMMANDS);
+
+        // Errors
+        vgBeginConditionalRender(queries[0], VG_SAMPLES_PASSED);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+        vgBeginConditionalRender(queries[1] + 1, VG_QUERY_WAIT);
+        if (vgGetError() != VG_INVALID_VALUE) return false;
+        vgEndConditionalRender();
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+        vgBeginConditionalRender(queries[0], VG_QUERY_WAIT);
+        vgBeginConditionalRender(queries[1], VG_QUERY_WAIT);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+        vgEndConditionalRender();
+
+        vgBeginQuery(VG_SAMPLES_PASSED, queries[1]);
+        vgBeginConditionalRender(queries[1], VG_QUERY_WAIT);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+        vgEndQuery(VG_SAMPLES_PASSED);
+
+        vgDeleteQueries(2, queries);
+        return vgGetError() == VG_NO_ERROR;
+    }
+
+    bool VirtualGPUTester::TimerQuery() {
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({0, 1, 2});
+        vgViewport(0, 0, 8, 8);
+        VGuint queries[3] = {0, 0, 0};
+        vgGenQueries(3, queries);
+
+        VGint bits = 0;
+        vgGetQueryiv(VG_TIMESTAMP, VG_QUERY_COUNTER_BITS, &bits);
+        if (bits != 64) return false;
+
+        for (bool deferred : {false, true}) {
+            if (deferred) {
+                vgEnable(VG_DEFERRED_COMMANDS);
+            }
+            vgQueryCounter(queries[0], VG_TIMESTAMP);
+            vgBeginQuery(VG_TIME_ELAPSED, queries[1]);
+            vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+            vgEndQuery(VG_TIME_ELAPSED);
+            vgQueryCounter(queries[2], VG_TIMESTAMP);
+
+            VGuint available = VG_TRUE;
+            vgGetQueryObjectuiv(queries[2], VG_QUERY_RESULT_AVAILABLE, &available);
+            if (available != (deferred ? VG_FALSE : VG_TRUE)) return false;
+
+            VGuint64 begin = 0;
+            VGuint64 end = 0;
+            VGint64 elapsed = 0;
+            vgGetQueryObjectui64v(queries[0], VG_QUERY_RESULT, &begin);
+            vgGetQueryObjecti64v(queries[1], VG_QUERY_RESULT, &elapsed);
+            vgGetQueryObjectui64v(queries[2], VG_QUERY_RESULT, &end);
+            if (vgGetError() != VG_NO_ERROR) return false;
+
+            // The draw ran between the timestamps
+            if (begin == 0 || elapsed <= 0 || end < begin + static_cast<VGuint64>(elapsed)) return false;
+        }
+        vgDisable(VG_DEFERRED_COMMANDS);
+
+        // Errors
+        vgQueryCounter(queries[0], VG_TIME_ELAPSED);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+        vgQueryCounter(queries[1], VG_TIMESTAMP);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+        vgBeginQuery(VG_TIME_ELAPSED, queries[0]);
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+        vgBeginQuery(VG_TIMESTAMP, queries[0]);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+
+        vgDeleteQueries(3, queries);
+        return vgGetError() == VG_NO_ERROR;
+    }
+
+    bool VirtualGPUTester::PipelineStatisticsQuery() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        // Two triangles of opposite winding, one of them is culled.
+        SetupCountingDraw({0, 1, 2, 2, 1, 0});
+        VGuint program = gpu.using_program_->id;
+        vgViewport(0, 0, 8, 8);
+        vgEnable(VG_CULL_FACE);
+        vgEnable(VG_STENCIL_TEST);
+        VGuint queries[2] = {0, 0};
+        vgGenQueries(2, queries);
+
+        for (bool tiled : {true, false}) {
+            gpu.state_.tiled_rasterization_enabled = tiled;
+
+            for (bool early : {false, true}) {
+                // Early tests reject every fragment before shading, the stencil test keeps Hi-Z out of the way.
+                vgProgramParameteri(program, VG_EARLY_FRAGMENT_TESTS, early ? VG_TRUE : VG_FALSE);
+                vgStencilFunc(early ? VG_NEVER : VG_ALWAYS, 0, 0xFF);
+
+                vgBeginQuery(VG_PIPELINE_STATISTICS, queries[0]);
+                vgBeginQuery(VG_SAMPLES_PASSED, queries[1]);
+                vgDrawElements(VG_TRIANGLES, 6, VG_UNSIGNED_SHORT, nullptr);
+                vgEndQuery(VG_SAMPLES_PASSED);
+                vgEndQuery(VG_PIPELINE_STATISTICS);
+
+                VGuint64 values[13] = {};
+                for (VGenum pname = VG_VERTICES_SHADED; pname <= VG_ROP_TIME; pname++) {
+                    vgGetQueryObjectui64v(queries[0], pname, &values[pname - VG_VERTICES_SHADED]);
+                }
+                VGuint samples = 0;
+                vgGetQueryObjectuiv(queries[1], VG_QUERY_RESULT, &samples);
+                if (vgGetError() != VG_NO_ERROR) return false;
+
+                const VGuint64 fragment_count = 8 * 8;
+                if (values[0] != 3 || values[1] != 2 || values[2] != 0 || values[3] != 1) return false;
+                if (values[4] != fragment_count) return false;
+                if (values[5] != (early ? fragment_count : 0)) return false;
+                if (values[6] != (early ? 0 : fragment_count)) return false;
+                if (values[7] != (early ? 0 : fragment_count) || values[7] != samples) return false;
+
+                VGuint64 total_time = 0;
+                for (size_t i = 8; i < 13; i++) {
+                    total_time += values[i];
+                }
+                if (total_time == 0) return false;
+            }
+        }
+
+        // Statistics are read one by one, other queries have no statistics
+        VGuint64 value = 0;
+        vgGetQueryObjectui64v(queries[0], VG_QUERY_RESULT, &value);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+        vgGetQueryObjectui64v(queries[1], VG_VERTICES_SHADED, &value);
+        if (vgGetError() != VG_INVALID_ENUM) return false;
+
+        vgDeleteQueries(2, queries);
+        return vgGetError() == VG_NO_ERROR;
+    }
+
+    bool VirtualGPUTester::VaryingLookup() {
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<uint32_t> hash_dist;
+        for (int set = 0; set < 100; set++) {
+            std::array<uint32_t, VirtualGPU::MAX_VARYING_COUNT> name_hashes;
+            std::array<VirtualGPU::VaryingDesc, VirtualGPU::MAX_VARYING_COUNT> descs;
+            for (size_t i = 0; i < name_hashes.size(); i++) {
+                name_hashes[i] = set == 0 ? static_cast<uint32_t>(i) << 27 : hash_dist(rng);
+                descs[i].size = static_cast<int>(i % 4) + 1;
+                descs[i].register_index = i * 3;
+            }
+
+            VirtualGPU::VaryingLookup lookup;
+            lookup.Build(name_hashes.data(), descs.data(), name_hashes.size());
+            if (lookup.linear_count != 0) return false;
+            for (size_t i = 0; i < name_hashes.size(); i++) {
+                const VirtualGPU::VaryingDesc* desc = lookup.Find(name_hashes[i]);
+                if (desc == nullptr || desc->size != descs[i].size) return false;
+                if (desc->register_index != descs[i].register_index) return false;
+            }
+            if (lookup.Find(name_hashes[0] ^ 0x80000000u) != nullptr) return false;
+        }
+
+        // No seed separates equal hashes, the names are scanned in order
+        const uint32_t equal_hashes[3] = {0x2001, 0x2002, 0x2001};
+        VirtualGPU::VaryingDesc equal_descs[3];
+        for (size_t i = 0; i < 3; i++) {
+            equal_descs[i].size = 2;
+            equal_descs[i].register_index = i * 2;
+        }
+        VirtualGPU::VaryingLookup linear;
+        linear.Build(equal_hashes, equal_descs, 3);
+        if (linear.linear_count != 3) return false;
+        const VirtualGPU::VaryingDesc* first = linear.Find(0x2001);
+        const VirtualGPU::VaryingDesc* second = linear.Find(0x2002);
+        if (first == nullptr || first->register_index != 0) return false;
+        if (second == nullptr || second->register_index != 2) return false;
+        if (linear.Find(0x2003) != nullptr) return false;
+
+        VirtualGPU::VaryingLookup empty;
+        empty.Build(nullptr, nullptr, 0);
+        return empty.Find(0) == nullptr && empty.Find(0x1001) == nullptr;
+    }
+
+    bool VirtualGPUTester::VaryingLayoutLink() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({});
+        VGuint p = vgCreateProgram();
+        VGuint vs = vgCreateShader(VG_VERTEX_SHADER);
+        VGuint fs = vgCreateShader(VG_FRAGMENT_SHADER);
+        vgShaderSource(vs, reinterpret_cast<void*>(VaryingsVertexShader));
+        vgShaderSource(fs, reinterpret_cast<void*>(VaryingsFragmentShader));
+        vgAttachShader(p, vs);
+        vgAttachShader(p, fs);
+        vgLinkProgram(p);
+        vgUseProgram(p);
+        vgViewport(0, 0, 8, 8);
+
+        VirtualGPU::Program* prog = gpu.using_program_;
+        if (prog->is_varying_layout_linked) return false;
+
+        // Enough vertices for several shading batches, the first one lays out the varyings.
+        for (bool tiled : {true, false}) {
+            gpu.state_.tiled_rasterization_enabled = tiled;
+            ResetInvocationCounts();
+            varying_mismatches = 0;
+            vgDrawArrays(VG_TRIANGLES, 0, 300);
+            if (vgGetError() != VG_NO_ERROR) return false;
+            if (fragment_shader_invocations != 100 * 8 * 8 || varying_mismatches != 0) return false;
+        }
+
+        if (!prog->is_varying_layout_linked) return false;
+        if (prog->smooth_varying_count != 3 || prog->flat_varying_count != 1) return false;
+        if (prog->smooth_varying_descs[1].register_index != 1 || prog->smooth_varying_descs[2].register_index != 4) {
+            return false;
+        }
+        const VirtualGPU::VaryingDesc* desc = prog->smooth_varying_lookup.Find(0x1003);
+        if (desc == nullptr || desc->size != 4 || desc->register_index != 4) return false;
+        if (prog->flat_varying_lookup.Find(0x1001) != nullptr) return false;
+
+        // Relinking lays the varyings out again
+        vgLinkProgram(p);
+        if (prog->is_varying_layout_linked || prog->smooth_varying_count != 0) return false;
+
+        return vgGetError() == VG_NO_ERROR;
+    }
+
+    bool VirtualGPUTester::UniformLookup() {
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<uint32_t> hash_dist;
+        for (size_t count : {size_t{1}, size_t{3}, size_t{17}, size_t{64}, size_t{300}}) {
+            std::unordered_map<uint32_t, size_t> name_hash_to_location;
+            while (name_hash_to_location.size() < count) {
+                name_hash_to_location.insert({hash_dist(rng), name_hash_to_location.size()});
+            }
+
+            VirtualGPU::UniformLookup lookup;
+            lookup.Build(name_hash_to_location);
+            if (lookup.name_count != count || lookup.linear_count != 0 || lookup.slots.size() < count * 4) return false;
+            for (const auto& [name_hash, location] : name_hash_to_location) {
+                if (lookup.Find(name_hash) != location) return false;
+                if (name_hash_to_location.count(name_hash ^ 1u) == 0 &&
+                    lookup.Find(name_hash ^ 1u) != VirtualGPU::UniformLookup::EMPTY_LOCATION) {
+                    return false;
+                }
+            }
+        }
+
+        VirtualGPU::UniformLookup empty;
+        empty.Build({});
+        return empty.Find(0) == VirtualGPU::UniformLookup::EMPTY_LOCATION &&
+               VirtualGPU::UniformLookup().Find(0x3001) == VirtualGPU::UniformLookup::EMPTY_LOCATION;
+    }
+
+    bool VirtualGPUTester::UniformSnapshot() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({});
+        VGuint p = vgCreateProgram();
+        VGuint vs = vgCreateShader(VG_VERTEX_SHADER);
+        VGuint fs = vgCreateShader(VG_FRAGMENT_SHADER);
+        vgShaderSource(vs, reinterpret_cast<void*>(CountingVertexShader));
+        vgShaderSource(fs, reinterpret_cast<void*>(UniformsFragmentShader));
+        vgAttachShader(p, vs);
+        vgAttachShader(p, fs);
+        vgLinkProgram(p);
+        vgUseProgram(p);
+        vgViewport(0, 0, 8, 8);
+
+        // Enough names to grow the lookup past its first size
+        const uint32_t NAME_COUNT = 40;
+        for (uint32_t i = 0; i < NAME_COUNT; i++) {
+            vgUniform1i(vgGetUniformLocation(p, 0x4000u + i), static_cast<VGint>(i));
+        }
+        const float colors[8] = {1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f};
+        vgUniform4fv(vgGetUniformLocation(p, 0x3001u), 2, colors);
+        const VGint scale = vgGetUniformLocation(p, 0x3002u);
+        vgUniform1f(scale, 0.5f);
+        expected_uniform_scale = 0.5f;
+
+        for (bool tiled : {true, false}) {
+            gpu.state_.tiled_rasterization_enabled = tiled;
+            ResetInvocationCounts();
+            uniform_mismatches = 0;
+            vgDrawArrays(VG_TRIANGLES, 0, 3);
+            if (vgGetError() != VG_NO_ERROR) return false;
+            if (fragment_shader_invocations != 8 * 8 || uniform_mismatches != 0) return false;
+        }
+
+        // Uniform calls after the draw do not reach its snapshot
+        vgUniform1f(scale, 2.f);
+        const UniformRef ref = gpu.uniform_snapshot_.refs[static_cast<size_t>(scale)];
+        float frozen = 0.f;
+        std::memcpy(&frozen, ref.data, sizeof(float));
+        if (frozen != 0.5f || ref.count != 1 || ref.stride != sizeof(float)) return false;
+        for (const UniformRef& r : gpu.uniform_snapshot_.refs) {
+            if (reinterpret_cast<uintptr_t>(r.data) % 16 != 0) return false;
+        }
+        for (uint32_t i = 0; i < NAME_COUNT; i++) {
+            const UniformRef r = GetSnapshotUniform(0x4000u + i);
+            int32_t value = -1;
+            std::memcpy(&value, r.data, sizeof(int32_t));
+            if (r.count != 1 || value != static_cast<int32_t>(i)) return false;
+        }
+
+        // Names located after a draw are found by the next one
+        vgUniform1f(vgGetUniformLocation(p, 0x3003u), 1.f);
+        expected_uniform_scale = 2.f;
+        ResetInvocationCounts();
+        uniform_mismatches = 0;
+        vgDrawArrays(VG_TRIANGLES, 0, 3);
+        if (fragment_shader_invocations != 8 * 8 || uniform_mismatches != 0) return false;
+        if (GetSnapshotUniform(0x3003u).count != 1) return false;
+
+        // Relinking forgets the names
+        vgLinkProgram(p);
+        if (gpu.using_program_->uniform_lookup.Find(0x3001u) != VirtualGPU::UniformLookup::EMPTY_LOCATION) {
+            return false;
+        }
+
+        return vgGetError() == VG_NO_ERROR;
+    }
+
+    bool VirtualGPUTester::AttributeFetchers() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        struct Vertex {
+            uint8_t color[4];
+            int16_t offset[2];
+            uint16_t normal[3];
+            uint16_t padding;
+            float weight;
+        };
+        std::array<Vertex, 3> vertices;
+        for (size_t i = 0; i < vertices.size(); i++) {
+            const float f = static_cast<float>(i);
+            Vertex& v = vertices[i];
+            v.color[0] = static_cast<uint8_t>(i * 51);
+            v.color[1] = 255;
+            v.color[2] = 0;
+            v.color[3] = 102;
+            v.offset[0] = static_cast<int16_t>(-7 * static_cast<int>(i));
+            v.offset[1] = 3;
+            v.padding = 0;
+            v.weight = 0.5f + f;
+            v.normal[0] = vg::FloatToHalf(f);
+            v.normal[1] = vg::FloatToHalf(-0.5f);
+            v.normal[2] = vg::FloatToHalf(2.f * f);
+        }
+
+        VGuint vao = 0;
+        vgGenVertexArrays(1, &vao);
+        vgBindVertexArray(vao);
+        VGuint vbo = 0;
+        vgGenBuffers(1, &vbo);
+        vgBindBuffer(VG_ARRAY_BUFFER, vbo);
+        vgBufferData(VG_ARRAY_BUFFER, sizeof(vertices), vertices.data(), VG_STATIC_DRAW);
+        const VGsizei stride = sizeof(Vertex);
+        const auto member = [](size_t offset) { return reinterpret_cast<const void*>(offset); };
+        vgVertexAttribPointer(0, 4, VG_UNSIGNED_BYTE, VG_TRUE, stride, member(offsetof(Vertex, color)));
+        vgVertexAttribPointer(1, 2, VG_SHORT, VG_FALSE, stride, member(offsetof(Vertex, offset)));
+        vgVertexAttribPointer(2, 3, VG_HALF_FLOAT, VG_FALSE, stride, member(offsetof(Vertex, normal)));
+        vgVertexAttribPointer(3, 1, VG_FLOAT, VG_FALSE, stride, member(offsetof(Vertex, weight)));
+        for (VGuint location = 0; location < 4; location++) {
+            vgEnableVertexAttribArray(location);
+        }
+        vgVertexAttrib4d(5, 1.0, 2.0, 3.0, 4.0);
+        // Disabled attributes read the constant of their location
+        vgVertexAttribPointer(6, 4, VG_FLOAT, VG_FALSE, 0, nullptr);
+        vgVertexAttrib2f(6, 8.f, 9.f);
+        if (vgGetError() != VG_NO_ERROR) return false;
+
+        gpu.CompileAttributeFetchers();
+        if (gpu.attribute_fetchers_.size() != 7) return false;
+
+        std::array<Vector4, 8> expected[3];
+        for (size_t i = 0; i < vertices.size(); i++) {
+            const float f = static_cast<float>(i);
+            expected[i][0] = Vector4(static_cast<float>(i * 51) / 255.f, 1.f, 0.f, 0.4f);
+            expected[i][1] = Vector4(-7.f * f, 3.f, 0.f, 1.f);
+            expected[i][2] = Vector4(f, -0.5f, 2.f * f, 1.f);
+            expected[i][3] = Vector4(0.5f + f, 0.f, 0.f, 1.f);
+            expected[i][4] = Vector4(0.f, 0.f, 0.f, 0.f);
+            expected[i][5] = Vector4(1.f, 2.f, 3.f, 4.f);
+            expected[i][6] = Vector4(8.f, 9.f, 0.f, 1.f);
+            expected[i][7] = Vector4(0.f, 0.f, 0.f, 0.f);
+        }
+
+        const size_t vertex_indices[3] = {2, 0, 1};
+        for (size_t location = 0; location < 8; location++) {
+            const VirtualGPU::AttributeFetcher& fetcher = location < gpu.attribute_fetchers_.size()
+                                                              ? gpu.attribute_fetchers_[location]
+                                                              : VirtualGPU::ZERO_ATTRIBUTE_FETCHER;
+            for (size_t i = 0; i < vertices.size(); i++) {
+                float comps[4];
+                fetcher.fetch(fetcher.base + fetcher.stride * i, comps);
+                if (!Vector4(comps[0], comps[1], comps[2], comps[3]).IsEqualApprox(expected[i][location])) {
+                    return false;
+                }
+            }
+
+            // Structure of arrays
+            float x[3], y[3], z[3], w[3];
+            float* const components[4] = {x, y, z, w};
+            fetcher.fetch_batch(fetcher.base, fetcher.stride, vertex_indices, 3, components);
+            for (size_t i = 0; i < 3; i++) {
+                if (!Vector4(x[i], y[i], z[i], w[i]).IsEqualApprox(expected[vertex_indices[i]][location])) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool VirtualGPUTester::WideVertexShader() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        // The triangles reference the vertices back to front, so the batches gather scattered vertex indices.
+        std::vector<uint16_t> indices;
+        for (uint16_t i = 0; i < 150; i++) {
+            const uint16_t first = static_cast<uint16_t>((149 - i) * 3);
+            indices.insert(indices.end(), {first, static_cast<uint16_t>(first + 1), static_cast<uint16_t>(first + 2)});
+        }
+        SetupCountingDraw(indices);
+        VGuint p = vgCreateProgram();
+        VGuint vs = vgCreateShader(VG_VERTEX_SHADER);
+        VGuint fs = vgCreateShader(VG_FRAGMENT_SHADER);
+        vgShaderSource(vs, reinterpret_cast<void*>(VaryingsVertexShader));
+        vgShaderSourceWide(vs, reinterpret_cast<void*>(VaryingsWideVertexShader));
+        vgShaderSource(fs, reinterpret_cast<void*>(VaryingsFragmentShader));
+        if (vgGetError() != VG_NO_ERROR) return false;
+        vgShaderSourceWide(p, reinterpret_cast<void*>(VaryingsWideVertexShader));
+        if (vgGetError() != VG_INVALID_OPERATION) return false;
+        vgShaderSourceWide(100000, reinterpret_cast<void*>(VaryingsWideVertexShader));
+        if (vgGetError() != VG_INVALID_VALUE) return false;
+        vgAttachShader(p, vs);
+        vgAttachShader(p, fs);
+        vgLinkProgram(p);
+        vgUseProgram(p);
+        vgViewport(0, 0, 8, 8);
+
+        // Every vertex is shaded exactly once, whether it lands in a full batch or the padded last one.
+        for (bool tiled : {true, false}) {
+            gpu.state_.tiled_rasterization_enabled = tiled;
+            for (bool is_indexed : {false, true}) {
+                ResetInvocationCounts();
+                wide_vertex_shader_batches = 0;
+                varying_mismatches = 0;
+                if (is_indexed) {
+                    vgDrawElements(VG_TRIANGLES, static_cast<VGsizei>(indices.size()), VG_UNSIGNED_SHORT, nullptr);
+                } else {
+                    vgDrawArrays(VG_TRIANGLES, 0, 301);
+                }
+                if (vgGetError() != VG_NO_ERROR) return false;
+                const int triangle_count = is_indexed ? 150 : 100;
+                if (fragment_shader_invocations != triangle_count * 8 * 8 || varying_mismatches != 0) return false;
+                if (wide_vertex_shader_batches == 0) return false;
+
+                const size_t vertex_count = is_indexed ? 450 : 301;
+                for (size_t i = 0; i < vertex_shader_invocations.size(); i++) {
+                    if (vertex_shader_invocations[i] != (i < vertex_count ? 1 : 0)) return false;
+                }
+            }
+        }
+
+        // Without a wide shader, the scalar one shades every vertex.
+        vgShaderSourceWide(vs, nullptr);
+        ResetInvocationCounts();
+        wide_vertex_shader_batches = 0;
+        vgDrawArrays(VG_TRIANGLES, 0, 30);
+        if (vgGetError() != VG_NO_ERROR) return false;
+        if (wide_vertex_shader_batches != 0 || fragment_shader_invocations != 10 * 8 * 8) return false;
+        for (size_t i = 0; i < 30; i++) {
+            if (vertex_shader_invocations[i] != 1) return false;
+        }
+
+        return vgGetError() == VG_NO_ERROR;
+    }
+
+    bool VirtualGPUTester::QuadFragmentShader() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({});
+        VGuint p = vgCreateProgram();
+        VGuint vs = vgCreateShader(VG_VERTEX_SHADER);
+        VGuint fs = vgCreateShader(VG_FRAGMENT_SHADER);
+        vgShaderSource(vs, reinterpret_cast<void*>(HalfViewportVertexShader));
+        vgShaderSource(fs, reinterpret_cast<void*>(CountingWhiteFragmentShader));
+        vgAttachShader(p, vs);
+        vgAttachShader(p, fs);
+        vgLinkProgram(p);
+        vgUseProgram(p);
+        vgViewport(0, 0, 16, 16);
+
+        const VirtualGPU::Attachment& attch = gpu.bound_draw_frame_buffer_->color_attachments[0];
+        const size_t buffer_size = static_cast<size_t>(attch.width * attch.height * 4);
+        for (bool tiled : {true, false}) {
+            gpu.state_.tiled_rasterization_enabled = tiled;
+
+            // Reference image of the per fragment shader
+            vgShaderSourceWide(fs, nullptr);
+            std::fill_n(attch.external_memory, buffer_size, uint8_t{0});
+            ResetInvocationCounts();
+            vgDrawArrays(VG_TRIANGLES, 0, 3);
+            vgFinish();
+            const std::vector<uint8_t> expected(attch.external_memory, attch.external_memory + buffer_size);
+            const int fragment_count = fragment_shader_invocations;
+            if (fragment_count == 0) return false;
+
+            // The diagonal edge cuts quads, their outside lanes are helpers.
+            vgShaderSourceWide(fs, reinterpret_cast<void*>(DerivativesQuadFragmentShader));
+            std::fill_n(attch.external_memory, buffer_size, uint8_t{0});
+            ResetInvocationCounts();
+            helper_lanes = 0;
+            derivative_mismatches = 0;
+            vgDrawArrays(VG_TRIANGLES, 0, 3);
+            vgFinish();
+            if (vgGetError() != VG_NO_ERROR) return false;
+            if (fragment_shader_invocations != fragment_count || helper_lanes == 0 || derivative_mismatches != 0) {
+                return false;
+            }
+            if (!std::equal(expected.begin(), expected.end(), attch.external_memory)) return false;
+        }
+
+        // Quad derivatives of a value
+        const float values[VirtualGPU::FragmentQuad::LANE_COUNT] = {1.f, 3.f, 7.f, 15.f};
+        if (VirtualGPU::FragmentQuad::Dx(values, 0) != 2.f || VirtualGPU::FragmentQuad::Dx(values, 3) != 8.f) {
+            return false;
+        }
+        if (VirtualGPU::FragmentQuad::Dy(values, 0) != 6.f || VirtualGPU::FragmentQuad::Dy(values, 1) != 12.f) {
+            return false;
+        }
+
+        return vgGetError() == VG_NO_ERROR;
+    }
+
+    bool VirtualGPUTester::ClipOutcodesAndGuardBand() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        if (gpu.ComputeOutcode(Vector4(0.5_r, -0.5_r, 0.0_r, 1.0_r)) != 0) return false;
+        if (gpu.ComputeOutcode(Vector4(2.0_r, 0.0_r, -3.0_r, 1.0_r)) !=
+            ((1u << VirtualGPU::VG_PLANE_POS_RIGHT) | (1u << VirtualGPU::VG_PLANE_POS_NEAR))) {
+            return false;
+        }
+
+        // viewport is 128x64
+        const Color128 white(1.f, 1.f, 1.f, 1.f);
+        VirtualGPU::Varying v0, v1, v2;
+        PopulateClipVarying(v0, Vector4(-0.5_r, -0.5_r, 0.0_r, 1.0_r), white);
+        PopulateClipVarying(v2, Vector4(-0.5_r, 0.5_r, 0.0_r, 1.0_r), white);
+        gpu.state_.cull_enabled = false;
+        std::vector<VirtualGPU::RasterPrimitive> prims;
+
+        // Crossing the right plane inside the guard band, not clipped
+        PopulateClipVarying(v1, Vector4(3.0_r, -0.5_r, 0.0_r, 1.0_r), white);
+        if (!gpu.SetupPrimitive({&v0, &v1, &v2}, prims) || prims.size() != 1u) return false;
+        if (!math::IsEqualApprox(prims[0].vertices[1].viewport_coord.x, 256.0_r)) return false;
+
+        // Beyond the guard band, clipped to a quad in the viewport
+        prims.clear();
+        PopulateClipVarying(v1, Vector4(20.0_r, -0.5_r, 0.0_r, 1.0_r), white);
+        if (!gpu.SetupPrimitive({&v0, &v1, &v2}, prims) || prims.size() != 2u) return false;
+        for (const VirtualGPU::RasterPrimitive& prim : prims) {
+            for (size_t i = 0; i < 3; i++) {
+                if (prim.vertices[i].viewport_coord.x > 128.0_r + math::EPSILON_POINT_ON_PLANE) return false;
+            }
+        }
+
+        // Crossing the near plane, clipped
+        prims.clear();
+        PopulateClipVarying(v1, Vector4(3.0_r, -0.5_r, -3.0_r, 1.0_r), white);
+        if (!gpu.SetupPrimitive({&v0, &v1, &v2}, prims) || prims.size() != 2u) return false;
+
+        // Outlines are clipped, their edges end at the viewport
+        prims.clear();
+        gpu.state_.polygon_mode = VG_LINE;
+        PopulateClipVarying(v1, Vector4(3.0_r, -0.5_r, 0.0_r, 1.0_r), white);
+        if (!gpu.SetupPrimitive({&v0, &v1, &v2}, prims) || prims.size() != 4u) return false;
+        gpu.state_.polygon_mode = VG_FILL;
+
+        // Outside of one plane, rejected
+        prims.clear();
+        PopulateClipVarying(v0, Vector4(1.5_r, -0.5_r, 0.0_r, 1.0_r), white);
+        PopulateClipVarying(v2, Vector4(1.5_r, 0.5_r, 0.0_r, 1.0_r), white);
+        if (gpu.SetupPrimitive({&v0, &v1, &v2}, prims) || !prims.empty()) return false;
+
+        // A guard band triangle covering the viewport draws nothing outside of it.
+        SetupCountingDraw({});
+        VGuint p = vgCreateProgram();
+        VGuint vs = vgCreateShader(VG_VERTEX_SHADER);
+        VGuint fs = vgCreateShader(VG_FRAGMENT_SHADER);
+        vgShaderSource(vs, reinterpret_cast<void*>(CountingVertexShader));
+        vgShaderSource(fs, reinterpret_cast<void*>(CountingWhiteFragmentShader));
+        vgAttachShader(p, vs);
+        vgAttachShader(p, fs);
+        vgLinkProgram(p);
+        vgUseProgram(p);
+        vgViewport(8, 8, 16, 16);
+
+        const VirtualGPU::Attachment& attch = gpu.bound_draw_frame_buffer_->color_attachments[0];
+        for (bool tiled : {true, false}) {
+            gpu.state_.tiled_rasterization_enabled = tiled;
+            std::fill_n(attch.external_memory, static_cast<size_t>(attch.width * attch.height * 4), uint8_t{0});
+            ResetInvocationCounts();
+            vgDrawArrays(VG_TRIANGLES, 0, 3);
+            vgFinish();
+            if (vgGetError() != VG_NO_ERROR || fragment_shader_invocations != 16 * 16) return false;
+            for (int y = 0; y < attch.height; y++) {
+                for (int x = 0; x < attch.width; x++) {
+                    const uint8_t* pixel = attch.external_memory + static_cast<size_t>((y * attch.width + x) * 4);
+                    const bool inside = x >= 8 && x < 24 && y >= 8 && y < 24;
+                    if (pixel[0] != (inside ? 255 : 0)) return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool VirtualGPUTester::RasterizeWatertight() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        gpu.state_.cull_enabled = false;
+        gpu.state_.depth_test_enabled = false;
+        gpu.state_.scissor_test_enabled = false;
+
+        // A 12x6 grid mesh over [4.3, 100.7] x [3.1, 60.9]. Inner vertices are jittered, some of them onto pixel
+        // centers and pixel center lines, so that edges pass exactly through pixel centers.
+        const int columns = 12;
+        const int rows = 6;
+        const real x0 = 4.3_r;
+        const real y0 = 3.1_r;
+        const real x1 = 100.7_r;
+        const real y1 = 60.9_r;
+
+        uint32_t seed = 777u;
+        const auto Jitter = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<real>(static_cast<int>(seed >> 28) - 8) * 0.2_r;
+        };
+
+        std::vector<Vector3> grid;
+        for (int j = 0; j <= rows; j++) {
+            for (int i = 0; i <= columns; i++) {
+                Vector3 p(x0 + (x1 - x0) * static_cast<real>(i) / static_cast<real>(columns),
+                          y0 + (y1 - y0) * static_cast<real>(j) / static_cast<real>(rows), 0.5_r);
+                if (i != 0 && j != 0 && i != columns && j != rows) {
+                    if ((i + j) % 3 == 0) {
+                        p.x = math::Floor(p.x) + 0.5_r;
+                        p.y = math::Floor(p.y) + 0.5_r;
+                    } else if ((i + j) % 3 == 1) {
+                        p.x = math::Floor(p.x) + 0.5_r + Jitter();
+                        p.y += Jitter();
+                    } else {
+                        p.x += Jitter();
+                        p.y += Jitter();
+                    }
+                }
+                grid.push_back(p);
+            }
+        }
+
+        const auto Vertex = [&grid](int i, int j) { return grid[static_cast<size_t>(j * (columns + 1) + i)]; };
+
+        for (const bool use_block : {false, true}) {
+            gpu.coverage_row_func_ = use_block ? vg::GetCoverageRowFunc(vg::DetectSimdLevel()) : nullptr;
+
+            std::vector<int> coverage(128 * 64, 0);
+            const auto Draw = [&](const Vector3& a, const Vector3& b, const Vector3& c) {
+                VirtualGPU::Varying va, vb, vc;
+                PopulateVarying(va, 1.0f, 10.0f);
+                PopulateVarying(vb, 2.0f, 20.0f);
+                PopulateVarying(vc, 3.0f, 30.0f);
+                va.viewport_coord = a;
+                vb.viewport_coord = b;
+                vc.viewport_coord = c;
+                va.vg_Position.w = vb.vg_Position.w = vc.vg_Position.w = 1.0_r;
+                for (const auto& f : gpu.Rasterize(va, vb, vc)) {
+                    const int px = static_cast<int>(math::Floor(f.screen_coord.x));
+                    const int py = static_cast<int>(math::Floor(f.screen_coord.y));
+                    coverage[static_cast<size_t>(py * 128 + px)]++;
+                }
+            };
+
+            // alternating diagonals and windings
+            for (int j = 0; j < rows; j++) {
+                for (int i = 0; i < columns; i++) {
+                    const Vector3 a = Vertex(i, j);
+                    const Vector3 b = Vertex(i + 1, j);
+                    const Vector3 c = Vertex(i + 1, j + 1);
+                    const Vector3 d = Vertex(i, j + 1);
+                    if ((i + j) % 2 == 0) {
+                        Draw(a, b, c);
+                        Draw(a, d, c);
+                    } else {
+                        Draw(a, b, d);
+                        Draw(b, c, d);
+                    }
+                }
+            }
+
+            // Every pixel center inside the outer rectangle is covered exactly once.
+            for (int py = 0; py < 64; py++) {
+                for (int px = 0; px < 128; px++) {
+                    const real cx = static_cast<real>(px) + 0.5_r;
+                    const real cy = static_cast<real>(py) + 0.5_r;
+                    const int expected = cx > x0 && cx < x1 && cy > y0 && cy < y1 ? 1 : 0;
+                    if (coverage[static_cast<size_t>(py * 128 + px)] != expected) return false;
+                }
+            }
+        }
+
+        // A pixel center on an edge belongs to the top and left edges only, for both windings.
+        const Vector3 square[4] = {Vector3(2.5_r, 2.5_r, 0.5_r), Vector3(6.5_r, 2.5_r, 0.5_r),
+                                   Vector3(6.5_r, 6.5_r, 0.5_r), Vector3(2.5_r, 6.5_r, 0.5_r)};
+        for (const bool flip : {false, true}) {
+            VirtualGPU::Varying va, vb, vc;
+            PopulateVarying(va, 1.0f, 10.0f);
+            PopulateVarying(vb, 2.0f, 20.0f);
+            PopulateVarying(vc, 3.0f, 30.0f);
+            va.viewport_coord = square[0];
+            vb.viewport_coord = flip ? square[3] : square[1];
+            vc.viewport_coord = flip ? square[1] : square[3];
+            va.vg_Position.w = vb.vg_Position.w = vc.vg_Position.w = 1.0_r;
+
+            // covers (2..5, 2) on the top edge and (2, 3..5) on the left edge, not the diagonal
+            const auto out = gpu.Rasterize(va, vb, vc);
+            if (out.size() != 10u) return false;
+            for (const auto& f : out) {
+                const int px = static_cast<int>(math::Floor(f.screen_coord.x));
+                const int py = static_cast<int>(math::Floor(f.screen_coord.y));
+                if (px < 2 || py < 2 || px + py >= 8) return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool VirtualGPUTester::RasterizeStreamsFragmentChunks() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        gpu.state_.cull_enabled = false;
+        gpu.state_.depth_test_enabled = false;
+        gpu.state_.scissor_test_enabled = false;
+
+        VirtualGPU::Varying v0, v1, v2;
+        const Color128 white(1.f, 1.f, 1.f, 1.f);
+        PopulateClipVarying(v0, Vector4(0.0_r, 0.0_r, 0.0_r, 1.0_r), white);
+        PopulateClipVarying(v1, Vector4(0.0_r, 0.0_r, 0.0_r, 1.0_r), white);
+        PopulateClipVarying(v2, Vector4(0.0_r, 0.0_r, 0.0_r, 1.0_r), white);
+        v0.viewport_coord = Vector3(1.3_r, 2.7_r, 0.5_r);
+        v1.viewport_coord = Vector3(125.1_r, 9.4_r, 0.5_r);
+        v2.viewport_coord = Vector3(30.8_r, 61.2_r, 0.5_r);
+
+        const VirtualGPU::Rect region = {0, 0, 128, 64};
+        const VirtualGPU::Attachment& attch = gpu.bound_draw_frame_buffer_->color_attachments[0];
+        auto chunk = std::make_unique<VirtualGPU::FragmentChunk>();
+        chunk->fs = CountingFragmentShader;
+
+        for (const bool use_block : {false, true}) {
+            gpu.coverage_row_func_ = use_block ? vg::GetCoverageRowFunc(vg::DetectSimdLevel()) : nullptr;
+            const std::vector<VirtualGPU::Fragment> collected = gpu.Rasterize(v0, v1, v2, region);
+            if (collected.size() <= 4 * VirtualGPU::FragmentChunk::CAPACITY) return false;
+
+            gpu.ClearColorAttachment(0, Color128(0.f, 0.f, 0.f, 0.f));
+            fragment_shader_invocations = 0;
+
+            // Full chunks are shaded while rasterizing, the rest by the last flush.
+            gpu.Rasterize(v0, v1, v2, region, nullptr, *chunk);
+            if (chunk->size == 0 || chunk->size > VirtualGPU::FragmentChunk::CAPACITY) return false;
+            if (static_cast<size_t>(fragment_shader_invocations) + chunk->size != collected.size()) return false;
+
+            gpu.FlushFragments(*chunk);
+            if (chunk->size != 0) return false;
+            if (static_cast<size_t>(fragment_shader_invocations) != collected.size()) return false;
+
+            // The shaded pixels are the collected ones.
+            size_t written = 0;
+            for (size_t i = 0; i < static_cast<size_t>(attch.width * attch.height); i++) {
+                written += attch.external_memory[i * 4] == 255 ? 1u : 0u;
+            }
+            if (written != collected.size()) return false;
+            for (const VirtualGPU::Fragment& f : collected) {
+                const size_t x = static_cast<size_t>(f.screen_coord.x);
+                const size_t y = static_cast<size_t>(f.screen_coord.y);
+                if (attch.external_memory[(y * static_cast<size_t>(attch.width) + x) * 4] != 255) return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool VirtualGPUTester::LinkSetsVaryingStride() {
+        // A program that writes only vg_Position keeps only positions.
+        VirtualGPU::Program position_only;
+        VirtualGPU::LinkVaryingLayout(position_only);
+        if (position_only.varying_stride != VirtualGPU::VARYING_POSITION_SIZE) return false;
+
+        VirtualGPU::Program prog;
+        prog.smooth_varying_name_hashes[0] = 1;
+        prog.smooth_varying_descs[0].size = 2;
+        prog.smooth_varying_descs[0].register_index = 0;
+        prog.smooth_varying_name_hashes[1] = 2;
+        prog.smooth_varying_descs[1].size = 3;
+        prog.smooth_varying_descs[1].register_index = 2;
+        prog.smooth_varying_count = 2;
+        prog.flat_varying_name_hashes[0] = 3;
+        prog.flat_varying_descs[0].size = 1;
+        prog.flat_varying_descs[0].register_index = 0;
+        prog.flat_varying_count = 1;
+        VirtualGPU::LinkVaryingLayout(prog);
+        if (prog.smooth_register_size != 5 || prog.flat_register_size != 1) return false;
+        if (prog.varying_stride != VirtualGPU::VARYING_POSITION_SIZE + 6) return false;
+
+        VirtualGPU::Varying v;
+        v.vg_Position = Vector4(1.0_r, 2.0_r, 3.0_r, 4.0_r);
+        v.used_smooth_register_size = 5;
+        v.used_flat_register_size = 1;
+        for (size_t i = 0; i < 5; i++) {
+            v.smooth_register[i] = static_cast<float>(10 + i);
+        }
+        v.flat_register[0] = 20.f;
+
+        std::vector<float> record(prog.varying_stride);
+        VirtualGPU::PackVarying(v, prog, record.data());
+        const std::vector<float> expected = {1.f, 2.f, 3.f, 4.f, 10.f, 11.f, 12.f, 13.f, 14.f, 20.f};
+        if (record != expected) return false;
+
+        VirtualGPU::Varying out;
+        VirtualGPU::UnpackVarying(record.data(), prog, out);
+        if (out.used_smooth_register_size != 5 || out.used_flat_register_size != 1) return false;
+        if (out.vg_Position.x != 1.0_r || out.vg_Position.w != 4.0_r) return false;
+        for (size_t i = 0; i < 5; i++) {
+            if (out.smooth_register[i] != v.smooth_register[i]) return false;
+        }
+        if (out.flat_register[0] != 20.f) return false;
+
+        // Binned triangles keep the varying records and the used part of the gradient only
+        VirtualGPU::RasterPrimitive prim;
+        prim.vertex_count = 3;
+        for (size_t i = 0; i < 3; i++) {
+            prim.vertices[i] = v;
+            prim.vertices[i].viewport_coord = Vector3(static_cast<real>(i), 5.0_r, 0.5_r);
+        }
+        for (size_t i = 0; i < 5; i++) {
+            prim.smooth_gradient.dx[i] = static_cast<float>(i);
+            prim.smooth_gradient.dy[i] = -static_cast<float>(i);
+        }
+        prim.smooth_gradient.inv_w_dx = 0.25_r;
+        prim.smooth_gradient.inv_w_dy = 0.75_r;
+
+        std::vector<float> records;
+        VirtualGPU::PackRasterPrimitive(prim, prog, records);
+        if (records.size() != 3 * (VirtualGPU::RASTER_VIEWPORT_COORD_SIZE + prog.varying_stride) + 2 + 2 * 5) {
+            return false;
+        }
+        VirtualGPU::RasterPrimitive unpacked;
+        VirtualGPU::UnpackRasterPrimitive(records.data(), 3, prog, unpacked);
+        if (unpacked.vertex_count != 3 || unpacked.vertices[2].viewport_coord.x != 2.0_r) return false;
+        if (unpacked.vertices[2].flat_register[0] != 20.f || unpacked.vertices[1].smooth_register[4] != 14.f) {
+            return false;
+        }
+        if (unpacked.smooth_gradient.inv_w_dx != 0.25_r || unpacked.smooth_gradient.inv_w_dy != 0.75_r) return false;
+        return unpacked.smooth_gradient.dx[4] == 4.f && unpacked.smooth_gradient.dy[4] == -4.f;
+    }
+
+    bool VirtualGPUTester::DepthOnlyDrawSkipsShading() {
+        VirtualGPU& gpu = VirtualGPU::GetInstance();
+        if (!InitFreshGPU()) {
+            return false;
+        }
+
+        SetupCountingDraw({0, 1, 2});
+        vgEnable(VG_DEPTH_TEST);
+        VGuint query = 0;
+        vgGenQueries(1, &query);
+
+        const VirtualGPU::Attachment& color = gpu.bound_draw_frame_buffer_->color_attachments[0];
+        const VirtualGPU::Attachment& ds = gpu.bound_draw_frame_buffer_->depth_stencil_attachment;
+        for (bool tiled : {true, false}) {
+            gpu.state_.tiled_rasterization_enabled = tiled;
+            vgDrawBuffer(VG_BACK);
+            vgDepthFunc(VG_LESS);
+            vgClearColor(0.f, 0.f, 0.f, 0.f);
+            vgClearDepth(1.0);
+            vgViewport(0, 0, ds.width, ds.height);
+            vgClear(VG_COLOR_BUFFER_BIT | VG_DEPTH_BUFFER_BIT);
+            vgViewport(0, 0, 8, 8);
+
+            // Nothing reaches a color attachment, the triangle only writes depth
+            vgDrawBuffer(VG_NONE);
+            ResetInvocationCounts();
+            vgBeginQuery(VG_SAMPLES_PASSED, query);
+            vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+            vgEndQuery(VG_SAMPLES_PASSED);
+            VGuint samples = 0;
+            vgGetQueryObjectuiv(query, VG_QUERY_RESULT, &samples);
+            if (vgGetError() != VG_NO_ERROR || !gpu.is_depth_only_draw_) return false;
+            if (fragment_shader_invocations != 0 || samples != 8 * 8) return false;
+
+            for (int y = 0; y < ds.height; y++) {
+                for (int x = 0; x < ds.width; x++) {
+                    const size_t pixel = static_cast<size_t>(y * ds.width + x);
+                    real depth = 0.0_r;
+                    uint8_t stencil = 0;
+                    vg::DecodeDepthStencil(&depth, &stencil, ds.memory->data() + ds.offset + pixel * 4);
+                    const real expected = x < 8 && y < 8 ? 0.5_r : 1.0_r;
+                    if (math::Abs(depth - expected) > 1e-4_r) return false;
+
+                    const uint8_t* p = color.external_memory + pixel * 4;
+                    if (p[0] != 0 || p[1] != 0 || p[2] != 0 || p[3] != 0) return false;
+                }
+            }
+
+            // A color draw at the same depth passes where the depth only draw wrote
+            vgDrawBuffer(VG_BACK);
+            vgDepthFunc(VG_EQUAL);
+            ResetInvocationCounts();
+            vgDrawElements(VG_TRIANGLES, 3, VG_UNSIGNED_SHORT, nullptr);
+            vgFinish();
+            if (gpu.is_depth_only_draw_ || fragment_shader_invocations != 8 * 8) return false;
+        }
+
+        return vgGetError() == VG_NO_ERROR;
+    }
+
+}  // namespace ho
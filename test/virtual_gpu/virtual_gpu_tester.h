@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstring>
+
 #include "virtual_gpu/virtual_gpu.h"
 
 namespace ho {
@@ -13,9 +15,11 @@ namespace ho {
         static bool VaryingOut();
         static bool FragmentIn();
         static bool FSOutputOut();
+        static bool FragmentInDerivative();
 
         static bool GetColorLock();
         static bool GetDepthLock();
+        static bool PrepareLockTablesSizedToAttachments();
 
         static bool ClearColorAttachmentFullViewport();
         static bool ClearColorAttachmentPartialViewport();
@@ -171,6 +175,55 @@ namespace ho {
         static bool RasterizeTriangleDegeneratedInPoint();
         static bool RasterizeTriangleEarlyDepthFailed();
         static bool RasterizeTriangleEarlyStencilFailed();
+        static bool RasterizeTriangleRegion();
+        static bool CoverageRowMatchesPortable();
+        static bool RasterizeTriangleBlockMatchesReference();
+        static bool HiZClearAndResolve();
+        static bool HiZRejectsOccludedBlocks();
+
+        static bool SetupPrimitiveTriangle();
+        static bool SetupPrimitiveCulled();
+        static bool SetupPrimitivePolygonModeLine();
+
+        static bool GetRenderAreaViewportScissorIntersect();
+
+        static bool DrawBinnedSubmissionOrder();
+        static bool DrawBinnedRespectsScissor();
+        static bool ShadeFragmentsEarlyFragmentTests();
+
+        static bool ProgramParameteriEarlyFragmentTests();
+
+        static bool TexImage2DMipmapLevels();
+        static bool GenerateMipmapBoxFilter();
+        static bool GenerateMipmapErrors();
+
+        static bool DrawElementsShadesReferencedVertices();
+        static bool DrawRangeElementsVertexRange();
+
+        static bool AssemblePrimitivesLayout();
+        static bool DrawArraysPrimitiveBatches();
+
+        static bool InitializeWorkerCount();
+
+        static bool DeferredCommands();
+        static bool FenceSync();
+        static bool ClientWaitSyncFlushPoll();
+        static bool OcclusionQuery();
+        static bool ConditionalRender();
+        static bool TimerQuery();
+        static bool PipelineStatisticsQuery();
+        static bool VaryingLookup();
+        static bool VaryingLayoutLink();
+        static bool UniformLookup();
+        static bool UniformSnapshot();
+        static bool AttributeFetchers();
+        static bool WideVertexShader();
+        static bool QuadFragmentShader();
+        static bool ClipOutcodesAndGuardBand();
+        static bool RasterizeWatertight();
+        static bool RasterizeStreamsFragmentChunks();
+        static bool LinkSetsVaryingStride();
+        static bool DepthOnlyDrawSkipsShading();
 
        private:
         static void PopulateVarying(VirtualGPU::Varying& v, float smooth_start, float flat_val) {
@@ -186,5 +239,193 @@ namespace ho {
                 v.flat_register[i] = flat_val + static_cast<float>(i);
             }
         };
+
+        // Writes flat register 0..3 as color to draw slot 0.
+        static void FlatColorFragmentShader(const VirtualGPU::Fragment& in, VirtualGPU::FSOutputs& out) {
+            out.Out(0, Color128(in.flat_register[0], in.flat_register[1], in.flat_register[2], in.flat_register[3]));
+        }
+
+        static void CountingFragmentShader(const VirtualGPU::Fragment& in, VirtualGPU::FSOutputs& out) {
+            fragment_shader_invocations.fetch_add(1, std::memory_order_relaxed);
+            FlatColorFragmentShader(in, out);
+        }
+
+        static inline std::atomic<int> fragment_shader_invocations{0};
+
+        // Places the vertices on the corners of a triangle covering the viewport, by vertex index modulo 3, and
+        // counts the calls per vertex index.
+        static void CountingVertexShader(size_t vertex_index, VirtualGPU::Varying& out) {
+            vertex_shader_invocations[vertex_index].fetch_add(1, std::memory_order_relaxed);
+            switch (vertex_index % 3) {
+                case 0:
+                    out.vg_Position = Vector4(-1.0_r, -1.0_r, 0.0_r, 1.0_r);
+                    break;
+                case 1:
+                    out.vg_Position = Vector4(3.0_r, -1.0_r, 0.0_r, 1.0_r);
+                    break;
+                default:
+                    out.vg_Position = Vector4(-1.0_r, 3.0_r, 0.0_r, 1.0_r);
+                    break;
+            }
+        }
+
+        static inline std::array<std::atomic<int>, 512> vertex_shader_invocations;
+
+        // Writes varyings of every size, smooth and flat, on top of CountingVertexShader.
+        static void VaryingsVertexShader(size_t vertex_index, VirtualGPU::Varying& out) {
+            CountingVertexShader(vertex_index, out);
+            out.Out(0x1001, 0.25f);
+            out.OutFlat(0x2001, Vector2(1.f, 2.f));
+            out.Out(0x1002, Vector3(0.5f, 0.75f, 1.f));
+            out.Out(0x1003, Vector4(1.f, 2.f, 3.f, 4.f));
+        }
+
+        // VaryingsVertexShader of a batch, counts the shaded lanes per vertex index.
+        static void VaryingsWideVertexShader(VirtualGPU::VertexBatch& out) {
+            constexpr size_t WIDTH = VirtualGPU::VertexBatch::WIDTH;
+            wide_vertex_shader_batches.fetch_add(1, std::memory_order_relaxed);
+            float v1001[1][WIDTH];
+            float v2001[2][WIDTH];
+            float v1002[3][WIDTH];
+            float v1003[4][WIDTH];
+            for (size_t i = 0; i < WIDTH; i++) {
+                const size_t vertex_index = out.vertex_indices[i];
+                if (i < out.count) {
+                    vertex_shader_invocations[vertex_index].fetch_add(1, std::memory_order_relaxed);
+                }
+                const float corner = static_cast<float>(vertex_index % 3);
+                out.vg_Position[0][i] = corner == 1.f ? 3.f : -1.f;
+                out.vg_Position[1][i] = corner == 2.f ? 3.f : -1.f;
+                out.vg_Position[2][i] = 0.f;
+                out.vg_Position[3][i] = 1.f;
+                v1001[0][i] = 0.25f;
+                v2001[0][i] = 1.f;
+                v2001[1][i] = 2.f;
+                v1002[0][i] = 0.5f;
+                v1002[1][i] = 0.75f;
+                v1002[2][i] = 1.f;
+                for (size_t c = 0; c < 4; c++) {
+                    v1003[c][i] = static_cast<float>(c + 1);
+                }
+            }
+            out.Out(0x1003, v1003);
+            out.Out(0x1001, v1001);
+            out.OutFlat(0x2001, v2001);
+            out.Out(0x1002, v1002);
+        }
+
+        static inline std::atomic<int> wide_vertex_shader_batches{0};
+
+        // Covers the lower left half of the viewport with a varying of the clip coordinate, which is linear in screen
+        // space.
+        static void HalfViewportVertexShader(size_t vertex_index, VirtualGPU::Varying& out) {
+            const float x = vertex_index % 3 == 1 ? 1.f : -1.f;
+            const float y = vertex_index % 3 == 2 ? 1.f : -1.f;
+            out.vg_Position = Vector4(x, y, 0.f, 1.f);
+            out.Out(0x1004, Vector2(x, y));
+        }
+
+        static void CountingWhiteFragmentShader(const VirtualGPU::Fragment&, VirtualGPU::FSOutputs& out) {
+            fragment_shader_invocations.fetch_add(1, std::memory_order_relaxed);
+            out.Out(0, Color128(1.f, 1.f, 1.f, 1.f));
+        }
+
+        // CountingWhiteFragmentShader of a quad, counts the helper lanes and the lanes whose quad derivatives differ
+        // from the analytic ones.
+        static void DerivativesQuadFragmentShader(const VirtualGPU::FragmentQuad& in, VirtualGPU::FSQuadOutputs& out) {
+            Vector2 positions[VirtualGPU::FragmentQuad::LANE_COUNT];
+            in.In<Vector2>(0x1004, positions);
+            for (size_t lane = 0; lane < VirtualGPU::FragmentQuad::LANE_COUNT; lane++) {
+                if (in.IsHelper(lane)) {
+                    helper_lanes.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    fragment_shader_invocations.fetch_add(1, std::memory_order_relaxed);
+                }
+                const Vector2 dx = VirtualGPU::FragmentQuad::Dx(positions, lane);
+                const Vector2 dy = VirtualGPU::FragmentQuad::Dy(positions, lane);
+                if (!dx.IsEqualApprox(in[lane].InDx<Vector2>(0x1004)) ||
+                    !dy.IsEqualApprox(in[lane].InDy<Vector2>(0x1004))) {
+                    derivative_mismatches.fetch_add(1, std::memory_order_relaxed);
+                }
+                out.Out(lane, 0, Color128(1.f, 1.f, 1.f, 1.f));
+            }
+        }
+
+        static inline std::atomic<int> helper_lanes{0};
+        static inline std::atomic<int> derivative_mismatches{0};
+
+        // Counts the fragments that read back other values than VaryingsVertexShader wrote.
+        static void VaryingsFragmentShader(const VirtualGPU::Fragment& in, VirtualGPU::FSOutputs& out) {
+            fragment_shader_invocations.fetch_add(1, std::memory_order_relaxed);
+            const bool is_matched = math::IsEqualApprox(in.In<float>(0x1001), 0.25f) &&
+                                    in.InFlat<Vector2>(0x2001).IsEqualApprox(Vector2(1.f, 2.f)) &&
+                                    in.In<Vector3>(0x1002).IsEqualApprox(Vector3(0.5f, 0.75f, 1.f)) &&
+                                    in.In<Vector4>(0x1003).IsEqualApprox(Vector4(1.f, 2.f, 3.f, 4.f));
+            if (!is_matched) {
+                varying_mismatches.fetch_add(1, std::memory_order_relaxed);
+            }
+            out.Out(0, Color128());
+        }
+
+        static inline std::atomic<int> varying_mismatches{0};
+
+        // The uniform snapshot of the executing draw, as GetUniformRef of shader_api.h resolves it.
+        static UniformRef GetSnapshotUniform(uint32_t name_hash) {
+            const VirtualGPU& vg = VirtualGPU::GetInstance();
+            const uint32_t location = vg.using_program_->uniform_lookup.Find(name_hash);
+            return location < vg.uniform_snapshot_.refs.size() ? vg.uniform_snapshot_.refs[location] : UniformRef();
+        }
+
+        // Counts the fragments that read back other uniforms than UniformSnapshot set.
+        static void UniformsFragmentShader(const VirtualGPU::Fragment&, VirtualGPU::FSOutputs& out) {
+            fragment_shader_invocations.fetch_add(1, std::memory_order_relaxed);
+            const UniformRef colors = GetSnapshotUniform(0x3001);
+            const UniformRef scale = GetSnapshotUniform(0x3002);
+            Vector4 color;
+            float scale_value = 0.f;
+            if (colors.count == 2 && scale.count == 1) {
+                std::memcpy(&color, colors.data + colors.stride, sizeof(color));
+                std::memcpy(&scale_value, scale.data, sizeof(scale_value));
+            }
+            if (!color.IsEqualApprox(Vector4(5.f, 6.f, 7.f, 8.f)) || scale_value != expected_uniform_scale) {
+                uniform_mismatches.fetch_add(1, std::memory_order_relaxed);
+            }
+            out.Out(0, Color128());
+        }
+
+        static inline std::atomic<int> uniform_mismatches{0};
+        static inline float expected_uniform_scale = 0.f;
+
+        // Binds a program of CountingVertexShader and CountingFragmentShader and a vertex array of 512 vertices
+        // with 'indices' as its element buffer.
+        static void SetupCountingDraw(const std::vector<uint16_t>& indices);
+        static void ResetInvocationCounts();
+
+        static void PopulateClipVarying(VirtualGPU::Varying& v, const Vector4& clip_coord, const Color128& color) {
+            v.vg_Position = clip_coord;
+            v.used_smooth_register_size = 0;
+            v.used_flat_register_size = 4;
+            v.flat_register[0] = color.r;
+            v.flat_register[1] = color.g;
+            v.flat_register[2] = color.b;
+            v.flat_register[3] = color.a;
+        }
+
+        // Links 'prog' to the layout of 'varyings', packs them into its varying buffer and binds it. The records are
+        // appended to 'prims' in order, 'prog' must outlive the draw.
+        static void PackClipVaryings(VirtualGPU::Program& prog, const std::vector<const VirtualGPU::Varying*>& varyings,
+                                     VirtualGPU::PrimitiveList& prims) {
+            prog.smooth_register_size = varyings[0]->used_smooth_register_size;
+            prog.flat_register_size = varyings[0]->used_flat_register_size;
+            prog.varying_stride = VirtualGPU::VARYING_POSITION_SIZE +
+                                  static_cast<size_t>(prog.smooth_register_size + prog.flat_register_size);
+            prog.varying_buffer.resize(varyings.size() * prog.varying_stride);
+            for (size_t i = 0; i < varyings.size(); i++) {
+                float* record = prog.varying_buffer.data() + i * prog.varying_stride;
+                VirtualGPU::PackVarying(*varyings[i], prog, record);
+                prims.vertices.push_back(record);
+            }
+            VirtualGPU::GetInstance().using_program_ = &prog;
+        }
     };
 }  // namespace ho
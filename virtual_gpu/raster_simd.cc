@@ -0,0 +1,165 @@
+#include "raster_simd.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define HO_RASTER_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define HO_RASTER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace ho {
+    namespace vg {
+        namespace {
+            uint32_t CoverageRowBlock(const TriangleEdges& edges, const int64_t row_value[3]) {
+                uint32_t mask = 0;
+                for (int i = 0; i < RASTER_BLOCK_SIZE; i++) {
+                    const int64_t x = i;
+                    if (row_value[0] + edges.dx[0] * x >= 0 && row_value[1] + edges.dx[1] * x >= 0 &&
+                        row_value[2] + edges.dx[2] * x >= 0) {
+                        mask |= 1u << i;
+                    }
+                }
+                return mask;
+            }
+
+#ifdef HO_RASTER_X86
+            // A pixel is outside if any edge value is negative, the sign bit of the or of the three values.
+            uint32_t CoverageRowSSE2(const TriangleEdges& edges, const int64_t row_value[3]) {
+                __m128i outside[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(),
+                                      _mm_setzero_si128()};
+                for (int e = 0; e < 3; e++) {
+                    const __m128i step = _mm_set1_epi64x(edges.dx[e] * 2);
+                    __m128i v = _mm_set_epi64x(row_value[e] + edges.dx[e], row_value[e]);
+                    for (int i = 0; i < 4; i++) {
+                        outside[i] = _mm_or_si128(outside[i], v);
+                        v = _mm_add_epi64(v, step);
+                    }
+                }
+
+                int mask = 0;
+                for (int i = 0; i < 4; i++) {
+                    mask |= _mm_movemask_pd(_mm_castsi128_pd(outside[i])) << (i * 2);
+                }
+                return static_cast<uint32_t>(~mask & 0xFF);
+            }
+
+#if defined(__GNUC__) || defined(__clang__)
+            __attribute__((target("avx2")))
+#endif
+            uint32_t CoverageRowAVX2(const TriangleEdges& edges, const int64_t row_value[3]) {
+                __m256i outside_lo = _mm256_setzero_si256();
+                __m256i outside_hi = _mm256_setzero_si256();
+                for (int e = 0; e < 3; e++) {
+                    const int64_t dx = edges.dx[e];
+                    const __m256i v_lo = _mm256_add_epi64(_mm256_set1_epi64x(row_value[e]),
+                                                          _mm256_setr_epi64x(0, dx, dx * 2, dx * 3));
+                    const __m256i v_hi = _mm256_add_epi64(v_lo, _mm256_set1_epi64x(dx * 4));
+                    outside_lo = _mm256_or_si256(outside_lo, v_lo);
+                    outside_hi = _mm256_or_si256(outside_hi, v_hi);
+                }
+
+                const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(outside_lo)) |
+                                 (_mm256_movemask_pd(_mm256_castsi256_pd(outside_hi)) << 4);
+                return static_cast<uint32_t>(~mask & 0xFF);
+            }
+
+            bool HasAVX2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+                int info[4];
+                __cpuid(info, 0);
+                if (info[0] < 7) {
+                    return false;
+                }
+                __cpuid(info, 1);
+                const bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+                                          (_xgetbv(0) & 0x6) == 0x6;
+                __cpuidex(info, 7, 0);
+                return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+                return __builtin_cpu_supports("avx2");
+#endif
+            }
+#endif  // HO_RASTER_X86
+
+#ifdef HO_RASTER_NEON
+            uint32_t CoverageRowNEON(const TriangleEdges& edges, const int64_t row_value[3]) {
+                int64x2_t outside[4] = {vdupq_n_s64(0), vdupq_n_s64(0), vdupq_n_s64(0), vdupq_n_s64(0)};
+                for (int e = 0; e < 3; e++) {
+                    const int64x2_t step = vdupq_n_s64(edges.dx[e] * 2);
+                    int64x2_t v = vsetq_lane_s64(row_value[e] + edges.dx[e], vdupq_n_s64(row_value[e]), 1);
+                    for (int i = 0; i < 4; i++) {
+                        outside[i] = vorrq_s64(outside[i], v);
+                        v = vaddq_s64(v, step);
+                    }
+                }
+
+                // sign bit per lane
+                uint32_t mask = 0;
+                for (int i = 0; i < 4; i++) {
+                    const uint64x2_t sign = vshrq_n_u64(vreinterpretq_u64_s64(outside[i]), 63);
+                    mask |= static_cast<uint32_t>(vgetq_lane_u64(sign, 0) | (vgetq_lane_u64(sign, 1) << 1)) << (i * 2);
+                }
+                return ~mask & 0xFFu;
+            }
+#endif  // HO_RASTER_NEON
+        }  // namespace
+
+        SimdLevel DetectSimdLevel() {
+#if defined(HO_RASTER_X86)
+            return HasAVX2() ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#elif defined(HO_RASTER_NEON)
+            return SimdLevel::NEON;
+#else
+            return SimdLevel::BLOCK;
+#endif
+        }
+
+        bool IsSimdLevelSupported(SimdLevel level) {
+            switch (level) {
+                case SimdLevel::SCALAR:
+                case SimdLevel::BLOCK:
+                    return true;
+#ifdef HO_RASTER_X86
+                case SimdLevel::SSE2:
+                    return true;
+                case SimdLevel::AVX2:
+                    return HasAVX2();
+#endif
+#ifdef HO_RASTER_NEON
+                case SimdLevel::NEON:
+                    return true;
+#endif
+                default:
+                    return false;
+            }
+        }
+
+        CoverageRowFunc GetCoverageRowFunc(SimdLevel level) {
+            if (!IsSimdLevelSupported(level)) {
+                return nullptr;
+            }
+            switch (level) {
+                case SimdLevel::BLOCK:
+                    return CoverageRowBlock;
+#ifdef HO_RASTER_X86
+                case SimdLevel::SSE2:
+                    return CoverageRowSSE2;
+                case SimdLevel::AVX2:
+                    return CoverageRowAVX2;
+#endif
+#ifdef HO_RASTER_NEON
+                case SimdLevel::NEON:
+                    return CoverageRowNEON;
+#endif
+                default:
+                    return nullptr;
+            }
+        }
+    }  // namespace vg
+}  // namespace ho
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+#include "core/macros.h"
+
+namespace ho {
+    namespace vg {
+        // Instruction sets the block rasterizer can use for coverage tests.
+        enum class SimdLevel {
+            SCALAR,  // per pixel reference loop, no block rasterization
+            BLOCK,   // block rasterization with portable coverage tests
+            SSE2,
+            AVX2,
+            NEON,
+        };
+
+        // Width and height of the pixel block the rasterizer tests at once.
+        // A coverage row covers one line of a block, one bit per pixel.
+        INLINE constexpr int RASTER_BLOCK_SIZE = 8;
+
+        // Vertices are snapped to a grid of 1 / 2^SUBPIXEL_BITS pixel before the edge functions are set up.
+        INLINE constexpr int SUBPIXEL_BITS = 8;
+        INLINE constexpr int64_t SUBPIXEL_SCALE = int64_t(1) << SUBPIXEL_BITS;
+
+        // Fixed point edge functions of a triangle, sign adjusted so that the inside is positive for both windings
+        // and biased by -1 on edges that are not top or left. A pixel is covered if all three values are >= 0.
+        struct TriangleEdges {
+            int64_t dx[3];  // increment per pixel in x
+            int64_t dy[3];  // increment per pixel in y
+        };
+
+        // Returns one bit per pixel for RASTER_BLOCK_SIZE consecutive pixels of a row.
+        // 'row_value' holds the edge values at the first pixel center.
+        using CoverageRowFunc = uint32_t (*)(const TriangleEdges& edges, const int64_t row_value[3]);
+
+        // Best level supported by the compiler and the running CPU.
+        SimdLevel DetectSimdLevel();
+
+        bool IsSimdLevelSupported(SimdLevel level);
+
+        // Returns nullptr for SCALAR or an unsupported level.
+        CoverageRowFunc GetCoverageRowFunc(SimdLevel level);
+    }  // namespace vg
+}  // namespace ho
@@ -4,68 +4,6 @@
 #include "virtual_gpu_utils.h"
 
 namespace ho {
-    ALWAYS_INLINE float LoadAsFloat(const uint8_t* p, VGenum type, bool normalized) {
-        switch (type) {
-            case VG_FLOAT:
-                return *reinterpret_cast<const VGfloat*>(p);
-
-            case VG_HALF_FLOAT:
-                return vg::HalfToFloat(*reinterpret_cast<const uint16_t*>(p));
-
-            case VG_BYTE: {
-                int v = *reinterpret_cast<const VGbyte*>(p);
-                if (!normalized) {
-                    return float(v);
-                }
-                return math::Clamp(float(v) / 127.f, -1.f, 1.f);
-            }
-
-            case VG_UNSIGNED_BYTE: {
-                unsigned v = *reinterpret_cast<const VGubyte*>(p);
-                if (!normalized) {
-                    return float(v);
-                }
-                return math::Clamp(float(v) / 255.f, 0.f, 1.f);
-            }
-
-            case VG_SHORT: {
-                int v = *reinterpret_cast<const VGshort*>(p);
-                if (!normalized) {
-                    return float(v);
-                }
-                return math::Clamp(float(v) / 32767.f, -1.f, 1.f);
-            }
-
-            case VG_UNSIGNED_SHORT: {
-                unsigned v = *reinterpret_cast<const VGushort*>(p);
-                if (!normalized) {
-                    return float(v);
-                }
-                return math::Clamp(float(v) / 65535.f, 0.f, 1.f);
-            }
-
-            case VG_INT: {
-                int v = *reinterpret_cast<const VGint*>(p);
-                if (!normalized) {
-                    return float(v);
-                }
-                return math::Clamp(float(double(v) / 2147483647.0), -1.f, 1.f);
-            }
-
-            case VG_UNSIGNED_INT: {
-                unsigned v = *reinterpret_cast<const VGuint*>(p);
-                if (!normalized) {
-                    return float(v);
-                }
-                return math::Clamp(float(double(v) / 4294967295.0), 0.f, 1.f);
-            }
-
-            default:
-                assert(false);
-                return 0.f;
-        }
-    }
-
     ALWAYS_INLINE int64_t LoadAsInt(const uint8_t* p, VGenum type) {
         switch (type) {
             case VG_BYTE:
@@ -96,70 +34,29 @@ namespace ho {
     // int16_t,uint32_t,int32_t
     template <typename T>
     ALWAYS_INLINE T FetchAttribute(VGuint location, size_t index) {
-        static uint8_t default_zero[16] = {0};
-
         VirtualGPU& vg = VirtualGPU::GetInstance();
-
-        const uint8_t* src = nullptr;
-        VGenum type;
-        int type_size = 0;
-        int comp_count = 0;
-        bool normalized = false;
-        bool is_pure_integer = false;
-
-        auto ait = vg.bound_vertex_array_->index_to_attrib.find(location);
-        if (ait != vg.bound_vertex_array_->index_to_attrib.end() && ait->second.enabled) {
-            VirtualGPU::Attribute& attr = ait->second;
-            type = attr.type;
-            type_size = vg::GetTypeSize(attr.type);
-            comp_count = attr.size;
-            normalized = attr.normalized;
-            is_pure_integer = attr.is_pure_integer;
-            int stride = attr.stride == 0 ? attr.size * type_size : attr.stride;
-            src = attr.buffer->memory->data() + attr.offset + (stride * index);
-        } else {
-            auto cit = vg.constant_attributes_.find(location);
-            if (cit != vg.constant_attributes_.end()) {
-                VirtualGPU::ConstantAttribute& cattr = cit->second;
-                src = reinterpret_cast<const uint8_t*>(cattr.f);
-                type = cattr.type;
-                type_size = vg::GetTypeSize(cattr.type);
-                comp_count = 4;
-                normalized = cattr.normalized;
-                is_pure_integer = cattr.is_pure_integer;
-            } else {
-                src = default_zero;
-                type = VG_FLOAT;
-                type_size = sizeof(float);
-                normalized = false;
-                is_pure_integer = false;
-                comp_count = 4;
-            }
-        }
+        const VirtualGPU::AttributeFetcher& fetcher = location < vg.attribute_fetchers_.size()
+                                                          ? vg.attribute_fetchers_[location]
+                                                          : VirtualGPU::ZERO_ATTRIBUTE_FETCHER;
+        const uint8_t* src = fetcher.base + fetcher.stride * index;
+        const VGenum type = fetcher.type;
+        const bool is_pure_integer = fetcher.is_pure_integer;
 
         if constexpr (std::is_same_v<T, float>) {
-            float comps[4] = {0.f, 0.f, 0.f, 1.f};
-            for (int i = 0; i < comp_count; i++) {
-                comps[i] = LoadAsFloat(src + i * type_size, type, normalized);
-            }
+            float comps[4];
+            fetcher.fetch(src, comps);
             return comps[0];
         } else if constexpr (std::is_same_v<T, Vector2>) {
-            float comps[4] = {0.f, 0.f, 0.f, 1.f};
-            for (int i = 0; i < comp_count; i++) {
-                comps[i] = LoadAsFloat(src + i * type_size, type, normalized);
-            }
+            float comps[4];
+            fetcher.fetch(src, comps);
             return Vector2(comps[0], comps[1]);
         } else if constexpr (std::is_same_v<T, Vector3>) {
-            float comps[4] = {0.f, 0.f, 0.f, 1.f};
-            for (int i = 0; i < comp_count; i++) {
-                comps[i] = LoadAsFloat(src + i * type_size, type, normalized);
-            }
+            float comps[4];
+            fetcher.fetch(src, comps);
             return Vector3(comps[0], comps[1], comps[2]);
         } else if constexpr (std::is_same_v<T, Vector4>) {
-            float comps[4] = {0.f, 0.f, 0.f, 1.f};
-            for (int i = 0; i < comp_count; i++) {
-                comps[i] = LoadAsFloat(src + i * type_size, type, normalized);
-            }
+            float comps[4];
+            fetcher.fetch(src, comps);
             return Vector4(comps[0], comps[1], comps[2], comps[3]);
         } else if constexpr (std::is_same_v<T, uint8_t>) {
             assert(is_pure_integer);
@@ -184,22 +81,49 @@ namespace ho {
         }
     }
 
+    // Fetches the attribute at 'location' of 'count' vertices as floats into structure of arrays, component c of
+    // vertex_indices[i] goes to components[c][i]. Components the attribute lacks read (0, 0, 0, 1).
+    ALWAYS_INLINE void FetchAttributes(VGuint location, const size_t* vertex_indices, size_t count,
+                                       float* const components[4]) {
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+        const VirtualGPU::AttributeFetcher& fetcher = location < vg.attribute_fetchers_.size()
+                                                          ? vg.attribute_fetchers_[location]
+                                                          : VirtualGPU::ZERO_ATTRIBUTE_FETCHER;
+        fetcher.fetch_batch(fetcher.base, fetcher.stride, vertex_indices, count, components);
+    }
+
+    // FetchAttributes of every lane of a wide vertex shader batch.
+    ALWAYS_INLINE void FetchAttributes(VGuint location, const VirtualGPU::VertexBatch& batch,
+                                       float (&components)[4][VirtualGPU::VertexBatch::WIDTH]) {
+        float* const rows[4] = {components[0], components[1], components[2], components[3]};
+        FetchAttributes(location, batch.vertex_indices.data(), VirtualGPU::VertexBatch::WIDTH, rows);
+    }
+
+    // Resolves a uniform of the executing draw. Shaders that read a uniform more than once, e.g. the elements of an
+    // array, resolve it once and fetch through the ref.
+    ALWAYS_INLINE UniformRef GetUniformRef(uint32_t name_hash) {
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+        assert(vg.using_program_);
+        const uint32_t location = vg.using_program_->uniform_lookup.Find(name_hash);
+        assert(location < vg.uniform_snapshot_.refs.size());
+        return vg.uniform_snapshot_.refs[location];
+    }
+
     // T can be  float, Vector2, Vector3, Vector4, Matrix2x2, Matrix3x3, Matrix4x4,
     // uint32_t, int32_t
     template <typename T>
-    ALWAYS_INLINE T FetchUniform(uint32_t name_hash, size_t index) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
-        assert(vg.using_program_);
-        auto loc_it = vg.using_program_->uniform_name_hash_to_location.find(name_hash);
-        assert(loc_it != vg.using_program_->uniform_name_hash_to_location.end());
-        VirtualGPU::Uniform& u = vg.using_program_->uniforms[loc_it->second];
-        assert((VGsizei)index < u.count);
-        const uint8_t* src = u.data.data() + index * static_cast<size_t>(u.size * vg::GetTypeSize(u.type));
+    ALWAYS_INLINE T FetchUniform(const UniformRef& ref, size_t index) {
+        assert(static_cast<VGsizei>(index) < ref.count);
         T dst;
-        std::memcpy(reinterpret_cast<float*>(&dst), src, sizeof(T));
+        std::memcpy(reinterpret_cast<float*>(&dst), ref.data + index * ref.stride, sizeof(T));
         return dst;
     }
 
+    template <typename T>
+    ALWAYS_INLINE T FetchUniform(uint32_t name_hash, size_t index) {
+        return FetchUniform<T>(GetUniformRef(name_hash), index);
+    }
+
     // T can be  float, Vector2, Vector3, Vector4, Matrix2x2, Matrix3x3, Matrix4x4,
     // uint32_t, int32_t
     template <typename T>
@@ -454,8 +378,9 @@ namespace ho {
     }
 
     // T can be float, Color128
+    // Texture2DLod<T>(unit, coord, lod); is same as 'textureLod(sampler, coord, lod)' in glsl.
     template <typename T>
-    ALWAYS_INLINE T Texture2D(VGuint unit_slot, const Vector2& tex_coord) {
+    ALWAYS_INLINE T Texture2DLod(VGuint unit_slot, const Vector2& tex_coord, VGfloat lod) {
         VirtualGPU& vg = VirtualGPU::GetInstance();
         VirtualGPU::TextureUnit& unit = vg.texture_units_[unit_slot];
 
@@ -489,14 +414,20 @@ namespace ho {
             }
         }
 
-        // 2) LOD -> no op
+        // 2) LOD -> given
 
-        // 3) base/max level clamp -> no op
+        // 3) base/max level clamp -> levels of the mipmap chain
 
-        // 4) choose mip level -> level 0 only
+        // 4) choose mip level
+        const vg::MipmapSelection selection =
+            vg::SelectMipmap(sam->min_filter, sam->mag_filter, lod, tex->mipmap_count);
 
-        // 5) min/mag -> always mag filter
-        T filtered = ApplyFilter<T>(sam->mag_filter, *tex, 0, wrap_u, wrap_v);
+        // 5) min/mag, blend two levels for *_MIPMAP_LINEAR
+        T filtered = ApplyFilter<T>(selection.filter, *tex, selection.level0, wrap_u, wrap_v);
+        if (selection.weight > 0.f) {
+            const T next = ApplyFilter<T>(selection.filter, *tex, selection.level1, wrap_u, wrap_v);
+            filtered = filtered * (1.f - selection.weight) + next * selection.weight;
+        }
 
         // 6) depth compare -> no op
 
@@ -505,6 +436,59 @@ namespace ho {
         return filtered;
     }
 
+    // T can be float, Color128
+    // Texture2DGrad<T>(unit, coord, dx, dy); is same as 'textureGrad(sampler, coord, dx, dy)' in glsl.
+    // 'dPdx' and 'dPdy' are the screen space derivatives of 'tex_coord', see Fragment::InDx, Fragment::InDy and dFdx.
+    template <typename T>
+    ALWAYS_INLINE T Texture2DGrad(VGuint unit_slot, const Vector2& tex_coord, const Vector2& dPdx,
+                                  const Vector2& dPdy) {
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+        const VirtualGPU::TextureObject* tex =
+            vg.texture_units_[unit_slot].bound_texture_targets[vg::GetTextureSlot(VG_TEXTURE_2D)];
+        if (!tex) {
+            return T();
+        }
+
+        // The longer axis of the pixel's footprint in texels decides the level.
+        const VGfloat width = static_cast<VGfloat>(tex->mipmap[0].width);
+        const VGfloat height = static_cast<VGfloat>(tex->mipmap[0].height);
+        const VGfloat rho_x = Vector2(dPdx.x * width, dPdx.y * height).SqrdMagnitude();
+        const VGfloat rho_y = Vector2(dPdy.x * width, dPdy.y * height).SqrdMagnitude();
+        const VGfloat lod = 0.5f * std::log2(math::Max(rho_x, rho_y));
+
+        return Texture2DLod<T>(unit_slot, tex_coord, lod);
+    }
+
+    // T can be float, Color128
+    // Samples the base level, use Texture2DGrad for minified textures.
+    template <typename T>
+    ALWAYS_INLINE T Texture2D(VGuint unit_slot, const Vector2& tex_coord) {
+        return Texture2DLod<T>(unit_slot, tex_coord, 0.f);
+    }
+
+    // dFdx(values, lane); is same as 'dFdxFine(value)' in glsl, for a value computed by every lane of a FragmentQuad.
+    template <typename T>
+    ALWAYS_INLINE T dFdx(const T (&values)[VirtualGPU::FragmentQuad::LANE_COUNT], size_t lane) {
+        return VirtualGPU::FragmentQuad::Dx(values, lane);
+    }
+
+    // dFdy(values, lane); is same as 'dFdyFine(value)' in glsl, for a value computed by every lane of a FragmentQuad.
+    template <typename T>
+    ALWAYS_INLINE T dFdy(const T (&values)[VirtualGPU::FragmentQuad::LANE_COUNT], size_t lane) {
+        return VirtualGPU::FragmentQuad::Dy(values, lane);
+    }
+
+    // T can be float, Color128
+    // Texture2DQuad<T>(unit, coords, out); is same as 'texture(sampler, coord)' in glsl for every lane of a
+    // FragmentQuad, the level of a lane follows from the differences of 'tex_coords' across the quad.
+    template <typename T>
+    ALWAYS_INLINE void Texture2DQuad(VGuint unit_slot, const Vector2 (&tex_coords)[4], T (&out)[4]) {
+        static_assert(VirtualGPU::FragmentQuad::LANE_COUNT == 4);
+        for (size_t lane = 0; lane < 4; lane++) {
+            out[lane] = Texture2DGrad<T>(unit_slot, tex_coords[lane], dFdx(tex_coords, lane), dFdy(tex_coords, lane));
+        }
+    }
+
     // T can be float, Color128
     template <typename T>
     ALWAYS_INLINE T Texture3D(VGuint unit_slot, const Vector3& tex_coord) {
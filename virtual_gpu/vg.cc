@@ -1,6 +1,7 @@
 #include "vg.h"
 
 #include <cassert>
+#include <chrono>
 
 #include "virtual_gpu.h"
 #include "virtual_gpu_utils.h"
@@ -32,7 +33,7 @@ namespace ho {
     // GL VERSION 1.0 API
     //////////////////////////////////////////////////
     void vgCullFace(VGenum mode) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -43,7 +44,7 @@ namespace ho {
         }
     }
     void vgFrontFace(VGenum mode) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -54,7 +55,7 @@ namespace ho {
         }
     }
     void vgPolygonMode(VGenum face, VGenum mode) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -65,7 +66,7 @@ namespace ho {
         }
     }
     void vgScissor(VGint x, VGint y, VGsizei width, VGsizei height) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -77,7 +78,7 @@ namespace ho {
         }
     }
     // void vgTexParameterf(VGenum target, VGenum pname, VGfloat param) {
-    //     VirtualGPU& vg = VirtualGPU::GetInstance();
+    //     VirtualGPU& vg = VirtualGPU::GetContext();
     //     if (vg.state_.error_state != VG_NO_ERROR) {
     //         return;
     //     }
@@ -100,7 +101,8 @@ namespace ho {
     //     }
     // }
     void vgTexParameterfv(VGenum target, VGenum pname, const VGfloat* params) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -127,7 +129,8 @@ namespace ho {
         }
     }
     void vgTexParameteri(VGenum target, VGenum pname, VGint param) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -170,7 +173,9 @@ namespace ho {
                 }
                 break;
             case VG_TEXTURE_MIN_FILTER:
-                if (param >= static_cast<VGint>(VG_NEAREST) && param <= static_cast<VGint>(VG_LINEAR)) {
+                if ((param >= static_cast<VGint>(VG_NEAREST) && param <= static_cast<VGint>(VG_LINEAR)) ||
+                    (param >= static_cast<VGint>(VG_NEAREST_MIPMAP_NEAREST) &&
+                     param <= static_cast<VGint>(VG_LINEAR_MIPMAP_LINEAR))) {
                     ds.min_filter = param;
                 } else {
                     vg.state_.error_state = VG_INVALID_ENUM;
@@ -220,7 +225,8 @@ namespace ho {
         }
     }
     void vgTexParameteriv(VGenum target, VGenum pname, const VGint* params) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -250,11 +256,12 @@ namespace ho {
     }
     void vgTexImage1D(VGenum target, VGint level, VGint internalformat, VGsizei width, VGint border, VGenum format,
                       VGenum type, const void* pixels) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
-        if (border != 0 || width < 0 || level != 0) {
+        if (border != 0 || width < 0 || level < 0 || level >= VirtualGPU::MAX_MIPMAP_LEVEL_COUNT) {
             vg.state_.error_state = VG_INVALID_VALUE;
             return;
         }
@@ -345,12 +352,14 @@ namespace ho {
 
         tex_level.memory->clear();
         tex_level.memory->resize(static_cast<size_t>(width) * static_cast<size_t>(dst_pixel_size));
+        VirtualGPU::UpdateMipmapCount(*tex);
 
         if (pixels == nullptr) {
             return;
         }
 
         const uint8_t* src = static_cast<const uint8_t*>(pixels);
+        vg.InvalidateHiZ(tex_level.memory);
         uint8_t* dst = tex_level.memory->data();
 
         for (int x = 0; x < width; x++) {
@@ -362,11 +371,12 @@ namespace ho {
 
     void vgTexImage2D(VGenum target, VGint level, VGint internalformat, VGsizei width, VGsizei height, VGint border,
                       VGenum format, VGenum type, const void* pixels) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
-        if (border != 0 || width < 0 || height < 0 || level != 0) {
+        if (border != 0 || width < 0 || height < 0 || level < 0 || level >= VirtualGPU::MAX_MIPMAP_LEVEL_COUNT) {
             vg.state_.error_state = VG_INVALID_VALUE;
             return;
         }
@@ -458,12 +468,14 @@ namespace ho {
         tex_level.memory->clear();
         tex_level.memory->resize(static_cast<size_t>(width) * static_cast<size_t>(height) *
                                  static_cast<size_t>(dst_pixel_size));
+        VirtualGPU::UpdateMipmapCount(*tex);
 
         if (pixels == nullptr) {
             return;
         }
 
         const uint8_t* src = static_cast<const uint8_t*>(pixels);
+        vg.InvalidateHiZ(tex_level.memory);
         uint8_t* dst = tex_level.memory->data();
 
         for (int y = 0; y < height; y++) {
@@ -475,7 +487,8 @@ namespace ho {
         }
     }
     void vgDrawBuffer(VGenum buf) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        // Recorded commands keep the draw buffers they were recorded with.
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -524,7 +537,7 @@ namespace ho {
     }
 
     void vgClear(VGbitfield mask) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -536,17 +549,9 @@ namespace ho {
             return;
         }
 
-        const bool is_color_cleared = (mask & VG_COLOR_BUFFER_BIT) != 0;
         const bool is_depth_cleared = ((mask & VG_DEPTH_BUFFER_BIT) != 0);
         const bool is_stencil_cleared = (mask & VG_STENCIL_BUFFER_BIT) != 0;
 
-        // Clear color
-        if (is_color_cleared) {
-            for (size_t i = 0; i < VirtualGPU::DRAW_BUFFER_SLOT_COUNT; ++i) {
-                vg.ClearColorAttachment(i, vg.state_.clear_color);
-            }
-        }
-
         if (fb->depth_stencil_attachment.memory == nullptr) {
             if (is_depth_cleared || is_stencil_cleared) {
                 vg.state_.error_state = VG_INVALID_OPERATION;
@@ -559,38 +564,36 @@ namespace ho {
                 vg.state_.error_state = VG_INVALID_OPERATION;
                 return;
             }
-            vg.ClearDepthAttachment(static_cast<real>(vg.state_.clear_depth));
         }
 
-        if (fb->depth_stencil_attachment.format == VG_DEPTH_STENCIL) {
-            vg.ClearDepthStencilAttachment(is_depth_cleared, is_stencil_cleared,
-                                           static_cast<real>(vg.state_.clear_depth),
-                                           static_cast<uint8_t>(vg.state_.clear_stencil));
-        }
+        VirtualGPU::Command cmd;
+        cmd.type = VirtualGPU::CommandType::CLEAR;
+        cmd.clear_mask = mask;
+        vg.RunCommand(cmd);
     }
     void vgClearColor(VGfloat red, VGfloat green, VGfloat blue, VGfloat alpha) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
         vg.state_.clear_color = Color128(red, green, blue, alpha);
     }
     void vgClearStencil(VGint s) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
         vg.state_.clear_stencil = s;
     }
     void vgClearDepth(VGdouble depth) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
         vg.state_.clear_depth = depth;
     }
     void vgStencilMask(VGuint mask) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -598,7 +601,7 @@ namespace ho {
         vg.state_.stencil_write_mask[1] = mask;
     }
     void vgColorMask(VGboolean red, VGboolean green, VGboolean blue, VGboolean alpha) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -611,14 +614,14 @@ namespace ho {
         }
     }
     void vgDepthMask(VGboolean flag) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
         vg.state_.depth_write_enabled = static_cast<bool>(flag);
     }
     void vgDisable(VGenum cap) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -650,12 +653,19 @@ namespace ho {
             case VG_POLYGON_OFFSET_POINT:
                 vg.state_.point_offset_enabled = false;
                 break;
+            case VG_TILED_RASTERIZATION:
+                vg.state_.tiled_rasterization_enabled = false;
+                break;
+            case VG_DEFERRED_COMMANDS:
+                vg.Finish();
+                vg.state_.deferred_commands_enabled = false;
+                break;
             default:
                 vg.state_.error_state = VG_INVALID_ENUM;
         }
     }
     void vgEnable(VGenum cap) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -686,14 +696,20 @@ namespace ho {
             case VG_POLYGON_OFFSET_POINT:
                 vg.state_.point_offset_enabled = true;
                 break;
+            case VG_TILED_RASTERIZATION:
+                vg.state_.tiled_rasterization_enabled = true;
+                break;
+            case VG_DEFERRED_COMMANDS:
+                vg.state_.deferred_commands_enabled = true;
+                break;
             default:
                 vg.state_.error_state = VG_INVALID_ENUM;
         }
     }
-    void vgFinish(void) {}  // no op
-    void vgFlush(void) {}   // no op
+    void vgFinish(void) { VirtualGPU::GetContext().Finish(); }
+    void vgFlush(void) { VirtualGPU::GetContext().Flush(); }
     void vgBlendFunc(VGenum sfactor, VGenum dfactor) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -721,7 +737,7 @@ namespace ho {
         vg.state_.blend_dst_alpha_factor = dfactor;
     }
     void vgStencilFunc(VGenum func, VGint ref, VGuint mask) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -737,7 +753,7 @@ namespace ho {
         vg.state_.stencil_func_mask[1] = mask;
     }
     void vgStencilOp(VGenum sfail, VGenum dpfail, VGenum dppass) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -775,7 +791,7 @@ namespace ho {
     }
 
     void vgDepthFunc(VGenum func) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -787,7 +803,7 @@ namespace ho {
     }
 
     void vgReadBuffer(VGenum src) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -835,14 +851,14 @@ namespace ho {
     }
 
     VGenum vgGetError(void) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         const VGenum err = vg.state_.error_state;
         vg.state_.error_state = VG_NO_ERROR;
         return err;
     }
 
     VGboolean vgIsEnabled(VGenum cap) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
 
         switch (cap) {
             case VG_BLEND:
@@ -874,13 +890,19 @@ namespace ho {
             case VG_POLYGON_OFFSET_POINT:
                 return static_cast<VGboolean>(vg.state_.point_offset_enabled);
                 break;
+            case VG_TILED_RASTERIZATION:
+                return static_cast<VGboolean>(vg.state_.tiled_rasterization_enabled);
+                break;
+            case VG_DEFERRED_COMMANDS:
+                return static_cast<VGboolean>(vg.state_.deferred_commands_enabled);
+                break;
             default:
                 vg.state_.error_state = VG_INVALID_ENUM;
                 return VG_FALSE;
         }
     }
     void vgDepthRange(VGdouble n, VGdouble f) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -888,7 +910,7 @@ namespace ho {
         vg.state_.max_depth = f;
     }
     void vgViewport(VGint x, VGint y, VGsizei width, VGsizei height) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -900,7 +922,7 @@ namespace ho {
     // GL VERSION 1.1 API
     //////////////////////////////////////////////////
     void vgDrawArrays(VGenum mode, VGint first, VGsizei count) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -919,240 +941,31 @@ namespace ho {
             return;
         }
 
-        vg.using_program_->varying_buffer.resize(static_cast<size_t>(count));
-
-        // Vertex Processing
-        std::vector<JobDeclaration> vs_jobs;
-        vs_jobs.reserve(static_cast<size_t>(count));
-
-        const int BATCH_SIZE = 100;
-
-        for (int i = first; i < first + count; i += BATCH_SIZE) {
-            const int batch_end = math::Min(i + BATCH_SIZE - 1, first + count - 1);
-            VirtualGPU::VSJobInput* input = new VirtualGPU::VSJobInput{
-                reinterpret_cast<VirtualGPU::VertexShader>(vg.using_program_->vertex_shader->source),
-                static_cast<size_t>(first), static_cast<size_t>(i), static_cast<size_t>(batch_end)};
-
-            JobDeclaration job;
-            job.entry = VirtualGPU::VSJobEntry;
-            job.input_data = input;
-            job.input_size = sizeof(VirtualGPU::VSJobInput);
-
-            vs_jobs.emplace_back(job);
-        }
-
-        vg.job_system_.KickJobsAndWait(vs_jobs);
-
-        vs_jobs.clear();
-
-        // Primitive Assembly & Kick After Vertex Processing Jobs
-        size_t gap = 0;
-        size_t v_count = 0;
-        switch (mode) {
-            case VG_POINT:
-                gap = 1;
-                v_count = 1;
-                break;
-            case VG_LINE:
-                gap = 2;
-                v_count = 2;
-                break;
-            case VG_LINE_STRIP:
-                gap = 1;
-                v_count = 2;
-                break;
-            case VG_TRIANGLES:
-                gap = 3;
-                v_count = 3;
-                break;
-            case VG_TRIANGLE_STRIP:
-                gap = 1;
-                v_count = 3;
-                break;
-            default:
-                vg.state_.error_state = VG_INVALID_ENUM;
-                return;
-        }
-
-        JobDeclaration after_job;
-        after_job.entry = VirtualGPU::AfterVSJobEntry;
-        after_job.input_size = sizeof(VirtualGPU::AfterVSJobInput);
-
-        for (size_t i = 0; i + v_count <= vg.using_program_->varying_buffer.size(); i += gap) {
-            std::vector<VirtualGPU::Varying*> poly;
-            poly.reserve(v_count);
-
-            // Fetch base vertices
-            for (size_t j = i; j < i + v_count; j++) {
-                poly.emplace_back(&vg.using_program_->varying_buffer[j]);
-            }
-
-            // TRIANGLE_STRIP: flip winding order on odd triangles
-            if (mode == VG_TRIANGLE_STRIP && (i % 2 == 1)) {
-                std::swap(poly[1], poly[2]);
-            }
-
-            VirtualGPU::AfterVSJobInput* input = new VirtualGPU::AfterVSJobInput(
-                {std::move(poly),
-                 reinterpret_cast<VirtualGPU::FragmentShader>(vg.using_program_->fragment_shader->source)});
-
-            after_job.input_data = input;
-
-            vg.job_system_.KickJob(after_job);
+        size_t stride = 0;
+        size_t vertex_count = 0;
+        if (!VirtualGPU::GetPrimitiveLayout(mode, stride, vertex_count)) {
+            vg.state_.error_state = VG_INVALID_ENUM;
+            return;
         }
 
-        vg.job_system_.WaitForIdle();
-        vg.using_program_->varying_buffer.clear();
+        VirtualGPU::Command cmd;
+        cmd.type = VirtualGPU::CommandType::DRAW_ARRAYS;
+        cmd.mode = mode;
+        cmd.first = first;
+        cmd.count = count;
+        vg.RunCommand(cmd);
     }
     void vgDrawElements(VGenum mode, VGsizei count, VGenum type, const void* indices) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
-        if (count < 0) {
-            vg.state_.error_state = VG_INVALID_VALUE;
-            return;
-        }
-        if (vg.bound_vertex_array_ == nullptr || vg.using_program_ == nullptr ||
-            vg.bound_draw_frame_buffer_ == nullptr || vg.bound_vertex_array_->element_buffer == nullptr ||
-            vg.bound_vertex_array_->element_buffer->memory == nullptr) {
-            vg.state_.error_state = VG_INVALID_OPERATION;
-            return;
-        }
-
-        if (vg.using_program_->link_status == VG_FALSE) {
-            vg.state_.error_state = VG_INVALID_OPERATION;
-            return;
-        }
-
-        size_t idx_size = 0;
-        switch (type) {
-            case VG_UNSIGNED_BYTE:
-                idx_size = 1;
-                break;
-            case VG_UNSIGNED_SHORT:
-                idx_size = 2;
-                break;
-            case VG_UNSIGNED_INT:
-                idx_size = 4;
-                break;
-            default:
-                vg.state_.error_state = VG_INVALID_ENUM;
-                return;
-        }
-
-        if (indices != nullptr && (reinterpret_cast<uintptr_t>(indices) + static_cast<size_t>(count) * idx_size >
-                                   vg.bound_vertex_array_->element_buffer->memory->size())) {
-            vg.state_.error_state = VG_INVALID_VALUE;
-            return;
-        }
-
-        vg.using_program_->varying_buffer.resize(static_cast<size_t>(vg.bound_vertex_array_->vertex_count));
-
-        // Vertex Processing
-        std::vector<JobDeclaration> vs_jobs;
-        vs_jobs.reserve(static_cast<size_t>(vg.bound_vertex_array_->vertex_count));
-
-        const int BATCH_SIZE = 100;
 
-        for (int i = 0; i < vg.bound_vertex_array_->vertex_count; i += BATCH_SIZE) {
-            const int batch_end = math::Min((i + BATCH_SIZE - 1), (vg.bound_vertex_array_->vertex_count - 1));
-            VirtualGPU::VSJobInput* input = new VirtualGPU::VSJobInput{
-                reinterpret_cast<VirtualGPU::VertexShader>(vg.using_program_->vertex_shader->source), 0,
-                static_cast<size_t>(i), static_cast<size_t>(batch_end)};
-
-            JobDeclaration job;
-            job.entry = VirtualGPU::VSJobEntry;
-            job.input_data = input;
-            job.input_size = sizeof(VirtualGPU::VSJobInput);
-
-            vs_jobs.emplace_back(job);
-        }
-
-        vg.job_system_.KickJobsAndWait(vs_jobs);
-
-        vs_jobs.clear();
-
-        // Primitive Assembly & Kick After Vertex Processing Jobs
-        size_t gap = 0;
-        size_t v_count = 0;
-        switch (mode) {
-            case VG_POINT:
-                gap = 1;
-                v_count = 1;
-                break;
-            case VG_LINE:
-                gap = 2;
-                v_count = 2;
-                break;
-            case VG_LINE_STRIP:
-                gap = 1;
-                v_count = 2;
-                break;
-            case VG_TRIANGLES:
-                gap = 3;
-                v_count = 3;
-                break;
-            case VG_TRIANGLE_STRIP:
-                gap = 1;
-                v_count = 3;
-                break;
-            default:
-                vg.state_.error_state = VG_INVALID_ENUM;
-                return;
-        }
-
-        uint8_t* ebo = vg.bound_vertex_array_->element_buffer->memory->data();
-        uintptr_t offset = indices == nullptr ? 0 : reinterpret_cast<uintptr_t>(indices);
-
-        const uint8_t* base = ebo + offset;
-
-        auto FetchIndex = [&](size_t k) -> size_t {
-            switch (type) {
-                case VG_UNSIGNED_BYTE:
-                    return static_cast<size_t>((reinterpret_cast<const uint8_t*>(base))[k]);
-                case VG_UNSIGNED_SHORT:
-                    return static_cast<size_t>((reinterpret_cast<const uint16_t*>(base))[k]);
-                case VG_UNSIGNED_INT:
-                    return static_cast<size_t>((reinterpret_cast<const uint32_t*>(base))[k]);
-                default:
-                    return 0;
-            }
-        };
-
-        JobDeclaration job;
-        job.entry = VirtualGPU::AfterVSJobEntry;
-        job.input_size = sizeof(VirtualGPU::AfterVSJobInput);
-
-        for (size_t i = 0; i + v_count <= static_cast<size_t>(count); i += gap) {
-            std::vector<VirtualGPU::Varying*> poly;
-            poly.reserve(v_count);
-
-            for (size_t j = 0; j < v_count; j++) {
-                size_t idx = FetchIndex(i + j);
-                poly.emplace_back(&(vg.using_program_->varying_buffer[idx]));
-            }
-
-            // TRIANGLE_STRIP: flip winding order on odd triangles
-            if (mode == VG_TRIANGLE_STRIP && ((i / gap) % 2 == 1)) {
-                std::swap(poly[1], poly[2]);
-            }
-
-            VirtualGPU::AfterVSJobInput* input = new VirtualGPU::AfterVSJobInput(
-                {std::move(poly),
-                 reinterpret_cast<VirtualGPU::FragmentShader>(vg.using_program_->fragment_shader->source)});
-
-            job.input_data = input;
-
-            vg.job_system_.KickJob(job);
-        }
-
-        vg.job_system_.WaitForIdle();
-        vg.using_program_->varying_buffer.clear();
+        vg.DrawElements(mode, count, type, indices, nullptr);
     }
 
     void vgPolygonOffset(VGfloat factor, VGfloat units) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1162,14 +975,15 @@ namespace ho {
 
     void vgTexSubImage1D(VGenum target, VGint level, VGint xoffset, VGsizei width, VGenum format, VGenum type,
                          const void* pixels) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
         if (pixels == nullptr) {
             return;
         }
-        if (width < 0 || level != 0) {
+        if (width < 0 || level < 0 || level >= VirtualGPU::MAX_MIPMAP_LEVEL_COUNT) {
             vg.state_.error_state = VG_INVALID_VALUE;
             return;
         }
@@ -1227,6 +1041,7 @@ namespace ho {
         const size_t dst_pixel_size = static_cast<size_t>(vg::GetPixelSize(tex->internal_format, tex->component_type));
 
         const uint8_t* src = static_cast<const uint8_t*>(pixels);
+        vg.InvalidateHiZ(tex_level.memory);
         uint8_t* dst = tex_level.memory->data() + static_cast<size_t>(xoffset) * dst_pixel_size;
 
         for (int x = 0; x < width; x++) {
@@ -1237,7 +1052,8 @@ namespace ho {
     }
     void vgTexSubImage2D(VGenum target, VGint level, VGint xoffset, VGint yoffset, VGsizei width, VGsizei height,
                          VGenum format, VGenum type, const void* pixels) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1246,7 +1062,7 @@ namespace ho {
             return;
         }
 
-        if (level != 0 || width < 0 || height < 0) {
+        if (level < 0 || level >= VirtualGPU::MAX_MIPMAP_LEVEL_COUNT || width < 0 || height < 0) {
             vg.state_.error_state = VG_INVALID_VALUE;
             return;
         }
@@ -1306,6 +1122,7 @@ namespace ho {
 
         const uint8_t* src = static_cast<const uint8_t*>(pixels);
 
+        vg.InvalidateHiZ(tex_level.memory);
         for (int y = 0; y < height; y++) {
             uint8_t* dst = tex_level.memory->data() +
                            static_cast<size_t>((yoffset + y) * tex_level.width + xoffset) * dst_pixel_size;
@@ -1317,7 +1134,7 @@ namespace ho {
         }
     }
     void vgBindTexture(VGenum target, VGuint texture) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1370,7 +1187,7 @@ namespace ho {
     }
 
     void vgDeleteTextures(VGsizei n, const VGuint* textures) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1404,7 +1221,7 @@ namespace ho {
     }
 
     void vgGenTextures(VGsizei n, VGuint* textures) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1424,7 +1241,7 @@ namespace ho {
         }
     }
     VGboolean vgIsTexture(VGuint texture) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (texture == 0) {
             return static_cast<VGboolean>(VG_FALSE);
         }
@@ -1445,19 +1262,28 @@ namespace ho {
     // GL VERSION 1.2 API
     //////////////////////////////////////////////////
     void vgDrawRangeElements(VGenum mode, VGuint start, VGuint end, VGsizei count, VGenum type, const void* indices) {
-        // ignore driver hints(start, end)
-        (void)start, (void)end;
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+        if (end < start) {
+            vg.state_.error_state = VG_INVALID_VALUE;
+            return;
+        }
 
-        vgDrawElements(mode, count, type, indices);
+        const uint32_t range[2] = {start, end};
+        vg.DrawElements(mode, count, type, indices, range);
     }
 
     void vgTexImage3D(VGenum target, VGint level, VGint internalformat, VGsizei width, VGsizei height, VGsizei depth,
                       VGint border, VGenum format, VGenum type, const void* pixels) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
-        if (border != 0 || width < 0 || height < 0 || depth < 0 || level != 0) {
+        if (border != 0 || width < 0 || height < 0 || depth < 0 || level < 0 ||
+            level >= VirtualGPU::MAX_MIPMAP_LEVEL_COUNT) {
             vg.state_.error_state = VG_INVALID_VALUE;
             return;
         }
@@ -1544,12 +1370,14 @@ namespace ho {
 
         tex_level.memory->clear();
         tex_level.memory->resize(static_cast<size_t>(width * height * depth) * dst_pixel_size);
+        VirtualGPU::UpdateMipmapCount(*tex);
 
         if (pixels == nullptr) {
             return;
         }
 
         const uint8_t* src = static_cast<const uint8_t*>(pixels);
+        vg.InvalidateHiZ(tex_level.memory);
         uint8_t* dst = tex_level.memory->data();
 
         for (int z = 0; z < depth; z++) {
@@ -1564,7 +1392,8 @@ namespace ho {
     }
     void vgTexSubImage3D(VGenum target, VGint level, VGint xoffset, VGint yoffset, VGint zoffset, VGsizei width,
                          VGsizei height, VGsizei depth, VGenum format, VGenum type, const void* pixels) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1572,7 +1401,7 @@ namespace ho {
             return;
         }
 
-        if (level != 0 || width < 0 || height < 0 || depth < 0) {
+        if (level < 0 || level >= VirtualGPU::MAX_MIPMAP_LEVEL_COUNT || width < 0 || height < 0 || depth < 0) {
             vg.state_.error_state = VG_INVALID_VALUE;
             return;
         }
@@ -1633,6 +1462,7 @@ namespace ho {
 
         const uint8_t* src = static_cast<const uint8_t*>(pixels);
 
+        vg.InvalidateHiZ(tex_level.memory);
         for (int z = 0; z < depth; z++) {
             uint8_t* z_dst = tex_level.memory->data() +
                              static_cast<size_t>(zoffset + z * tex_level.width * tex_level.height) * dst_pixel_size;
@@ -1651,7 +1481,7 @@ namespace ho {
     // GL VERSION 1.3 API
     //////////////////////////////////////////////////
     void vgActiveTexture(VGenum texture) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1668,7 +1498,7 @@ namespace ho {
     // GL VERSION 1.4 API
     //////////////////////////////////////////////////
     void vgBlendFuncSeparate(VGenum sfactorRGB, VGenum dfactorRGB, VGenum sfactorAlpha, VGenum dfactorAlpha) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1690,7 +1520,7 @@ namespace ho {
         vg.state_.blend_dst_alpha_factor = dfactorAlpha;
     }
     void vgMultiDrawArrays(VGenum mode, const VGint* first, const VGsizei* count, VGsizei drawcount) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1713,7 +1543,7 @@ namespace ho {
     }
     void vgMultiDrawElements(VGenum mode, const VGsizei* count, VGenum type, const void* const* indices,
                              VGsizei drawcount) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
 
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
@@ -1743,14 +1573,14 @@ namespace ho {
     }
 
     void vgBlendColor(VGfloat red, VGfloat green, VGfloat blue, VGfloat alpha) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
         vg.state_.blend_constant = {red, green, blue, alpha};
     }
     void vgBlendEquation(VGenum mode) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1767,8 +1597,175 @@ namespace ho {
     //////////////////////////////////////////////////
     // GL VERSION 1.5 API
     //////////////////////////////////////////////////
+    void vgGenQueries(VGsizei n, VGuint* ids) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+        if (n < 0) {
+            vg.state_.error_state = VG_INVALID_VALUE;
+            return;
+        }
+        if (!ids) {
+            return;
+        }
+        for (VGsizei i = 0; i < n; i++) {
+            vg.base_id_++;
+            VirtualGPU::QueryObject query;
+            query.id = vg.base_id_;
+            vg.query_pool_.insert({vg.base_id_, query});
+            ids[i] = vg.base_id_;
+        }
+    }
+
+    void vgDeleteQueries(VGsizei n, const VGuint* ids) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+        if (n < 0) {
+            vg.state_.error_state = VG_INVALID_VALUE;
+            return;
+        }
+        if (!ids) {
+            return;
+        }
+
+        for (VGsizei i = 0; i < n; i++) {
+            auto it = vg.query_pool_.find(ids[i]);
+            if (it == vg.query_pool_.end()) {
+                continue;
+            }
+
+            // An active query ends without a result.
+            for (size_t t = 0; t < static_cast<size_t>(VirtualGPU::QUERY_TARGET_COUNT); t++) {
+                if (vg.current_queries_[t] == &it->second) {
+                    vg.current_queries_[t] = nullptr;
+                    vg.running_queries_[t] = nullptr;
+                }
+            }
+            vg.query_pool_.erase(it);
+        }
+    }
+
+    VGboolean vgIsQuery(VGuint id) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        return static_cast<VGboolean>(vg.query_pool_.count(id) != 0 ? VG_TRUE : VG_FALSE);
+    }
+
+    void vgBeginQuery(VGenum target, VGuint id) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+
+        const size_t target_index = VirtualGPU::GetQueryTargetIndex(target);
+        if (target_index == INVALID_SLOT) {
+            vg.state_.error_state = VG_INVALID_ENUM;
+            return;
+        }
+
+        auto it = vg.query_pool_.find(id);
+        if (it == vg.query_pool_.end() || vg.current_queries_[target_index] != nullptr) {
+            vg.state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+        VirtualGPU::QueryObject& query = it->second;
+        if (query.is_active || (query.target != VG_NONE && query.target != target)) {
+            vg.state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+
+        query.target = target;
+        query.is_active = true;
+        vg.current_queries_[target_index] = &query;
+
+        VirtualGPU::Command cmd;
+        cmd.type = VirtualGPU::CommandType::BEGIN_QUERY;
+        cmd.query = &query;
+        vg.RunCommand(cmd);
+    }
+
+    void vgEndQuery(VGenum target) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+
+        const size_t target_index = VirtualGPU::GetQueryTargetIndex(target);
+        if (target_index == INVALID_SLOT) {
+            vg.state_.error_state = VG_INVALID_ENUM;
+            return;
+        }
+
+        VirtualGPU::QueryObject* query = vg.current_queries_[target_index];
+        if (!query) {
+            vg.state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+
+        query->is_active = false;
+        query->end_count++;
+        vg.current_queries_[target_index] = nullptr;
+
+        VirtualGPU::Command cmd;
+        cmd.type = VirtualGPU::CommandType::END_QUERY;
+        cmd.query = query;
+        vg.RunCommand(cmd);
+    }
+
+    void vgGetQueryiv(VGenum target, VGenum pname, VGint* params) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+
+        // Timestamps are never active.
+        const size_t target_index = VirtualGPU::GetQueryTargetIndex(target);
+        if (target_index == INVALID_SLOT && target != VG_TIMESTAMP) {
+            vg.state_.error_state = VG_INVALID_ENUM;
+            return;
+        }
+        if (!params) {
+            return;
+        }
+
+        switch (pname) {
+            case VG_CURRENT_QUERY: {
+                const VirtualGPU::QueryObject* query =
+                    target_index == INVALID_SLOT ? nullptr : vg.current_queries_[target_index];
+                *params = query ? static_cast<VGint>(query->id) : 0;
+                break;
+            }
+            case VG_QUERY_COUNTER_BITS:
+                *params = 64;
+                break;
+            default:
+                vg.state_.error_state = VG_INVALID_ENUM;
+                break;
+        }
+    }
+
+    void vgGetQueryObjectiv(VGuint id, VGenum pname, VGint* params) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        uint64_t value = 0;
+        if (vg.GetQueryObject(id, pname, value) && params) {
+            *params = static_cast<VGint>(math::Min(value, static_cast<uint64_t>(std::numeric_limits<VGint>::max())));
+        }
+    }
+
+    void vgGetQueryObjectuiv(VGuint id, VGenum pname, VGuint* params) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        uint64_t value = 0;
+        if (vg.GetQueryObject(id, pname, value) && params) {
+            *params = static_cast<VGuint>(math::Min(value, static_cast<uint64_t>(std::numeric_limits<VGuint>::max())));
+        }
+    }
+
     void vgBindBuffer(VGenum target, VGuint buffer) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1823,7 +1820,7 @@ namespace ho {
     }
 
     void vgDeleteBuffers(VGsizei n, const VGuint* buffers) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1857,7 +1854,7 @@ namespace ho {
     }
 
     void vgGenBuffers(VGsizei n, VGuint* buffers) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -1877,7 +1874,7 @@ namespace ho {
         }
     }
     VGboolean vgIsBuffer(VGuint buffer) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (buffer == 0u) {
             return static_cast<VGboolean>(VG_FALSE);
         }
@@ -1893,7 +1890,8 @@ namespace ho {
         }
     }
     void vgBufferData(VGenum target, VGsizeiptr size, const void* data, VGenum usage) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
 
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
@@ -1948,7 +1946,8 @@ namespace ho {
     }
 
     void vgBufferSubData(VGenum target, VGintptr offset, VGsizeiptr size, const void* data) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
 
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
@@ -2007,7 +2006,7 @@ namespace ho {
     // GL VERSION 2.0 API
     //////////////////////////////////////////////////
     void vgBlendEquationSeparate(VGenum modeRGB, VGenum modeAlpha) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2022,7 +2021,8 @@ namespace ho {
     }
 
     void vgDrawBuffers(VGsizei n, const VGenum* bufs) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        // Recorded commands keep the draw buffers they were recorded with.
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2065,7 +2065,7 @@ namespace ho {
     }
 
     void vgStencilOpSeparate(VGenum face, VGenum sfail, VGenum dpfail, VGenum dppass) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2115,7 +2115,7 @@ namespace ho {
         }
     }
     void vgStencilFuncSeparate(VGenum face, VGenum func, VGint ref, VGuint mask) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2148,7 +2148,7 @@ namespace ho {
         }
     }
     void vgStencilMaskSeparate(VGenum face, VGuint mask) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2168,7 +2168,8 @@ namespace ho {
         }
     }
     void vgAttachShader(VGuint program, VGuint shader) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2228,7 +2229,7 @@ namespace ho {
     }  // no op
     void vgCompileShader(VGuint shader) { (void)shader; }  // no op
     VGuint vgCreateProgram(void) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return 0;
         }
@@ -2240,7 +2241,7 @@ namespace ho {
         return vg.base_id_;
     }
     VGuint vgCreateShader(VGenum type) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return 0;
         }
@@ -2258,7 +2259,7 @@ namespace ho {
         return vg.base_id_;
     }
     void vgDeleteProgram(VGuint program) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2280,7 +2281,7 @@ namespace ho {
         DestroyProgram(program);
     }
     void vgDeleteShader(VGuint shader) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2302,7 +2303,8 @@ namespace ho {
         DestroyShader(shader);
     }
     void vgDetachShader(VGuint program, VGuint shader) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2350,7 +2352,8 @@ namespace ho {
         prog.link_status = VG_FALSE;
     }
     void vgEnableVertexAttribArray(VGuint index) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2369,7 +2372,8 @@ namespace ho {
     }
 
     void vgDisableVertexAttribArray(VGuint index) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2387,7 +2391,7 @@ namespace ho {
         vg.bound_vertex_array_->index_to_attrib[index].enabled = false;
     }
     VGint vgGetUniformLocation(VGuint program, uint32_t name_hash) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return -1;
         }
@@ -2417,7 +2421,7 @@ namespace ho {
         return vgGetUniformLocation(program, fnv1a_32(name, strlen(name)));
     }
     VGboolean vgIsProgram(VGuint program) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (program == 0u) {
             return static_cast<VGboolean>(VG_FALSE);
         }
@@ -2433,7 +2437,7 @@ namespace ho {
         }
     }
     VGboolean vgIsShader(VGuint shader) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (shader == 0u) {
             return static_cast<VGboolean>(VG_FALSE);
         }
@@ -2449,7 +2453,8 @@ namespace ho {
         }
     }
     void vgLinkProgram(VGuint program) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2477,16 +2482,22 @@ namespace ho {
         prog.flat_varying_count = 0;
         prog.flat_varying_name_hashes.fill(0);
         prog.flat_varying_descs.fill({VG_FLOAT, 0, 0});
+        prog.is_varying_layout_linked = false;
+        prog.varying_stride = 0;
+        prog.smooth_register_size = 0;
+        prog.flat_register_size = 0;
 
         prog.uniforms.clear();
         prog.uniform_name_hash_to_location.clear();
+        prog.uniform_lookup = VirtualGPU::UniformLookup();
 
         prog.fragout_name_hash_to_draw_buffer_slot.clear();
 
         it->second.link_status = VG_TRUE;
     }
     void vgShaderSource(VGuint shader, void* source) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2504,8 +2515,54 @@ namespace ho {
 
         it->second.source = source;
     }
+    void vgShaderSourceWide(VGuint shader, void* source) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+
+        if (shader > vg.base_id_) {
+            vg.state_.error_state = VG_INVALID_VALUE;
+            return;
+        }
+
+        auto it = vg.shader_pool_.find(shader);
+        if (it == vg.shader_pool_.end() || it->second.is_deleted) {
+            vg.state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+
+        it->second.wide_source = source;
+    }
+    void vgProgramParameteri(VGuint program, VGenum pname, VGint value) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+
+        auto it = vg.program_pool_.find(program);
+        if (it == vg.program_pool_.end()) {
+            vg.state_.error_state = VG_INVALID_VALUE;
+            return;
+        }
+
+        if (pname != VG_EARLY_FRAGMENT_TESTS) {
+            vg.state_.error_state = VG_INVALID_ENUM;
+            return;
+        }
+
+        if (value != static_cast<VGint>(VG_TRUE) && value != static_cast<VGint>(VG_FALSE)) {
+            vg.state_.error_state = VG_INVALID_VALUE;
+            return;
+        }
+
+        it->second.early_fragment_tests = value == static_cast<VGint>(VG_TRUE);
+    }
+
     void vgUseProgram(VGuint program) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2543,7 +2600,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::Uniform* vgUniform1t(VGint location, T v0) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -2578,7 +2635,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::Uniform* vgUniform2t(VGint location, T v0, T v1) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -2614,7 +2671,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::Uniform* vgUniform3t(VGint location, T v0, T v1, T v2) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -2650,7 +2707,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::Uniform* vgUniform4t(VGint location, T v0, T v1, T v2, T v3) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -2686,7 +2743,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::Uniform* vgUniform1tv(VGint location, VGsizei count, const T* value) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -2726,7 +2783,7 @@ namespace ho {
 
     template <typename T, size_t N>
     VirtualGPU::Uniform* vgUniformNtv(VGint location, VGsizei count, const T* value) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -2892,7 +2949,7 @@ namespace ho {
         }
     }
     void vgUniformMatrix2fv(VGint location, VGsizei count, VGboolean transpose, const VGfloat* value) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -2947,7 +3004,7 @@ namespace ho {
         }
     }
     void vgUniformMatrix3fv(VGint location, VGsizei count, VGboolean transpose, const VGfloat* value) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -3007,7 +3064,7 @@ namespace ho {
         }
     }
     void vgUniformMatrix4fv(VGint location, VGsizei count, VGboolean transpose, const VGfloat* value) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -3131,7 +3188,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::ConstantAttribute* vgVertexAttrib1t(VGuint index, T x) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -3150,7 +3207,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::ConstantAttribute* vgVertexAttrib1tv(VGuint index, const T* v) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -3169,7 +3226,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::ConstantAttribute* vgVertexAttrib2t(VGuint index, T x, T y) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -3188,7 +3245,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::ConstantAttribute* vgVertexAttrib2tv(VGuint index, const T* v) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -3207,7 +3264,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::ConstantAttribute* vgVertexAttrib3t(VGuint index, T x, T y, T z) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -3226,7 +3283,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::ConstantAttribute* vgVertexAttrib3tv(VGuint index, const T* v) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -3245,7 +3302,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::ConstantAttribute* vgVertexAttrib4t(VGuint index, T x, T y, T z, T w) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -3264,7 +3321,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::ConstantAttribute* vgVertexAttrib4tv(VGuint index, const T* v) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -3283,7 +3340,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::ConstantAttribute* vgVertexAttrib4Nt(VGuint index, T x, T y, T z, T w) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -3302,7 +3359,7 @@ namespace ho {
 
     template <typename T>
     VirtualGPU::ConstantAttribute* vgVertexAttrib4Ntv(VGuint index, const T* v) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return nullptr;
         }
@@ -3539,7 +3596,8 @@ namespace ho {
     }
     void vgVertexAttribPointer(VGuint index, VGint size, VGenum type, VGboolean normalized, VGsizei stride,
                                const void* pointer) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -3605,7 +3663,7 @@ namespace ho {
     // GL VERSION 3.0 API
     //////////////////////////////////////////////////
     void vgColorMaski(VGuint index, VGboolean r, VGboolean g, VGboolean b, VGboolean a) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -3622,7 +3680,7 @@ namespace ho {
     }
 
     void vgEnablei(VGenum target, VGuint index) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -3640,7 +3698,7 @@ namespace ho {
         vg.state_.draw_buffer_states[static_cast<size_t>(index)].blend_enabled = true;
     }
     void vgDisablei(VGenum target, VGuint index) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -3658,7 +3716,7 @@ namespace ho {
         vg.state_.draw_buffer_states[static_cast<size_t>(index)].blend_enabled = false;
     }
     VGboolean vgIsEnabledi(VGenum target, VGuint index) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return static_cast<VGboolean>(VG_FALSE);
         }
@@ -3676,7 +3734,8 @@ namespace ho {
         return vg.state_.draw_buffer_states[static_cast<size_t>(index)].blend_enabled;
     }
     void vgBindBufferRange(VGenum target, VGuint index, VGuint buffer, VGintptr offset, VGsizeiptr size) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -3742,7 +3801,8 @@ namespace ho {
     }
 
     void vgBindBufferBase(VGenum target, VGuint index, VGuint buffer) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -3761,8 +3821,55 @@ namespace ho {
         vgBindBufferRange(target, index, buffer, 0, static_cast<VGsizeiptr>(it->second.memory->size()));
     }
 
+    void vgBeginConditionalRender(VGuint id, VGenum mode) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+
+        switch (mode) {
+            case VG_QUERY_WAIT:
+            case VG_QUERY_NO_WAIT:
+            case VG_QUERY_BY_REGION_WAIT:
+            case VG_QUERY_BY_REGION_NO_WAIT:
+                break;
+            default:
+                vg.state_.error_state = VG_INVALID_ENUM;
+                return;
+        }
+
+        auto it = vg.query_pool_.find(id);
+        if (it == vg.query_pool_.end()) {
+            vg.state_.error_state = VG_INVALID_VALUE;
+            return;
+        }
+        const VirtualGPU::QueryObject& query = it->second;
+        if (vg.state_.conditional_render_query != 0 || query.is_active ||
+            (query.target != VG_SAMPLES_PASSED && query.target != VG_ANY_SAMPLES_PASSED)) {
+            vg.state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+
+        vg.state_.conditional_render_query = id;
+        vg.state_.conditional_render_mode = mode;
+    }
+
+    void vgEndConditionalRender(void) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+
+        if (vg.state_.conditional_render_query == 0) {
+            vg.state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+        vg.state_.conditional_render_query = 0;
+    }
+
     void vgVertexAttribIPointer(VGuint index, VGint size, VGenum type, VGsizei stride, const void* pointer) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -3965,7 +4072,8 @@ namespace ho {
         }
     }
     void vgBindFragDataLocation(VGuint program, VGuint color, uint32_t name_hash) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4001,7 +4109,7 @@ namespace ho {
         return vgBindFragDataLocation(program, color, fnv1a_32(name, strlen(name)));
     }
     VGint vgGetFragDataLocation(VGuint program, uint32_t name_hash) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return -1;
         }
@@ -4094,7 +4202,8 @@ namespace ho {
         }
     }
     void vgClearBufferiv(VGenum buffer, VGint drawbuffer, const VGint* value) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4134,7 +4243,8 @@ namespace ho {
     }
 
     void vgClearBufferuiv(VGenum buffer, VGint drawbuffer, const VGuint* value) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4160,7 +4270,8 @@ namespace ho {
     }
 
     void vgClearBufferfv(VGenum buffer, VGint drawbuffer, const VGfloat* value) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4215,7 +4326,8 @@ namespace ho {
     }
 
     void vgClearBufferfi(VGenum buffer, VGint drawbuffer, VGfloat depth, VGint stencil) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4234,7 +4346,7 @@ namespace ho {
     }
 
     VGboolean vgIsRenderbuffer(VGuint renderbuffer) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
 
         if (renderbuffer == 0u) {
             return static_cast<VGboolean>(VG_FALSE);
@@ -4251,7 +4363,7 @@ namespace ho {
         }
     }
     void vgBindRenderbuffer(VGenum target, VGuint renderbuffer) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4293,7 +4405,7 @@ namespace ho {
     }
 
     void vgDeleteRenderbuffers(VGsizei n, const VGuint* renderbuffers) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4322,7 +4434,7 @@ namespace ho {
         }
     }
     void vgGenRenderbuffers(VGsizei n, VGuint* renderbuffers) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4341,7 +4453,8 @@ namespace ho {
         }
     }
     void vgRenderbufferStorage(VGenum target, VGenum internalformat, VGsizei width, VGsizei height) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4393,12 +4506,13 @@ namespace ho {
                 return;
         }
 
+        vg.InvalidateHiZ(vg.bound_render_buffer_->memory);
         vg.bound_render_buffer_->width = width;
         vg.bound_render_buffer_->height = height;
         vg.bound_render_buffer_->format = internalformat;
     }
     VGboolean vgIsFramebuffer(VGuint framebuffer) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
 
         if (framebuffer == 0u) {
             return static_cast<VGboolean>(VG_FALSE);
@@ -4415,7 +4529,7 @@ namespace ho {
         }
     }
     void vgBindFramebuffer(VGenum target, VGuint framebuffer) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4459,7 +4573,7 @@ namespace ho {
     }
 
     void vgDeleteFramebuffers(VGsizei n, const VGuint* framebuffers) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4488,7 +4602,7 @@ namespace ho {
         }
     }
     void vgGenFramebuffers(VGsizei n, VGuint* framebuffers) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4507,7 +4621,7 @@ namespace ho {
         }
     }
     VGenum vgCheckFramebufferStatus(VGenum target) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return VG_FRAMEBUFFER_UNDEFINED;
         }
@@ -4594,7 +4708,8 @@ namespace ho {
     }
 
     void vgFramebufferTexture1D(VGenum target, VGenum attachment, VGenum textarget, VGuint texture, VGint level) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) return;
 
         VirtualGPU::FrameBuffer* fb = nullptr;
@@ -4677,7 +4792,8 @@ namespace ho {
     }
 
     void vgFramebufferTexture2D(VGenum target, VGenum attachment, VGenum textarget, VGuint texture, VGint level) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4763,7 +4879,8 @@ namespace ho {
 
     void vgFramebufferTexture3D(VGenum target, VGenum attachment, VGenum textarget, VGuint texture, VGint level,
                                 VGint zoffset) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) return;
 
         VirtualGPU::FrameBuffer* fb = nullptr;
@@ -4854,7 +4971,8 @@ namespace ho {
     }
 
     void vgFramebufferRenderbuffer(VGenum target, VGenum attachment, VGenum renderbuffertarget, VGuint renderbuffer) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4927,8 +5045,36 @@ namespace ho {
         attch->component_type = rb.component_type;
     }
 
+    void vgGenerateMipmap(VGenum target) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+
+        if (target != VG_TEXTURE_1D && target != VG_TEXTURE_2D && target != VG_TEXTURE_3D) {
+            vg.state_.error_state = VG_INVALID_ENUM;
+            return;
+        }
+        const size_t slot = vg::GetTextureSlot(target);
+
+        VirtualGPU::TextureObject* tex = vg.texture_units_[vg.active_texture_unit_].bound_texture_targets[slot];
+        if (!tex || tex->is_deleted) {
+            vg.state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+
+        // Depth and stencil values are not averaged.
+        if (!tex->mipmap[0].memory || !vg::IsColorFormat(tex->internal_format)) {
+            vg.state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+
+        vg.GenerateMipmap(*tex);
+    }
+
     void vgBindVertexArray(VGuint array) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4964,7 +5110,7 @@ namespace ho {
     }
 
     void vgDeleteVertexArrays(VGsizei n, const VGuint* arrays) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -4995,7 +5141,7 @@ namespace ho {
     }
 
     void vgGenVertexArrays(VGsizei n, VGuint* arrays) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -5014,7 +5160,7 @@ namespace ho {
         }
     }
     VGboolean vgIsVertexArray(VGuint array) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
 
         if (array == 0u) {
             return static_cast<VGboolean>(VG_FALSE);
@@ -5036,7 +5182,8 @@ namespace ho {
     //////////////////////////////////////////////////
 
     void vgFramebufferTexture(VGenum target, VGenum attachment, VGuint texture, VGint level) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -5099,11 +5246,140 @@ namespace ho {
         }
     }
 
+    VGsync vgFenceSync(VGenum condition, VGbitfield flags) {
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+
+        if (condition != VG_SYNC_GPU_COMMANDS_COMPLETE) {
+            vg.SetSyncError(VG_INVALID_ENUM);
+            return nullptr;
+        }
+        if (flags != 0) {
+            vg.SetSyncError(VG_INVALID_VALUE);
+            return nullptr;
+        }
+
+        vg.base_id_++;
+        VGsync sync = reinterpret_cast<VGsync>(static_cast<uintptr_t>(vg.base_id_));
+        VirtualGPU::SyncObject obj;
+        obj.counter = vg.GetPendingCounter();
+        vg.sync_pool_.emplace(sync, std::move(obj));
+        return sync;
+    }
+
+    VGboolean vgIsSync(VGsync sync) {
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+        return static_cast<VGboolean>(vg.sync_pool_.count(sync) != 0 ? VG_TRUE : VG_FALSE);
+    }
+
+    void vgDeleteSync(VGsync sync) {
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+        if (sync == nullptr) {
+            return;
+        }
+
+        auto it = vg.sync_pool_.find(sync);
+        if (it == vg.sync_pool_.end()) {
+            vg.SetSyncError(VG_INVALID_VALUE);
+            return;
+        }
+        vg.sync_pool_.erase(it);
+    }
+
+    VGenum vgClientWaitSync(VGsync sync, VGbitfield flags, VGuint64 timeout) {
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+
+        auto it = vg.sync_pool_.find(sync);
+        if (it == vg.sync_pool_.end() || (flags & ~VG_SYNC_FLUSH_COMMANDS_BIT) != 0) {
+            vg.SetSyncError(VG_INVALID_VALUE);
+            return VG_WAIT_FAILED;
+        }
+        // The pool may rehash while waiting.
+        const std::shared_ptr<AtomicNumeric<uint32_t>> counter = it->second.counter;
+
+        if (it->second.IsSignaled()) {
+            return VG_ALREADY_SIGNALED;
+        }
+        const bool is_flush_requested = (flags & VG_SYNC_FLUSH_COMMANDS_BIT) != 0;
+        if (timeout == 0 && !is_flush_requested) {
+            return VG_TIMEOUT_EXPIRED;
+        }
+
+        // Clamped so that the deadline does not overflow.
+        const VGuint64 max_timeout = static_cast<VGuint64>(std::chrono::nanoseconds::max().count() / 2);
+        const auto deadline =
+            std::chrono::steady_clock::now() +
+            std::chrono::nanoseconds(static_cast<std::chrono::nanoseconds::rep>(math::Min(timeout, max_timeout)));
+        // A fence on commands that were not submitted yet would never signal, so they are flushed. A poll with
+        // VG_SYNC_FLUSH_COMMANDS_BIT flushes once the commands submitted before are done, so polling ends.
+        if (counter == vg.recorded_counter_) {
+            if (vg.submitted_counter_ != nullptr && timeout != VG_TIMEOUT_IGNORED &&
+                !vg.job_system_->TryWaitForCounter(vg.submitted_counter_,
+                                                   deadline - std::chrono::steady_clock::now())) {
+                return VG_TIMEOUT_EXPIRED;
+            }
+            vg.Flush();
+        }
+
+        if (timeout == VG_TIMEOUT_IGNORED) {
+            vg.job_system_->WaitForCounter(counter);
+            return VG_CONDITION_SATISFIED;
+        }
+        return vg.job_system_->TryWaitForCounter(counter, deadline - std::chrono::steady_clock::now())
+                   ? VG_CONDITION_SATISFIED
+                   : VG_TIMEOUT_EXPIRED;
+    }
+
+    void vgWaitSync(VGsync sync, VGbitfield flags, VGuint64 timeout) {
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+
+        if (vg.sync_pool_.count(sync) == 0 || flags != 0 || timeout != VG_TIMEOUT_IGNORED) {
+            vg.SetSyncError(VG_INVALID_VALUE);
+            return;
+        }
+        // Commands run in issue order, later commands never pass the fence.
+    }
+
+    void vgGetSynciv(VGsync sync, VGenum pname, VGsizei count, VGsizei* length, VGint* values) {
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+
+        auto it = vg.sync_pool_.find(sync);
+        if (it == vg.sync_pool_.end() || count < 0) {
+            vg.SetSyncError(VG_INVALID_VALUE);
+            return;
+        }
+
+        VGint value = 0;
+        switch (pname) {
+            case VG_OBJECT_TYPE:
+                value = static_cast<VGint>(VG_SYNC_FENCE);
+                break;
+            case VG_SYNC_STATUS:
+                value = static_cast<VGint>(it->second.IsSignaled() ? VG_SIGNALED : VG_UNSIGNALED);
+                break;
+            case VG_SYNC_CONDITION:
+                value = static_cast<VGint>(VG_SYNC_GPU_COMMANDS_COMPLETE);
+                break;
+            case VG_SYNC_FLAGS:
+                value = 0;
+                break;
+            default:
+                vg.SetSyncError(VG_INVALID_ENUM);
+                return;
+        }
+
+        if (count > 0 && values) {
+            values[0] = value;
+        }
+        if (length) {
+            *length = count > 0 ? 1 : 0;
+        }
+    }
+
     //////////////////////////////////////////////////
     // GL VERSION 3.3 API
     //////////////////////////////////////////////////
     void vgGenSamplers(VGsizei count, VGuint* samplers) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -5122,7 +5398,7 @@ namespace ho {
         }
     }
     void vgDeleteSamplers(VGsizei count, const VGuint* samplers) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -5155,7 +5431,7 @@ namespace ho {
     }
 
     VGboolean vgIsSampler(VGuint sampler) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
 
         if (sampler == 0u) {
             return static_cast<VGboolean>(VG_FALSE);
@@ -5171,7 +5447,7 @@ namespace ho {
         }
     }
     void vgBindSampler(VGuint unit, VGuint sampler) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -5219,7 +5495,8 @@ namespace ho {
     }
 
     void vgSamplerParameteri(VGuint sampler, VGenum pname, VGint param) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -5260,7 +5537,8 @@ namespace ho {
                 break;
 
             case VG_TEXTURE_MIN_FILTER:
-                if (eparam >= VG_NEAREST && eparam <= VG_LINEAR)
+                if ((eparam >= VG_NEAREST && eparam <= VG_LINEAR) ||
+                    (eparam >= VG_NEAREST_MIPMAP_NEAREST && eparam <= VG_LINEAR_MIPMAP_LINEAR))
                     ds.min_filter = param;
                 else
                     vg.state_.error_state = VG_INVALID_ENUM;
@@ -5307,7 +5585,8 @@ namespace ho {
     }
 
     void vgSamplerParameteriv(VGuint sampler, VGenum pname, const VGint* params) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -5339,7 +5618,7 @@ namespace ho {
     }
 
     // void vgSamplerParameterf(VGuint sampler, VGenum pname, VGfloat param) {
-    //     VirtualGPU& vg = VirtualGPU::GetInstance();
+    //     VirtualGPU& vg = VirtualGPU::GetContext();
     //     if (vg.state_.error_state != VG_NO_ERROR) {
     //         return;
     //     }
@@ -5359,7 +5638,8 @@ namespace ho {
     // }
 
     void vgSamplerParameterfv(VGuint sampler, VGenum pname, const VGfloat* params) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         if (vg.state_.error_state != VG_NO_ERROR) {
             return;
         }
@@ -5386,14 +5666,64 @@ namespace ho {
                 break;
         }
     }
+
+    void vgQueryCounter(VGuint id, VGenum target) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        if (vg.state_.error_state != VG_NO_ERROR) {
+            return;
+        }
+
+        if (target != VG_TIMESTAMP) {
+            vg.state_.error_state = VG_INVALID_ENUM;
+            return;
+        }
+
+        auto it = vg.query_pool_.find(id);
+        if (it == vg.query_pool_.end()) {
+            vg.state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+        VirtualGPU::QueryObject& query = it->second;
+        if (query.is_active || (query.target != VG_NONE && query.target != VG_TIMESTAMP)) {
+            vg.state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+
+        query.target = VG_TIMESTAMP;
+        query.end_count++;
+
+        VirtualGPU::Command cmd;
+        cmd.type = VirtualGPU::CommandType::QUERY_COUNTER;
+        cmd.query = &query;
+        vg.RunCommand(cmd);
+    }
+
+    void vgGetQueryObjecti64v(VGuint id, VGenum pname, VGint64* params) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        uint64_t value = 0;
+        if (vg.GetQueryObject(id, pname, value) && params) {
+            const uint64_t max_value = static_cast<uint64_t>(std::numeric_limits<VGint64>::max());
+            *params = static_cast<VGint64>(math::Min(value, max_value));
+        }
+    }
+
+    void vgGetQueryObjectui64v(VGuint id, VGenum pname, VGuint64* params) {
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        uint64_t value = 0;
+        if (vg.GetQueryObject(id, pname, value) && params) {
+            *params = value;
+        }
+    }
+
     // ======================================================
     // Helper Implementation
     // ======================================================
     void FreeVram(std::vector<uint8_t>* mem) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (!mem) {
             return;
         }
+        vg.InvalidateHiZ(mem);
         for (auto it = vg.vram_.begin(); it != vg.vram_.end(); ++it) {
             if (&(*it) == mem) {
                 vg.vram_.erase(it);
@@ -5403,7 +5733,7 @@ namespace ho {
     }
 
     void ReleaseAttachment(VGuint refid) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         if (refid == 0u) {
             return;
         }
@@ -5419,7 +5749,7 @@ namespace ho {
     }
 
     void ReleaseVertexArray(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         auto it = vg.vertex_array_pool_.find(id);
         if (it == vg.vertex_array_pool_.end()) {
             return;
@@ -5435,7 +5765,7 @@ namespace ho {
     }
 
     void ReleaseBufferObject(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         auto it = vg.buffer_pool_.find(id);
         if (it == vg.buffer_pool_.end()) {
             return;
@@ -5450,7 +5780,7 @@ namespace ho {
     }
 
     void ReleaseTextureObject(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         auto it = vg.texture_pool_.find(id);
         if (it == vg.texture_pool_.end()) {
             return;
@@ -5465,7 +5795,7 @@ namespace ho {
     }
 
     void ReleaseSampler(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         auto it = vg.sampler_pool_.find(id);
         if (it == vg.sampler_pool_.end()) {
             return;
@@ -5480,7 +5810,7 @@ namespace ho {
     }
 
     void ReleaseFrameBuffer(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         auto it = vg.frame_buffer_pool_.find(id);
         if (it == vg.frame_buffer_pool_.end()) {
             return;
@@ -5495,7 +5825,7 @@ namespace ho {
     }
 
     void ReleaseRenderBuffer(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         auto it = vg.render_buffer_pool_.find(id);
         if (it == vg.render_buffer_pool_.end()) {
             return;
@@ -5510,7 +5840,7 @@ namespace ho {
     }
 
     void ReleaseShader(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         auto it = vg.shader_pool_.find(id);
         if (it == vg.shader_pool_.end()) {
             return;
@@ -5525,7 +5855,7 @@ namespace ho {
     }
 
     void ReleaseProgram(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
         auto it = vg.program_pool_.find(id);
         if (it == vg.program_pool_.end()) {
             return;
@@ -5540,7 +5870,8 @@ namespace ho {
     }
 
     void DestroyVertexArray(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         auto it = vg.vertex_array_pool_.find(id);
         if (it == vg.vertex_array_pool_.end()) {
             return;
@@ -5567,7 +5898,8 @@ namespace ho {
     }
 
     void DestroyBufferObject(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         auto it = vg.buffer_pool_.find(id);
         if (it == vg.buffer_pool_.end()) {
             return;
@@ -5585,7 +5917,8 @@ namespace ho {
     }
 
     void DestroyTextureObject(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         auto it = vg.texture_pool_.find(id);
         if (it == vg.texture_pool_.end()) {
             return;
@@ -5607,7 +5940,8 @@ namespace ho {
     }
 
     void DestroySampler(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         auto it = vg.sampler_pool_.find(id);
         if (it == vg.sampler_pool_.end()) {
             return;
@@ -5622,7 +5956,8 @@ namespace ho {
     }
 
     void DestroyFrameBuffer(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         auto it = vg.frame_buffer_pool_.find(id);
         if (it == vg.frame_buffer_pool_.end()) {
             return;
@@ -5649,7 +5984,8 @@ namespace ho {
     }
 
     void DestroyRenderBuffer(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         auto it = vg.render_buffer_pool_.find(id);
         if (it == vg.render_buffer_pool_.end()) {
             return;
@@ -5668,7 +6004,8 @@ namespace ho {
     }
 
     void DestroyShader(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         auto it = vg.shader_pool_.find(id);
         if (it == vg.shader_pool_.end()) {
             return;
@@ -5685,7 +6022,8 @@ namespace ho {
     }
 
     void DestroyProgram(VGuint id) {
-        VirtualGPU& vg = VirtualGPU::GetInstance();
+        VirtualGPU& vg = VirtualGPU::GetContext();
+        vg.Finish();
         auto it = vg.program_pool_.find(id);
         if (it == vg.program_pool_.end()) {
             return;
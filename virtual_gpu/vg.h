@@ -185,10 +185,10 @@ namespace ho {
     // INLINE constexpr VGenum VG_EXTENSIONS = 0x1F03;
     INLINE constexpr VGenum VG_NEAREST = 0x2600;
     INLINE constexpr VGenum VG_LINEAR = 0x2601;
-    // INLINE constexpr VGenum VG_NEAREST_MIPMAP_NEAREST = 0x2700;
-    // INLINE constexpr VGenum VG_LINEAR_MIPMAP_NEAREST = 0x2701;
-    // INLINE constexpr VGenum VG_NEAREST_MIPMAP_LINEAR = 0x2702;
-    // INLINE constexpr VGenum VG_LINEAR_MIPMAP_LINEAR = 0x2703;
+    INLINE constexpr VGenum VG_NEAREST_MIPMAP_NEAREST = 0x2700;
+    INLINE constexpr VGenum VG_LINEAR_MIPMAP_NEAREST = 0x2701;
+    INLINE constexpr VGenum VG_NEAREST_MIPMAP_LINEAR = 0x2702;
+    INLINE constexpr VGenum VG_LINEAR_MIPMAP_LINEAR = 0x2703;
     INLINE constexpr VGenum VG_TEXTURE_MAG_FILTER = 0x2800;
     INLINE constexpr VGenum VG_TEXTURE_MIN_FILTER = 0x2801;
     INLINE constexpr VGenum VG_TEXTURE_WRAP_S = 0x2802;
@@ -500,10 +500,10 @@ namespace ho {
 
     // INLINE constexpr VGenum VG_BUFFER_SIZE = 0x8764;
     // INLINE constexpr VGenum VG_BUFFER_USAGE = 0x8765;
-    // INLINE constexpr VGenum VG_QUERY_COUNTER_BITS = 0x8864;
-    // INLINE constexpr VGenum VG_CURRENT_QUERY = 0x8865;
-    // INLINE constexpr VGenum VG_QUERY_RESULT = 0x8866;
-    // INLINE constexpr VGenum VG_QUERY_RESULT_AVAILABLE = 0x8867;
+    INLINE constexpr VGenum VG_QUERY_COUNTER_BITS = 0x8864;
+    INLINE constexpr VGenum VG_CURRENT_QUERY = 0x8865;
+    INLINE constexpr VGenum VG_QUERY_RESULT = 0x8866;
+    INLINE constexpr VGenum VG_QUERY_RESULT_AVAILABLE = 0x8867;
     INLINE constexpr VGenum VG_ARRAY_BUFFER = 0x8892;
     INLINE constexpr VGenum VG_ELEMENT_ARRAY_BUFFER = 0x8893;
     // INLINE constexpr VGenum VG_ARRAY_BUFFER_BINDING = 0x8894;
@@ -524,17 +524,17 @@ namespace ho {
     INLINE constexpr VGenum VG_DYNAMIC_DRAW = 0x88E8;
     INLINE constexpr VGenum VG_DYNAMIC_READ = 0x88E9;
     INLINE constexpr VGenum VG_DYNAMIC_COPY = 0x88EA;
-    // INLINE constexpr VGenum VG_SAMPLES_PASSED = 0x8914;
+    INLINE constexpr VGenum VG_SAMPLES_PASSED = 0x8914;
     // INLINE constexpr VGenum VG_SRC1_ALPHA = 0x8589;
 
-    // void vgGenQueries(VGsizei n, VGuint* ids);
-    // void vgDeleteQueries(VGsizei n, const VGuint* ids);
-    // VGboolean vgIsQuery(VGuint id);
-    // void vgBeginQuery(VGenum target, VGuint id);
-    // void vgEndQuery(VGenum target);
-    // void vgGetQueryiv(VGenum target, VGenum pname, VGint* params);
-    // void vgGetQueryObjectiv(VGuint id, VGenum pname, VGint* params);
-    // void vgGetQueryObjectuiv(VGuint id, VGenum pname, VGuint* params);
+    void vgGenQueries(VGsizei n, VGuint* ids);
+    void vgDeleteQueries(VGsizei n, const VGuint* ids);
+    VGboolean vgIsQuery(VGuint id);
+    void vgBeginQuery(VGenum target, VGuint id);
+    void vgEndQuery(VGenum target);
+    void vgGetQueryiv(VGenum target, VGenum pname, VGint* params);
+    void vgGetQueryObjectiv(VGuint id, VGenum pname, VGint* params);
+    void vgGetQueryObjectuiv(VGuint id, VGenum pname, VGuint* params);
     void vgBindBuffer(VGenum target, VGuint buffer);
     void vgDeleteBuffers(VGsizei n, const VGuint* buffers);
     void vgGenBuffers(VGsizei n, VGuint* buffers);
@@ -873,10 +873,10 @@ namespace ho {
     // INLINE constexpr VGenum VG_UNSIGNED_INT_SAMPLER_CUBE = 0x8DD4;
     // INLINE constexpr VGenum VG_UNSIGNED_INT_SAMPLER_1D_ARRAY = 0x8DD6;
     // INLINE constexpr VGenum VG_UNSIGNED_INT_SAMPLER_2D_ARRAY = 0x8DD7;
-    // INLINE constexpr VGenum VG_QUERY_WAIT = 0x8E13;
-    // INLINE constexpr VGenum VG_QUERY_NO_WAIT = 0x8E14;
-    // INLINE constexpr VGenum VG_QUERY_BY_REGION_WAIT = 0x8E15;
-    // INLINE constexpr VGenum VG_QUERY_BY_REGION_NO_WAIT = 0x8E16;
+    INLINE constexpr VGenum VG_QUERY_WAIT = 0x8E13;
+    INLINE constexpr VGenum VG_QUERY_NO_WAIT = 0x8E14;
+    INLINE constexpr VGenum VG_QUERY_BY_REGION_WAIT = 0x8E15;
+    INLINE constexpr VGenum VG_QUERY_BY_REGION_NO_WAIT = 0x8E16;
     // INLINE constexpr VGenum VG_BUFFER_ACCESS_FLAGS = 0x911F;
     // INLINE constexpr VGenum VG_BUFFER_MAP_LENGTH = 0x9120;
     // INLINE constexpr VGenum VG_BUFFER_MAP_OFFSET = 0x9121;
@@ -1030,8 +1030,8 @@ namespace ho {
     //                                    VGsizei* size, VGenum* type, VGchar*
     //                                    name);
     // void vgClampColor(VGenum target, VGenum clamp);
-    // void vgBeginConditionalRender(VGuint id, VGenum mode);
-    // void vgEndConditionalRender(void);
+    void vgBeginConditionalRender(VGuint id, VGenum mode);
+    void vgEndConditionalRender(void);
     void vgVertexAttribIPointer(VGuint index, VGint size, VGenum type, VGsizei stride, const void* pointer);
     // void vgGetVertexAttribIiv(VGuint index, VGenum pname, VGint* params);
     // void vgGetVertexAttribIuiv(VGuint index, VGenum pname, VGuint* params);
@@ -1096,7 +1096,7 @@ namespace ho {
     void vgFramebufferRenderbuffer(VGenum target, VGenum attachment, VGenum renderbuffertarget, VGuint renderbuffer);
     // void vgGetFramebufferAttachmentParameteriv(VGenum target, VGenum attachment,
     //                                            VGenum pname, VGint* params);
-    // void vgGenerateMipmap(VGenum target);
+    void vgGenerateMipmap(VGenum target);
     // void vgBlitFramebuffer(VGint srcX0, VGint srcY0, VGint srcX1, VGint srcY1,
     //                        VGint dstX0, VGint dstY0, VGint dstX1, VGint dstY1,
     //                        VGbitfield mask, VGenum filter);
@@ -1243,20 +1243,20 @@ namespace ho {
     // INLINE constexpr VGenum VG_PROVOKING_VERTEX = 0x8E4F;
     // INLINE constexpr VGenum VG_TEXTURE_CUBE_MAP_SEAMLESS = 0x884F;
     // INLINE constexpr VGenum VG_MAX_SERVER_WAIT_TIMEOUT = 0x9111;
-    // INLINE constexpr VGenum VG_OBJECT_TYPE = 0x9112;
-    // INLINE constexpr VGenum VG_SYNC_CONDITION = 0x9113;
-    // INLINE constexpr VGenum VG_SYNC_STATUS = 0x9114;
-    // INLINE constexpr VGenum VG_SYNC_FLAGS = 0x9115;
-    // INLINE constexpr VGenum VG_SYNC_FENCE = 0x9116;
-    // INLINE constexpr VGenum VG_SYNC_GPU_COMMANDS_COMPLETE = 0x9117;
-    // INLINE constexpr VGenum VG_UNSIGNALED = 0x9118;
-    // INLINE constexpr VGenum VG_SIGNALED = 0x9119;
-    // INLINE constexpr VGenum VG_ALREADY_SIGNALED = 0x911A;
-    // INLINE constexpr VGenum VG_TIMEOUT_EXPIRED = 0x911B;
-    // INLINE constexpr VGenum VG_CONDITION_SATISFIED = 0x911C;
-    // INLINE constexpr VGenum VG_WAIT_FAILED = 0x911D;
-    // INLINE constexpr VGuint64 VG_TIMEOUT_IGNORED = 0xFFFFFFFFFFFFFFFFull;
-    // INLINE constexpr VGenum VG_SYNC_FLUSH_COMMANDS_BIT = 0x00000001;
+    INLINE constexpr VGenum VG_OBJECT_TYPE = 0x9112;
+    INLINE constexpr VGenum VG_SYNC_CONDITION = 0x9113;
+    INLINE constexpr VGenum VG_SYNC_STATUS = 0x9114;
+    INLINE constexpr VGenum VG_SYNC_FLAGS = 0x9115;
+    INLINE constexpr VGenum VG_SYNC_FENCE = 0x9116;
+    INLINE constexpr VGenum VG_SYNC_GPU_COMMANDS_COMPLETE = 0x9117;
+    INLINE constexpr VGenum VG_UNSIGNALED = 0x9118;
+    INLINE constexpr VGenum VG_SIGNALED = 0x9119;
+    INLINE constexpr VGenum VG_ALREADY_SIGNALED = 0x911A;
+    INLINE constexpr VGenum VG_TIMEOUT_EXPIRED = 0x911B;
+    INLINE constexpr VGenum VG_CONDITION_SATISFIED = 0x911C;
+    INLINE constexpr VGenum VG_WAIT_FAILED = 0x911D;
+    INLINE constexpr VGuint64 VG_TIMEOUT_IGNORED = 0xFFFFFFFFFFFFFFFFull;
+    INLINE constexpr VGenum VG_SYNC_FLUSH_COMMANDS_BIT = 0x00000001;
     // INLINE constexpr VGenum VG_SAMPLE_POSITION = 0x8E50;
     // INLINE constexpr VGenum VG_SAMPLE_MASK = 0x8E51;
     // INLINE constexpr VGenum VG_SAMPLE_MASK_VALUE = 0x8E52;
@@ -1294,14 +1294,13 @@ namespace ho {
     //                                    VGsizei drawcount, const VGint*
     //                                    basevertex);
     // void vgProvokingVertex(VGenum mode);
-    // VGsync vgFenceSync(VGenum condition, VGbitfield flags);
-    // VGboolean vgIsSync(VGsync sync);
-    // void vgDeleteSync(VGsync sync);
-    // VGenum vgClientWaitSync(VGsync sync, VGbitfield flags, VGuint64 timeout);
-    // void vgWaitSync(VGsync sync, VGbitfield flags, VGuint64 timeout);
+    VGsync vgFenceSync(VGenum condition, VGbitfield flags);
+    VGboolean vgIsSync(VGsync sync);
+    void vgDeleteSync(VGsync sync);
+    VGenum vgClientWaitSync(VGsync sync, VGbitfield flags, VGuint64 timeout);
+    void vgWaitSync(VGsync sync, VGbitfield flags, VGuint64 timeout);
     // void vgGetInteger64v(VGenum pname, VGint64* data);
-    // void vgGetSynciv(VGsync sync, VGenum pname, VGsizei count, VGsizei* length,
-    //                  VGint* values);
+    void vgGetSynciv(VGsync sync, VGenum pname, VGsizei count, VGsizei* length, VGint* values);
     // void vgGetInteger64i_v(VGenum target, VGuint index, VGint64* data);
     // void vgGetBufferParameteri64v(VGenum target, VGenum pname, VGint64* params);
     void vgFramebufferTexture(VGenum target, VGenum attachment, VGuint texture, VGint level);
@@ -1323,7 +1322,7 @@ namespace ho {
     // INLINE constexpr VGenum VG_ONE_MINUS_SRC1_COLOR = 0x88FA;
     // INLINE constexpr VGenum VG_ONE_MINUS_SRC1_ALPHA = 0x88FB;
     // INLINE constexpr VGenum VG_MAX_DUAL_SOURCE_DRAW_BUFFERS = 0x88FC;
-    // INLINE constexpr VGenum VG_ANY_SAMPLES_PASSED = 0x8C2F;
+    INLINE constexpr VGenum VG_ANY_SAMPLES_PASSED = 0x8C2F;
     // INLINE constexpr VGenum VG_SAMPLER_BINDING = 0x8919;
     // INLINE constexpr VGenum VG_RGB10_A2UI = 0x906F;
     INLINE constexpr VGenum VG_TEXTURE_SWIZZLE_R = 0x8E42;
@@ -1331,8 +1330,8 @@ namespace ho {
     INLINE constexpr VGenum VG_TEXTURE_SWIZZLE_B = 0x8E44;
     INLINE constexpr VGenum VG_TEXTURE_SWIZZLE_A = 0x8E45;
     INLINE constexpr VGenum VG_TEXTURE_SWIZZLE_RGBA = 0x8E46;
-    // INLINE constexpr VGenum VG_TIME_ELAPSED = 0x88BF;
-    // INLINE constexpr VGenum VG_TIMESTAMP = 0x8E28;
+    INLINE constexpr VGenum VG_TIME_ELAPSED = 0x88BF;
+    INLINE constexpr VGenum VG_TIMESTAMP = 0x8E28;
     // INLINE constexpr VGenum VG_INT_2_10_10_10_REV = 0x8D9F;
 
     // void vgBindFragDataLocationIndexed(VGuint program, VGuint colorNumber,
@@ -1352,9 +1351,9 @@ namespace ho {
     // void vgGetSamplerParameterIiv(VGuint sampler, VGenum pname, VGint* params);
     // void vgGetSamplerParameterfv(VGuint sampler, VGenum pname, VGfloat* params);
     // void vgGetSamplerParameterIuiv(VGuint sampler, VGenum pname, VGuint* params);
-    // void vgQueryCounter(VGuint id, VGenum target);
-    // void vgGetQueryObjecti64v(VGuint id, VGenum pname, VGint64* params);
-    // void vgGetQueryObjectui64v(VGuint id, VGenum pname, VGuint64* params);
+    void vgQueryCounter(VGuint id, VGenum target);
+    void vgGetQueryObjecti64v(VGuint id, VGenum pname, VGint64* params);
+    void vgGetQueryObjectui64v(VGuint id, VGenum pname, VGuint64* params);
     // void vgVertexAttribDivisor(VGuint index, VGuint divisor);
     // void vgVertexAttribP1ui(VGuint index, VGenum type, VGboolean normalized,
     //                         VGuint value);
@@ -1373,4 +1372,53 @@ namespace ho {
     // void vgVertexAttribP4uiv(VGuint index, VGenum type, VGboolean normalized,
     //                          const VGuint* value);
 
+    //////////////////////////////////////////////////
+    // VIRTUAL GPU EXTENSION API
+    //////////////////////////////////////////////////
+    // Capability for vgEnable/vgDisable/vgIsEnabled.
+    // When enabled, primitives are binned into screen tiles after primitive setup and each tile is rasterized,
+    // shaded and merged by a single worker in submission order. Enabled by default.
+    INLINE constexpr VGenum VG_TILED_RASTERIZATION = 0x19000;
+
+    // Program parameter for vgProgramParameteri.
+    // When VG_TRUE, depth and stencil tests run once before the fragment shader and rejected fragments are not shaded.
+    // Fragment shaders cannot write depth, so the result matches late tests. VG_FALSE by default.
+    INLINE constexpr VGenum VG_EARLY_FRAGMENT_TESTS = 0x19001;
+
+    // Capability for vgEnable/vgDisable/vgIsEnabled.
+    // When enabled, draws and clears are recorded with a snapshot of the state and the uniforms they use instead of
+    // running at once. vgFlush hands the recorded commands to the job system and returns, vgFinish waits until they
+    // are done. Calls that change objects a recorded command reads wait for it first. Submitted commands run with their
+    // state swapped into the context, so every call, state changes included, waits until they are done. Work overlaps
+    // with them only between vgFlush and the next call. Disabled by default.
+    INLINE constexpr VGenum VG_DEFERRED_COMMANDS = 0x19002;
+
+    // Query target for vgBeginQuery/vgEndQuery.
+    // Gathers the pipeline statistics below over the commands between begin and end. Counters are kept per worker
+    // and merged when the query ends. Stage times read the clock per primitive and per shaded fragment, and are summed
+    // over the workers in nanoseconds. Each statistic is a query object parameter for vgGetQueryObject*.
+    INLINE constexpr VGenum VG_PIPELINE_STATISTICS = 0x19003;
+    INLINE constexpr VGenum VG_VERTICES_SHADED = 0x19004;
+    INLINE constexpr VGenum VG_PRIMITIVES_IN = 0x19005;           // assembled primitives
+    INLINE constexpr VGenum VG_PRIMITIVES_CLIPPED = 0x19006;      // removed by clipping
+    INLINE constexpr VGenum VG_PRIMITIVES_CULLED = 0x19007;       // culled, degenerate or covering no pixel
+    INLINE constexpr VGenum VG_FRAGMENTS_RASTERIZED = 0x19008;
+    INLINE constexpr VGenum VG_FRAGMENTS_EARLY_REJECTED = 0x19009;  // failed early fragment tests
+    INLINE constexpr VGenum VG_FRAGMENTS_SHADED = 0x1900A;
+    INLINE constexpr VGenum VG_FRAGMENTS_WRITTEN = 0x1900B;  // passed the fragment tests
+    INLINE constexpr VGenum VG_VERTEX_SHADER_TIME = 0x1900C;
+    INLINE constexpr VGenum VG_CLIP_TIME = 0x1900D;  // clipping and primitive setup
+    INLINE constexpr VGenum VG_RASTER_TIME = 0x1900E;
+    INLINE constexpr VGenum VG_FRAGMENT_SHADER_TIME = 0x1900F;
+    INLINE constexpr VGenum VG_ROP_TIME = 0x19010;  // fragment tests and output merging
+
+    void vgProgramParameteri(VGuint program, VGenum pname, VGint value);
+
+    // Sets the optional wide entry of a shader, run by draws in place of the source of vgShaderSource. nullptr
+    // removes it.
+    // Vertex shaders take a VirtualGPU::WideVertexShader that shades VirtualGPU::VertexBatch::WIDTH vertices at once
+    // in structure of arrays. The source still shades the first vertex of a program and must write the same varyings.
+    // Fragment shaders take a VirtualGPU::QuadFragmentShader that shades 2x2 pixels at once, see dFdx and dFdy.
+    void vgShaderSourceWide(VGuint shader, void* source);
+
 }  // namespace ho
\ No newline at end of file
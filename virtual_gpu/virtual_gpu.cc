@@ -1,14 +1,17 @@
 #include "virtual_gpu.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 
 #include "core/math/interp_funcs.h"
 #include "core/math/math_funcs.h"
+#include "core/thread/tracer.h"
 #include "virtual_gpu_utils.h"
 
 namespace ho {
     bool VirtualGPU::Initialize(uint8_t* color_buffer, int width, int height, VGenum color_format,
-                                VGenum component_type) {
+                                VGenum component_type, uint32_t worker_count, ThreadAffinity affinity) {
         if (color_buffer == nullptr || width <= 0 || width > MAX_ATTACHMENT_WIDTH || height <= 0 ||
             height > MAX_ATTACHMENT_HEIGHT) {
             return false;
@@ -18,6 +21,24 @@ namespace ho {
             return false;
         }
 
+        // Pending commands refer to the objects cleared below.
+        if (submitted_counter_ != nullptr) {
+            WaitForSubmittedCommands();
+        }
+        recorded_commands_.clear();
+        recorded_counter_.reset();
+        sync_pool_.clear();
+
+        if (worker_count == 0) {
+            worker_count = GetHardwareThreadCount();
+        }
+        if (job_system_->GetWorkerCount() != worker_count || job_system_->GetAffinity() != affinity) {
+            job_system_.reset();  // joins the old workers first
+            job_system_ = std::make_unique<JobSystem>(worker_count, affinity);
+            worker_statistics_ = std::vector<WorkerStatistics>(job_system_->GetWorkerCount() + 1);
+            fragment_chunks_ = std::vector<FragmentChunk>(job_system_->GetWorkerCount() + 1);
+        }
+
         // Clear states
         vram_.clear();
 
@@ -30,6 +51,7 @@ namespace ho {
         render_buffer_pool_.clear();
         shader_pool_.clear();
         program_pool_.clear();
+        query_pool_.clear();
 
         bound_vertex_array_ = nullptr;
         using_program_ = nullptr;
@@ -43,6 +65,8 @@ namespace ho {
         uniform_buffer_bindings_.clear();
         transform_feedback_buffer_bindings_.clear();
         constant_attributes_.clear();
+        current_queries_.fill(nullptr);
+        running_queries_.fill(nullptr);
 
         state_.clear_color = Color128(0.f, 0.f, 0.f, 0.f);
         state_.viewport = {0, 0, width, height};
@@ -94,6 +118,22 @@ namespace ho {
 
         state_.polygon_mode = VG_FILL;
 
+        state_.tiled_rasterization_enabled = true;
+
+        state_.conditional_render_query = 0;
+        state_.conditional_render_mode = VG_QUERY_WAIT;
+
+        for (LockTable& table : color_lock_tables_) {
+            table = LockTable();
+        }
+        depth_lock_table_ = LockTable();
+
+        coverage_row_func_ = vg::GetCoverageRowFunc(vg::DetectSimdLevel());
+
+        hiz_buffers_.clear();
+        active_hiz_ = nullptr;
+        is_depth_only_draw_ = false;
+
         state_.error_state = VG_NO_ERROR;
 
         // Create Default Frame Buffer
@@ -136,7 +176,48 @@ namespace ho {
         return true;
     }
 
-    VirtualGPU::VirtualGPU() : job_system_(WORKER_COUNT) {}
+    VirtualGPU::VirtualGPU()
+        : job_system_(std::make_unique<JobSystem>(GetHardwareThreadCount())),
+          worker_statistics_(job_system_->GetWorkerCount() + 1),
+          fragment_chunks_(job_system_->GetWorkerCount() + 1) {
+        current_queries_.fill(nullptr);
+        running_queries_.fill(nullptr);
+    }
+
+    void VirtualGPU::PrepareLockTables() {
+        const FrameBuffer* fb = bound_draw_frame_buffer_;
+
+        for (size_t slot = 0; slot < static_cast<size_t>(DRAW_BUFFER_SLOT_COUNT); slot++) {
+            const size_t attachment_index = fb->draw_slot_to_color_attachment[slot];
+            if (attachment_index == INVALID_SLOT || attachment_index >= static_cast<size_t>(COLOR_ATTACHMENT_COUNT)) {
+                continue;
+            }
+            const Attachment& attch = fb->color_attachments[attachment_index];
+            if (!attch.external_memory && !attch.memory) {
+                continue;
+            }
+            ReserveLockTable(color_lock_tables_[attachment_index], attch.width, attch.height);
+        }
+
+        const Attachment& ds = fb->depth_stencil_attachment;
+        if (ds.memory) {
+            ReserveLockTable(depth_lock_table_, ds.width, ds.height);
+        }
+    }
+
+    void VirtualGPU::ReserveLockTable(LockTable& table, int width, int height) {
+        const int w = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+        const int h = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+        if (w <= table.width && h <= table.height) {
+            return;
+        }
+
+        // Grow only, so switching between attachments of different sizes does not reallocate every draw.
+        table.width = math::Max(table.width, w);
+        table.height = math::Max(table.height, h);
+        table.locks =
+            std::make_unique<SpinLock[]>(static_cast<size_t>(table.width) * static_cast<size_t>(table.height));
+    }
 
     void VirtualGPU::ClearColorAttachment(size_t slot, const Color128& clear_color) {
         FrameBuffer* fb = bound_draw_frame_buffer_;
@@ -249,6 +330,8 @@ namespace ho {
                     row += pixel_size;
                 }
             }
+
+            ClearHiZ(attch, {x0, y0, x1 - x0, y1 - y0}, clear_depth);
         }
     }
 
@@ -321,38 +404,1017 @@ namespace ho {
                 row += 4;
             }
         }
+
+        if (is_depth_cleared) {
+            ClearHiZ(attch, {x0, y0, x1 - x0, y1 - y0}, clear_depth);
+        }
+    }
+
+    void VirtualGPU::UpdateMipmapCount(TextureObject& tex) {
+        const TextureLevel& base = tex.mipmap[0];
+        const int level_count =
+            math::Min(vg::GetMipmapLevelCount(base.width, base.height, base.depth), MAX_MIPMAP_LEVEL_COUNT);
+
+        tex.mipmap_count = 1;
+        for (VGint level = 1; level < level_count; level++) {
+            const TextureLevel& lvl = tex.mipmap[static_cast<size_t>(level)];
+            if (!lvl.memory || lvl.width != vg::GetMipmapSize(base.width, level) ||
+                lvl.height != vg::GetMipmapSize(base.height, level) ||
+                lvl.depth != vg::GetMipmapSize(base.depth, level)) {
+                break;
+            }
+            tex.mipmap_count++;
+        }
+    }
+
+    void VirtualGPU::GenerateMipmap(TextureObject& tex) {
+        const TextureLevel& base = tex.mipmap[0];
+        const int level_count =
+            math::Min(vg::GetMipmapLevelCount(base.width, base.height, base.depth), MAX_MIPMAP_LEVEL_COUNT);
+        const size_t pixel_size = static_cast<size_t>(vg::GetPixelSize(tex.internal_format, tex.component_type));
+
+        const int JOB_TEXEL_COUNT = 16384;
+
+        std::vector<JobDeclaration> jobs;
+        for (VGint level = 1; level < level_count; level++) {
+            TextureLevel& lvl = tex.mipmap[static_cast<size_t>(level)];
+            if (lvl.memory == nullptr) {
+                vram_.emplace_back(std::vector<uint8_t>());
+                lvl.memory = &vram_.back();
+            }
+            lvl.mipmap_level = level;
+            lvl.width = vg::GetMipmapSize(base.width, level);
+            lvl.height = vg::GetMipmapSize(base.height, level);
+            lvl.depth = vg::GetMipmapSize(base.depth, level);
+
+            InvalidateHiZ(lvl.memory);
+            lvl.memory->resize(static_cast<size_t>(lvl.width) * static_cast<size_t>(lvl.height) *
+                               static_cast<size_t>(lvl.depth) * pixel_size);
+
+            // Every level is read by the next one, so levels are generated one after another.
+            const int row_count = lvl.height * lvl.depth;
+            const int rows_per_job = math::Max(JOB_TEXEL_COUNT / lvl.width, 1);
+            jobs.clear();
+            for (int row = 0; row < row_count; row += rows_per_job) {
+                MipmapJobInput* input =
+                    new MipmapJobInput{&tex, level, row, math::Min(row + rows_per_job, row_count) - 1};
+
+                JobDeclaration job;
+                job.entry = MipmapJobEntry;
+                job.name = "MipmapJobEntry";
+                job.input_data = input;
+                job.input_size = sizeof(MipmapJobInput);
+
+                jobs.emplace_back(job);
+            }
+
+            job_system_->KickJobsAndWait(jobs);
+        }
+
+        tex.mipmap_count = level_count;
     }
 
-    void VirtualGPU::VSJobEntry(void* input, int size) {
-        assert(size == sizeof(VSJobInput));
+    void VirtualGPU::MipmapJobEntry(void* input, int size) {
+        assert(size == sizeof(MipmapJobInput));
         (void)size;
-        VSJobInput* in = static_cast<VSJobInput*>(input);
-        VirtualGPU& vg = VirtualGPU::GetInstance();
-        for (size_t i = in->first_index; i <= in->last_index; i++) {
-            in->vs(i, vg.using_program_->varying_buffer[i - in->base_index]);
+        MipmapJobInput* in = static_cast<MipmapJobInput*>(input);
+        const TextureObject& tex = *in->tex;
+        const TextureLevel& src = tex.mipmap[static_cast<size_t>(in->level - 1)];
+        const TextureLevel& dst = tex.mipmap[static_cast<size_t>(in->level)];
+        const size_t pixel_size = static_cast<size_t>(vg::GetPixelSize(tex.internal_format, tex.component_type));
+
+        const uint8_t* src_base = src.memory->data();
+        const auto Fetch = [&](int x, int y, int z) {
+            const size_t index = (static_cast<size_t>(z) * static_cast<size_t>(src.height) + static_cast<size_t>(y)) *
+                                     static_cast<size_t>(src.width) +
+                                 static_cast<size_t>(x);
+            Color128 color;
+            vg::DecodeColor(&color, src_base + index * pixel_size, tex.internal_format, tex.component_type);
+            return color;
+        };
+
+        // A texel averages the 2x2x2 texels above it. Axes of size 1 and the last texel of odd sizes repeat texels.
+        uint8_t* dst_addr = dst.memory->data() +
+                            static_cast<size_t>(in->first_row) * static_cast<size_t>(dst.width) * pixel_size;
+        for (int row = in->first_row; row <= in->last_row; row++) {
+            const int z = row / dst.height;
+            const int y = row % dst.height;
+            const int sz0 = math::Min(z * 2, src.depth - 1);
+            const int sz1 = math::Min(z * 2 + 1, src.depth - 1);
+            const int sy0 = math::Min(y * 2, src.height - 1);
+            const int sy1 = math::Min(y * 2 + 1, src.height - 1);
+
+            for (int x = 0; x < dst.width; x++) {
+                const int sx0 = math::Min(x * 2, src.width - 1);
+                const int sx1 = math::Min(x * 2 + 1, src.width - 1);
+
+                Color128 sum = Fetch(sx0, sy0, sz0) + Fetch(sx1, sy0, sz0) + Fetch(sx0, sy1, sz0) +
+                               Fetch(sx1, sy1, sz0) + Fetch(sx0, sy0, sz1) + Fetch(sx1, sy0, sz1) +
+                               Fetch(sx0, sy1, sz1) + Fetch(sx1, sy1, sz1);
+                vg::EncodeColor(dst_addr, sum * 0.125f, tex.internal_format, tex.component_type);
+                dst_addr += pixel_size;
+            }
         }
         delete in;
     }
 
-    std::vector<VirtualGPU::Varying> VirtualGPU::Clip(const std::vector<Varying>& polygon) const {
-        std::vector<Varying> out_polygon = polygon;
+    void VirtualGPU::ShadeVertices(size_t slot_count, size_t first_vertex, const uint32_t* slot_to_index) {
+        Program& prog = *using_program_;
+        const VertexShader vs = reinterpret_cast<VertexShader>(prog.vertex_shader->source);
+        const WideVertexShader wide_vs = reinterpret_cast<WideVertexShader>(prog.vertex_shader->wide_source);
+        const bool is_timing = IsTimingStages();
+        const auto get_vertex_index = [&](size_t slot) {
+            return slot_to_index == nullptr ? first_vertex + slot : static_cast<size_t>(slot_to_index[slot]);
+        };
+
+        // Shaders write a full varying, which is packed into the slot.
+        size_t first_slot = 0;
+        if (!prog.is_varying_layout_linked && slot_count > 0) {
+            const uint64_t start_time = is_timing ? GetTimestamp() : 0;
+            Varying v;
+            vs(get_vertex_index(0), v);
+            LinkVaryingLayout(prog);
+            prog.varying_buffer.resize(slot_count * prog.varying_stride);
+            PackVarying(v, prog, prog.varying_buffer.data());
+            if (is_timing) {
+                AddStatistic(STATISTIC_VERTEX_SHADER_TIME, GetTimestamp() - start_time);
+            }
+            first_slot = 1;
+        }
+        prog.varying_buffer.resize(slot_count * prog.varying_stride);
+
+        float* records = prog.varying_buffer.data();
+        const size_t stride = prog.varying_stride;
+        const auto shade_range = [&](size_t first, size_t last) {
+            const uint64_t start_time = is_timing ? GetTimestamp() : 0;
+            Varying v;
+            for (size_t i = first; i < last; i++) {
+                v.used_smooth_register_size = 0;
+                v.used_flat_register_size = 0;
+                vs(get_vertex_index(i), v);
+                PackVarying(v, prog, records + i * stride);
+            }
+            if (is_timing) {
+                AddStatistic(STATISTIC_VERTEX_SHADER_TIME, GetTimestamp() - start_time);
+            }
+        };
+        const auto shade_range_wide = [&](size_t first, size_t last) {
+            const uint64_t start_time = is_timing ? GetTimestamp() : 0;
+            VertexBatch batch;
+            for (size_t i = first; i < last; i += VertexBatch::WIDTH) {
+                batch.count = math::Min(VertexBatch::WIDTH, last - i);
+                for (size_t lane = 0; lane < VertexBatch::WIDTH; lane++) {
+                    batch.vertex_indices[lane] = get_vertex_index(i + math::Min(lane, batch.count - 1));
+                }
+                batch.used_smooth_register_size = 0;
+                batch.used_flat_register_size = 0;
+                wide_vs(batch);
+                batch.Store(records + i * stride, stride);
+            }
+            if (is_timing) {
+                AddStatistic(STATISTIC_VERTEX_SHADER_TIME, GetTimestamp() - start_time);
+            }
+        };
+
+        if (wide_vs != nullptr) {
+            job_system_->ParallelFor(first_slot, slot_count, VERTEX_BATCH_SIZE, shade_range_wide, "VSJobEntry");
+        } else {
+            job_system_->ParallelFor(first_slot, slot_count, VERTEX_BATCH_SIZE, shade_range, "VSJobEntry");
+        }
+
+        if (IsGatheringStatistics()) {
+            AddStatistic(STATISTIC_VERTICES_SHADED, slot_count);
+        }
+    }
+
+    void VirtualGPU::VertexBatch::Store(float* records, size_t stride) const {
+        const size_t smooth_size = static_cast<size_t>(used_smooth_register_size);
+        const size_t flat_size = static_cast<size_t>(used_flat_register_size);
+        for (size_t lane = 0; lane < count; lane++) {
+            float* record = records + lane * stride;
+            for (size_t c = 0; c < VARYING_POSITION_SIZE; c++) {
+                *record++ = vg_Position[c][lane];
+            }
+            for (size_t r = 0; r < smooth_size; r++) {
+                *record++ = smooth_register[r][lane];
+            }
+            for (size_t r = 0; r < flat_size; r++) {
+                *record++ = flat_register[r][lane];
+            }
+        }
+    }
+
+    void VirtualGPU::PackVarying(const Varying& v, const Program& prog, float* record) {
+        assert(v.used_smooth_register_size == prog.smooth_register_size);
+        assert(v.used_flat_register_size == prog.flat_register_size);
+        record[0] = v.vg_Position.x;
+        record[1] = v.vg_Position.y;
+        record[2] = v.vg_Position.z;
+        record[3] = v.vg_Position.w;
+        record += VARYING_POSITION_SIZE;
+        std::copy_n(v.smooth_register.begin(), prog.smooth_register_size, record);
+        std::copy_n(v.flat_register.begin(), prog.flat_register_size, record + prog.smooth_register_size);
+    }
+
+    void VirtualGPU::UnpackVarying(const float* record, const Program& prog, Varying& out) {
+        out.vg_Position = Vector4(record[0], record[1], record[2], record[3]);
+        record += VARYING_POSITION_SIZE;
+        std::copy_n(record, prog.smooth_register_size, out.smooth_register.begin());
+        std::copy_n(record + prog.smooth_register_size, prog.flat_register_size, out.flat_register.begin());
+        out.used_smooth_register_size = prog.smooth_register_size;
+        out.used_flat_register_size = prog.flat_register_size;
+    }
+
+    void VirtualGPU::LinkVaryingLayout(Program& prog) {
+        prog.smooth_varying_lookup.Build(prog.smooth_varying_name_hashes.data(), prog.smooth_varying_descs.data(),
+                                         static_cast<size_t>(prog.smooth_varying_count));
+        prog.flat_varying_lookup.Build(prog.flat_varying_name_hashes.data(), prog.flat_varying_descs.data(),
+                                       static_cast<size_t>(prog.flat_varying_count));
+
+        // Registers are appended in order, the layout ends after the last varying.
+        prog.smooth_register_size = 0;
+        for (size_t i = 0; i < static_cast<size_t>(prog.smooth_varying_count); i++) {
+            prog.smooth_register_size += prog.smooth_varying_descs[i].size;
+        }
+        prog.flat_register_size = 0;
+        for (size_t i = 0; i < static_cast<size_t>(prog.flat_varying_count); i++) {
+            prog.flat_register_size += prog.flat_varying_descs[i].size;
+        }
+        prog.varying_stride = VARYING_POSITION_SIZE + static_cast<size_t>(prog.smooth_register_size) +
+                              static_cast<size_t>(prog.flat_register_size);
+        prog.is_varying_layout_linked = true;
+    }
+
+    void VirtualGPU::VaryingLookup::Build(const uint32_t* name_hashes, const VaryingDesc* descs, size_t count) {
+        // Odd seeds along a Weyl sequence, about one in five separates MAX_VARYING_COUNT names.
+        assert(count <= slots.size());
+        linear_count = 0;
+        uint32_t candidate = 0x9E3779B9u;
+        for (int attempt = 0; attempt < MAX_SEED_ATTEMPTS; attempt++) {
+            seed = candidate | 1u;
+            candidate += 0x6A09E667u;
+            slots.fill(Slot());
+
+            bool is_collided = false;
+            for (size_t i = 0; i < count && !is_collided; i++) {
+                Slot& slot = slots[(name_hashes[i] * seed) >> (32 - LOOKUP_BITS)];
+                is_collided = slot.desc.size != 0;
+                slot.name_hash = name_hashes[i];
+                slot.desc = descs[i];
+            }
+            if (!is_collided) {
+                return;
+            }
+        }
+
+        // Names of equal hashes are never separated, Find scans them in order.
+        slots.fill(Slot());
+        for (size_t i = 0; i < count; i++) {
+            slots[i] = {name_hashes[i], descs[i]};
+        }
+        linear_count = count;
+    }
+
+    const VirtualGPU::VaryingDesc* VirtualGPU::VaryingLookup::FindLinear(uint32_t name_hash) const {
+        for (size_t i = 0; i < linear_count; i++) {
+            if (slots[i].name_hash == name_hash) {
+                return &slots[i].desc;
+            }
+        }
+        return nullptr;
+    }
+
+    void VirtualGPU::UniformLookup::Build(const std::unordered_map<uint32_t, size_t>& name_hash_to_location) {
+        // At most a quarter of the slots is used, the table doubles if no seed separates the names.
+        uint32_t bits = 1;
+        while ((size_t{1} << bits) < name_hash_to_location.size() * 4) {
+            bits++;
+        }
+
+        name_count = name_hash_to_location.size();
+        linear_count = 0;
+        uint32_t candidate = 0x9E3779B9u;
+        for (int attempt = 1; attempt <= MAX_SEED_ATTEMPTS && bits < 32; attempt++) {
+            seed = candidate | 1u;
+            candidate += 0x6A09E667u;
+            shift = 32 - bits;
+            slots.assign(size_t{1} << bits, Slot());
+
+            bool is_collided = false;
+            for (auto it = name_hash_to_location.begin(); it != name_hash_to_location.end() && !is_collided; ++it) {
+                Slot& slot = slots[(it->first * seed) >> shift];
+                is_collided = slot.location != EMPTY_LOCATION;
+                slot.name_hash = it->first;
+                slot.location = static_cast<uint32_t>(it->second);
+            }
+            if (!is_collided) {
+                return;
+            }
+            if (attempt % SEED_ATTEMPTS_PER_SIZE == 0) {
+                bits++;
+            }
+        }
+
+        slots.clear();
+        for (const auto& [name_hash, location] : name_hash_to_location) {
+            slots.push_back({name_hash, static_cast<uint32_t>(location)});
+        }
+        linear_count = slots.size();
+    }
+
+    uint32_t VirtualGPU::UniformLookup::FindLinear(uint32_t name_hash) const {
+        for (size_t i = 0; i < linear_count; i++) {
+            if (slots[i].name_hash == name_hash) {
+                return slots[i].location;
+            }
+        }
+        return EMPTY_LOCATION;
+    }
+
+    namespace {
+        const uint8_t ZERO_ATTRIBUTE[16] = {};
+    }
+
+    const VirtualGPU::AttributeFetcher VirtualGPU::ZERO_ATTRIBUTE_FETCHER = {
+        vg::FetchAttributeComponents<VG_FLOAT, 4, false>, vg::FetchAttributeComponentsBatch<VG_FLOAT, 4, false>,
+        ZERO_ATTRIBUTE, 0, VG_FLOAT, false};
+
+    void VirtualGPU::CompileAttributeFetchers() {
+        size_t location_count = 0;
+        for (const auto& [location, attr] : bound_vertex_array_->index_to_attrib) {
+            if (attr.enabled) {
+                location_count = math::Max(location_count, static_cast<size_t>(location) + 1);
+            }
+        }
+        for (const auto& [location, cattr] : constant_attributes_) {
+            location_count = math::Max(location_count, static_cast<size_t>(location) + 1);
+        }
+        attribute_fetchers_.assign(location_count, ZERO_ATTRIBUTE_FETCHER);
+
+        // Constant attributes are read where the vertex array has no enabled attribute.
+        for (const auto& [location, cattr] : constant_attributes_) {
+            AttributeFetcher fetcher;
+            if (!vg::GetAttributeFetchFunctions(cattr.type, 4, cattr.normalized, fetcher.fetch, fetcher.fetch_batch)) {
+                continue;
+            }
+            fetcher.base = reinterpret_cast<const uint8_t*>(cattr.f);
+            fetcher.type = cattr.type;
+            fetcher.is_pure_integer = cattr.is_pure_integer;
+            attribute_fetchers_[location] = fetcher;
+        }
+        for (const auto& [location, attr] : bound_vertex_array_->index_to_attrib) {
+            if (!attr.enabled || attr.buffer == nullptr || attr.buffer->memory == nullptr) {
+                continue;
+            }
+            AttributeFetcher fetcher;
+            if (!vg::GetAttributeFetchFunctions(attr.type, attr.size, attr.normalized, fetcher.fetch,
+                                                fetcher.fetch_batch)) {
+                continue;
+            }
+            fetcher.base = attr.buffer->memory->data() + attr.offset;
+            fetcher.stride = attr.stride == 0
+                                 ? static_cast<size_t>(attr.size) * vg::GetAttributeComponentSize(attr.type)
+                                 : static_cast<size_t>(attr.stride);
+            fetcher.type = attr.type;
+            fetcher.is_pure_integer = attr.is_pure_integer;
+            attribute_fetchers_[location] = fetcher;
+        }
+    }
+
+    void VirtualGPU::SnapshotUniforms() {
+        Program& prog = *using_program_;
+        if (prog.uniform_lookup.name_count != prog.uniform_name_hash_to_location.size()) {
+            prog.uniform_lookup.Build(prog.uniform_name_hash_to_location);
+        }
+
+        constexpr size_t BLOCK_SIZE = sizeof(UniformSnapshot::Block);
+        size_t block_count = 0;
+        for (const Uniform& u : prog.uniforms) {
+            block_count += (u.data.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        }
+
+        UniformSnapshot& snapshot = uniform_snapshot_;
+        snapshot.storage.resize(block_count);
+        snapshot.refs.resize(prog.uniforms.size());
+        UniformSnapshot::Block* block = snapshot.storage.data();
+        for (size_t location = 0; location < prog.uniforms.size(); location++) {
+            const Uniform& u = prog.uniforms[location];
+            UniformRef& ref = snapshot.refs[location];
+            if (!u.data.empty()) {
+                std::memcpy(block->bytes, u.data.data(), u.data.size());
+            }
+            ref.data = block->bytes;
+            ref.stride = static_cast<size_t>(u.size * vg::GetTypeSize(u.type));
+            ref.count = u.count;
+            block += (u.data.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        }
+    }
+
+    bool VirtualGPU::BuildVertexCache(const uint8_t* indices, VGsizei count, VGenum type, uint32_t min_index,
+                                      uint32_t max_index) {
+        VertexCache& cache = vertex_cache_;
+        cache.min_index = min_index;
+        cache.index_to_slot.assign(static_cast<size_t>(max_index - min_index) + 1, VertexCache::EMPTY_SLOT);
+        cache.slot_to_index.clear();
+        cache.element_slots.resize(static_cast<size_t>(count));
+
+        for (size_t k = 0; k < static_cast<size_t>(count); k++) {
+            const uint32_t index = vg::FetchElementIndex(indices, type, k);
+            if (index < min_index || index > max_index) {
+                return false;
+            }
+
+            uint32_t& slot = cache.index_to_slot[index - min_index];
+            if (slot == VertexCache::EMPTY_SLOT) {
+                slot = static_cast<uint32_t>(cache.slot_to_index.size());
+                cache.slot_to_index.emplace_back(index);
+            }
+            cache.element_slots[k] = slot;
+        }
+        return true;
+    }
+
+    void VirtualGPU::BuildSparseVertexCache(const uint8_t* indices, VGsizei count, VGenum type) {
+        VertexCache& cache = vertex_cache_;
+        cache.min_index = 0;
+        cache.index_to_slot.clear();
+        cache.slot_to_index.resize(static_cast<size_t>(count));
+        for (size_t k = 0; k < static_cast<size_t>(count); k++) {
+            cache.slot_to_index[k] = vg::FetchElementIndex(indices, type, k);
+        }
+        std::sort(cache.slot_to_index.begin(), cache.slot_to_index.end());
+        cache.slot_to_index.erase(std::unique(cache.slot_to_index.begin(), cache.slot_to_index.end()),
+                                  cache.slot_to_index.end());
+
+        cache.element_slots.resize(static_cast<size_t>(count));
+        for (size_t k = 0; k < static_cast<size_t>(count); k++) {
+            const uint32_t index = vg::FetchElementIndex(indices, type, k);
+            const auto it = std::lower_bound(cache.slot_to_index.begin(), cache.slot_to_index.end(), index);
+            cache.element_slots[k] = static_cast<uint32_t>(it - cache.slot_to_index.begin());
+        }
+    }
+
+    void VirtualGPU::DrawElements(VGenum mode, VGsizei count, VGenum type, const void* indices,
+                                  const uint32_t* range) {
+        if (count < 0) {
+            state_.error_state = VG_INVALID_VALUE;
+            return;
+        }
+        if (bound_vertex_array_ == nullptr || using_program_ == nullptr || bound_draw_frame_buffer_ == nullptr ||
+            bound_vertex_array_->element_buffer == nullptr || bound_vertex_array_->element_buffer->memory == nullptr) {
+            state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+
+        if (using_program_->link_status == VG_FALSE) {
+            state_.error_state = VG_INVALID_OPERATION;
+            return;
+        }
+
+        size_t idx_size = 0;
+        switch (type) {
+            case VG_UNSIGNED_BYTE:
+                idx_size = 1;
+                break;
+            case VG_UNSIGNED_SHORT:
+                idx_size = 2;
+                break;
+            case VG_UNSIGNED_INT:
+                idx_size = 4;
+                break;
+            default:
+                state_.error_state = VG_INVALID_ENUM;
+                return;
+        }
+
+        if (indices != nullptr && (reinterpret_cast<uintptr_t>(indices) + static_cast<size_t>(count) * idx_size >
+                                   bound_vertex_array_->element_buffer->memory->size())) {
+            state_.error_state = VG_INVALID_VALUE;
+            return;
+        }
+
+        size_t stride = 0;
+        size_t vertex_count = 0;
+        if (!GetPrimitiveLayout(mode, stride, vertex_count)) {
+            state_.error_state = VG_INVALID_ENUM;
+            return;
+        }
+
+        if (count == 0) {
+            return;
+        }
+
+        Command cmd;
+        cmd.type = CommandType::DRAW_ELEMENTS;
+        cmd.mode = mode;
+        cmd.count = count;
+        cmd.index_type = type;
+        cmd.indices = indices;
+        if (range != nullptr) {
+            cmd.has_range = true;
+            cmd.range[0] = range[0];
+            cmd.range[1] = range[1];
+        }
+        RunCommand(cmd);
+    }
+
+    void VirtualGPU::ExecuteDrawArrays(VGenum mode, VGint first, VGsizei count) {
+        SnapshotUniforms();
+        CompileAttributeFetchers();
+
+        // Vertex Processing
+        ShadeVertices(static_cast<size_t>(count), static_cast<size_t>(first), nullptr);
+
+        // Primitive Assembly
+        AssemblePrimitives(mode, static_cast<size_t>(count), nullptr);
+
+        DrawPrimitives(reinterpret_cast<FragmentShader>(using_program_->fragment_shader->source));
+        using_program_->varying_buffer.clear();
+    }
+
+    void VirtualGPU::ExecuteDrawElements(VGenum mode, VGsizei count, VGenum type, const void* indices,
+                                         const uint32_t* range) {
+        SnapshotUniforms();
+        CompileAttributeFetchers();
+
+        const uint8_t* ebo = bound_vertex_array_->element_buffer->memory->data();
+        const uint8_t* base = ebo + (indices == nullptr ? 0 : reinterpret_cast<uintptr_t>(indices));
+
+        // Post-transform Vertex Cache
+        // The range of vgDrawRangeElements sizes the cache directly if it lies inside the vertex array. Without one,
+        // or if an index lies outside of it, the referenced range is scanned first. A referenced range too wide for
+        // a dense lookup table is cached sparsely.
+        const size_t max_span = static_cast<size_t>(count) * VertexCache::MAX_SPAN_PER_ELEMENT;
+        const bool is_range_usable = range != nullptr && range[0] <= range[1] &&
+                                     static_cast<int64_t>(range[1]) < bound_vertex_array_->vertex_count &&
+                                     static_cast<size_t>(range[1] - range[0]) < max_span;
+        if (!is_range_usable || !BuildVertexCache(base, count, type, range[0], range[1])) {
+            uint32_t min_index = std::numeric_limits<uint32_t>::max();
+            uint32_t max_index = 0;
+            for (size_t k = 0; k < static_cast<size_t>(count); k++) {
+                const uint32_t index = vg::FetchElementIndex(base, type, k);
+                min_index = math::Min(min_index, index);
+                max_index = math::Max(max_index, index);
+            }
+            if (static_cast<size_t>(max_index - min_index) < max_span) {
+                BuildVertexCache(base, count, type, min_index, max_index);
+            } else {
+                BuildSparseVertexCache(base, count, type);
+            }
+        }
+
+        // Vertex Processing
+        ShadeVertices(vertex_cache_.slot_to_index.size(), 0, vertex_cache_.slot_to_index.data());
+
+        // Primitive Assembly
+        AssemblePrimitives(mode, static_cast<size_t>(count), vertex_cache_.element_slots.data());
+
+        DrawPrimitives(reinterpret_cast<FragmentShader>(using_program_->fragment_shader->source));
+        using_program_->varying_buffer.clear();
+    }
+
+    void VirtualGPU::ExecuteClear(VGbitfield mask) {
+        const FrameBuffer* fb = bound_draw_frame_buffer_;
+        const bool is_depth_cleared = (mask & VG_DEPTH_BUFFER_BIT) != 0;
+        const bool is_stencil_cleared = (mask & VG_STENCIL_BUFFER_BIT) != 0;
+
+        if ((mask & VG_COLOR_BUFFER_BIT) != 0) {
+            for (size_t i = 0; i < DRAW_BUFFER_SLOT_COUNT; ++i) {
+                ClearColorAttachment(i, state_.clear_color);
+            }
+        }
+
+        if (fb->depth_stencil_attachment.format == VG_DEPTH_COMPONENT) {
+            ClearDepthAttachment(static_cast<real>(state_.clear_depth));
+        }
+
+        if (fb->depth_stencil_attachment.format == VG_DEPTH_STENCIL) {
+            ClearDepthStencilAttachment(is_depth_cleared, is_stencil_cleared, static_cast<real>(state_.clear_depth),
+                                        static_cast<uint8_t>(state_.clear_stencil));
+        }
+    }
+
+    void VirtualGPU::RunCommand(Command& cmd) {
+        if (!state_.deferred_commands_enabled) {
+            ExecuteCommand(cmd);
+            return;
+        }
+
+        DrawState& snapshot = cmd.draw_state;
+        snapshot.state = state_;
+        snapshot.draw_frame_buffer = bound_draw_frame_buffer_;
+        if (bound_draw_frame_buffer_ != nullptr) {
+            snapshot.draw_slot_to_color_attachment = bound_draw_frame_buffer_->draw_slot_to_color_attachment;
+        }
+        if (cmd.type == CommandType::DRAW_ARRAYS || cmd.type == CommandType::DRAW_ELEMENTS) {
+            snapshot.program = using_program_;
+            snapshot.vertex_array = bound_vertex_array_;
+            snapshot.texture_units = texture_units_;
+            snapshot.constant_attributes = constant_attributes_;
+            snapshot.uniforms = using_program_->uniforms;
+        }
+        recorded_commands_.emplace_back(std::move(cmd));
+    }
+
+    void VirtualGPU::ExecuteCommand(const Command& cmd) {
+        switch (cmd.type) {
+            case CommandType::DRAW_ARRAYS:
+                if (!IsRenderingDiscarded()) {
+                    TRACE_SCOPE("DrawArrays");
+                    ExecuteDrawArrays(cmd.mode, cmd.first, cmd.count);
+                }
+                break;
+            case CommandType::DRAW_ELEMENTS:
+                if (!IsRenderingDiscarded()) {
+                    TRACE_SCOPE("DrawElements");
+                    ExecuteDrawElements(cmd.mode, cmd.count, cmd.index_type, cmd.indices,
+                                        cmd.has_range ? cmd.range : nullptr);
+                }
+                break;
+            case CommandType::CLEAR:
+                if (!IsRenderingDiscarded()) {
+                    TRACE_SCOPE("Clear");
+                    ExecuteClear(cmd.clear_mask);
+                }
+                break;
+            case CommandType::BEGIN_QUERY:
+                ExecuteBeginQuery(*cmd.query);
+                break;
+            case CommandType::END_QUERY:
+                ExecuteEndQuery(*cmd.query);
+                break;
+            case CommandType::QUERY_COUNTER:
+                ExecuteQueryCounter(*cmd.query);
+                break;
+        }
+    }
+
+    void VirtualGPU::SwapInDrawState(DrawState& draw_state) {
+        std::swap(state_, draw_state.state);
+        std::swap(using_program_, draw_state.program);
+        std::swap(bound_vertex_array_, draw_state.vertex_array);
+        std::swap(bound_draw_frame_buffer_, draw_state.draw_frame_buffer);
+        if (bound_draw_frame_buffer_ != nullptr) {
+            std::swap(bound_draw_frame_buffer_->draw_slot_to_color_attachment,
+                      draw_state.draw_slot_to_color_attachment);
+        }
+        std::swap(texture_units_, draw_state.texture_units);
+        std::swap(constant_attributes_, draw_state.constant_attributes);
+        if (using_program_ != nullptr) {
+            // Uniforms located after recording stay unset.
+            if (draw_state.uniforms.size() < using_program_->uniforms.size()) {
+                draw_state.uniforms.resize(using_program_->uniforms.size());
+            }
+            std::swap(using_program_->uniforms, draw_state.uniforms);
+        }
+    }
+
+    void VirtualGPU::SwapOutDrawState(DrawState& draw_state) {
+        if (using_program_ != nullptr) {
+            std::swap(using_program_->uniforms, draw_state.uniforms);
+        }
+        std::swap(state_, draw_state.state);
+        std::swap(using_program_, draw_state.program);
+        std::swap(bound_vertex_array_, draw_state.vertex_array);
+        if (bound_draw_frame_buffer_ != nullptr) {
+            std::swap(bound_draw_frame_buffer_->draw_slot_to_color_attachment,
+                      draw_state.draw_slot_to_color_attachment);
+        }
+        std::swap(bound_draw_frame_buffer_, draw_state.draw_frame_buffer);
+        std::swap(texture_units_, draw_state.texture_units);
+        std::swap(constant_attributes_, draw_state.constant_attributes);
+    }
+
+    void VirtualGPU::Flush() {
+        if (submitted_counter_ != nullptr) {
+            WaitForSubmittedCommands();
+        }
+        if (recorded_commands_.empty()) {
+            return;
+        }
+
+        // Swapping keeps the capacity of both lists.
+        std::swap(submitted_commands_, recorded_commands_);
+        submitted_counter_ =
+            recorded_counter_ != nullptr ? std::move(recorded_counter_) : std::make_shared<AtomicNumeric<uint32_t>>(1);
+        recorded_counter_.reset();
+
+        JobDeclaration job;
+        job.entry = CommandsJobEntry;
+        job.name = "CommandsJobEntry";
+        job.input_data = this;
+        job.input_size = sizeof(VirtualGPU);
+        job.counter = submitted_counter_;
+        job_system_->KickJob(job);
+    }
+
+    void VirtualGPU::Finish() {
+        Flush();
+        if (submitted_counter_ != nullptr) {
+            WaitForSubmittedCommands();
+        }
+    }
+
+    void VirtualGPU::WaitForSubmittedCommands() {
+        job_system_->WaitForCounter(submitted_counter_);
+        submitted_counter_.reset();
+        submitted_commands_.clear();
+    }
+
+    void VirtualGPU::SetSyncError(VGenum error) {
+        if (submitted_counter_ != nullptr) {
+            WaitForSubmittedCommands();
+        }
+        if (state_.error_state == VG_NO_ERROR) {
+            state_.error_state = error;
+        }
+    }
+
+    size_t VirtualGPU::GetQueryTargetIndex(VGenum target) {
+        switch (target) {
+            case VG_SAMPLES_PASSED:
+                return SAMPLES_PASSED_QUERY;
+            case VG_ANY_SAMPLES_PASSED:
+                return ANY_SAMPLES_PASSED_QUERY;
+            case VG_TIME_ELAPSED:
+                return TIME_ELAPSED_QUERY;
+            case VG_PIPELINE_STATISTICS:
+                return PIPELINE_STATISTICS_QUERY;
+            default:
+                return INVALID_SLOT;
+        }
+    }
+
+    void VirtualGPU::ExecuteBeginQuery(QueryObject& query) {
+        if (query.target == VG_TIME_ELAPSED) {
+            query.begin_time = GetTimestamp();
+        } else {
+            SumStatistics(query.begin_statistics);
+        }
+        running_queries_[GetQueryTargetIndex(query.target)] = &query;
+    }
+
+    void VirtualGPU::ExecuteEndQuery(QueryObject& query) {
+        running_queries_[GetQueryTargetIndex(query.target)] = nullptr;
+
+        if (query.target == VG_TIME_ELAPSED) {
+            query.result = GetTimestamp() - query.begin_time;
+        } else {
+            SumStatistics(query.statistics);
+            for (size_t i = 0; i < STATISTIC_COUNT; i++) {
+                query.statistics[i] -= query.begin_statistics[i];
+            }
+            const uint64_t samples = query.statistics[STATISTIC_FRAGMENTS_WRITTEN];
+            query.result = query.target == VG_ANY_SAMPLES_PASSED ? (samples != 0 ? 1 : 0) : samples;
+        }
+        query.resolved_count++;
+    }
+
+    void VirtualGPU::ExecuteQueryCounter(QueryObject& query) {
+        query.result = GetTimestamp();
+        query.resolved_count++;
+    }
+
+    void VirtualGPU::SumStatistics(Statistics& out) const {
+        // Called between draws, no worker adds concurrently.
+        out.fill(0);
+        for (const WorkerStatistics& worker : worker_statistics_) {
+            for (size_t i = 0; i < STATISTIC_COUNT; i++) {
+                out[i] += worker.values[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool VirtualGPU::IsRenderingDiscarded() const {
+        if (state_.conditional_render_query == 0) {
+            return false;
+        }
+        auto it = query_pool_.find(state_.conditional_render_query);
+        if (it == query_pool_.end() || it->second.resolved_count == 0) {
+            return false;
+        }
+        // Commands run in order, so the query already ended and every wait mode behaves the same.
+        return it->second.result == 0;
+    }
+
+    bool VirtualGPU::GetQueryObject(VGuint id, VGenum pname, uint64_t& value) {
+        if (state_.error_state != VG_NO_ERROR) {
+            return false;
+        }
+
+        auto it = query_pool_.find(id);
+        if (it == query_pool_.end() || it->second.is_active || it->second.end_count == 0) {
+            state_.error_state = VG_INVALID_OPERATION;
+            return false;
+        }
+        const QueryObject& query = it->second;
+
+        if (pname == VG_QUERY_RESULT_AVAILABLE) {
+            value = query.resolved_count == query.end_count ? VG_TRUE : VG_FALSE;
+            if (value == VG_FALSE) {
+                // Polling must end, the next call waits for the flushed commands.
+                Flush();
+            }
+            return true;
+        }
+
+        // Statistics queries hold one result per statistic, the others a single one.
+        const bool is_statistic = pname >= VG_VERTICES_SHADED && pname < VG_VERTICES_SHADED + STATISTIC_COUNT;
+        if (query.target == VG_PIPELINE_STATISTICS ? !is_statistic : pname != VG_QUERY_RESULT) {
+            state_.error_state = VG_INVALID_ENUM;
+            return false;
+        }
+
+        if (query.resolved_count != query.end_count) {
+            Finish();
+        }
+        value = is_statistic ? query.statistics[pname - VG_VERTICES_SHADED] : query.result;
+        return true;
+    }
+
+    std::shared_ptr<AtomicNumeric<uint32_t>> VirtualGPU::GetPendingCounter() {
+        if (!recorded_commands_.empty()) {
+            if (recorded_counter_ == nullptr) {
+                recorded_counter_ = std::make_shared<AtomicNumeric<uint32_t>>(1);
+            }
+            return recorded_counter_;
+        }
+        if (submitted_counter_ != nullptr && submitted_counter_->Get() != 0) {
+            return submitted_counter_;
+        }
+        return nullptr;
+    }
+
+    void VirtualGPU::CommandsJobEntry(void* input, int size) {
+        assert(size == sizeof(VirtualGPU));
+        (void)size;
+        VirtualGPU* vg = static_cast<VirtualGPU*>(input);
+        for (Command& cmd : vg->submitted_commands_) {
+            vg->SwapInDrawState(cmd.draw_state);
+            vg->ExecuteCommand(cmd);
+            vg->SwapOutDrawState(cmd.draw_state);
+        }
+    }
+
+    bool VirtualGPU::GetPrimitiveLayout(VGenum mode, size_t& stride, size_t& vertex_count) {
+        switch (mode) {
+            case VG_POINT:
+                stride = 1;
+                vertex_count = 1;
+                return true;
+            case VG_LINE:
+                stride = 2;
+                vertex_count = 2;
+                return true;
+            case VG_LINE_STRIP:
+                stride = 1;
+                vertex_count = 2;
+                return true;
+            case VG_TRIANGLES:
+                stride = 3;
+                vertex_count = 3;
+                return true;
+            case VG_TRIANGLE_STRIP:
+                stride = 1;
+                vertex_count = 3;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void VirtualGPU::AssemblePrimitives(VGenum mode, size_t element_count, const uint32_t* element_slots) {
+        size_t stride = 0;
+        size_t vertex_count = 0;
+        GetPrimitiveLayout(mode, stride, vertex_count);
+
+        PrimitiveList& prims = primitives_;
+        prims.vertices.clear();
+        prims.vertex_count = vertex_count;
+        if (element_count < vertex_count) {
+            return;
+        }
+        prims.vertices.reserve(((element_count - vertex_count) / stride + 1) * vertex_count);
+
+        const float* records = using_program_->varying_buffer.data();
+        const size_t record_stride = using_program_->varying_stride;
+        for (size_t i = 0; i + vertex_count <= element_count; i += stride) {
+            const size_t first = prims.vertices.size();
+            for (size_t j = i; j < i + vertex_count; j++) {
+                const size_t slot = element_slots == nullptr ? j : element_slots[j];
+                prims.vertices.emplace_back(records + slot * record_stride);
+            }
+
+            // TRIANGLE_STRIP: flip winding order on odd triangles
+            if (mode == VG_TRIANGLE_STRIP && (i % 2 == 1)) {
+                std::swap(prims.vertices[first + 1], prims.vertices[first + 2]);
+            }
+        }
+    }
+
+    void VirtualGPU::DrawPrimitives(FragmentShader fs) {
+        if (IsGatheringStatistics()) {
+            AddStatistic(STATISTIC_PRIMITIVES_IN, primitives_.GetCount());
+        }
+
+        PrepareHiZ();
+        is_depth_only_draw_ = !HasColorOutputs();
+        if (state_.tiled_rasterization_enabled) {
+            DrawBinned(primitives_, fs);
+            return;
+        }
+        PrepareLockTables();
+
+        const size_t prim_count = primitives_.GetCount();
+        if (prim_count == 0) {
+            return;
+        }
+
+        // Inputs must stay in place until every batch is done.
+        const size_t batch_count = (prim_count + PRIMITIVE_BATCH_SIZE - 1) / PRIMITIVE_BATCH_SIZE;
+        primitive_job_inputs_.resize(batch_count);
+
+        std::vector<JobDeclaration> jobs(batch_count);
+        for (size_t b = 0; b < batch_count; b++) {
+            const size_t first = b * PRIMITIVE_BATCH_SIZE;
+            const size_t last = math::Min(first + PRIMITIVE_BATCH_SIZE, prim_count) - 1;
+            primitive_job_inputs_[b] = {&primitives_, first, last, fs};
+
+            jobs[b].entry = AfterVSJobEntry;
+            jobs[b].name = "AfterVSJobEntry";
+            jobs[b].input_data = &primitive_job_inputs_[b];
+            jobs[b].input_size = sizeof(AfterVSJobInput);
+        }
+
+        job_system_->KickJobsAndWait(jobs);
+    }
+
+    bool VirtualGPU::HasColorOutputs() const {
+        const FrameBuffer* fb = bound_draw_frame_buffer_;
+        for (size_t slot = 0; slot < static_cast<size_t>(DRAW_BUFFER_SLOT_COUNT); slot++) {
+            const size_t attachment_index = fb->draw_slot_to_color_attachment[slot];
+            if (attachment_index == INVALID_SLOT || attachment_index >= static_cast<size_t>(COLOR_ATTACHMENT_COUNT)) {
+                continue;
+            }
+            const Attachment& attch = fb->color_attachments[attachment_index];
+            if (!attch.external_memory && !attch.memory) {
+                continue;
+            }
+            const bool* mask = state_.draw_buffer_states[slot].color_mask;
+            if (mask[0] || mask[1] || mask[2] || mask[3]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t VirtualGPU::ComputeOutcode(const Vector4& clip_coord) const {
+        uint32_t outcode = 0;
+        for (PlanePos plane_pos : {VG_PLANE_POS_LEFT, VG_PLANE_POS_RIGHT, VG_PLANE_POS_BOTTOM, VG_PLANE_POS_TOP,
+                                   VG_PLANE_POS_NEAR, VG_PLANE_POS_FAR}) {
+            if (!IsInside(clip_coord, plane_pos)) {
+                outcode |= 1u << plane_pos;
+            }
+        }
+        return outcode;
+    }
+
+    bool VirtualGPU::IsInGuardBand(const Vector4& clip_coord) {
+        const real extent = clip_coord.w * CLIP_GUARD_BAND;
+        return clip_coord.w > 0.0_r && math::Abs(clip_coord.x) <= extent && math::Abs(clip_coord.y) <= extent;
+    }
+
+    void VirtualGPU::Clip(ClipPolygon& polygon, uint32_t planes) const {
+        // Planes no vertex is outside of leave the polygon as is.
+        ClipPolygon scratch;
+        ClipPolygon* in = &polygon;
+        ClipPolygon* out = &scratch;
         for (PlanePos plane_pos : {VG_PLANE_POS_LEFT, VG_PLANE_POS_RIGHT, VG_PLANE_POS_BOTTOM, VG_PLANE_POS_TOP,
                                    VG_PLANE_POS_NEAR, VG_PLANE_POS_FAR}) {
-            out_polygon = ClipAgainstPlane(out_polygon, plane_pos);
-            if (out_polygon.empty()) {
+            if ((planes & (1u << plane_pos)) == 0) {
+                continue;
+            }
+            ClipAgainstPlane(*in, plane_pos, *out);
+            std::swap(in, out);
+            if (in->empty()) {
                 // When polygon is totally out of frustum.
                 break;
             }
         }
-        return out_polygon;
+
+        if (in != &polygon) {
+            polygon.clear();
+            for (const Varying& v : *in) {
+                polygon.push_back(v);
+            }
+        }
     }
 
-    std::vector<VirtualGPU::Varying> VirtualGPU::ClipAgainstPlane(const std::vector<Varying>& polygon,
-                                                                  PlanePos plane_pos) const {
+    void VirtualGPU::ClipAgainstPlane(const ClipPolygon& polygon, PlanePos plane_pos, ClipPolygon& out) const {
         // Sutherland-Hodgman Polygon Clipping Loop (Vertices always be treated as polygon)
-        std::vector<Varying> out_polygon;
+        out.clear();
         if (polygon.empty()) {
-            return out_polygon;
+            return;
         }
 
         const size_t v_count = polygon.size();
@@ -366,14 +1428,14 @@ namespace ho {
 
             if (is_prev_in && is_curr_in) {
                 // Case 1: in to in
-                out_polygon.emplace_back(curr_v);
+                out.push_back(curr_v);
             } else if (is_prev_in && !is_curr_in) {
                 // Case 2: in to out
                 Vector2 bary = GetClipBarycentric(prev_v.vg_Position, curr_v.vg_Position, plane_pos);
                 // if clip isn't parallel on plane or degenerated push interpolated
                 // varying.
                 if (!math::IsNaN(bary.x) && !math::IsNaN(bary.y)) {
-                    out_polygon.emplace_back(LerpVarying(prev_v, curr_v, bary));
+                    out.push_back(LerpVarying(prev_v, curr_v, bary));
                 }
             } else if (!is_prev_in && is_curr_in) {
                 // Case 3: out to in
@@ -381,16 +1443,14 @@ namespace ho {
                 // if clip isn't parallel on plane or degenerated push interpolated
                 // varying.
                 if (!math::IsNaN(bary.x) && !math::IsNaN(bary.y)) {
-                    out_polygon.emplace_back(LerpVarying(prev_v, curr_v, bary));
+                    out.push_back(LerpVarying(prev_v, curr_v, bary));
                 }
-                out_polygon.emplace_back(curr_v);
+                out.push_back(curr_v);
             } else {
                 // Case 4: out to out
                 // Do Nothing.
             }
         }
-
-        return out_polygon;
     }
 
     real VirtualGPU::EvalFrustumPlane(const Vector4& clip_coord, PlanePos plane_pos) const {
@@ -464,32 +1524,65 @@ namespace ho {
         v.viewport_coord = Vector3(x, y, z);
     }
 
-    std::vector<VirtualGPU::Fragment> VirtualGPU::Rasterize(const Varying& v) {
+    std::vector<VirtualGPU::Fragment> VirtualGPU::Rasterize(const Varying& v, const Rect& region) {
+        std::vector<Fragment> out;
+        FragmentChunk chunk;
+        chunk.collected = &out;
+        Rasterize(v, region, chunk);
+        FlushFragments(chunk);
+        return out;
+    }
+
+    std::vector<VirtualGPU::Fragment> VirtualGPU::Rasterize(const Varying& v1, const Varying& v2, const Rect& region) {
+        std::vector<Fragment> out;
+        FragmentChunk chunk;
+        chunk.collected = &out;
+        Rasterize(v1, v2, region, chunk);
+        FlushFragments(chunk);
+        return out;
+    }
+
+    std::vector<VirtualGPU::Fragment> VirtualGPU::Rasterize(const Varying& v1, const Varying& v2, const Varying& v3,
+                                                            const Rect& region, const SmoothGradient* smooth_gradient) {
         std::vector<Fragment> out;
-        Fragment frag;
-        frag.screen_coord = Vector2(math::Floor(v.viewport_coord.x) + 0.5_r, math::Floor(v.viewport_coord.y) + 0.5_r);
+        FragmentChunk chunk;
+        chunk.collected = &out;
+        Rasterize(v1, v2, v3, region, smooth_gradient, chunk);
+        FlushFragments(chunk);
+        return out;
+    }
+
+    void VirtualGPU::Rasterize(const Varying& v, const Rect& region, FragmentChunk& chunk) {
+        const int px = static_cast<int>(math::Floor(v.viewport_coord.x));
+        const int py = static_cast<int>(math::Floor(v.viewport_coord.y));
+        if (px < region.x || py < region.y || px >= region.x + region.width || py >= region.y + region.height) {
+            return;
+        }
+
+        const Vector2 screen_coord(static_cast<real>(px) + 0.5_r, static_cast<real>(py) + 0.5_r);
         const uint64_t depth_bit =
             bound_draw_frame_buffer_->depth_stencil_attachment.format == VG_DEPTH_COMPONENT ? 32u : 24u;
-        frag.depth = ApplyDepthOffset(v.viewport_coord.z, 0.f, depth_bit, state_.polygon_mode);
+        const real depth = ApplyDepthOffset(v.viewport_coord.z, 0.f, depth_bit, state_.polygon_mode);
 
-        if (ScissorTest(frag.screen_coord.x, frag.screen_coord.y) &&
-            TestDepthStencil(frag.screen_coord.x, frag.screen_coord.y, frag.depth, true, true)) {
+        if (ScissorTest(screen_coord.x, screen_coord.y) &&
+            RasterDepthStencilTest(screen_coord.x, screen_coord.y, depth, true)) {
+            Fragment& frag = AppendFragment(chunk);
+            frag.screen_coord = screen_coord;
+            frag.depth = depth;
             frag.used_smooth_register_size = v.used_smooth_register_size;
             std::copy_n(v.smooth_register.begin(), v.used_smooth_register_size, frag.smooth_register.begin());
             frag.used_flat_register_size = v.used_flat_register_size;
             std::copy_n(v.flat_register.begin(), v.used_flat_register_size, frag.flat_register.begin());
-            out.emplace_back(frag);
+            frag.is_front = true;
+            frag.smooth_gradient = nullptr;
+            frag.w = 1.0_r;
         }
-
-        return out;
     }
 
-    std::vector<VirtualGPU::Fragment> VirtualGPU::Rasterize(const Varying& v1, const Varying& v2) {
+    void VirtualGPU::Rasterize(const Varying& v1, const Varying& v2, const Rect& region, FragmentChunk& chunk) {
         assert(v1.used_smooth_register_size == v2.used_smooth_register_size);
         assert(v1.used_flat_register_size == v2.used_flat_register_size);
 
-        std::vector<Fragment> out;
-
         const int x0 = static_cast<int>(math::Floor(v1.viewport_coord.x));
         const int y0 = static_cast<int>(math::Floor(v1.viewport_coord.y));
         const int x1 = static_cast<int>(math::Floor(v2.viewport_coord.x));
@@ -503,11 +1596,9 @@ namespace ho {
         int err = dx - dy;
 
         if (dx == 0 && dy == 0) {
-            return out;
+            return;
         }
 
-        out.reserve(static_cast<size_t>(dx) + static_cast<size_t>(dy) + 1);
-
         // Calculate gradient
         const real Dx = static_cast<real>(x1 - x0);
         const real Dy = static_cast<real>(y1 - y0);
@@ -550,13 +1641,18 @@ namespace ho {
         int x = x0;
         int y = y0;
 
+        const int region_x_max = region.x + region.width;
+        const int region_y_max = region.y + region.height;
+
         while (true) {
             Vector2 screen_coord(static_cast<real>(x) + 0.5_r, static_cast<real>(y) + 0.5_r);
             real w = 1.0_r / inv_w;
 
-            if (ScissorTest(screen_coord.x, screen_coord.y) &&
-                TestDepthStencil(screen_coord.x, screen_coord.y, static_cast<real>(depth), true, true)) {
-                Fragment frag;
+            const bool in_region = x >= region.x && y >= region.y && x < region_x_max && y < region_y_max;
+
+            if (in_region && ScissorTest(screen_coord.x, screen_coord.y) &&
+                RasterDepthStencilTest(screen_coord.x, screen_coord.y, static_cast<real>(depth), true)) {
+                Fragment& frag = AppendFragment(chunk);
                 frag.screen_coord = screen_coord;
                 frag.depth = static_cast<real>(depth);
 
@@ -568,7 +1664,9 @@ namespace ho {
                 frag.used_flat_register_size = v2.used_flat_register_size;
                 std::copy_n(v2.flat_register.begin(), frag.used_flat_register_size, frag.flat_register.begin());
 
-                out.emplace_back(frag);
+                frag.is_front = true;
+                frag.smooth_gradient = nullptr;
+                frag.w = 1.0_r;
             }
 
             if (x == x1 && y == y1) {
@@ -605,69 +1703,116 @@ namespace ho {
                 }
             }
         }
-        return out;
     }
 
-    std::vector<VirtualGPU::Fragment> VirtualGPU::Rasterize(const Varying& v1, const Varying& v2, const Varying& v3) {
+    VirtualGPU::SnappedTriangle::SnappedTriangle(const Vector3& p1, const Vector3& p2, const Vector3& p3) {
+        constexpr int64_t S = vg::SUBPIXEL_SCALE;
+        const auto Snap = [](real v) { return static_cast<int64_t>(std::llround(static_cast<double>(v) * S)); };
+        x[0] = Snap(p1.x);
+        x[1] = Snap(p2.x);
+        x[2] = Snap(p3.x);
+        y[0] = Snap(p1.y);
+        y[1] = Snap(p2.y);
+        y[2] = Snap(p3.y);
+        area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+
+        // Pixel centers lie at x * S + S / 2, min include, max exclude
+        const int64_t b_min_x = math::Min(x[0], math::Min(x[1], x[2]));
+        const int64_t b_max_x = math::Max(x[0], math::Max(x[1], x[2]));
+        const int64_t b_min_y = math::Min(y[0], math::Min(y[1], y[2]));
+        const int64_t b_max_y = math::Max(y[0], math::Max(y[1], y[2]));
+        const int64_t x_min = (b_min_x + S / 2 - 1) >> vg::SUBPIXEL_BITS;
+        const int64_t x_max = ((b_max_x - S / 2) >> vg::SUBPIXEL_BITS) + 1;
+        const int64_t y_min = (b_min_y + S / 2 - 1) >> vg::SUBPIXEL_BITS;
+        const int64_t y_max = ((b_max_y - S / 2) >> vg::SUBPIXEL_BITS) + 1;
+        bounds = {static_cast<VGint>(x_min), static_cast<VGint>(y_min), static_cast<VGsizei>(x_max - x_min),
+                  static_cast<VGsizei>(y_max - y_min)};
+    }
+
+    bool VirtualGPU::IsCulled(bool is_front) const {
+        if (!state_.cull_enabled) {
+            return false;
+        }
+        switch (state_.cull_face) {
+            case VG_BACK:
+                return !is_front;
+            case VG_FRONT:
+                return is_front;
+            case VG_FRONT_AND_BACK:
+            default:
+                return true;
+        }
+    }
+
+    void VirtualGPU::Rasterize(const Varying& v1, const Varying& v2, const Varying& v3, const Rect& region,
+                               const SmoothGradient* smooth_gradient, FragmentChunk& chunk) {
         assert(v1.used_smooth_register_size == v2.used_smooth_register_size);
         assert(v1.used_flat_register_size == v2.used_flat_register_size);
         assert(v2.used_smooth_register_size == v3.used_smooth_register_size);
         assert(v2.used_flat_register_size == v3.used_flat_register_size);
 
         // Edge Function and Incremental Perspective Correct Interpolation
-        std::vector<Fragment> out;
-
-        const BoundingBox2D b =
-            BoundingBox2D(Vector2(v1.viewport_coord), Vector2(v2.viewport_coord), Vector2(v3.viewport_coord));
-
-        const Vector2 p0(math::Ceil(b.min.x - 0.5_r) + 0.5_r, math::Ceil(b.min.y - 0.5_r) + 0.5_r);
-
-        const EdgeFunction ef12(Vector2(v1.viewport_coord), Vector2(v2.viewport_coord), p0);
-        const bool ef12_is_topleft = (v2.viewport_coord.y < v1.viewport_coord.y) ||
-                                     (math::IsEqualApprox(v2.viewport_coord.y, v1.viewport_coord.y) &&
-                                      v2.viewport_coord.x > v1.viewport_coord.x);
-
-        const EdgeFunction ef23(Vector2(v2.viewport_coord), Vector2(v3.viewport_coord), p0);
-        const bool ef23_is_topleft = (v3.viewport_coord.y < v2.viewport_coord.y) ||
-                                     (math::IsEqualApprox(v3.viewport_coord.y, v2.viewport_coord.y) &&
-                                      v3.viewport_coord.x > v2.viewport_coord.x);
-
-        const EdgeFunction ef31(Vector2(v3.viewport_coord), Vector2(v1.viewport_coord), p0);
-        const bool ef31_is_topleft = (v1.viewport_coord.y < v3.viewport_coord.y) ||
-                                     (math::IsEqualApprox(v1.viewport_coord.y, v3.viewport_coord.y) &&
-                                      v1.viewport_coord.x > v3.viewport_coord.x);
-
-        const real area = (v2.viewport_coord.x - v1.viewport_coord.x) * (v3.viewport_coord.y - v1.viewport_coord.y) -
-                          (v2.viewport_coord.y - v1.viewport_coord.y) * (v3.viewport_coord.x - v1.viewport_coord.x);
+        // Vertices are snapped to the sub-pixel grid, coverage is decided exactly with integer edge functions.
+        // Clipping keeps viewport coordinates inside the guard band, far from overflowing the 64 bit products.
+        constexpr int64_t S = vg::SUBPIXEL_SCALE;
+        const SnappedTriangle snapped(v1.viewport_coord, v2.viewport_coord, v3.viewport_coord);
+        const int64_t* vx = snapped.x;
+        const int64_t* vy = snapped.y;
+
+        const int x_min = math::Max(snapped.bounds.x, region.x);
+        const int x_max = math::Min(snapped.bounds.x + snapped.bounds.width, region.x + region.width);
+        const int y_min = math::Max(snapped.bounds.y, region.y);
+        const int y_max = math::Min(snapped.bounds.y + snapped.bounds.height, region.y + region.height);
+
+        if (x_min >= x_max || y_min >= y_max) {
+            return;
+        }
 
-        if (math::IsEqualApprox(area, math::EPSILON_RASTERIZATION)) {
+        const int64_t area_fixed = snapped.area;
+        if (area_fixed == 0) {
             // degenerate case
-            return out;
+            return;
         }
 
-        // Face culling: Since screen space is Y-down, CCW winding results in negative area.
-        const bool is_front = (state_.front_face == VG_CCW) ? (area < 0) : (area > 0);
-        if (state_.cull_enabled) {
-            switch (state_.cull_face) {
-                case VG_BACK:
-                    if (!is_front) return out;
-                    break;
-                case VG_FRONT:
-                    if (is_front) return out;
-                    break;
-                case VG_FRONT_AND_BACK:
-                default:
-                    return out;
-            }
+        const bool is_front = IsFrontFace(area_fixed);
+        if (IsCulled(is_front)) {
+            return;
+        }
+
+        // The edge function of a -> b is E(p) = (a.y - b.y) * (p.x - a.x) + (b.x - a.x) * (p.y - a.y).
+        // It is positive inside a triangle of positive area and negative inside one of negative area, so 'sign'
+        // turns the inside positive for both windings. A pixel center exactly on an edge is covered only if the
+        // edge is a top edge (horizontal, inside below) or a left edge (inside to the right), so a pixel on an
+        // edge shared by two triangles is covered exactly once. Other edges are biased by -1 to exclude it.
+        const int64_t sign = area_fixed > 0 ? 1 : -1;
+        const int64_t px0 = int64_t(x_min) * S + S / 2;
+        const int64_t py0 = int64_t(y_min) * S + S / 2;
+
+        vg::TriangleEdges edges;
+        int64_t origin_value[3];
+        for (int e = 0; e < 3; e++) {
+            const int a = e;
+            const int b = (e + 1) % 3;
+            const int64_t gx = sign * (vy[a] - vy[b]);
+            const int64_t gy = sign * (vx[b] - vx[a]);
+            const bool is_topleft = gx > 0 || (gx == 0 && gy > 0);
+
+            edges.dx[e] = gx * S;
+            edges.dy[e] = gy * S;
+            origin_value[e] = gx * (px0 - vx[a]) + gy * (py0 - vy[a]) - (is_topleft ? 0 : 1);
         }
 
-        // The edge function is defined assuming CCW vertex order.
-        // For a CCW triangle, the edge function is positive inside the triangle
-        // and negative outside; for a CW triangle, the sign is inverted
-        // (negative inside, positive outside).
-        // The 'sign' value is used to unify the inside/outside test for both
-        // CCW and CW triangles under a single condition.
-        const real sign = area > 0.0_r ? 1.0_r : -1.0_r;
+        // Attributes are interpolated in floating point from the snapped positions.
+        const real inv_scale = 1.0_r / static_cast<real>(S);
+        const Vector2 q1(static_cast<real>(vx[0]) * inv_scale, static_cast<real>(vy[0]) * inv_scale);
+        const Vector2 q2(static_cast<real>(vx[1]) * inv_scale, static_cast<real>(vy[1]) * inv_scale);
+        const Vector2 q3(static_cast<real>(vx[2]) * inv_scale, static_cast<real>(vy[2]) * inv_scale);
+        const Vector2 p0(static_cast<real>(x_min) + 0.5_r, static_cast<real>(y_min) + 0.5_r);
+
+        const EdgeFunction ef12(q1, q2, p0);
+        const EdgeFunction ef23(q2, q3, p0);
+        const EdgeFunction ef31(q3, q1, p0);
+        const real area = static_cast<real>(area_fixed) * inv_scale * inv_scale;
 
         // polygon offset slope
         const real depth_slope = ComputeDepthSlope(v1.viewport_coord, v2.viewport_coord, v3.viewport_coord);
@@ -688,14 +1833,20 @@ namespace ho {
         const double offset_depth_v3 =
             static_cast<double>(ApplyDepthOffset(v3.viewport_coord.z, depth_slope, depth_bit, state_.polygon_mode));
 
+        // Depth only draws interpolate only depth and test it right here, see HasColorOutputs.
+        const bool is_depth_only = is_depth_only_draw_ && chunk.collected == nullptr;
+        const size_t smooth_register_size = is_depth_only ? 0 : static_cast<size_t>(v1.used_smooth_register_size);
+        uint64_t depth_only_count = 0;
+        uint64_t depth_only_passed_count = 0;
+
         float smooth_register_pw1[SMOOTH_REGISTER_SIZE];
         float smooth_register_pw2[SMOOTH_REGISTER_SIZE];
         float smooth_register_pw3[SMOOTH_REGISTER_SIZE];
 
         // Initial edge values at start pixel center of bounding box
-        real f12_row = ef12.initial_value;
-        real f23_row = ef23.initial_value;
-        real f31_row = ef31.initial_value;
+        const real f12_row = ef12.initial_value;
+        const real f23_row = ef23.initial_value;
+        const real f31_row = ef31.initial_value;
 
         // per-pixel x increments for edge functions are ef*.dx, per-row y increments
         // are ef*.dy
@@ -719,7 +1870,7 @@ namespace ho {
             inv_area;
         float smooth_register_row[SMOOTH_REGISTER_SIZE];
 
-        for (size_t i = 0; i < static_cast<size_t>(v1.used_smooth_register_size); i++) {
+        for (size_t i = 0; i < smooth_register_size; i++) {
             smooth_register_pw1[i] = v1.smooth_register[i] * inv_w1;
             smooth_register_pw2[i] = v2.smooth_register[i] * inv_w2;
             smooth_register_pw3[i] = v3.smooth_register[i] * inv_w3;
@@ -734,85 +1885,230 @@ namespace ho {
                                      inv_area;
         }
 
-        // min include, max exclude
-        const int x_min = static_cast<int>(math::Ceil(b.min.x - 0.5_r));
-        const int x_max = static_cast<int>(math::Floor(b.max.x - 0.5_r)) + 1;
-        const int y_min = static_cast<int>(math::Ceil(b.min.y - 0.5_r));
-        const int y_max = static_cast<int>(math::Floor(b.max.y - 0.5_r)) + 1;
+        // Emits the fragment of pixel (x, y) if it passes the early tests.
+        const auto EmitFragment = [&](int x, int y, double depth, real w, const float* smooth_register) {
+            const Vector2 target_coord(real(x) + 0.5_r, real(y) + 0.5_r);
+
+            if (!ScissorTest(target_coord.x, target_coord.y) ||
+                !RasterDepthStencilTest(target_coord.x, target_coord.y, static_cast<real>(depth), is_front)) {
+                return;
+            }
+
+            Fragment& frag = AppendFragment(chunk);
+            frag.screen_coord = target_coord;
+            frag.depth = static_cast<real>(depth);
+
+            frag.used_smooth_register_size = v3.used_smooth_register_size;
+            for (size_t i = 0; i < static_cast<size_t>(frag.used_smooth_register_size); i++) {
+                frag.smooth_register[i] = smooth_register[i] * w;  // NOLINT
+            }
+
+            frag.used_flat_register_size = v3.used_flat_register_size;
+            std::copy_n(v3.flat_register.begin(), frag.used_flat_register_size, frag.flat_register.begin());
+
+            frag.is_front = is_front;
+            frag.smooth_gradient = smooth_gradient;
+            frag.w = w;
+        };
+
+        // Tests and writes depth/stencil of pixel (x, y) of a depth only draw.
+        const auto TestDepthOnly = [&](int x, int y, double depth) {
+            const real fx = real(x) + 0.5_r;
+            const real fy = real(y) + 0.5_r;
+            if (!ScissorTest(fx, fy)) {
+                return;
+            }
+            depth_only_count++;
+            if (TestDepthStencil(fx, fy, static_cast<real>(depth), is_front)) {
+                depth_only_passed_count++;
+            }
+        };
+        const auto AddDepthOnlyStatistics = [&]() {
+            if (depth_only_count != 0 && IsGatheringStatistics()) {
+                AddStatistic(STATISTIC_FRAGMENTS_RASTERIZED, depth_only_count);
+                AddStatistic(STATISTIC_FRAGMENTS_EARLY_REJECTED, depth_only_count - depth_only_passed_count);
+                AddStatistic(STATISTIC_FRAGMENTS_WRITTEN, depth_only_passed_count);
+            }
+        };
+
+        if (coverage_row_func_ != nullptr) {
+            // Block raster loop
+            // Depth is linear in screen space and stays between the vertex depths inside the triangle.
+            const double vertex_min_depth = math::Min(offset_depth_v1, math::Min(offset_depth_v2, offset_depth_v3));
+            const double vertex_max_depth = math::Max(offset_depth_v1, math::Max(offset_depth_v2, offset_depth_v3));
+            const auto IsOccludedArea = [&](int x0, int y0, int x1, int y1, float stored_min, float stored_max) {
+                const double d = depth_init + static_cast<double>(x0 - x_min) * depth_dx +
+                                 static_cast<double>(y0 - y_min) * depth_dy;
+                const double span_x = depth_dx * static_cast<double>(x1 - 1 - x0);
+                const double span_y = depth_dy * static_cast<double>(y1 - 1 - y0);
+                const double lo = math::Max(d + math::Min(span_x, 0.0) + math::Min(span_y, 0.0), vertex_min_depth);
+                const double hi = math::Min(d + math::Max(span_x, 0.0) + math::Max(span_y, 0.0), vertex_max_depth);
+                return IsOccluded(stored_min, stored_max, lo, hi);
+            };
+
+            // Hierarchical Z, whole tiles first
+            const HiZBuffer* hiz = IsHiZTestable() && x_max <= active_hiz_->width && y_max <= active_hiz_->height
+                                       ? active_hiz_
+                                       : nullptr;
+            if (hiz != nullptr) {
+                bool is_visible = false;
+                for (int ty = y_min / TILE_HEIGHT; ty <= (y_max - 1) / TILE_HEIGHT && !is_visible; ty++) {
+                    for (int tx = x_min / TILE_WIDTH; tx <= (x_max - 1) / TILE_WIDTH && !is_visible; tx++) {
+                        const size_t tile_index = static_cast<size_t>(ty * hiz->tile_columns + tx);
+                        if (hiz->tile_dirty[tile_index]) {
+                            is_visible = true;
+                            break;
+                        }
+                        is_visible = !IsOccludedArea(
+                            math::Max(tx * TILE_WIDTH, x_min), math::Max(ty * TILE_HEIGHT, y_min),
+                            math::Min((tx + 1) * TILE_WIDTH, x_max), math::Min((ty + 1) * TILE_HEIGHT, y_max),
+                            hiz->tile_min_depth[tile_index], hiz->tile_max_depth[tile_index]);
+                    }
+                }
+                if (!is_visible) {
+                    return;
+                }
+            }
+
+            // Blocks are aligned to the raster block grid and clipped to the bounding box.
+            for (int cell_y = y_min / vg::RASTER_BLOCK_SIZE; cell_y * vg::RASTER_BLOCK_SIZE < y_max; cell_y++) {
+                const int by = math::Max(cell_y * vg::RASTER_BLOCK_SIZE, y_min);
+                const int bh = math::Min((cell_y + 1) * vg::RASTER_BLOCK_SIZE, y_max) - by;
+
+                for (int cell_x = x_min / vg::RASTER_BLOCK_SIZE; cell_x * vg::RASTER_BLOCK_SIZE < x_max; cell_x++) {
+                    const int bx = math::Max(cell_x * vg::RASTER_BLOCK_SIZE, x_min);
+                    const int bw = math::Min((cell_x + 1) * vg::RASTER_BLOCK_SIZE, x_max) - bx;
+                    const int64_t ox = bx - x_min;
+                    const int64_t oy = by - y_min;
+
+                    // An edge is linear, so its extremes over the block lie on the corner pixels.
+                    int64_t block_value[3];
+                    bool is_rejected = false;
+                    bool is_accepted = true;
+                    for (int e = 0; e < 3; e++) {
+                        block_value[e] = origin_value[e] + edges.dx[e] * ox + edges.dy[e] * oy;
+
+                        const int64_t span_x = edges.dx[e] * (bw - 1);
+                        const int64_t span_y = edges.dy[e] * (bh - 1);
+                        const int64_t lo =
+                            block_value[e] + math::Min(span_x, int64_t(0)) + math::Min(span_y, int64_t(0));
+                        const int64_t hi =
+                            block_value[e] + math::Max(span_x, int64_t(0)) + math::Max(span_y, int64_t(0));
+
+                        is_rejected = is_rejected || hi < 0;
+                        is_accepted = is_accepted && lo >= 0;
+                    }
+                    if (is_rejected) {
+                        continue;
+                    }
+
+                    if (hiz != nullptr) {
+                        const size_t block_index = static_cast<size_t>(cell_y * hiz->block_columns + cell_x);
+                        if (!hiz->block_dirty[block_index] &&
+                            IsOccludedArea(bx, by, bx + bw, by + bh, hiz->block_min_depth[block_index],
+                                           hiz->block_max_depth[block_index])) {
+                            continue;
+                        }
+                    }
+
+                    // A block goes to one flush.
+                    if (!is_depth_only && FragmentChunk::CAPACITY - chunk.size < static_cast<size_t>(bw * bh)) {
+                        FlushFragments(chunk);
+                    }
+
+                    const uint32_t row_mask = (1u << bw) - 1u;
+                    for (int j = 0; j < bh; j++) {
+                        uint32_t mask = row_mask;
+                        if (!is_accepted) {
+                            const int64_t row_value[3] = {block_value[0] + edges.dy[0] * j,
+                                                          block_value[1] + edges.dy[1] * j,
+                                                          block_value[2] + edges.dy[2] * j};
+                            mask &= coverage_row_func_(edges, row_value);
+                        }
+                        if (mask == 0) {
+                            continue;
+                        }
+
+                        const int y = by + j;
+                        const real fy = static_cast<real>(y - y_min);
+                        for (int i = 0; i < bw; i++) {
+                            if ((mask & (1u << i)) == 0) {
+                                continue;
+                            }
+
+                            const int x = bx + i;
+                            const real fx = static_cast<real>(x - x_min);
+                            const double depth = depth_init + static_cast<double>(fx) * depth_dx +
+                                                 static_cast<double>(fy) * depth_dy;
+                            if (is_depth_only) {
+                                TestDepthOnly(x, y, depth);
+                                continue;
+                            }
+
+                            float smooth_register[SMOOTH_REGISTER_SIZE];
+                            for (size_t k = 0; k < smooth_register_size; k++) {
+                                smooth_register[k] = smooth_register_row[k] + smooth_register_dx[k] * fx +
+                                                     smooth_register_dy[k] * fy;  // NOLINT
+                            }
+
+                            EmitFragment(x, y, depth, 1.0_r / (inv_w_row + inv_w_dx * fx + inv_w_dy * fy),
+                                         smooth_register);
+                        }
+                    }
+                }
+            }
+
+            AddDepthOnlyStatistics();
+            return;
+        }
 
-        out.reserve(static_cast<size_t>((x_max - x_min) * (y_max - y_min) / 2));
-        // Raster loop
+        // Reference raster loop
+        int64_t edge_row[3] = {origin_value[0], origin_value[1], origin_value[2]};
         for (int y = y_min; y < y_max; ++y) {
-            real f12_ev = f12_row;
-            real f23_ev = f23_row;
-            real f31_ev = f31_row;
+            int64_t edge_value[3] = {edge_row[0], edge_row[1], edge_row[2]};
 
             real inv_w = inv_w_row;
             const double dy_offset = static_cast<double>(y - y_min);
             double depth = depth_init + dy_offset * depth_dy;
 
             float smooth_register[SMOOTH_REGISTER_SIZE];
-            std::memcpy(smooth_register, smooth_register_row,
-                        static_cast<size_t>(v1.used_smooth_register_size) * sizeof(float));
+            std::memcpy(smooth_register, smooth_register_row, smooth_register_size * sizeof(float));
 
             for (int x = x_min; x < x_max; ++x) {
-                const bool inside12 =
-                    (f12_ev * sign > 0) || (ef12_is_topleft && math::Abs(f12_ev) <= math::EPSILON_RASTERIZATION);
-                const bool inside23 =
-                    (f23_ev * sign > 0) || (ef23_is_topleft && math::Abs(f23_ev) <= math::EPSILON_RASTERIZATION);
-                const bool inside31 =
-                    (f31_ev * sign > 0) || (ef31_is_topleft && math::Abs(f31_ev) <= math::EPSILON_RASTERIZATION);
-
-                if (inside12 && inside23 && inside31) {
-                    const Vector2 target_coord(real(x) + 0.5_r, real(y) + 0.5_r);
-
-                    const real w = 1.0_r / inv_w;
-
-                    if (ScissorTest(target_coord.x, target_coord.y) &&
-                        TestDepthStencil(target_coord.x, target_coord.y, static_cast<real>(depth), is_front, true)) {
-                        Fragment frag;
-                        frag.screen_coord = target_coord;
-                        frag.depth = static_cast<real>(depth);
-
-                        frag.used_smooth_register_size = v3.used_smooth_register_size;
-                        for (size_t i = 0; i < static_cast<size_t>(frag.used_smooth_register_size); i++) {
-                            frag.smooth_register[i] = smooth_register[i] * w;  // NOLINT
-                        }
-
-                        frag.used_flat_register_size = v3.used_flat_register_size;
-                        std::copy_n(v3.flat_register.begin(), frag.used_flat_register_size, frag.flat_register.begin());
-
-                        frag.is_front = is_front;
-                        out.emplace_back(frag);
+                if (edge_value[0] >= 0 && edge_value[1] >= 0 && edge_value[2] >= 0) {
+                    if (is_depth_only) {
+                        TestDepthOnly(x, y, depth);
+                    } else {
+                        EmitFragment(x, y, depth, 1.0_r / inv_w, smooth_register);
                     }
                 }
 
                 // +1 in x: advance edge and attributes
-                f12_ev += ef12.dx;
-                f23_ev += ef23.dx;
-                f31_ev += ef31.dx;
+                for (int e = 0; e < 3; e++) {
+                    edge_value[e] += edges.dx[e];
+                }
 
                 inv_w += inv_w_dx;
                 depth += depth_dx;
 
-                for (size_t i = 0; i < static_cast<size_t>(v3.used_smooth_register_size); i++) {
+                for (size_t i = 0; i < smooth_register_size; i++) {
                     smooth_register[i] += smooth_register_dx[i];  // NOLINT
                 }
             }
 
             // +1 in y: advance row start edge and row start attributes
-            f12_row += ef12.dy;
-            f23_row += ef23.dy;
-            f31_row += ef31.dy;
+            for (int e = 0; e < 3; e++) {
+                edge_row[e] += edges.dy[e];
+            }
 
             inv_w_row += inv_w_dy;
 
-            for (size_t i = 0; i < static_cast<size_t>(v3.used_smooth_register_size); i++) {
+            for (size_t i = 0; i < smooth_register_size; i++) {
                 smooth_register_row[i] += smooth_register_dy[i];  // NOLINT
             }
         }
 
-        return out;
+        AddDepthOnlyStatistics();
     }
 
     bool VirtualGPU::ScissorTest(real x, real y) const {
@@ -885,7 +2181,8 @@ namespace ho {
         const size_t pixel_index = static_cast<size_t>(py) * static_cast<size_t>(attch.width) + static_cast<size_t>(px);
         uint8_t* pixel_addr = attch.memory->data() + static_cast<size_t>(attch.offset) +
                               pixel_index * static_cast<size_t>(vg::GetPixelSize(attch.format, attch.component_type));
-        SpinLock& lock = GetDepthLock(px, py);
+        // Tile jobs own their pixels, so only the per primitive path needs to lock.
+        SpinLock* lock = state_.tiled_rasterization_enabled ? nullptr : &GetDepthLock(px, py);
 
         real old_depth = 0.0_r;
         bool depth_pass = true;
@@ -894,7 +2191,7 @@ namespace ho {
         const size_t face_idx = is_front_face ? 0 : 1;
 
         // Read
-        lock.Lock();
+        if (lock) lock->Lock();
         if (attch.format == VG_DEPTH_STENCIL) {
             // Read depth, stencil
 
@@ -1033,16 +2330,22 @@ namespace ho {
                 vg::EncodeDepthStencil(bytes, write_depth, stencil);
 
                 std::memcpy(pixel_addr, bytes, 4);
+                if (write_depth != old_depth && active_hiz_ != nullptr) {
+                    MarkHiZDirty(px, py);
+                }
 
             } else {
                 // Write depth only
                 if (state_.depth_test_enabled && depth_pass && state_.depth_write_enabled) {
                     vg::CopyPixel(pixel_addr, reinterpret_cast<const uint8_t*>(&depth), VG_DEPTH_COMPONENT, VG_FLOAT,
                                   VG_DEPTH_COMPONENT, VG_FLOAT);
+                    if (depth != old_depth && active_hiz_ != nullptr) {
+                        MarkHiZDirty(px, py);
+                    }
                 }
             }
         }
-        lock.Unlock();
+        if (lock) lock->Unlock();
         return (stencil_pass && depth_pass);
     }
 
@@ -1209,12 +2512,15 @@ namespace ho {
         uint8_t* pixel_addr =
             base +
             static_cast<size_t>(attch.offset + pixel_offset * vg::GetPixelSize(attch.format, attch.component_type));
-        SpinLock& lock = GetColorLock(fb->draw_slot_to_color_attachment[slot], px, py);
+        // Tile jobs own their pixels, so only the per primitive path needs to lock.
+        SpinLock* lock =
+            state_.tiled_rasterization_enabled ? nullptr
+                                               : &GetColorLock(fb->draw_slot_to_color_attachment[slot], px, py);
 
         Color128 dst_color;
 
         // read previous color
-        lock.Lock();
+        if (lock) lock->Lock();
         vg::DecodeColor(&dst_color, pixel_addr, attch.format, attch.component_type);
 
         Color128 final_color = color;
@@ -1261,69 +2567,115 @@ namespace ho {
         if (dbs.color_mask[3]) write_color.a = final_color.a;
 
         vg::EncodeColor(pixel_addr, write_color, attch.format, attch.component_type);
-        lock.Unlock();
+        if (lock) lock->Unlock();
     }
 
-    void VirtualGPU::AfterVSJobEntry(void* input, int size) {
-        assert(size == sizeof(AfterVSJobInput));
-        (void)size;
-        VirtualGPU& vg = VirtualGPU::GetInstance();
-        AfterVSJobInput* in = static_cast<AfterVSJobInput*>(input);
-
-        std::vector<Varying> poly;
-        poly.reserve(in->poly.size());
+    bool VirtualGPU::SetupPrimitive(const std::vector<Varying*>& poly, std::vector<RasterPrimitive>& out) const {
+        ClipPolygon clipped;
+        for (const Varying* v : poly) {
+            clipped.push_back(*v);
+        }
+        return SetupPrimitive(clipped, out);
+    }
 
-        for (Varying* v : in->poly) {
-            poly.emplace_back(*v);
+    bool VirtualGPU::SetupPrimitive(ClipPolygon& clipped, std::vector<RasterPrimitive>& out) const {
+        assert(clipped.size() <= 3);
+
+        // Outcodes: a primitive outside of one plane is rejected, one inside of all planes is not clipped.
+        uint32_t outcode_union = 0;
+        uint32_t outcode_intersection = CLIP_PLANES_ALL;
+        bool is_in_guard_band = true;
+        for (const Varying& v : clipped) {
+            const uint32_t outcode = ComputeOutcode(v.vg_Position);
+            outcode_union |= outcode;
+            outcode_intersection &= outcode;
+            is_in_guard_band = is_in_guard_band && IsInGuardBand(v.vg_Position);
+        }
+        if (outcode_intersection != 0) {
+            return false;
+        }
+        if (clipped.size() == 3 && state_.polygon_mode == VG_FILL && is_in_guard_band) {
+            outcode_union &= ~CLIP_PLANES_XY;
         }
 
         // Clipping
-        poly = vg.Clip(poly);
-
-        if (poly.empty()) {
-            delete in;
-            return;
+        if (outcode_union != 0) {
+            Clip(clipped, outcode_union);
+            if (clipped.empty()) {
+                return false;
+            }
         }
 
         // Perspective devide, Viewport transform
-        for (Varying& v : poly) {
-            vg.PerspectiveDivide(v);
-            vg.ViewportTransform(v);
+        for (Varying& v : clipped) {
+            PerspectiveDivide(v);
+            ViewportTransform(v);
         }
 
-        // Rasterization
-        std::vector<Fragment> frags;
-        std::vector<Fragment> temp_frags;
-        const VGenum pmode = vg.state_.polygon_mode;
+        auto EmitPoint = [&](const Varying& v) {
+            RasterPrimitive& prim = out.emplace_back();
+            prim.vertices[0] = v;
+            prim.vertex_count = 1;
+            prim.bounds = {static_cast<int>(math::Floor(v.viewport_coord.x)),
+                           static_cast<int>(math::Floor(v.viewport_coord.y)), 1, 1};
+        };
+
+        auto EmitLine = [&](const Varying& v1, const Varying& v2) {
+            const int x1 = static_cast<int>(math::Floor(v1.viewport_coord.x));
+            const int y1 = static_cast<int>(math::Floor(v1.viewport_coord.y));
+            const int x2 = static_cast<int>(math::Floor(v2.viewport_coord.x));
+            const int y2 = static_cast<int>(math::Floor(v2.viewport_coord.y));
+
+            RasterPrimitive& prim = out.emplace_back();
+            prim.vertices[0] = v1;
+            prim.vertices[1] = v2;
+            prim.vertex_count = 2;
+            prim.bounds = {math::Min(x1, x2), math::Min(y1, y2), math::Abs(x2 - x1) + 1, math::Abs(y2 - y1) + 1};
+        };
+
+        auto EmitTriangle = [&](const Varying& v1, const Varying& v2, const Varying& v3) {
+            // Same snapped decisions as the triangle rasterizer, applied before the triangle is binned.
+            const SnappedTriangle snapped(v1.viewport_coord, v2.viewport_coord, v3.viewport_coord);
+            if (snapped.area == 0) {
+                // degenerate case
+                return;
+            }
+            if (IsCulled(IsFrontFace(snapped.area))) {
+                return;
+            }
+            if (snapped.bounds.width <= 0 || snapped.bounds.height <= 0) {
+                // covers no pixel center
+                return;
+            }
 
-        if (poly.size() == 1) {
-            frags = vg.Rasterize(poly[0]);
-        } else if (poly.size() == 2) {
-            frags = vg.Rasterize(poly[0], poly[1]);
+            RasterPrimitive& prim = out.emplace_back();
+            prim.vertices[0] = v1;
+            prim.vertices[1] = v2;
+            prim.vertices[2] = v3;
+            prim.vertex_count = 3;
+            prim.bounds = snapped.bounds;
+            ComputeSmoothGradient(v1, v2, v3, prim.smooth_gradient);
+        };
+
+        if (clipped.size() == 1) {
+            EmitPoint(clipped[0]);
+        } else if (clipped.size() == 2) {
+            EmitLine(clipped[0], clipped[1]);
         } else {
-            switch (pmode) {
+            switch (state_.polygon_mode) {
                 case VG_POINT:
-                    for (const Varying& v : poly) {
-                        temp_frags = vg.Rasterize(v);
-                        frags.insert(frags.end(), std::make_move_iterator(temp_frags.begin()),
-                                     std::make_move_iterator(temp_frags.end()));
+                    for (const Varying& v : clipped) {
+                        EmitPoint(v);
                     }
                     break;
-
                 case VG_LINE:
-                    for (size_t i = 0; i < poly.size(); i++) {
-                        const Varying& a = poly[i];
-                        const Varying& b = poly[(i + 1) % poly.size()];
-                        temp_frags = vg.Rasterize(a, b);
-                        frags.insert(frags.end(), std::make_move_iterator(temp_frags.begin()),
-                                     std::make_move_iterator(temp_frags.end()));
+                    for (size_t i = 0; i < clipped.size(); i++) {
+                        EmitLine(clipped[i], clipped[(i + 1) % clipped.size()]);
                     }
                     break;
                 case VG_FILL:
-                    for (size_t i = 1; i + 1 < poly.size(); i++) {
-                        temp_frags = vg.Rasterize(poly[0], poly[i], poly[i + 1]);
-                        frags.insert(frags.end(), std::make_move_iterator(temp_frags.begin()),
-                                     std::make_move_iterator(temp_frags.end()));
+                    for (size_t i = 1; i + 1 < clipped.size(); i++) {
+                        EmitTriangle(clipped[0], clipped[i], clipped[i + 1]);
                     }
                     break;
                 default:
@@ -1331,28 +2683,783 @@ namespace ho {
                     break;
             }
         }
+        return true;
+    }
+
+    void VirtualGPU::ComputeSmoothGradient(const Varying& v1, const Varying& v2, const Varying& v3,
+                                           SmoothGradient& out) {
+        const Vector3& p1 = v1.viewport_coord;
+        const Vector3& p2 = v2.viewport_coord;
+        const Vector3& p3 = v3.viewport_coord;
+
+        // Gradient of the plane through (x, y, value) of the three vertices
+        const real e2x = p2.x - p1.x;
+        const real e2y = p2.y - p1.y;
+        const real e3x = p3.x - p1.x;
+        const real e3y = p3.y - p1.y;
+        const real inv_area = 1.0_r / (e2x * e3y - e2y * e3x);
+
+        const real inv_w1 = 1.0_r / v1.vg_Position.w;
+        const real inv_w2 = 1.0_r / v2.vg_Position.w;
+        const real inv_w3 = 1.0_r / v3.vg_Position.w;
+        out.inv_w_dx = ((inv_w2 - inv_w1) * e3y - (inv_w3 - inv_w1) * e2y) * inv_area;
+        out.inv_w_dy = ((inv_w3 - inv_w1) * e2x - (inv_w2 - inv_w1) * e3x) * inv_area;
+
+        for (size_t i = 0; i < static_cast<size_t>(v1.used_smooth_register_size); i++) {
+            const real d2 = v2.smooth_register[i] * inv_w2 - v1.smooth_register[i] * inv_w1;
+            const real d3 = v3.smooth_register[i] * inv_w3 - v1.smooth_register[i] * inv_w1;
+            out.dx[i] = static_cast<float>((d2 * e3y - d3 * e2y) * inv_area);
+            out.dy[i] = static_cast<float>((d3 * e2x - d2 * e3x) * inv_area);
+        }
+    }
+
+    void VirtualGPU::RasterizePrimitive(const RasterPrimitive& prim, const Rect& region, FragmentChunk& chunk) {
+        switch (prim.vertex_count) {
+            case 1:
+                Rasterize(prim.vertices[0], region, chunk);
+                break;
+            case 2:
+                Rasterize(prim.vertices[0], prim.vertices[1], region, chunk);
+                break;
+            case 3:
+                Rasterize(prim.vertices[0], prim.vertices[1], prim.vertices[2], region, &prim.smooth_gradient, chunk);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void VirtualGPU::PackRasterPrimitive(const RasterPrimitive& prim, const Program& prog,
+                                         std::vector<float>& records) {
+        const size_t vertex_size = RASTER_VIEWPORT_COORD_SIZE + prog.varying_stride;
+        const size_t smooth_size = static_cast<size_t>(prog.smooth_register_size);
+        const size_t vertex_count = static_cast<size_t>(prim.vertex_count);
+        const size_t offset = records.size();
+        records.resize(offset + vertex_count * vertex_size + (vertex_count == 3 ? 2 + 2 * smooth_size : 0));
+
+        float* record = records.data() + offset;
+        for (size_t i = 0; i < vertex_count; i++) {
+            const Vector3& p = prim.vertices[i].viewport_coord;
+            record[0] = p.x;
+            record[1] = p.y;
+            record[2] = p.z;
+            PackVarying(prim.vertices[i], prog, record + RASTER_VIEWPORT_COORD_SIZE);
+            record += vertex_size;
+        }
+        if (vertex_count == 3) {
+            const SmoothGradient& gradient = prim.smooth_gradient;
+            record[0] = static_cast<float>(gradient.inv_w_dx);
+            record[1] = static_cast<float>(gradient.inv_w_dy);
+            std::copy_n(gradient.dx.begin(), smooth_size, record + 2);
+            std::copy_n(gradient.dy.begin(), smooth_size, record + 2 + smooth_size);
+        }
+    }
+
+    void VirtualGPU::UnpackRasterPrimitive(const float* record, int vertex_count, const Program& prog,
+                                           RasterPrimitive& out) {
+        const size_t vertex_size = RASTER_VIEWPORT_COORD_SIZE + prog.varying_stride;
+        const size_t smooth_size = static_cast<size_t>(prog.smooth_register_size);
+        out.vertex_count = vertex_count;
+        for (size_t i = 0; i < static_cast<size_t>(vertex_count); i++) {
+            out.vertices[i].viewport_coord = Vector3(record[0], record[1], record[2]);
+            UnpackVarying(record + RASTER_VIEWPORT_COORD_SIZE, prog, out.vertices[i]);
+            record += vertex_size;
+        }
+        if (vertex_count == 3) {
+            SmoothGradient& gradient = out.smooth_gradient;
+            gradient.inv_w_dx = record[0];
+            gradient.inv_w_dy = record[1];
+            std::copy_n(record + 2, smooth_size, gradient.dx.begin());
+            std::copy_n(record + 2 + smooth_size, smooth_size, gradient.dy.begin());
+        }
+    }
+
+    void VirtualGPU::FlushFragments(FragmentChunk& chunk) {
+        if (chunk.size == 0) {
+            return;
+        }
+
+        if (chunk.collected != nullptr) {
+            chunk.collected->insert(chunk.collected->end(), chunk.fragments.begin(),
+                                    chunk.fragments.begin() + static_cast<std::ptrdiff_t>(chunk.size));
+        } else {
+            const uint64_t start_time = IsTimingStages() ? GetTimestamp() : 0;
+            ShadeFragments(chunk.fragments.data(), chunk.size, chunk.fs);
+            if (IsTimingStages()) {
+                chunk.shade_time += GetTimestamp() - start_time;
+            }
+        }
+        chunk.size = 0;
+    }
 
-        if (frags.empty()) {
-            delete in;
+    void VirtualGPU::ShadeFragments(const Fragment* frags, size_t count, FragmentShader fs) {
+        const QuadFragmentShader quad_fs =
+            using_program_ != nullptr && using_program_->fragment_shader != nullptr
+                ? reinterpret_cast<QuadFragmentShader>(using_program_->fragment_shader->wide_source)
+                : nullptr;
+        if (quad_fs != nullptr) {
+            ShadeFragmentQuads(frags, count, quad_fs);
             return;
         }
 
+        const bool early_fragment_tests = IsEarlyFragmentTestsEnabled();
+        const bool is_gathering = IsGatheringStatistics();
+        const bool is_timing = IsTimingStages();
+        const uint64_t start_time = is_timing ? GetTimestamp() : 0;
+        uint64_t early_rejected_count = 0;
+        uint64_t passed_count = 0;
+        uint64_t fs_time = 0;
+
         // Output merger
         FSOutputs outputs;
-        for (const Fragment& frag : frags) {
+        for (const Fragment* frag_it = frags; frag_it != frags + count; frag_it++) {
+            const Fragment& frag = *frag_it;
+            if (early_fragment_tests &&
+                !TestDepthStencil(frag.screen_coord.x, frag.screen_coord.y, frag.depth, frag.is_front)) {
+                early_rejected_count++;
+                continue;
+            }
             outputs.Reset();
-            in->fs(frag, outputs);
-            if (!vg.TestDepthStencil(frag.screen_coord.x, frag.screen_coord.y, frag.depth, frag.is_front)) {
+            const uint64_t fs_start_time = is_timing ? GetTimestamp() : 0;
+            fs(frag, outputs);
+            if (is_timing) {
+                fs_time += GetTimestamp() - fs_start_time;
+            }
+            if (!early_fragment_tests &&
+                !TestDepthStencil(frag.screen_coord.x, frag.screen_coord.y, frag.depth, frag.is_front)) {
                 continue;
             }
-            for (size_t slot = 0; slot < static_cast<size_t>(DRAW_BUFFER_SLOT_COUNT); slot++) {
-                if (!outputs.written.test(slot)) {
+            passed_count++;
+            WriteFragmentOutputs(frag, outputs);
+        }
+
+        if (is_gathering) {
+            AddStatistic(STATISTIC_FRAGMENTS_RASTERIZED, count);
+            AddStatistic(STATISTIC_FRAGMENTS_EARLY_REJECTED, early_rejected_count);
+            AddStatistic(STATISTIC_FRAGMENTS_SHADED, count - early_rejected_count);
+            AddStatistic(STATISTIC_FRAGMENTS_WRITTEN, passed_count);
+        }
+        if (is_timing) {
+            // Everything but the fragment shader is counted as output merging.
+            AddStatistic(STATISTIC_FRAGMENT_SHADER_TIME, fs_time);
+            AddStatistic(STATISTIC_ROP_TIME, GetTimestamp() - start_time - fs_time);
+        }
+    }
+
+    void VirtualGPU::ShadeFragmentQuads(const Fragment* frags, size_t count, QuadFragmentShader fs) {
+        assert(count <= FragmentChunk::CAPACITY);
+        const bool early_fragment_tests = IsEarlyFragmentTestsEnabled();
+        const bool is_gathering = IsGatheringStatistics();
+        const bool is_timing = IsTimingStages();
+        const uint64_t start_time = is_timing ? GetTimestamp() : 0;
+        uint64_t early_rejected_count = 0;
+        uint64_t passed_count = 0;
+        uint64_t fs_time = 0;
+
+        // Group the fragments by quad, a primitive has at most one fragment per pixel.
+        struct QuadLane {
+            uint32_t quad_key;
+            uint32_t lane;
+            const Fragment* frag;
+        };
+        std::array<QuadLane, FragmentChunk::CAPACITY> lanes;
+        for (size_t i = 0; i < count; i++) {
+            const uint32_t x = static_cast<uint32_t>(frags[i].screen_coord.x);
+            const uint32_t y = static_cast<uint32_t>(frags[i].screen_coord.y);
+            lanes[i] = {((y >> 1) << 16) | (x >> 1), ((y & 1) << 1) | (x & 1), &frags[i]};
+        }
+        std::sort(lanes.begin(), lanes.begin() + static_cast<std::ptrdiff_t>(count),
+                  [](const QuadLane& a, const QuadLane& b) {
+                      return a.quad_key != b.quad_key ? a.quad_key < b.quad_key : a.lane < b.lane;
+                  });
+
+        FragmentQuad quad;
+        FSQuadOutputs outputs;
+        for (size_t first = 0; first < count;) {
+            uint32_t present_mask = 0;
+            quad.coverage_mask = 0;
+            size_t last = first;
+            for (; last < count && lanes[last].quad_key == lanes[first].quad_key; last++) {
+                const Fragment& frag = *lanes[last].frag;
+                const uint32_t bit = 1u << lanes[last].lane;
+                quad.fragments[lanes[last].lane] = frag;
+                present_mask |= bit;
+                if (early_fragment_tests &&
+                    !TestDepthStencil(frag.screen_coord.x, frag.screen_coord.y, frag.depth, frag.is_front)) {
+                    early_rejected_count++;
                     continue;
                 }
+                quad.coverage_mask |= bit;
+            }
+            const QuadLane& source = lanes[first];
+            first = last;
+
+            // Nothing to write, no need for derivatives.
+            if (quad.coverage_mask == 0) {
+                continue;
+            }
+
+            for (uint32_t lane = 0; lane < FragmentQuad::LANE_COUNT; lane++) {
+                if ((present_mask & (1u << lane)) == 0) {
+                    const int dx = static_cast<int>(lane & 1) - static_cast<int>(source.lane & 1);
+                    const int dy = static_cast<int>(lane >> 1) - static_cast<int>(source.lane >> 1);
+                    ExtrapolateFragment(*source.frag, dx, dy, quad.fragments[lane]);
+                }
+            }
+
+            outputs.Reset();
+            const uint64_t fs_start_time = is_timing ? GetTimestamp() : 0;
+            fs(quad, outputs);
+            if (is_timing) {
+                fs_time += GetTimestamp() - fs_start_time;
+            }
 
-                vg.WriteColor(frag.screen_coord.x, frag.screen_coord.y, outputs.values[slot], slot);
+            for (size_t lane = 0; lane < FragmentQuad::LANE_COUNT; lane++) {
+                const Fragment& frag = quad.fragments[lane];
+                if (quad.IsHelper(lane) ||
+                    (!early_fragment_tests &&
+                     !TestDepthStencil(frag.screen_coord.x, frag.screen_coord.y, frag.depth, frag.is_front))) {
+                    continue;
+                }
+                passed_count++;
+                WriteFragmentOutputs(frag, outputs.lanes[lane]);
             }
         }
-        delete in;
+
+        if (is_gathering) {
+            AddStatistic(STATISTIC_FRAGMENTS_RASTERIZED, count);
+            AddStatistic(STATISTIC_FRAGMENTS_EARLY_REJECTED, early_rejected_count);
+            AddStatistic(STATISTIC_FRAGMENTS_SHADED, count - early_rejected_count);
+            AddStatistic(STATISTIC_FRAGMENTS_WRITTEN, passed_count);
+        }
+        if (is_timing) {
+            AddStatistic(STATISTIC_FRAGMENT_SHADER_TIME, fs_time);
+            AddStatistic(STATISTIC_ROP_TIME, GetTimestamp() - start_time - fs_time);
+        }
+    }
+
+    void VirtualGPU::ExtrapolateFragment(const Fragment& src, int dx, int dy, Fragment& out) {
+        out = src;
+        out.screen_coord += Vector2(static_cast<real>(dx), static_cast<real>(dy));
+        const SmoothGradient* gradient = src.smooth_gradient;
+        if (gradient == nullptr) {
+            return;
+        }
+
+        // a/w and 1/w are linear in screen space.
+        const real rdx = static_cast<real>(dx);
+        const real rdy = static_cast<real>(dy);
+        const real src_inv_w = 1.0_r / src.w;
+        const real inv_w = src_inv_w + gradient->inv_w_dx * rdx + gradient->inv_w_dy * rdy;
+        if (!(inv_w > 0.0_r)) {
+            // behind the eye, keep the values of 'src'
+            return;
+        }
+        const real w = 1.0_r / inv_w;
+        for (size_t i = 0; i < static_cast<size_t>(src.used_smooth_register_size); i++) {
+            const real pw = src.smooth_register[i] * src_inv_w + gradient->dx[i] * rdx + gradient->dy[i] * rdy;
+            out.smooth_register[i] = static_cast<float>(pw * w);
+        }
+        out.w = w;
+    }
+
+    void VirtualGPU::WriteFragmentOutputs(const Fragment& frag, const FSOutputs& outputs) {
+        for (size_t slot = 0; slot < static_cast<size_t>(DRAW_BUFFER_SLOT_COUNT); slot++) {
+            if (!outputs.written.test(slot)) {
+                continue;
+            }
+
+            WriteColor(frag.screen_coord.x, frag.screen_coord.y, outputs.values[slot], slot);
+        }
+    }
+
+    void VirtualGPU::AfterVSJobEntry(void* input, int size) {
+        assert(size == sizeof(AfterVSJobInput));
+        (void)size;
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+        const AfterVSJobInput* in = static_cast<const AfterVSJobInput*>(input);
+
+        // Reused by every primitive of the batch
+        ClipPolygon poly;
+        std::vector<RasterPrimitive> raster_prims;
+        FragmentChunk& chunk = vg.GetFragmentChunk();
+        chunk.fs = in->fs;
+        chunk.shade_time = 0;
+
+        const bool is_timing = vg.IsTimingStages();
+        uint64_t clipped_count = 0;
+        uint64_t culled_count = 0;
+        uint64_t clip_time = 0;
+        uint64_t raster_time = 0;
+
+        // Triangles in the guard band reach out of the viewport, see CLIP_GUARD_BAND.
+        const Rect region = vg.GetRenderArea();
+        for (size_t i = in->first_index; i <= in->last_index; i++) {
+            const float* const* vertices = in->prims->Get(i);
+            poly.clear();
+            for (size_t j = 0; j < in->prims->vertex_count; j++) {
+                UnpackVarying(vertices[j], *vg.using_program_, poly.emplace_back());
+            }
+            raster_prims.clear();
+            const uint64_t setup_start_time = is_timing ? GetTimestamp() : 0;
+            if (!vg.SetupPrimitive(poly, raster_prims)) {
+                clipped_count++;
+            } else if (raster_prims.empty()) {
+                culled_count++;
+            }
+            if (is_timing) {
+                clip_time += GetTimestamp() - setup_start_time;
+            }
+
+            for (const RasterPrimitive& prim : raster_prims) {
+                const uint64_t raster_start_time = is_timing ? GetTimestamp() : 0;
+                vg.RasterizePrimitive(prim, region, chunk);
+                vg.FlushFragments(chunk);
+                if (is_timing) {
+                    raster_time += GetTimestamp() - raster_start_time;
+                }
+            }
+        }
+
+        if (vg.IsGatheringStatistics()) {
+            vg.AddStatistic(STATISTIC_PRIMITIVES_CLIPPED, clipped_count);
+            vg.AddStatistic(STATISTIC_PRIMITIVES_CULLED, culled_count);
+        }
+        if (is_timing) {
+            vg.AddStatistic(STATISTIC_CLIP_TIME, clip_time);
+            // Shading is counted by the flushes.
+            vg.AddStatistic(STATISTIC_RASTER_TIME, raster_time - chunk.shade_time);
+        }
+    }
+
+    VirtualGPU::Rect VirtualGPU::GetRenderArea() const {
+        const FrameBuffer* fb = bound_draw_frame_buffer_;
+
+        // Render area is limited by the smallest attachment that can be written.
+        int w = MAX_ATTACHMENT_WIDTH;
+        int h = MAX_ATTACHMENT_HEIGHT;
+
+        for (size_t slot = 0; slot < static_cast<size_t>(DRAW_BUFFER_SLOT_COUNT); slot++) {
+            const size_t attachment_index = fb->draw_slot_to_color_attachment[slot];
+            if (attachment_index == INVALID_SLOT || attachment_index >= static_cast<size_t>(COLOR_ATTACHMENT_COUNT)) {
+                continue;
+            }
+            const Attachment& attch = fb->color_attachments[attachment_index];
+            if (!attch.external_memory && !attch.memory) {
+                continue;
+            }
+            w = math::Min(w, static_cast<int>(attch.width));
+            h = math::Min(h, static_cast<int>(attch.height));
+        }
+
+        const Attachment& ds = fb->depth_stencil_attachment;
+        if (ds.memory) {
+            w = math::Min(w, static_cast<int>(ds.width));
+            h = math::Min(h, static_cast<int>(ds.height));
+        }
+
+        // viewport
+        int x0 = math::Clamp(state_.viewport.x, 0, w);
+        int y0 = math::Clamp(state_.viewport.y, 0, h);
+        int x1 = math::Clamp(state_.viewport.x + state_.viewport.width, 0, w);
+        int y1 = math::Clamp(state_.viewport.y + state_.viewport.height, 0, h);
+
+        // scissor
+        if (state_.scissor_test_enabled) {
+            x0 = math::Max(x0, math::Clamp(state_.scissor.x, 0, w));
+            y0 = math::Max(y0, math::Clamp(state_.scissor.y, 0, h));
+            x1 = math::Min(x1, math::Clamp(state_.scissor.x + state_.scissor.width, 0, w));
+            y1 = math::Min(y1, math::Clamp(state_.scissor.y + state_.scissor.height, 0, h));
+        }
+
+        return {x0, y0, math::Max(x1 - x0, 0), math::Max(y1 - y0, 0)};
+    }
+
+    void VirtualGPU::DrawBinned(const PrimitiveList& prims, FragmentShader fs) {
+        const size_t prim_count = prims.GetCount();
+        if (prim_count == 0) {
+            return;
+        }
+
+        // Primitive setup
+        // Inputs must stay in place until every job is done.
+        const size_t batch_count = (prim_count + PRIMITIVE_BATCH_SIZE - 1) / PRIMITIVE_BATCH_SIZE;
+        setup_batches_.resize(batch_count);
+        setup_job_inputs_.resize(batch_count);
+
+        std::vector<JobDeclaration> jobs(batch_count);
+        for (size_t b = 0; b < batch_count; b++) {
+            const size_t first = b * PRIMITIVE_BATCH_SIZE;
+            setup_job_inputs_[b] = {&prims, first, math::Min(first + PRIMITIVE_BATCH_SIZE, prim_count) - 1,
+                                    &setup_batches_[b]};
+
+            jobs[b].entry = SetupJobEntry;
+            jobs[b].name = "SetupJobEntry";
+            jobs[b].input_data = &setup_job_inputs_[b];
+            jobs[b].input_size = sizeof(SetupJobInput);
+        }
+
+        job_system_->KickJobsAndWait(jobs);
+
+        jobs.clear();
+
+        // Binning
+        const Rect area = GetRenderArea();
+        if (area.width <= 0 || area.height <= 0) {
+            return;
+        }
+
+        const int area_x_max = area.x + area.width;
+        const int area_y_max = area.y + area.height;
+
+        const int tile_x_begin = area.x / TILE_WIDTH;
+        const int tile_y_begin = area.y / TILE_HEIGHT;
+        const int tile_cols = (area_x_max - 1) / TILE_WIDTH + 1 - tile_x_begin;
+        const int tile_rows = (area_y_max - 1) / TILE_HEIGHT + 1 - tile_y_begin;
+
+        tile_bins_.resize(static_cast<size_t>(tile_cols * tile_rows));
+        for (std::vector<TileBinEntry>& bin : tile_bins_) {
+            bin.clear();
+        }
+
+        // Primitives are visited in submission order, so every bin is sorted by submission order.
+        for (size_t b = 0; b < batch_count; b++) {
+            const SetupBatch& batch = setup_batches_[b];
+            for (const BinnedPrimitive& prim : batch.prims) {
+                const int x0 = math::Max(prim.bounds.x, area.x);
+                const int y0 = math::Max(prim.bounds.y, area.y);
+                const int x1 = math::Min(prim.bounds.x + prim.bounds.width, area_x_max);
+                const int y1 = math::Min(prim.bounds.y + prim.bounds.height, area_y_max);
+
+                if (x0 >= x1 || y0 >= y1) {
+                    continue;
+                }
+
+                for (int ty = y0 / TILE_HEIGHT; ty <= (y1 - 1) / TILE_HEIGHT; ty++) {
+                    for (int tx = x0 / TILE_WIDTH; tx <= (x1 - 1) / TILE_WIDTH; tx++) {
+                        const size_t bin_index =
+                            static_cast<size_t>((ty - tile_y_begin) * tile_cols + tx - tile_x_begin);
+                        tile_bins_[bin_index].push_back(
+                            {batch.records.data() + prim.record_offset, prim.vertex_count});
+                    }
+                }
+            }
+        }
+
+        // Rasterization, fragment processing and output merging per tile
+        tile_job_inputs_.clear();
+        for (int ty = 0; ty < tile_rows; ty++) {
+            for (int tx = 0; tx < tile_cols; tx++) {
+                const std::vector<TileBinEntry>& bin = tile_bins_[static_cast<size_t>(ty * tile_cols + tx)];
+                if (bin.empty()) {
+                    continue;
+                }
+
+                const int x0 = math::Max((tile_x_begin + tx) * TILE_WIDTH, area.x);
+                const int y0 = math::Max((tile_y_begin + ty) * TILE_HEIGHT, area.y);
+                const int x1 = math::Min((tile_x_begin + tx + 1) * TILE_WIDTH, area_x_max);
+                const int y1 = math::Min((tile_y_begin + ty + 1) * TILE_HEIGHT, area_y_max);
+
+                tile_job_inputs_.push_back({&bin, {x0, y0, x1 - x0, y1 - y0}, fs});
+            }
+        }
+
+        jobs.resize(tile_job_inputs_.size());
+        for (size_t t = 0; t < tile_job_inputs_.size(); t++) {
+            jobs[t].entry = TileJobEntry;
+            jobs[t].name = "TileJobEntry";
+            jobs[t].input_data = &tile_job_inputs_[t];
+            jobs[t].input_size = sizeof(TileJobInput);
+        }
+
+        job_system_->KickJobsAndWait(jobs);
+    }
+
+    void VirtualGPU::SetupJobEntry(void* input, int size) {
+        assert(size == sizeof(SetupJobInput));
+        (void)size;
+        const SetupJobInput* in = static_cast<const SetupJobInput*>(input);
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+        const Program& prog = *vg.using_program_;
+        SetupBatch& out = *in->out;
+        out.prims.clear();
+        out.records.clear();
+
+        // Reused by every primitive of the batch
+        ClipPolygon poly;
+        std::vector<RasterPrimitive> raster_prims;
+
+        const uint64_t start_time = vg.IsTimingStages() ? GetTimestamp() : 0;
+        uint64_t clipped_count = 0;
+        uint64_t culled_count = 0;
+        for (size_t i = in->first_index; i <= in->last_index; i++) {
+            const float* const* vertices = in->prims->Get(i);
+            poly.clear();
+            for (size_t j = 0; j < in->prims->vertex_count; j++) {
+                UnpackVarying(vertices[j], prog, poly.emplace_back());
+            }
+            raster_prims.clear();
+            if (!vg.SetupPrimitive(poly, raster_prims)) {
+                clipped_count++;
+            } else if (raster_prims.empty()) {
+                culled_count++;
+            }
+            for (const RasterPrimitive& prim : raster_prims) {
+                out.prims.push_back({prim.bounds, prim.vertex_count, out.records.size()});
+                PackRasterPrimitive(prim, prog, out.records);
+            }
+        }
+
+        if (vg.IsGatheringStatistics()) {
+            vg.AddStatistic(STATISTIC_PRIMITIVES_CLIPPED, clipped_count);
+            vg.AddStatistic(STATISTIC_PRIMITIVES_CULLED, culled_count);
+        }
+        if (vg.IsTimingStages()) {
+            vg.AddStatistic(STATISTIC_CLIP_TIME, GetTimestamp() - start_time);
+        }
+    }
+
+    void VirtualGPU::TileJobEntry(void* input, int size) {
+        assert(size == sizeof(TileJobInput));
+        (void)size;
+        const TileJobInput* in = static_cast<const TileJobInput*>(input);
+        VirtualGPU& vg = VirtualGPU::GetInstance();
+        const bool is_timing = vg.IsTimingStages();
+        uint64_t raster_time = 0;
+        FragmentChunk& chunk = vg.GetFragmentChunk();
+        chunk.fs = in->fs;
+        chunk.shade_time = 0;
+        // Fragments point to its gradient, each primitive is flushed before the next one is unpacked.
+        RasterPrimitive prim;
+        for (const TileBinEntry& entry : *in->bin) {
+            const uint64_t raster_start_time = is_timing ? GetTimestamp() : 0;
+            UnpackRasterPrimitive(entry.record, entry.vertex_count, *vg.using_program_, prim);
+            vg.RasterizePrimitive(prim, in->region, chunk);
+            vg.FlushFragments(chunk);
+            if (is_timing) {
+                raster_time += GetTimestamp() - raster_start_time;
+            }
+        }
+        if (is_timing) {
+            // Shading is counted by the flushes.
+            vg.AddStatistic(STATISTIC_RASTER_TIME, raster_time - chunk.shade_time);
+        }
+        if (vg.active_hiz_ != nullptr) {
+            ResolveHiZ(*vg.active_hiz_, in->region);
+        }
+    }
+
+    void VirtualGPU::PrepareHiZ() {
+        active_hiz_ = nullptr;
+
+        const Attachment& attch = bound_draw_frame_buffer_->depth_stencil_attachment;
+        if (!attch.memory) {
+            return;
+        }
+
+        auto it = hiz_buffers_.find(attch.memory);
+        if (it != hiz_buffers_.end() && (it->second.width != attch.width || it->second.height != attch.height ||
+                                         it->second.offset != attch.offset || it->second.format != attch.format ||
+                                         it->second.component_type != attch.component_type)) {
+            hiz_buffers_.erase(it);
+            it = hiz_buffers_.end();
+        }
+
+        if (it == hiz_buffers_.end()) {
+            if (!state_.tiled_rasterization_enabled || !state_.depth_test_enabled) {
+                return;
+            }
+
+            // Everything is unknown until the first resolve.
+            HiZBuffer hiz;
+            hiz.memory = attch.memory;
+            hiz.width = attch.width;
+            hiz.height = attch.height;
+            hiz.offset = attch.offset;
+            hiz.format = attch.format;
+            hiz.component_type = attch.component_type;
+
+            hiz.block_columns = (attch.width + vg::RASTER_BLOCK_SIZE - 1) / vg::RASTER_BLOCK_SIZE;
+            hiz.block_rows = (attch.height + vg::RASTER_BLOCK_SIZE - 1) / vg::RASTER_BLOCK_SIZE;
+            const size_t block_count = static_cast<size_t>(hiz.block_columns) * static_cast<size_t>(hiz.block_rows);
+            hiz.block_min_depth.assign(block_count, 0.f);
+            hiz.block_max_depth.assign(block_count, 0.f);
+            hiz.block_dirty.assign(block_count, 1);
+
+            hiz.tile_columns = (attch.width + TILE_WIDTH - 1) / TILE_WIDTH;
+            hiz.tile_rows = (attch.height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+            const size_t tile_count = static_cast<size_t>(hiz.tile_columns) * static_cast<size_t>(hiz.tile_rows);
+            hiz.tile_min_depth.assign(tile_count, 0.f);
+            hiz.tile_max_depth.assign(tile_count, 0.f);
+            hiz.tile_dirty.assign(tile_count, 1);
+
+            it = hiz_buffers_.emplace(attch.memory, std::move(hiz)).first;
+        }
+
+        if (!state_.tiled_rasterization_enabled) {
+            // Workers of a per primitive draw write any pixel concurrently, so they don't mark what they write. The
+            // whole buffer is resolved again by the next tiled draw.
+            std::fill(it->second.block_dirty.begin(), it->second.block_dirty.end(), uint8_t(1));
+            std::fill(it->second.tile_dirty.begin(), it->second.tile_dirty.end(), uint8_t(1));
+            return;
+        }
+
+        active_hiz_ = &it->second;
+        ResolveHiZ(*active_hiz_, {0, 0, attch.width, attch.height});
+    }
+
+    void VirtualGPU::InvalidateHiZ(const std::vector<uint8_t>* memory) {
+        auto it = hiz_buffers_.find(memory);
+        if (it == hiz_buffers_.end()) {
+            return;
+        }
+        if (active_hiz_ == &it->second) {
+            active_hiz_ = nullptr;
+        }
+        hiz_buffers_.erase(it);
+    }
+
+    void VirtualGPU::ResolveHiZ(HiZBuffer& hiz, const Rect& area) {
+        const uint8_t* base = hiz.memory->data() + static_cast<size_t>(hiz.offset);
+        const size_t pixel_size = static_cast<size_t>(vg::GetPixelSize(hiz.format, hiz.component_type));
+
+        const int x0 = math::Max(area.x, 0);
+        const int y0 = math::Max(area.y, 0);
+        const int x1 = math::Min(area.x + area.width, static_cast<int>(hiz.width));
+        const int y1 = math::Min(area.y + area.height, static_cast<int>(hiz.height));
+        if (x0 >= x1 || y0 >= y1) {
+            return;
+        }
+
+        // Blocks
+        for (int by = y0 / vg::RASTER_BLOCK_SIZE; by <= (y1 - 1) / vg::RASTER_BLOCK_SIZE; by++) {
+            for (int bx = x0 / vg::RASTER_BLOCK_SIZE; bx <= (x1 - 1) / vg::RASTER_BLOCK_SIZE; bx++) {
+                const size_t block_index = static_cast<size_t>(by * hiz.block_columns + bx);
+                if (!hiz.block_dirty[block_index]) {
+                    continue;
+                }
+
+                real min_depth = math::REAL_MAX;
+                real max_depth = -math::REAL_MAX;
+                const int px_end = math::Min((bx + 1) * vg::RASTER_BLOCK_SIZE, static_cast<int>(hiz.width));
+                const int py_end = math::Min((by + 1) * vg::RASTER_BLOCK_SIZE, static_cast<int>(hiz.height));
+                for (int py = by * vg::RASTER_BLOCK_SIZE; py < py_end; py++) {
+                    const uint8_t* pixel_addr =
+                        base + (static_cast<size_t>(py) * static_cast<size_t>(hiz.width) +
+                                static_cast<size_t>(bx * vg::RASTER_BLOCK_SIZE)) *
+                                   pixel_size;
+                    for (int px = bx * vg::RASTER_BLOCK_SIZE; px < px_end; px++) {
+                        real depth = 0.0_r;
+                        if (hiz.format == VG_DEPTH_STENCIL) {
+                            uint8_t stencil = 0;
+                            vg::DecodeDepthStencil(&depth, &stencil, pixel_addr);
+                        } else {
+                            vg::CopyPixel(reinterpret_cast<uint8_t*>(&depth), pixel_addr, hiz.format,
+                                          hiz.component_type, VG_DEPTH_COMPONENT, VG_FLOAT);
+                        }
+                        min_depth = math::Min(min_depth, depth);
+                        max_depth = math::Max(max_depth, depth);
+                        pixel_addr += pixel_size;
+                    }
+                }
+
+                hiz.block_min_depth[block_index] = static_cast<float>(min_depth);
+                hiz.block_max_depth[block_index] = static_cast<float>(max_depth);
+                hiz.block_dirty[block_index] = 0;
+            }
+        }
+
+        // Tiles
+        const int tile_blocks_x = TILE_WIDTH / vg::RASTER_BLOCK_SIZE;
+        const int tile_blocks_y = TILE_HEIGHT / vg::RASTER_BLOCK_SIZE;
+        for (int ty = y0 / TILE_HEIGHT; ty <= (y1 - 1) / TILE_HEIGHT; ty++) {
+            for (int tx = x0 / TILE_WIDTH; tx <= (x1 - 1) / TILE_WIDTH; tx++) {
+                const size_t tile_index = static_cast<size_t>(ty * hiz.tile_columns + tx);
+                if (!hiz.tile_dirty[tile_index]) {
+                    continue;
+                }
+
+                float min_depth = math::REAL_MAX;
+                float max_depth = -math::REAL_MAX;
+                bool is_resolved = true;
+                const int bx_end = math::Min((tx + 1) * tile_blocks_x, hiz.block_columns);
+                const int by_end = math::Min((ty + 1) * tile_blocks_y, hiz.block_rows);
+                for (int by = ty * tile_blocks_y; by < by_end; by++) {
+                    for (int bx = tx * tile_blocks_x; bx < bx_end; bx++) {
+                        const size_t block_index = static_cast<size_t>(by * hiz.block_columns + bx);
+                        is_resolved = is_resolved && !hiz.block_dirty[block_index];
+                        min_depth = math::Min(min_depth, hiz.block_min_depth[block_index]);
+                        max_depth = math::Max(max_depth, hiz.block_max_depth[block_index]);
+                    }
+                }
+
+                // A tile partially covered by 'area' may still hold written blocks.
+                if (is_resolved) {
+                    hiz.tile_min_depth[tile_index] = min_depth;
+                    hiz.tile_max_depth[tile_index] = max_depth;
+                    hiz.tile_dirty[tile_index] = 0;
+                }
+            }
+        }
+    }
+
+    void VirtualGPU::ClearHiZ(const Attachment& attch, const Rect& area, real clear_depth) {
+        auto it = hiz_buffers_.find(attch.memory);
+        if (it == hiz_buffers_.end()) {
+            return;
+        }
+        HiZBuffer& hiz = it->second;
+
+        // Blocks inside the cleared area take the clear depth, blocks on its border are resolved.
+        const int x1 = area.x + area.width;
+        const int y1 = area.y + area.height;
+        for (int by = area.y / vg::RASTER_BLOCK_SIZE; by <= (y1 - 1) / vg::RASTER_BLOCK_SIZE; by++) {
+            for (int bx = area.x / vg::RASTER_BLOCK_SIZE; bx <= (x1 - 1) / vg::RASTER_BLOCK_SIZE; bx++) {
+                const size_t block_index = static_cast<size_t>(by * hiz.block_columns + bx);
+                const bool is_covered =
+                    bx * vg::RASTER_BLOCK_SIZE >= area.x && by * vg::RASTER_BLOCK_SIZE >= area.y &&
+                    math::Min((bx + 1) * vg::RASTER_BLOCK_SIZE, static_cast<int>(hiz.width)) <= x1 &&
+                    math::Min((by + 1) * vg::RASTER_BLOCK_SIZE, static_cast<int>(hiz.height)) <= y1;
+                if (is_covered) {
+                    hiz.block_min_depth[block_index] = static_cast<float>(clear_depth);
+                    hiz.block_max_depth[block_index] = static_cast<float>(clear_depth);
+                    hiz.block_dirty[block_index] = 0;
+                } else {
+                    hiz.block_dirty[block_index] = 1;
+                }
+            }
+        }
+        for (int ty = area.y / TILE_HEIGHT; ty <= (y1 - 1) / TILE_HEIGHT; ty++) {
+            for (int tx = area.x / TILE_WIDTH; tx <= (x1 - 1) / TILE_WIDTH; tx++) {
+                hiz.tile_dirty[static_cast<size_t>(ty * hiz.tile_columns + tx)] = 1;
+            }
+        }
+
+        ResolveHiZ(hiz, area);
+    }
+
+    bool VirtualGPU::IsHiZTestable() const {
+        return active_hiz_ != nullptr && coverage_row_func_ != nullptr && state_.tiled_rasterization_enabled &&
+               state_.depth_test_enabled && !state_.stencil_test_enabled;
+    }
+
+    bool VirtualGPU::IsOccluded(float stored_min, float stored_max, double min_depth, double max_depth) const {
+        // Covers rounding of the stored and the interpolated depth.
+        const double slack = 1e-6;
+        const double eps = static_cast<double>(math::EPSILON_DEPTH_TEST);
+        switch (state_.depth_func) {
+            case VG_NEVER:
+                return true;
+            case VG_LESS:
+                return min_depth - slack >= static_cast<double>(stored_max) + eps;
+            case VG_LEQUAL:
+                return min_depth - slack > static_cast<double>(stored_max) + eps;
+            case VG_GREATER:
+                return max_depth + slack <= static_cast<double>(stored_min) - eps;
+            case VG_GEQUAL:
+                return max_depth + slack < static_cast<double>(stored_min) - eps;
+            default:
+                return false;
+        }
     }
 }  // namespace ho
\ No newline at end of file
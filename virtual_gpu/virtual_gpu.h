@@ -1,10 +1,14 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <bitset>
+#include <chrono>
+#include <cstring>
 #include <half.hpp>
 #include <limits>
 #include <list>
+#include <memory>
 #include <unordered_map>
 #include <variant>
 
@@ -19,43 +23,130 @@
 #include "core/templates/atomic_numeric.h"
 #include "core/thread/job_system.h"
 #include "core/thread/spin_lock.h"
+#include "raster_simd.h"
 #include "virtual_gpu_utils.h"
 
 namespace ho {
     class VirtualGPUTester;
 
+    // A uniform of the executing draw, resolved once by GetUniformRef. FetchUniform reads it with a plain load.
+    // Valid until the draw ends.
+    struct UniformRef {
+        const uint8_t* data = nullptr;
+        size_t stride = 0;  // bytes of one element
+        VGsizei count = 0;
+    };
+
     // prototypes for specifying default argument
     template <typename T>
     T FetchAttribute(VGuint location, size_t index = 0);
+    void FetchAttributes(VGuint location, const size_t* vertex_indices, size_t count, float* const components[4]);
     template <typename T>
     T FetchUniform(uint32_t name_hash, size_t index = 0);
+    template <typename T>
+    T FetchUniform(const UniformRef& ref, size_t index = 0);
 
     class VirtualGPU {
-        static constexpr int WORKER_COUNT = 8;
-
         static constexpr int TILE_WIDTH = 16;
         static constexpr int TILE_HEIGHT = 16;
         static constexpr int MAX_ATTACHMENT_WIDTH = 4096;
         static constexpr int MAX_ATTACHMENT_HEIGHT = 4096;
-        static constexpr int MAX_LOCK_TABLE_WIDTH = MAX_ATTACHMENT_WIDTH / TILE_WIDTH;
-        static constexpr int MAX_LOCK_TABLE_HEIGHT = MAX_ATTACHMENT_HEIGHT / TILE_HEIGHT;
+        static constexpr int MAX_MIPMAP_LEVEL_COUNT = 13;  // 4096 down to 1
 
         static constexpr int COLOR_ATTACHMENT_COUNT = VG_COLOR_ATTACHMENT31 - VG_COLOR_ATTACHMENT0 + 1;
         static constexpr int TEXTURE_UNIT_COUNT = VG_TEXTURE31 - VG_TEXTURE0 + 1;
         static constexpr int DRAW_BUFFER_SLOT_COUNT = VG_DRAW_BUFFER15 - VG_DRAW_BUFFER0 + 1;
         static constexpr int BUFFER_OBJECT_SLOT_COUNT = 9;
 
+        // Indices of the query targets in current_queries_ and running_queries_
+        static constexpr size_t SAMPLES_PASSED_QUERY = 0;
+        static constexpr size_t ANY_SAMPLES_PASSED_QUERY = 1;
+        static constexpr size_t TIME_ELAPSED_QUERY = 2;
+        static constexpr size_t PIPELINE_STATISTICS_QUERY = 3;
+        static constexpr int QUERY_TARGET_COUNT = 4;
+
         static constexpr int MAX_VARYING_COUNT = 10;
         static constexpr int SMOOTH_REGISTER_SIZE = 32;
         static constexpr int FLAT_REGISTER_SIZE = 32;
 
+        struct VaryingDesc {
+            VGenum type = VG_FLOAT;
+            int size = 0;
+            size_t register_index = 0;
+        };
+
+        // Finds a linked varying with one load. The varying named h is in slot (h * seed) >> (32 - LOOKUP_BITS),
+        // Build picks a seed for which the names of the program do not collide.
+        struct VaryingLookup {
+            static constexpr uint32_t LOOKUP_BITS = 5;
+            static_assert(MAX_VARYING_COUNT <= (1 << LOOKUP_BITS));
+            // Seeds tried before Build stops hashing and stores the names in order, which Find then scans.
+            static constexpr int MAX_SEED_ATTEMPTS = 4096;
+
+            struct Slot {
+                uint32_t name_hash = 0;
+                VaryingDesc desc;
+            };
+
+            void Build(const uint32_t* name_hashes, const VaryingDesc* descs, size_t count);
+
+            // nullptr if the program has no such varying
+            ALWAYS_INLINE const VaryingDesc* Find(uint32_t name_hash) const {
+                if (linear_count != 0) {
+                    return FindLinear(name_hash);
+                }
+                const Slot& slot = slots[(name_hash * seed) >> (32 - LOOKUP_BITS)];
+                return slot.name_hash == name_hash && slot.desc.size != 0 ? &slot.desc : nullptr;
+            }
+            const VaryingDesc* FindLinear(uint32_t name_hash) const;
+
+            uint32_t seed = 1;
+            size_t linear_count = 0;  // names stored in order if no seed separated them, 0 if hashed
+            std::array<Slot, 1 << LOOKUP_BITS> slots;
+        };
+
+        // Finds the location of a uniform with one load, like VaryingLookup. The table is sized to the names, which
+        // a program only adds until it is linked again.
+        struct UniformLookup {
+            static constexpr uint32_t EMPTY_LOCATION = std::numeric_limits<uint32_t>::max();
+            // The table doubles every SEED_ATTEMPTS_PER_SIZE seeds. Build stops hashing after MAX_SEED_ATTEMPTS, like
+            // VaryingLookup.
+            static constexpr int SEED_ATTEMPTS_PER_SIZE = 64;
+            static constexpr int MAX_SEED_ATTEMPTS = 256;
+
+            struct Slot {
+                uint32_t name_hash = 0;
+                uint32_t location = EMPTY_LOCATION;
+            };
+
+            void Build(const std::unordered_map<uint32_t, size_t>& name_hash_to_location);
+
+            // EMPTY_LOCATION if the program has no such uniform
+            ALWAYS_INLINE uint32_t Find(uint32_t name_hash) const {
+                if (linear_count != 0) {
+                    return FindLinear(name_hash);
+                }
+                const Slot& slot = slots[(name_hash * seed) >> shift];
+                return slot.name_hash == name_hash ? slot.location : EMPTY_LOCATION;
+            }
+            uint32_t FindLinear(uint32_t name_hash) const;
+
+            uint32_t seed = 1;
+            uint32_t shift = 31;
+            std::vector<Slot> slots = std::vector<Slot>(2);
+            size_t name_count = 0;    // names the table was built from
+            size_t linear_count = 0;  // names stored in order if no seed separated them, 0 if hashed
+        };
+
        public:
         static VirtualGPU& GetInstance() {
             static VirtualGPU instance;
             return instance;
         }
 
-        bool Initialize(uint8_t* color_buffer, int width, int height, VGenum color_format, VGenum component_type);
+        // worker_count 0 picks one worker per logical processor.
+        bool Initialize(uint8_t* color_buffer, int width, int height, VGenum color_format, VGenum component_type,
+                        uint32_t worker_count = 0, ThreadAffinity affinity = ThreadAffinity::NONE);
 
         // ======================================================
         //  Object used in shader Definitions
@@ -69,32 +160,23 @@ namespace ho {
 
             // T can be float, Vector2, Vector3, Vector4
             // Out<T>("var"_vg, val); is same as 'out T var; var = val;' in glsl.
+            // Every vertex of a program must write the same varyings, the first shaded vertex lays them out.
             template <typename T>
             void Out(uint32_t name_hash, const T& v) {
                 Program* prog = VirtualGPU::GetInstance().using_program_;
-                size_t reg_index = 0xFFFFFFFF;
-
-                for (size_t i = 0; i < static_cast<size_t>(prog->smooth_varying_count); i++) {
-                    if (prog->smooth_varying_name_hashes[i] == name_hash) {
-                        assert(prog->smooth_varying_descs[i].size == sizeof(T) / sizeof(float));
-                        reg_index = prog->smooth_varying_descs[i].register_index;
-                        used_smooth_register_size += prog->smooth_varying_descs[i].size;
-                        break;
-                    }
-                }
-
-                if (reg_index == 0xFFFFFFFF) {
-                    reg_index = static_cast<size_t>(used_smooth_register_size);
-                    size_t var_index = static_cast<size_t>(prog->smooth_varying_count++);
-
-                    prog->smooth_varying_name_hashes[var_index] = name_hash;
-                    prog->smooth_varying_descs[var_index].size = sizeof(T) / sizeof(float);
-                    prog->smooth_varying_descs[var_index].register_index = reg_index;
-
-                    used_smooth_register_size += static_cast<size_t>(prog->smooth_varying_descs[var_index].size);
-                    assert(used_smooth_register_size <= SMOOTH_REGISTER_SIZE);
+                const VaryingDesc* desc =
+                    prog->is_varying_layout_linked
+                        ? prog->smooth_varying_lookup.Find(name_hash)
+                        : AddVarying(prog->smooth_varying_name_hashes, prog->smooth_varying_descs,
+                                     prog->smooth_varying_count, name_hash, sizeof(T) / sizeof(float),
+                                     used_smooth_register_size, SMOOTH_REGISTER_SIZE);
+                if (desc == nullptr) {
+                    assert(false && "varying is not written by the first vertex");
+                    return;
                 }
-                *reinterpret_cast<T*>(&smooth_register[reg_index]) = v;
+                assert(desc->size == sizeof(T) / sizeof(float));
+                used_smooth_register_size += desc->size;
+                *reinterpret_cast<T*>(&smooth_register[desc->register_index]) = v;
             }
 
             // T can be float, Vector2, Vector3, Vector4
@@ -103,32 +185,44 @@ namespace ho {
             template <typename T>
             void OutFlat(uint32_t name_hash, const T& v) {
                 Program* prog = VirtualGPU::GetInstance().using_program_;
-                size_t reg_index = 0xFFFFFFFF;
-
-                for (size_t i = 0; i < static_cast<size_t>(prog->flat_varying_count); i++) {
-                    if (prog->flat_varying_name_hashes[i] == name_hash) {
-                        assert(prog->flat_varying_descs[i].size == sizeof(T) / sizeof(float));
-                        reg_index = prog->flat_varying_descs[i].register_index;
-                        used_flat_register_size += prog->flat_varying_descs[i].size;
-                        break;
-                    }
+                const VaryingDesc* desc =
+                    prog->is_varying_layout_linked
+                        ? prog->flat_varying_lookup.Find(name_hash)
+                        : AddVarying(prog->flat_varying_name_hashes, prog->flat_varying_descs,
+                                     prog->flat_varying_count, name_hash, sizeof(T) / sizeof(float),
+                                     used_flat_register_size, FLAT_REGISTER_SIZE);
+                if (desc == nullptr) {
+                    assert(false && "varying is not written by the first vertex");
+                    return;
                 }
+                assert(desc->size == sizeof(T) / sizeof(float));
+                used_flat_register_size += desc->size;
+                *reinterpret_cast<T*>(&flat_register[desc->register_index]) = v;
+            }
 
-                if (reg_index == 0xFFFFFFFF) {
-                    reg_index = static_cast<size_t>(used_flat_register_size);
-                    size_t var_index = static_cast<size_t>(prog->flat_varying_count++);
-
-                    prog->flat_varying_name_hashes[var_index] = name_hash;
-                    prog->flat_varying_descs[var_index].size = sizeof(T) / sizeof(float);
-                    prog->flat_varying_descs[var_index].register_index = reg_index;
-
-                    used_flat_register_size += prog->flat_varying_descs[var_index].size;
-                    assert(used_flat_register_size <= FLAT_REGISTER_SIZE);
+           private:
+            // Finds or appends the varying while the program's layout is not linked, the next free registers of
+            // this vertex hold an appended varying.
+            static const VaryingDesc* AddVarying(std::array<uint32_t, MAX_VARYING_COUNT>& name_hashes,
+                                                 std::array<VaryingDesc, MAX_VARYING_COUNT>& descs, int& count,
+                                                 uint32_t name_hash, size_t size, int used_register_size,
+                                                 int register_size) {
+                for (size_t i = 0; i < static_cast<size_t>(count); i++) {
+                    if (name_hashes[i] == name_hash) {
+                        return &descs[i];
+                    }
                 }
-                *reinterpret_cast<T*>(&flat_register[reg_index]) = v;
+
+                assert(count < MAX_VARYING_COUNT);
+                assert(used_register_size + static_cast<int>(size) <= register_size);
+                (void)register_size;
+                const size_t var_index = static_cast<size_t>(count++);
+                name_hashes[var_index] = name_hash;
+                descs[var_index].size = static_cast<int>(size);
+                descs[var_index].register_index = static_cast<size_t>(used_register_size);
+                return &descs[var_index];
             }
 
-           private:
             Vector3 viewport_coord;
             std::array<float, SMOOTH_REGISTER_SIZE> smooth_register;  // its interpolated in rasterization
             std::array<float, FLAT_REGISTER_SIZE> flat_register;      // its not interpolated in rasterization
@@ -136,6 +230,67 @@ namespace ho {
             int used_flat_register_size = 0;    // Number of float elements currently used in the flat register array.
         };
 
+        // Input and output of a wide vertex shader, which shades WIDTH vertices at once in structure of arrays so its
+        // per vertex arithmetic vectorizes across vertices. Component c of lane i is [c][i]. Lanes from 'count' on
+        // repeat the last vertex, a shader runs every lane and only the first 'count' are kept.
+        class VertexBatch {
+           public:
+            friend VirtualGPU;
+            friend VirtualGPUTester;
+
+            static constexpr size_t WIDTH = 8;
+
+            size_t count = 0;
+            std::array<size_t, WIDTH> vertex_indices;  // e.g. for FetchAttributes
+
+            alignas(32) float vg_Position[4][WIDTH];
+
+            // Out("var"_vg, components); is Varying::Out of every lane, for a varying of SIZE components.
+            template <size_t SIZE>
+            void Out(uint32_t name_hash, const float (&components)[SIZE][WIDTH]) {
+                Write(VirtualGPU::GetInstance().using_program_->smooth_varying_lookup, name_hash, components,
+                      smooth_register, used_smooth_register_size);
+            }
+
+            template <size_t SIZE>
+            void OutFlat(uint32_t name_hash, const float (&components)[SIZE][WIDTH]) {
+                Write(VirtualGPU::GetInstance().using_program_->flat_varying_lookup, name_hash, components,
+                      flat_register, used_flat_register_size);
+            }
+
+           private:
+            // The program is linked before wide shaders run, its first vertex is shaded by the scalar shader.
+            template <size_t SIZE, size_t REGISTER_SIZE>
+            static void Write(const VaryingLookup& lookup, uint32_t name_hash, const float (&components)[SIZE][WIDTH],
+                              float (&registers)[REGISTER_SIZE][WIDTH], int& used_register_size) {
+                const VaryingDesc* desc = lookup.Find(name_hash);
+                if (desc == nullptr) {
+                    assert(false && "varying is not written by the first vertex");
+                    return;
+                }
+                assert(desc->size == static_cast<int>(SIZE));
+                used_register_size += desc->size;
+                std::memcpy(registers[desc->register_index], components, sizeof(components));
+            }
+
+            // Packs the first 'count' lanes into consecutive varying_buffer slots from 'records' on.
+            void Store(float* records, size_t stride) const;
+
+            alignas(32) float smooth_register[SMOOTH_REGISTER_SIZE][WIDTH];
+            alignas(32) float flat_register[FLAT_REGISTER_SIZE][WIDTH];
+            int used_smooth_register_size = 0;
+            int used_flat_register_size = 0;
+        };
+
+        // Screen space derivatives of a triangle's perspective divided smooth registers and of 1/w.
+        // Shared by all fragments of the triangle to derive their varyings' derivatives.
+        struct SmoothGradient {
+            std::array<float, SMOOTH_REGISTER_SIZE> dx;
+            std::array<float, SMOOTH_REGISTER_SIZE> dy;
+            real inv_w_dx = 0.0_r;
+            real inv_w_dy = 0.0_r;
+        };
+
         class Fragment {
            public:
             friend VirtualGPU;
@@ -145,41 +300,65 @@ namespace ho {
             // In<T>("var"_vg); is same as 'in T var;' in glsl.
             template <typename T>
             T In(uint32_t name_hash) const {
-                Program* prog = VirtualGPU::GetInstance().using_program_;
-                size_t reg_index = 0xFFFFFFFF;
-
-                for (size_t i = 0; i < static_cast<size_t>(prog->smooth_varying_count); i++) {
-                    if (prog->smooth_varying_name_hashes[i] == name_hash) {
-                        assert(prog->smooth_varying_descs[i].size == sizeof(T) / sizeof(float));
-                        reg_index = prog->smooth_varying_descs[i].register_index;
-                        break;
-                    }
-                }
-
-                assert(reg_index != 0xFFFFFFFF);
-                return *reinterpret_cast<const T*>(&smooth_register[reg_index]);
+                const VaryingDesc* desc = FindSmooth<T>(name_hash);
+                return desc != nullptr ? *reinterpret_cast<const T*>(&smooth_register[desc->register_index]) : T();
             }
 
             // T can be float, Vector2, Vector3, Vector4
             // InFlat<T>("var"_vg); is same as 'in flat T var;' in glsl.
             template <typename T>
             T InFlat(uint32_t name_hash) const {
-                Program* prog = VirtualGPU::GetInstance().using_program_;
-                size_t reg_index = 0xFFFFFFFF;
+                const Program* prog = VirtualGPU::GetInstance().using_program_;
+                assert(prog->is_varying_layout_linked);
+                const VaryingDesc* desc = prog->flat_varying_lookup.Find(name_hash);
+                assert(desc != nullptr && desc->size == sizeof(T) / sizeof(float));
+                return desc != nullptr ? *reinterpret_cast<const T*>(&flat_register[desc->register_index]) : T();
+            }
 
-                for (size_t i = 0; i < static_cast<size_t>(prog->flat_varying_count); i++) {
-                    if (prog->flat_varying_name_hashes[i] == name_hash) {
-                        assert(prog->flat_varying_descs[i].size == sizeof(T) / sizeof(float));
-                        reg_index = prog->flat_varying_descs[i].register_index;
-                        break;
-                    }
-                }
+            // T can be float, Vector2, Vector3, Vector4
+            // InDx<T>("var"_vg); is same as 'dFdx(var)' in glsl. Zero for points and lines.
+            template <typename T>
+            T InDx(uint32_t name_hash) const {
+                return InDerivative<T>(name_hash, true);
+            }
 
-                assert(reg_index != 0xFFFFFFFF);
-                return *reinterpret_cast<const T*>(&flat_register[reg_index]);
+            // T can be float, Vector2, Vector3, Vector4
+            // InDy<T>("var"_vg); is same as 'dFdy(var)' in glsl. Zero for points and lines.
+            template <typename T>
+            T InDy(uint32_t name_hash) const {
+                return InDerivative<T>(name_hash, false);
             }
 
            private:
+            template <typename T>
+            static const VaryingDesc* FindSmooth(uint32_t name_hash) {
+                const Program* prog = VirtualGPU::GetInstance().using_program_;
+                assert(prog->is_varying_layout_linked);
+                const VaryingDesc* desc = prog->smooth_varying_lookup.Find(name_hash);
+                assert(desc != nullptr && desc->size == sizeof(T) / sizeof(float));
+                return desc;
+            }
+
+            template <typename T>
+            T InDerivative(uint32_t name_hash, bool is_x) const {
+                T out = T();
+                const VaryingDesc* desc = FindSmooth<T>(name_hash);
+                if (!smooth_gradient || desc == nullptr) {
+                    return out;
+                }
+                const size_t reg_index = desc->register_index;
+
+                // d(a) = (d(a/w) - a * d(1/w)) * w
+                const std::array<float, SMOOTH_REGISTER_SIZE>& pw_d = is_x ? smooth_gradient->dx : smooth_gradient->dy;
+                const real inv_w_d = is_x ? smooth_gradient->inv_w_dx : smooth_gradient->inv_w_dy;
+                float* out_components = reinterpret_cast<float*>(&out);
+                for (size_t i = 0; i < sizeof(T) / sizeof(float); i++) {
+                    const real a = smooth_register[reg_index + i];
+                    out_components[i] = static_cast<float>((pw_d[reg_index + i] - a * inv_w_d) * w);
+                }
+                return out;
+            }
+
             Vector2 screen_coord;
             real depth;
             std::array<float, SMOOTH_REGISTER_SIZE> smooth_register;
@@ -187,6 +366,10 @@ namespace ho {
             int used_smooth_register_size = 0;
             int used_flat_register_size = 0;
             bool is_front;
+
+            // Triangles only
+            const SmoothGradient* smooth_gradient = nullptr;
+            real w = 1.0_r;
         };
 
         class FSOutputs {
@@ -211,15 +394,89 @@ namespace ho {
             std::bitset<DRAW_BUFFER_SLOT_COUNT> written;
         };
 
+        // 2x2 pixels of a primitive, shaded at once by a quad fragment shader. Lane i is pixel
+        // (x + (i & 1), y + (i >> 1)) of the quad at even (x, y). Lanes the primitive doesn't cover, or whose early
+        // fragment tests failed, are helper lanes: they are shaded for the derivatives of the others but write
+        // nothing. Their varyings are extrapolated along the primitive.
+        class FragmentQuad {
+           public:
+            friend VirtualGPU;
+            friend VirtualGPUTester;
+
+            static constexpr size_t LANE_COUNT = 4;
+
+            const Fragment& operator[](size_t lane) const { return fragments[lane]; }
+            bool IsHelper(size_t lane) const { return (coverage_mask & (1u << lane)) == 0; }
+
+            // In<T>("var"_vg, values); is Fragment::In<T> of every lane.
+            template <typename T>
+            void In(uint32_t name_hash, T (&values)[LANE_COUNT]) const {
+                for (size_t lane = 0; lane < LANE_COUNT; lane++) {
+                    values[lane] = fragments[lane].In<T>(name_hash);
+                }
+            }
+
+            // Difference of 'values' of the lanes along the row, or the column, of 'lane'.
+            // Same as 'dFdxFine(value)' and 'dFdyFine(value)' in glsl.
+            template <typename T>
+            static T Dx(const T (&values)[LANE_COUNT], size_t lane) {
+                const size_t row = lane & 2;
+                return values[row + 1] - values[row];
+            }
+
+            template <typename T>
+            static T Dy(const T (&values)[LANE_COUNT], size_t lane) {
+                const size_t column = lane & 1;
+                return values[column + 2] - values[column];
+            }
+
+           private:
+            std::array<Fragment, LANE_COUNT> fragments;
+            uint32_t coverage_mask = 0;
+        };
+
+        class FSQuadOutputs {
+           public:
+            friend VirtualGPU;
+            friend VirtualGPUTester;
+
+            // Out(lane, loc, color); is FSOutputs::Out of a lane, helper lanes discard it.
+            void Out(size_t lane, size_t location, const Color128& out) {
+                assert(lane < FragmentQuad::LANE_COUNT);
+                lanes[lane].Out(location, out);
+            }
+
+           private:
+            void Reset() {
+                for (FSOutputs& outputs : lanes) {
+                    outputs.Reset();
+                }
+            }
+
+            std::array<FSOutputs, FragmentQuad::LANE_COUNT> lanes;
+        };
+
        private:
         VirtualGPU();
 
+        // Entry of the vg* calls, waits until the submitted commands are done. They run with their draw state swapped
+        // into the context, so no call may read or change it meanwhile, not even one that only sets state.
+        static VirtualGPU& GetContext() {
+            VirtualGPU& vg = GetInstance();
+            if (vg.submitted_counter_ != nullptr) {
+                vg.WaitForSubmittedCommands();
+            }
+            return vg;
+        }
+
         // ======================================================
         //  VirtualGPU Core Object and State Definitions
         // ======================================================
 
         using VertexShader = void (*)(size_t vertex_index, Varying& out);
+        using WideVertexShader = void (*)(VertexBatch& batch);
         using FragmentShader = void (*)(const Fragment& in, FSOutputs& out);
+        using QuadFragmentShader = void (*)(const FragmentQuad& in, FSQuadOutputs& out);
 
         struct BufferObject {
             uint32_t id = 0;
@@ -268,6 +525,21 @@ namespace ho {
             bool enabled = false;
         };
 
+        // Reads the attribute of one location in the layout of the executing draw, without lookups or type
+        // switches. 'fetch' converts the components at 'src' to floats, components the attribute lacks read
+        // (0, 0, 0, 1). 'fetch_batch' converts 'count' vertices into components[0..3][i].
+        struct AttributeFetcher {
+            vg::AttributeFetchFunction fetch = nullptr;
+            vg::AttributeBatchFetchFunction fetch_batch = nullptr;
+            const uint8_t* base = nullptr;  // of vertex 0
+            size_t stride = 0;              // 0 for constant attributes
+            VGenum type = VG_FLOAT;
+            bool is_pure_integer = false;
+        };
+
+        // Fetcher of locations without an attribute, reads zeros.
+        static const AttributeFetcher ZERO_ATTRIBUTE_FETCHER;
+
         struct VertexArray {
             uint32_t id = 0;
             int vertex_count = std::numeric_limits<int>::max();
@@ -319,8 +591,8 @@ namespace ho {
 
         struct TextureObject {
             uint32_t id = 0;
-            std::array<TextureLevel, 1> mipmap;
-            int mipmap_count = 1;
+            std::array<TextureLevel, MAX_MIPMAP_LEVEL_COUNT> mipmap;
+            int mipmap_count = 1;  // consecutive levels from 0 whose sizes form a mipmap chain
             VGenum texture_type = VG_NONE;
             VGenum component_type = VG_NONE;
             VGenum internal_format = VG_RGBA;
@@ -389,6 +661,7 @@ namespace ho {
             uint32_t id = 0;
             VGenum type = VG_NONE;
             void* source = nullptr;
+            void* wide_source = nullptr;  // WideVertexShader or QuadFragmentShader of vgShaderSourceWide, optional
             int refcount = 0;
             bool is_deleted = false;
         };
@@ -400,18 +673,19 @@ namespace ho {
             std::vector<uint8_t> data;
         };
 
-        struct VaryingDesc {
-            VGenum type = VG_FLOAT;
-            int size = 0;
-            size_t register_index = 0;
-        };
-
         struct Program {
             uint32_t id = 0;
             Shader* vertex_shader = nullptr;
             Shader* fragment_shader = nullptr;
 
-            std::vector<Varying> varying_buffer;
+            // Vertex shader outputs of the executing draw, packed 'varying_stride' floats per slot: vg_Position, then
+            // the smooth and the flat registers of the linked layout. A program that writes only vg_Position moves
+            // only positions from the vertex shader to primitive setup.
+            std::vector<float> varying_buffer;
+            size_t varying_stride = 0;     // set by LinkVaryingLayout
+            int smooth_register_size = 0;  // registers of the linked layout
+            int flat_register_size = 0;
+
             // Parallel arrays: varying_name_hashes[i] maps to varying_descs[i].
             // Both arrays are synchronized to store the hash and its corresponding varying description at the same
             // index.
@@ -423,13 +697,23 @@ namespace ho {
             std::array<VaryingDesc, MAX_VARYING_COUNT> flat_varying_descs;
             int flat_varying_count = 0;
 
+            // The first vertex the program shades appends the varyings above, on the drawing thread. The layout is
+            // then linked into the lookups, which Out and In read without changing the program.
+            bool is_varying_layout_linked = false;
+            VaryingLookup smooth_varying_lookup;
+            VaryingLookup flat_varying_lookup;
+
             std::vector<Uniform> uniforms;
             std::unordered_map<uint32_t, size_t> uniform_name_hash_to_location;
+            UniformLookup uniform_lookup;  // rebuilt by the draw once names were added
             std::unordered_map<uint32_t, size_t> fragout_name_hash_to_draw_buffer_slot;
 
             VGenum link_status = VG_FALSE;
             int refcount = 0;
             bool is_deleted = false;
+
+            // Depth and stencil tests run once before the fragment shader instead of after it.
+            bool early_fragment_tests = false;
         };
 
         struct Rect {
@@ -439,12 +723,133 @@ namespace ho {
             VGsizei height = 0;
         };
 
-        struct State {
-            std::array<std::array<SpinLock, MAX_LOCK_TABLE_WIDTH * MAX_LOCK_TABLE_HEIGHT>, COLOR_ATTACHMENT_COUNT>
-                color_lock_tables;
+        // Point, line or triangle in viewport space, ready to be rasterized.
+        struct RasterPrimitive {
+            std::array<Varying, 3> vertices;
+            int vertex_count = 0;
+            Rect bounds;  // covered pixels, min include, max exclude
+            SmoothGradient smooth_gradient;  // triangles only
+        };
+
+        // Raster primitive of a tile-binned draw, kept until its tiles are rasterized. PackRasterPrimitive stores its
+        // vertices and gradient in the records of its setup batch, sized by the program's varyings.
+        struct BinnedPrimitive {
+            Rect bounds;
+            int vertex_count = 0;
+            size_t record_offset = 0;  // into SetupBatch::records
+        };
+        // Raster primitives of a setup job in submission order.
+        struct SetupBatch {
+            std::vector<BinnedPrimitive> prims;
+            std::vector<float> records;
+        };
+        // Primitive of a tile bin, pointing into the records of its setup batch.
+        struct TileBinEntry {
+            const float* record;
+            int vertex_count;
+        };
+
+        // Fragments on their way from the rasterizer to fragment shading and output merging. The rasterizer appends to
+        // a fixed size chunk that is flushed whenever it is full and after each primitive, so fragments are read while
+        // they are still in cache. The block rasterizer never splits a block, which keeps its quads whole.
+        struct FragmentChunk {
+            static constexpr size_t CAPACITY = 2 * vg::RASTER_BLOCK_SIZE * vg::RASTER_BLOCK_SIZE;
+
+            std::array<Fragment, CAPACITY> fragments;
+            size_t size = 0;
+            FragmentShader fs = nullptr;
+            std::vector<Fragment>* collected = nullptr;  // takes the flushed fragments instead of 'fs' if set
+            uint64_t shade_time = 0;                     // spent in flushes while timing stages
+        };
+
+        // Depth bounds of a depth attachment per raster block and per tile.
+        // Bounds of areas written since their last resolve are unknown and never reject.
+        static_assert(TILE_WIDTH % vg::RASTER_BLOCK_SIZE == 0 && TILE_HEIGHT % vg::RASTER_BLOCK_SIZE == 0,
+                      "a tile must consist of whole raster blocks");
+        struct HiZBuffer {
+            const std::vector<uint8_t>* memory = nullptr;
+            VGsizei width = 0;
+            VGsizei height = 0;
+            VGsizei offset = 0;
+            VGenum format = VG_NONE;
+            VGenum component_type = VG_NONE;
+
+            int block_columns = 0;
+            int block_rows = 0;
+            std::vector<float> block_min_depth;
+            std::vector<float> block_max_depth;
+            std::vector<uint8_t> block_dirty;
+
+            int tile_columns = 0;
+            int tile_rows = 0;
+            std::vector<float> tile_min_depth;
+            std::vector<float> tile_max_depth;
+            std::vector<uint8_t> tile_dirty;
+        };
+
+        // One lock per screen tile of an attachment.
+        struct LockTable {
+            std::unique_ptr<SpinLock[]> locks;
+            int width = 0;   // in tiles
+            int height = 0;  // in tiles
+        };
+
+        // Assembled primitives of a draw, 'vertex_count' consecutive varying_buffer slots per primitive.
+        struct PrimitiveList {
+            std::vector<const float*> vertices;
+            size_t vertex_count = 0;
 
-            std::array<SpinLock, MAX_LOCK_TABLE_WIDTH * MAX_LOCK_TABLE_HEIGHT> depth_lock_table;
+            size_t GetCount() const { return vertex_count == 0 ? 0 : vertices.size() / vertex_count; }
+            const float* const* Get(size_t index) const { return vertices.data() + index * vertex_count; }
+        };
+
+        // Batch of the per primitive path
+        struct AfterVSJobInput {
+            const PrimitiveList* prims;
+            size_t first_index;
+            size_t last_index;
+            FragmentShader fs;
+        };
 
+        // Batch and tile of the tile-binned path
+        struct SetupJobInput {
+            const PrimitiveList* prims;
+            size_t first_index;
+            size_t last_index;
+            SetupBatch* out;
+        };
+        struct TileJobInput {
+            const std::vector<TileBinEntry>* bin;
+            Rect region;
+            FragmentShader fs;
+        };
+
+        // Post-transform vertex cache of an indexed draw. Each referenced vertex gets one varying_buffer slot, in
+        // order of first reference, so shared vertices are shaded once.
+        struct VertexCache {
+            static constexpr uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+            // index_to_slot covers at most this many vertices per element, draws of wider ranges (e.g. a stray
+            // index) look their vertices up in sorted slot_to_index instead.
+            static constexpr size_t MAX_SPAN_PER_ELEMENT = 4;
+
+            uint32_t min_index = 0;
+            std::vector<uint32_t> index_to_slot;  // slot of vertex 'min_index + i', EMPTY_SLOT if not referenced
+            std::vector<uint32_t> slot_to_index;  // vertex index shaded into each slot
+            std::vector<uint32_t> element_slots;  // slot of each element of the draw
+        };
+
+        // Uniforms of the executing draw, copied when it starts so shaders read them without a lookup and later
+        // uniform calls do not reach the draw. Every uniform begins on a 16 byte boundary.
+        struct UniformSnapshot {
+            struct alignas(16) Block {
+                uint8_t bytes[16];
+            };
+
+            std::vector<Block> storage;
+            std::vector<UniformRef> refs;  // by location, into storage
+        };
+
+        struct State {
             Color128 clear_color = Color128(0.f, 0.f, 0.f, 0.f);
 
             Rect viewport = {0, 0, 0, 0};
@@ -492,9 +897,92 @@ namespace ho {
 
             VGenum polygon_mode = VG_FILL;
 
+            bool tiled_rasterization_enabled = true;
+            bool deferred_commands_enabled = false;
+
+            VGuint conditional_render_query = 0;  // 0 if conditional rendering is not active
+            VGenum conditional_render_mode = VG_QUERY_WAIT;
+
             VGenum error_state = VG_NO_ERROR;
         };
 
+        // What a recorded command reads from the context, swapped in while the command runs.
+        struct DrawState {
+            State state;
+            Program* program = nullptr;
+            VertexArray* vertex_array = nullptr;
+            FrameBuffer* draw_frame_buffer = nullptr;
+            // of 'draw_frame_buffer', which vgDrawBuffer changes without waiting for recorded commands
+            std::array<size_t, VG_DRAW_BUFFER15 - VG_DRAW_BUFFER0 + 1> draw_slot_to_color_attachment;
+            std::array<TextureUnit, TEXTURE_UNIT_COUNT> texture_units;
+            std::unordered_map<VGuint, ConstantAttribute> constant_attributes;
+            std::vector<Uniform> uniforms;  // of 'program'
+        };
+
+        // Pipeline statistics, in the order of their query object parameters starting at VG_VERTICES_SHADED.
+        enum Statistic : size_t {
+            STATISTIC_VERTICES_SHADED = 0,
+            STATISTIC_PRIMITIVES_IN,
+            STATISTIC_PRIMITIVES_CLIPPED,
+            STATISTIC_PRIMITIVES_CULLED,
+            STATISTIC_FRAGMENTS_RASTERIZED,
+            STATISTIC_FRAGMENTS_EARLY_REJECTED,
+            STATISTIC_FRAGMENTS_SHADED,
+            STATISTIC_FRAGMENTS_WRITTEN,  // also the samples passed
+            STATISTIC_VERTEX_SHADER_TIME,
+            STATISTIC_CLIP_TIME,
+            STATISTIC_RASTER_TIME,
+            STATISTIC_FRAGMENT_SHADER_TIME,
+            STATISTIC_ROP_TIME,
+            STATISTIC_COUNT
+        };
+        using Statistics = std::array<uint64_t, STATISTIC_COUNT>;
+
+        // Statistics gathered by one worker. Each worker adds to its own counters, so draws do not contend.
+        struct alignas(Thread::CACHE_LINE_BYTES) WorkerStatistics {
+            std::array<std::atomic<uint64_t>, STATISTIC_COUNT> values{};
+        };
+
+        // The API side tracks the calls, the executing side the result, so both stay valid while commands are
+        // recorded.
+        struct QueryObject {
+            uint32_t id = 0;
+            VGenum target = VG_NONE;  // set by the first vgBeginQuery or vgQueryCounter
+            bool is_active = false;
+            uint32_t end_count = 0;       // vgEndQuery and vgQueryCounter calls
+            uint32_t resolved_count = 0;  // executed ends
+
+            uint64_t begin_time = 0;      // TIME_ELAPSED
+            Statistics begin_statistics;  // counter sums when the query began
+            Statistics statistics;        // PIPELINE_STATISTICS
+            uint64_t result = 0;          // samples, nanoseconds or timestamp
+        };
+
+        enum class CommandType { DRAW_ARRAYS, DRAW_ELEMENTS, CLEAR, BEGIN_QUERY, END_QUERY, QUERY_COUNTER };
+
+        // Validated draw, clear or query.
+        struct Command {
+            CommandType type = CommandType::DRAW_ARRAYS;
+            VGenum mode = VG_NONE;
+            VGint first = 0;  // DRAW_ARRAYS
+            VGsizei count = 0;
+            VGenum index_type = VG_NONE;  // DRAW_ELEMENTS
+            const void* indices = nullptr;
+            bool has_range = false;
+            uint32_t range[2] = {0, 0};
+            VGbitfield clear_mask = 0;      // CLEAR
+            QueryObject* query = nullptr;  // BEGIN_QUERY, END_QUERY, QUERY_COUNTER
+            DrawState draw_state;          // recorded commands only
+        };
+
+        // Fence. Signaled when the commands issued before it are done, tracked by the completion counter of the
+        // command list that holds the last of them.
+        struct SyncObject {
+            std::shared_ptr<AtomicNumeric<uint32_t>> counter;  // nullptr if nothing was pending
+
+            bool IsSignaled() const { return counter == nullptr || counter->Get() == 0; }
+        };
+
         // ======================================================
         // Members
         // ======================================================
@@ -510,6 +998,7 @@ namespace ho {
         std::unordered_map<uint32_t, RenderBuffer> render_buffer_pool_;
         std::unordered_map<uint32_t, Shader> shader_pool_;
         std::unordered_map<uint32_t, Program> program_pool_;
+        std::unordered_map<uint32_t, QueryObject> query_pool_;
 
         VertexArray* bound_vertex_array_ = nullptr;
         Program* using_program_ = nullptr;
@@ -523,35 +1012,83 @@ namespace ho {
         std::unordered_map<VGuint, BufferBinding> uniform_buffer_bindings_;
         std::unordered_map<VGuint, BufferBinding> transform_feedback_buffer_bindings_;
         std::unordered_map<VGuint, ConstantAttribute> constant_attributes_;
+        std::array<QueryObject*, QUERY_TARGET_COUNT> current_queries_;
 
         State state_;
 
-        JobSystem job_system_;
+        // Per draw storage of tile-binned rasterization, kept to reuse its capacity between draws.
+        std::vector<SetupBatch> setup_batches_;
+        std::vector<std::vector<TileBinEntry>> tile_bins_;
+        VertexCache vertex_cache_;
+        UniformSnapshot uniform_snapshot_;
+        std::vector<AttributeFetcher> attribute_fetchers_;  // by location, compiled per draw
+        PrimitiveList primitives_;
+        std::vector<AfterVSJobInput> primitive_job_inputs_;
+        std::vector<SetupJobInput> setup_job_inputs_;
+        std::vector<TileJobInput> tile_job_inputs_;
+
+        // Pixel locks of the per primitive path. Allocated on first use and sized to the bound attachments.
+        std::array<LockTable, COLOR_ATTACHMENT_COUNT> color_lock_tables_;
+        LockTable depth_lock_table_;
+
+        // Coverage test of the block rasterizer picked for the running CPU.
+        // nullptr selects the per pixel reference loop.
+        vg::CoverageRowFunc coverage_row_func_ = nullptr;
+
+        // Hierarchical Z of depth attachments, keyed by their memory.
+        std::unordered_map<const std::vector<uint8_t>*, HiZBuffer> hiz_buffers_;
+        HiZBuffer* active_hiz_ = nullptr;  // Hi-Z of the bound depth attachment, set per draw
+
+        // Set per draw by DrawPrimitives, see HasColorOutputs.
+        bool is_depth_only_draw_ = false;
+
+        // Recreated by Initialize when the worker count or the affinity changes.
+        std::unique_ptr<JobSystem> job_system_;
+
+        // Deferred commands. The submitted ones run on the job system and own the context until they are done.
+        std::vector<Command> recorded_commands_;
+        std::vector<Command> submitted_commands_;
+        std::shared_ptr<AtomicNumeric<uint32_t>> submitted_counter_;
+        std::shared_ptr<AtomicNumeric<uint32_t>> recorded_counter_;  // created by the first fence on the recorded ones
+
+        std::unordered_map<VGsync, SyncObject> sync_pool_;
+
+        // Queries, as seen by the executed commands.
+        std::array<QueryObject*, QUERY_TARGET_COUNT> running_queries_;
+        std::vector<WorkerStatistics> worker_statistics_;  // one per worker, then one for the other threads
+        std::vector<FragmentChunk> fragment_chunks_;       // one per worker, then one for the other threads
 
         // ======================================================
         // Rendering Pipeline API
         // ======================================================
 
+        // Grows the lock tables to cover every attachment of the bound draw frame buffer.
+        // Must be called before kicking per primitive jobs, never while they run.
+        void PrepareLockTables();
+        static void ReserveLockTable(LockTable& table, int width, int height);
+
         ALWAYS_INLINE SpinLock& GetColorLock(size_t attachment_index, int x, int y) {
-            assert(x >= 0 && x < MAX_ATTACHMENT_WIDTH);
-            assert(y >= 0 && y < MAX_ATTACHMENT_HEIGHT);
+            const LockTable& table = color_lock_tables_[attachment_index];
 
             int lock_x = x / TILE_WIDTH;
             int lock_y = y / TILE_HEIGHT;
+            assert(lock_x >= 0 && lock_x < table.width);
+            assert(lock_y >= 0 && lock_y < table.height);
 
-            size_t lock_index = static_cast<size_t>(lock_y * MAX_LOCK_TABLE_WIDTH + lock_x);
-            return state_.color_lock_tables[attachment_index][lock_index];
+            size_t lock_index = static_cast<size_t>(lock_y * table.width + lock_x);
+            return table.locks[lock_index];
         }
 
         ALWAYS_INLINE SpinLock& GetDepthLock(int x, int y) {
-            assert(x >= 0 && x < MAX_ATTACHMENT_WIDTH);
-            assert(y >= 0 && y < MAX_ATTACHMENT_HEIGHT);
+            const LockTable& table = depth_lock_table_;
 
             int lock_x = x / TILE_WIDTH;
             int lock_y = y / TILE_HEIGHT;
+            assert(lock_x >= 0 && lock_x < table.width);
+            assert(lock_y >= 0 && lock_y < table.height);
 
-            size_t lock_index = static_cast<size_t>(lock_y * MAX_LOCK_TABLE_WIDTH + lock_x);
-            return state_.depth_lock_table[lock_index];
+            size_t lock_index = static_cast<size_t>(lock_y * table.width + lock_x);
+            return table.locks[lock_index];
         }
 
         void ClearColorAttachment(size_t slot, const Color128& clear_color);
@@ -559,15 +1096,106 @@ namespace ho {
         void ClearDepthStencilAttachment(bool is_depth_cleared, bool is_stencil_cleared, real clear_depth,
                                          uint8_t clear_stencil);
 
-        // Vertex Processing
-        struct VSJobInput {
-            VertexShader vs;
-            size_t base_index;
-            size_t first_index;
-            size_t last_index;
+        // Mipmap
+        // Counts the levels from 0 whose sizes halve the previous level, the chain ends at the first mismatch.
+        static void UpdateMipmapCount(TextureObject& tex);
+        // Fills every level below level 0 with a box filtered copy of the level above. Rows of a level are split
+        // into jobs, levels are generated one after another.
+        void GenerateMipmap(TextureObject& tex);
+
+        struct MipmapJobInput {
+            const TextureObject* tex;
+            VGint level;
+            int first_row;  // rows of all slices, slice by slice
+            int last_row;
         };
 
-        static void VSJobEntry(void* input, int size);
+        static void MipmapJobEntry(void* input, int size);
+
+        // Vertex Processing
+        static constexpr size_t VERTEX_BATCH_SIZE = 96;  // slots per job, whole batches of wide shaders
+        static_assert(VERTEX_BATCH_SIZE % VertexBatch::WIDTH == 0);
+
+        // Runs the vertex shader into 'slot_count' varying_buffer slots with ParallelFor. Slot i shades vertex
+        // slot_to_index[i], or vertex 'first_vertex + i' if slot_to_index is nullptr.
+        // The first draw of a program shades slot 0 alone to lay out and link the varyings. The wide shader of the
+        // program, if any, shades the other slots in batches.
+        void ShadeVertices(size_t slot_count, size_t first_vertex, const uint32_t* slot_to_index);
+        // Builds the lookups and the varying_buffer stride from the varyings the first vertex appended.
+        static void LinkVaryingLayout(Program& prog);
+        static constexpr size_t VARYING_POSITION_SIZE = 4;  // vg_Position, first in every varying_buffer slot
+        static void PackVarying(const Varying& v, const Program& prog, float* record);
+        static void UnpackVarying(const float* record, const Program& prog, Varying& out);
+        // Copies the uniforms of using_program_ into uniform_snapshot_, before the draw shades anything.
+        void SnapshotUniforms();
+        // Fills attribute_fetchers_ from the bound vertex array and the constant attributes, before the draw shades
+        // anything. Each fetcher gets the functions specialized for the type, size and normalization it reads.
+        void CompileAttributeFetchers();
+
+        // Fills vertex_cache_ with the vertices referenced by 'count' indices of 'type'.
+        // Vertex indices are looked up in [min_index, max_index], returns false if an index lies outside.
+        bool BuildVertexCache(const uint8_t* indices, VGsizei count, VGenum type, uint32_t min_index,
+                              uint32_t max_index);
+        // Fills vertex_cache_ without index_to_slot, slots are in order of vertex index.
+        void BuildSparseVertexCache(const uint8_t* indices, VGsizei count, VGenum type);
+        // Validates and runs or records a draw of 'count' indices of 'type' stored at 'indices' in the bound element
+        // buffer. 'range' holds the inclusive index range given by vgDrawRangeElements or nullptr.
+        void DrawElements(VGenum mode, VGsizei count, VGenum type, const void* indices, const uint32_t* range);
+
+        // Draws of validated arguments. Only the vertices referenced by the indices are shaded.
+        void ExecuteDrawArrays(VGenum mode, VGint first, VGsizei count);
+        void ExecuteDrawElements(VGenum mode, VGsizei count, VGenum type, const void* indices, const uint32_t* range);
+        void ExecuteClear(VGbitfield mask);
+
+        // Deferred Commands
+        // Runs 'cmd' at once, or records it with a snapshot of the draw state while deferred commands are enabled.
+        void RunCommand(Command& cmd);
+        void ExecuteCommand(const Command& cmd);
+        void SwapInDrawState(DrawState& draw_state);
+        void SwapOutDrawState(DrawState& draw_state);
+        // Hands the recorded commands to the job system.
+        void Flush();
+        // Flushes and waits until every command is done.
+        void Finish();
+        void WaitForSubmittedCommands();
+        static void CommandsJobEntry(void* input, int size);
+        // Completion counter of the last issued command, nullptr if every command is done.
+        std::shared_ptr<AtomicNumeric<uint32_t>> GetPendingCounter();
+        // Sync calls skip the wait for the submitted commands, which own the state until they are done.
+        void SetSyncError(VGenum error);
+
+        // Queries
+        // Index of a query target in current_queries_ and running_queries_, INVALID_SLOT if not supported.
+        static size_t GetQueryTargetIndex(VGenum target);
+        void ExecuteBeginQuery(QueryObject& query);
+        void ExecuteEndQuery(QueryObject& query);
+        void ExecuteQueryCounter(QueryObject& query);
+        void SumStatistics(Statistics& out) const;
+
+        // Nanoseconds of the steady clock, the time base of timer queries and stage times.
+        static ALWAYS_INLINE uint64_t GetTimestamp() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             std::chrono::steady_clock::now().time_since_epoch())
+                                             .count());
+        }
+        // Statistics are gathered only while a query reads them. Stage times read the clock per primitive and per
+        // shaded fragment, so they are taken only for pipeline statistics queries.
+        ALWAYS_INLINE bool IsGatheringStatistics() const {
+            return running_queries_[SAMPLES_PASSED_QUERY] != nullptr ||
+                   running_queries_[ANY_SAMPLES_PASSED_QUERY] != nullptr ||
+                   running_queries_[PIPELINE_STATISTICS_QUERY] != nullptr;
+        }
+        ALWAYS_INLINE bool IsTimingStages() const { return running_queries_[PIPELINE_STATISTICS_QUERY] != nullptr; }
+        // Adds to the counter of the calling worker.
+        ALWAYS_INLINE void AddStatistic(Statistic statistic, uint64_t value) {
+            worker_statistics_[job_system_->GetCurrentWorkerIndex()].values[statistic].fetch_add(
+                value, std::memory_order_relaxed);
+        }
+        // True if conditional rendering discards the draws and clears.
+        bool IsRenderingDiscarded() const;
+        // Value of 'pname' of a query for vgGetQueryObject*. Waits for the result if it is asked for, sets the error
+        // state and returns false on failure.
+        bool GetQueryObject(VGuint id, VGenum pname, uint64_t& value);
 
         // Rasterization, true: passed, false: not passed
         enum PlanePos {
@@ -581,8 +1209,52 @@ namespace ho {
             VG_PLANE_POS_LAST
         };
 
-        std::vector<Varying> Clip(const std::vector<Varying>& polygon) const;
-        std::vector<Varying> ClipAgainstPlane(const std::vector<Varying>& polygon, PlanePos plane_pos) const;
+        // Polygon of the clipper. A triangle clipped by the six frustum planes has at most 3 + 6 vertices, so it lives
+        // on the stack and clipping never allocates.
+        class ClipPolygon {
+           public:
+            static constexpr size_t CAPACITY = 9;
+
+            size_t size() const { return count_; }
+            bool empty() const { return count_ == 0; }
+            void clear() { count_ = 0; }
+            void push_back(const Varying& v) {
+                assert(count_ < CAPACITY);
+                vertices_[count_++] = v;
+            }
+            Varying& emplace_back() {
+                assert(count_ < CAPACITY);
+                return vertices_[count_++];
+            }
+
+            Varying& operator[](size_t i) { return vertices_[i]; }
+            const Varying& operator[](size_t i) const { return vertices_[i]; }
+            Varying* begin() { return vertices_.data(); }
+            Varying* end() { return vertices_.data() + count_; }
+            const Varying* begin() const { return vertices_.data(); }
+            const Varying* end() const { return vertices_.data() + count_; }
+
+           private:
+            std::array<Varying, CAPACITY> vertices_;
+            size_t count_ = 0;
+        };
+
+        // Bit p of the outcode is set if 'clip_coord' is outside PlanePos p, for the six frustum planes.
+        static constexpr uint32_t CLIP_PLANES_XY = (1u << VG_PLANE_POS_LEFT) | (1u << VG_PLANE_POS_RIGHT) |
+                                                   (1u << VG_PLANE_POS_BOTTOM) | (1u << VG_PLANE_POS_TOP);
+        static constexpr uint32_t CLIP_PLANES_ALL =
+            CLIP_PLANES_XY | (1u << VG_PLANE_POS_NEAR) | (1u << VG_PLANE_POS_FAR);
+        uint32_t ComputeOutcode(const Vector4& clip_coord) const;
+
+        // Filled triangles whose vertices are in front of the eye and within CLIP_GUARD_BAND in normalized device x
+        // and y are not clipped against the x and y planes, rasterization is limited to the render area instead.
+        // Keeps viewport coordinates small enough for the rasterizer.
+        static constexpr real CLIP_GUARD_BAND = 8.0_r;
+        static bool IsInGuardBand(const Vector4& clip_coord);
+
+        // Clips 'polygon' in place against the planes of the 'planes' outcode bits, empty if nothing is left.
+        void Clip(ClipPolygon& polygon, uint32_t planes = CLIP_PLANES_ALL) const;
+        void ClipAgainstPlane(const ClipPolygon& polygon, PlanePos plane_pos, ClipPolygon& out) const;
         real EvalFrustumPlane(const Vector4& clip_coord, PlanePos plane_pos) const;
         bool IsInside(const Vector4& clip_coord, PlanePos plane_pos) const;
         Vector2 GetClipBarycentric(const Vector4& clip_coord1, const Vector4& clip_coord2, PlanePos plane_pos) const;
@@ -591,16 +1263,31 @@ namespace ho {
         void PerspectiveDivide(Varying& v) const;
         void ViewportTransform(Varying& v) const;
 
-        std::vector<Fragment> Rasterize(const Varying& v);
-        std::vector<Fragment> Rasterize(const Varying& v1, const Varying& v2);
-
-        struct BoundingBox2D {
-            BoundingBox2D(const Vector2& v1, const Vector2& v2, const Vector2& v3)
-                : min(math::Min(v1.x, v2.x, v3.x), math::Min(v1.y, v2.y, v3.y)),
-                  max(math::Max(v1.x, v2.x, v3.x), math::Max(v1.y, v2.y, v3.y)) {}
-            Vector2 min;
-            Vector2 max;
+        // Fragments are only generated inside 'region' and appended to 'chunk'.
+        void Rasterize(const Varying& v, const Rect& region, FragmentChunk& chunk);
+        void Rasterize(const Varying& v1, const Varying& v2, const Rect& region, FragmentChunk& chunk);
+
+        // Collect every fragment at once. The default region covers every addressable pixel.
+        std::vector<Fragment> Rasterize(const Varying& v,
+                                        const Rect& region = {0, 0, MAX_ATTACHMENT_WIDTH, MAX_ATTACHMENT_HEIGHT});
+        std::vector<Fragment> Rasterize(const Varying& v1, const Varying& v2,
+                                        const Rect& region = {0, 0, MAX_ATTACHMENT_WIDTH, MAX_ATTACHMENT_HEIGHT});
+
+        // Triangle snapped to the sub-pixel grid. Setup and the rasterizer decide from the same snapped values, so a
+        // triangle is binned to exactly the pixels it covers.
+        struct SnappedTriangle {
+            SnappedTriangle(const Vector3& p1, const Vector3& p2, const Vector3& p3);
+
+            int64_t x[3];
+            int64_t y[3];
+            int64_t area;  // twice the signed area in sub-pixel units, 0 if degenerate
+            Rect bounds;   // pixel centers inside the snapped bounding box, empty if none
         };
+        // Screen space is Y-down, so CCW winding results in negative area.
+        ALWAYS_INLINE bool IsFrontFace(int64_t area) const {
+            return state_.front_face == VG_CCW ? area < 0 : area > 0;
+        }
+        bool IsCulled(bool is_front) const;
 
         struct EdgeFunction {
             EdgeFunction(const Vector2& start, const Vector2& end, const Vector2& initial)
@@ -613,7 +1300,12 @@ namespace ho {
             real initial_value;
         };
 
-        std::vector<Fragment> Rasterize(const Varying& v1, const Varying& v2, const Varying& v3);
+        // Fragments point to 'smooth_gradient' when given, it must outlive them.
+        void Rasterize(const Varying& v1, const Varying& v2, const Varying& v3, const Rect& region,
+                       const SmoothGradient* smooth_gradient, FragmentChunk& chunk);
+        std::vector<Fragment> Rasterize(const Varying& v1, const Varying& v2, const Varying& v3,
+                                        const Rect& region = {0, 0, MAX_ATTACHMENT_WIDTH, MAX_ATTACHMENT_HEIGHT},
+                                        const SmoothGradient* smooth_gradient = nullptr);
 
         // Output Merging
         bool ScissorTest(real x, real y) const;
@@ -624,27 +1316,119 @@ namespace ho {
         // true: passed, false: not passed
         bool TestDepthStencil(real x, real y, real depth, bool is_front_face, bool compare_only = false);
 
+        ALWAYS_INLINE bool IsEarlyFragmentTestsEnabled() const {
+            return using_program_ != nullptr && using_program_->early_fragment_tests;
+        }
+
+        // Compare only test of the rasterizer. Skipped for early fragment tests, which test and write once before
+        // shading.
+        ALWAYS_INLINE bool RasterDepthStencilTest(real x, real y, real depth, bool is_front_face) {
+            return IsEarlyFragmentTestsEnabled() || TestDepthStencil(x, y, depth, is_front_face, true);
+        }
+
         real GetBlendFactor(VGenum factor, const Color128& src, const Color128& dst, int channel) const;
 
         real ApplyBlendEquation(VGenum eq, real src_term, real dst_term) const;
 
         void WriteColor(real x, real y, const Color128& color, size_t slot);
 
-        struct AfterVSJobInput {
-            std::vector<Varying*> poly;
-            FragmentShader fs;
-        };
+        // Primitive Setup
+        // Clips the assembled primitive, maps it to viewport space and splits it into raster primitives according to
+        // the polygon mode. Culled and degenerate triangles are dropped here. Returns false if clipping removed it.
+        bool SetupPrimitive(const std::vector<Varying*>& poly, std::vector<RasterPrimitive>& out) const;
+        // Same, for a primitive already in 'poly', which is clipped in place.
+        bool SetupPrimitive(ClipPolygon& poly, std::vector<RasterPrimitive>& out) const;
+        static void ComputeSmoothGradient(const Varying& v1, const Varying& v2, const Varying& v3,
+                                          SmoothGradient& out);
+        void RasterizePrimitive(const RasterPrimitive& prim, const Rect& region, FragmentChunk& chunk);
+        // A packed vertex is its viewport coordinate followed by a varying record. Triangles append the gradient of 1/w
+        // in x and y, then the smooth register gradient in x and y.
+        static constexpr size_t RASTER_VIEWPORT_COORD_SIZE = 3;
+        static void PackRasterPrimitive(const RasterPrimitive& prim, const Program& prog, std::vector<float>& records);
+        static void UnpackRasterPrimitive(const float* record, int vertex_count, const Program& prog,
+                                          RasterPrimitive& out);
+        // Chunk of the calling worker.
+        FragmentChunk& GetFragmentChunk() { return fragment_chunks_[job_system_->GetCurrentWorkerIndex()]; }
+        ALWAYS_INLINE Fragment& AppendFragment(FragmentChunk& chunk) {
+            if (chunk.size == FragmentChunk::CAPACITY) {
+                FlushFragments(chunk);
+            }
+            return chunk.fragments[chunk.size++];
+        }
+        // Shades and merges the fragments of 'chunk', or moves them to chunk.collected, and empties it.
+        void FlushFragments(FragmentChunk& chunk);
+        // Shades with the quad fragment shader of using_program_ if it has one.
+        void ShadeFragments(const Fragment* frags, size_t count, FragmentShader fs);
+        // 'count' is at most FragmentChunk::CAPACITY, fragments of one primitive.
+        void ShadeFragmentQuads(const Fragment* frags, size_t count, QuadFragmentShader fs);
+        // Helper lane of a quad, 'src' moved by (dx, dy) pixels with its smooth registers extrapolated along the
+        // triangle. Points and lines copy 'src', their derivatives are zero.
+        static void ExtrapolateFragment(const Fragment& src, int dx, int dy, Fragment& out);
+        void WriteFragmentOutputs(const Fragment& frag, const FSOutputs& outputs);
+
+        // Primitive Assembly
+        // Vertex stride and vertex count per primitive of a draw mode, returns false for unsupported modes.
+        static bool GetPrimitiveLayout(VGenum mode, size_t& stride, size_t& vertex_count);
+        // Gathers the primitives of 'element_count' elements into primitives_. 'element_slots' maps elements to
+        // varying_buffer slots, nullptr if element i is slot i.
+        void AssemblePrimitives(VGenum mode, size_t element_count, const uint32_t* element_slots);
+        // Sets up, rasterizes and shades primitives_ with the tile-binned or the per primitive path.
+        void DrawPrimitives(FragmentShader fs);
+        // False if no draw buffer reaches a writable color attachment, e.g. after vgDrawBuffer(VG_NONE). Fragment
+        // shaders can't discard or write depth, so such a draw only tests and writes depth/stencil: triangles do it
+        // in the raster loop and are never shaded.
+        bool HasColorOutputs() const;
+
+        // Per primitive path
+        // Primitives are split into batches of PRIMITIVE_BATCH_SIZE, submitted at once. Batch inputs live in
+        // primitive_job_inputs_ for the whole draw.
+        static constexpr size_t PRIMITIVE_BATCH_SIZE = 64;
 
         static void AfterVSJobEntry(void* input, int size);
 
+        // Tile-binned Rasterization
+        // Primitives are set up in parallel, binned into TILE_WIDTH x TILE_HEIGHT screen tiles in submission order and
+        // every tile is processed by exactly one job. A tile job owns its pixels, so depth/stencil test and color write
+        // don't need locks and blending follows submission order. Setup runs in batches of PRIMITIVE_BATCH_SIZE, batch
+        // and tile inputs live in setup_job_inputs_ and tile_job_inputs_ for the whole draw.
+        Rect GetRenderArea() const;
+        void DrawBinned(const PrimitiveList& prims, FragmentShader fs);
+
+        static void SetupJobEntry(void* input, int size);
+        static void TileJobEntry(void* input, int size);
+
+        // Hierarchical Z
+        // Binds the Hi-Z of the bound depth attachment for the next tiled draw. A tiled draw with depth test creates it
+        // on first use, a per primitive draw binds none and marks the whole Hi-Z dirty instead.
+        void PrepareHiZ();
+        // Drops the Hi-Z of 'memory' after it was written or freed outside the pipeline.
+        void InvalidateHiZ(const std::vector<uint8_t>* memory);
+        // Recomputes the bounds of written blocks and tiles overlapping 'area'.
+        static void ResolveHiZ(HiZBuffer& hiz, const Rect& area);
+        void ClearHiZ(const Attachment& attch, const Rect& area, real clear_depth);
+        ALWAYS_INLINE void MarkHiZDirty(int x, int y) {
+            HiZBuffer& hiz = *active_hiz_;
+            const int bx = x / vg::RASTER_BLOCK_SIZE;
+            const int by = y / vg::RASTER_BLOCK_SIZE;
+            hiz.block_dirty[static_cast<size_t>(by * hiz.block_columns + bx)] = 1;
+            hiz.tile_dirty[static_cast<size_t>((y / TILE_HEIGHT) * hiz.tile_columns + x / TILE_WIDTH)] = 1;
+        }
+        // Hi-Z is read only by tile jobs, which own their tiles, and only when a rejected fragment has no side effect.
+        bool IsHiZTestable() const;
+        // true if every fragment with depth in [min_depth, max_depth] fails the depth test against 'stored' bounds.
+        bool IsOccluded(float stored_min, float stored_max, double min_depth, double max_depth) const;
+
         // ======================================================
         // Friend decl
         // ======================================================
 
         template <typename T>
         friend T FetchAttribute(VGuint location, size_t index);
+        friend void FetchAttributes(VGuint location, const size_t* vertex_indices, size_t count,
+                                    float* const components[4]);
         template <typename T>
         friend T FetchUniform(uint32_t name_hash, size_t index);
+        friend UniformRef GetUniformRef(uint32_t name_hash);
         template <typename T>
         friend T FetchUniformBlock(VGuint binding, int offset);
 
@@ -659,6 +1443,10 @@ namespace ho {
         template <typename T>
         friend T Texture1D(VGuint unit_slot, VGfloat u);
         template <typename T>
+        friend T Texture2DLod(VGuint unit_slot, const Vector2& tex_coord, VGfloat lod);
+        template <typename T>
+        friend T Texture2DGrad(VGuint unit_slot, const Vector2& tex_coord, const Vector2& dPdx, const Vector2& dPdy);
+        template <typename T>
         friend T Texture2D(VGuint unit_slot, const Vector2& tex_coord);
         template <typename T>
         friend T Texture3D(VGuint unit_slot, const Vector3& tex_coord);
@@ -792,6 +1580,14 @@ namespace ho {
         friend void vgBlendColor(VGfloat red, VGfloat green, VGfloat blue, VGfloat alpha);
         friend void vgBlendEquation(VGenum mode);
 
+        friend void vgGenQueries(VGsizei n, VGuint* ids);
+        friend void vgDeleteQueries(VGsizei n, const VGuint* ids);
+        friend VGboolean vgIsQuery(VGuint id);
+        friend void vgBeginQuery(VGenum target, VGuint id);
+        friend void vgEndQuery(VGenum target);
+        friend void vgGetQueryiv(VGenum target, VGenum pname, VGint* params);
+        friend void vgGetQueryObjectiv(VGuint id, VGenum pname, VGint* params);
+        friend void vgGetQueryObjectuiv(VGuint id, VGenum pname, VGuint* params);
         friend void vgBindBuffer(VGenum target, VGuint buffer);
         friend void vgDeleteBuffers(VGsizei n, const VGuint* buffers);
         friend void vgGenBuffers(VGsizei n, VGuint* buffers);
@@ -842,7 +1638,9 @@ namespace ho {
         friend VGboolean vgIsProgram(VGuint program);
         friend VGboolean vgIsShader(VGuint shader);
         friend void vgLinkProgram(VGuint program);
+        friend void vgProgramParameteri(VGuint program, VGenum pname, VGint value);
         friend void vgShaderSource(VGuint shader, void* source);
+        friend void vgShaderSourceWide(VGuint shader, void* source);
         friend void vgUseProgram(VGuint program);
         template <typename T>
         friend Uniform* vgUniform1t(VGint location, T v0);
@@ -331,5 +331,234 @@ namespace ho {
             *depth = static_cast<real>(qd) / 16777215.0_r;
         }
 
+        ALWAYS_INLINE VGsizei GetMipmapSize(VGsizei base_size, VGint level) { return math::Max(base_size >> level, 1); }
+
+        // Number of levels of a full mipmap chain down to 1x1x1
+        ALWAYS_INLINE int GetMipmapLevelCount(VGsizei width, VGsizei height, VGsizei depth) {
+            VGsizei size = math::Max(width, math::Max(height, depth));
+            int count = 1;
+            while (size > 1) {
+                size >>= 1;
+                count++;
+            }
+            return count;
+        }
+
+        // Filter and levels of a texture lookup, 'weight' is the share of 'level1'.
+        struct MipmapSelection {
+            VGint filter = VG_NEAREST;
+            VGint level0 = 0;
+            VGint level1 = 0;
+            float weight = 0.f;
+        };
+
+        // Picks the magnification or minification filter for 'lod' and the levels it samples.
+        // 'level_count' is the number of levels of the texture's mipmap chain.
+        ALWAYS_INLINE MipmapSelection SelectMipmap(VGint min_filter, VGint mag_filter, float lod, int level_count) {
+            MipmapSelection selection;
+            // NaN samples the base level
+            if (!(lod > 0.f)) {
+                selection.filter = mag_filter;
+                return selection;
+            }
+
+            // Clamped before any conversion to int, huge derivatives give an infinite lod.
+            const VGint max_level = level_count - 1;
+            lod = math::Min(lod, static_cast<float>(max_level));
+            switch (min_filter) {
+                case VG_NEAREST_MIPMAP_NEAREST:
+                case VG_LINEAR_MIPMAP_NEAREST:
+                    selection.filter =
+                        min_filter == static_cast<VGint>(VG_NEAREST_MIPMAP_NEAREST) ? VG_NEAREST : VG_LINEAR;
+                    selection.level0 = math::Min(static_cast<VGint>(math::Ceil(lod + 0.5f)) - 1, max_level);
+                    selection.level1 = selection.level0;
+                    return selection;
+
+                case VG_NEAREST_MIPMAP_LINEAR:
+                case VG_LINEAR_MIPMAP_LINEAR:
+                    selection.filter =
+                        min_filter == static_cast<VGint>(VG_NEAREST_MIPMAP_LINEAR) ? VG_NEAREST : VG_LINEAR;
+                    if (lod >= static_cast<float>(max_level)) {
+                        selection.level0 = max_level;
+                        selection.level1 = max_level;
+                        return selection;
+                    }
+                    selection.level0 = static_cast<VGint>(math::Floor(lod));
+                    selection.level1 = selection.level0 + 1;
+                    selection.weight = lod - static_cast<float>(selection.level0);
+                    return selection;
+
+                default:
+                    selection.filter = min_filter;
+                    return selection;
+            }
+        }
+
+        // Reads the k-th element of an index array of 'type'.
+        ALWAYS_INLINE uint32_t FetchElementIndex(const uint8_t* indices, VGenum type, size_t k) {
+            switch (type) {
+                case VG_UNSIGNED_BYTE:
+                    return static_cast<uint32_t>(indices[k]);
+                case VG_UNSIGNED_SHORT:
+                    return static_cast<uint32_t>(reinterpret_cast<const uint16_t*>(indices)[k]);
+                case VG_UNSIGNED_INT:
+                    return reinterpret_cast<const uint32_t*>(indices)[k];
+                default:
+                    return 0;
+            }
+        }
+
+        // Bytes of one component of a vertex attribute of 'type'.
+        constexpr size_t GetAttributeComponentSize(VGenum type) {
+            switch (type) {
+                case VG_BYTE:
+                case VG_UNSIGNED_BYTE:
+                    return 1;
+                case VG_SHORT:
+                case VG_UNSIGNED_SHORT:
+                case VG_HALF_FLOAT:
+                    return 2;
+                case VG_DOUBLE:
+                    return 8;
+                default:
+                    return 4;
+            }
+        }
+
+        // Converts one component of a vertex attribute to float, normalized integers map to [0, 1] or [-1, 1].
+        template <VGenum TYPE, bool NORMALIZED>
+        ALWAYS_INLINE float LoadAttributeComponent(const uint8_t* p) {
+            if constexpr (TYPE == VG_FLOAT) {
+                VGfloat v;
+                std::memcpy(&v, p, sizeof(v));
+                return v;
+            } else if constexpr (TYPE == VG_DOUBLE) {
+                VGdouble v;
+                std::memcpy(&v, p, sizeof(v));
+                return static_cast<float>(v);
+            } else if constexpr (TYPE == VG_HALF_FLOAT) {
+                uint16_t v;
+                std::memcpy(&v, p, sizeof(v));
+                return HalfToFloat(v);
+            } else if constexpr (TYPE == VG_BYTE) {
+                const float v = static_cast<float>(*reinterpret_cast<const VGbyte*>(p));
+                return NORMALIZED ? math::Max(v / 127.f, -1.f) : v;
+            } else if constexpr (TYPE == VG_UNSIGNED_BYTE) {
+                const float v = static_cast<float>(*p);
+                return NORMALIZED ? v / 255.f : v;
+            } else if constexpr (TYPE == VG_SHORT) {
+                VGshort v;
+                std::memcpy(&v, p, sizeof(v));
+                return NORMALIZED ? math::Max(static_cast<float>(v) / 32767.f, -1.f) : static_cast<float>(v);
+            } else if constexpr (TYPE == VG_UNSIGNED_SHORT) {
+                VGushort v;
+                std::memcpy(&v, p, sizeof(v));
+                return NORMALIZED ? static_cast<float>(v) / 65535.f : static_cast<float>(v);
+            } else if constexpr (TYPE == VG_INT) {
+                VGint v;
+                std::memcpy(&v, p, sizeof(v));
+                return NORMALIZED ? math::Max(static_cast<float>(static_cast<double>(v) / 2147483647.0), -1.f)
+                                  : static_cast<float>(v);
+            } else {
+                static_assert(TYPE == VG_UNSIGNED_INT, "unsupported vertex attrib type");
+                VGuint v;
+                std::memcpy(&v, p, sizeof(v));
+                return NORMALIZED ? static_cast<float>(static_cast<double>(v) / 4294967295.0) : static_cast<float>(v);
+            }
+        }
+
+        using AttributeFetchFunction = void (*)(const uint8_t* src, float* components);
+        using AttributeBatchFetchFunction = void (*)(const uint8_t* base, size_t stride, const size_t* vertex_indices,
+                                                     size_t count, float* const* components);
+
+        // Reads the SIZE components of TYPE at 'src' as floats, the missing ones as (0, 0, 0, 1).
+        template <VGenum TYPE, int SIZE, bool NORMALIZED>
+        void FetchAttributeComponents(const uint8_t* src, float* components) {
+            constexpr size_t COMPONENT_SIZE = GetAttributeComponentSize(TYPE);
+            components[0] = LoadAttributeComponent<TYPE, NORMALIZED>(src);
+            components[1] = SIZE > 1 ? LoadAttributeComponent<TYPE, NORMALIZED>(src + COMPONENT_SIZE) : 0.f;
+            components[2] = SIZE > 2 ? LoadAttributeComponent<TYPE, NORMALIZED>(src + 2 * COMPONENT_SIZE) : 0.f;
+            components[3] = SIZE > 3 ? LoadAttributeComponent<TYPE, NORMALIZED>(src + 3 * COMPONENT_SIZE) : 1.f;
+        }
+
+        // FetchAttributeComponents of 'count' vertices, component c of vertex_indices[i] goes to components[c][i].
+        template <VGenum TYPE, int SIZE, bool NORMALIZED>
+        void FetchAttributeComponentsBatch(const uint8_t* base, size_t stride, const size_t* vertex_indices,
+                                           size_t count, float* const* components) {
+            float* x = components[0];
+            float* y = components[1];
+            float* z = components[2];
+            float* w = components[3];
+            for (size_t i = 0; i < count; i++) {
+                float vertex[4];
+                FetchAttributeComponents<TYPE, SIZE, NORMALIZED>(base + stride * vertex_indices[i], vertex);
+                x[i] = vertex[0];
+                y[i] = vertex[1];
+                z[i] = vertex[2];
+                w[i] = vertex[3];
+            }
+        }
+
+        template <VGenum TYPE>
+        ALWAYS_INLINE bool GetAttributeFetchFunctions(int size, bool normalized, AttributeFetchFunction& fetch,
+                                                      AttributeBatchFetchFunction& fetch_batch) {
+            switch (size) {
+                case 1:
+                    fetch = normalized ? FetchAttributeComponents<TYPE, 1, true>
+                                       : FetchAttributeComponents<TYPE, 1, false>;
+                    fetch_batch = normalized ? FetchAttributeComponentsBatch<TYPE, 1, true>
+                                             : FetchAttributeComponentsBatch<TYPE, 1, false>;
+                    return true;
+                case 2:
+                    fetch = normalized ? FetchAttributeComponents<TYPE, 2, true>
+                                       : FetchAttributeComponents<TYPE, 2, false>;
+                    fetch_batch = normalized ? FetchAttributeComponentsBatch<TYPE, 2, true>
+                                             : FetchAttributeComponentsBatch<TYPE, 2, false>;
+                    return true;
+                case 3:
+                    fetch = normalized ? FetchAttributeComponents<TYPE, 3, true>
+                                       : FetchAttributeComponents<TYPE, 3, false>;
+                    fetch_batch = normalized ? FetchAttributeComponentsBatch<TYPE, 3, true>
+                                             : FetchAttributeComponentsBatch<TYPE, 3, false>;
+                    return true;
+                case 4:
+                    fetch = normalized ? FetchAttributeComponents<TYPE, 4, true>
+                                       : FetchAttributeComponents<TYPE, 4, false>;
+                    fetch_batch = normalized ? FetchAttributeComponentsBatch<TYPE, 4, true>
+                                             : FetchAttributeComponentsBatch<TYPE, 4, false>;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // Picks the fetch functions instantiated for an attribute layout, false if the layout is not supported.
+        ALWAYS_INLINE bool GetAttributeFetchFunctions(VGenum type, int size, bool normalized,
+                                                      AttributeFetchFunction& fetch,
+                                                      AttributeBatchFetchFunction& fetch_batch) {
+            switch (type) {
+                case VG_BYTE:
+                    return GetAttributeFetchFunctions<VG_BYTE>(size, normalized, fetch, fetch_batch);
+                case VG_UNSIGNED_BYTE:
+                    return GetAttributeFetchFunctions<VG_UNSIGNED_BYTE>(size, normalized, fetch, fetch_batch);
+                case VG_SHORT:
+                    return GetAttributeFetchFunctions<VG_SHORT>(size, normalized, fetch, fetch_batch);
+                case VG_UNSIGNED_SHORT:
+                    return GetAttributeFetchFunctions<VG_UNSIGNED_SHORT>(size, normalized, fetch, fetch_batch);
+                case VG_INT:
+                    return GetAttributeFetchFunctions<VG_INT>(size, normalized, fetch, fetch_batch);
+                case VG_UNSIGNED_INT:
+                    return GetAttributeFetchFunctions<VG_UNSIGNED_INT>(size, normalized, fetch, fetch_batch);
+                case VG_HALF_FLOAT:
+                    return GetAttributeFetchFunctions<VG_HALF_FLOAT>(size, normalized, fetch, fetch_batch);
+                case VG_FLOAT:
+                    return GetAttributeFetchFunctions<VG_FLOAT>(size, normalized, fetch, fetch_batch);
+                case VG_DOUBLE:
+                    return GetAttributeFetchFunctions<VG_DOUBLE>(size, normalized, fetch, fetch_batch);
+                default:
+                    return false;
+            }
+        }
+
     }  // namespace vg
 }  // namespace ho
\ No newline at end of file